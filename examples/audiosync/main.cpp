@@ -0,0 +1,243 @@
+/*
+ * Drives groups of bulbs from music, and measures how late the lights are
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QtCore>
+#include <cmath>
+#include <cstdio>
+
+#include "lifxmanager.h"
+#include "lifxgroup.h"
+#include "lifxaudio.h"
+#include "lifxtransitionengine.h"
+
+/*
+ * Nearest click at or before sample, -1 if there is none
+ */
+static qint64 clickBefore(const QVector<qint64> &clicks, qint64 sample)
+{
+    qint64 best = -1;
+
+    for (auto click : clicks) {
+        if (click > sample)
+            break;
+        best = click;
+    }
+    return best;
+}
+
+/*
+ * Runs a synthetic click track through the analyzer as fast as it goes,
+ * and the rest of the path with what it costs, to show each stage's
+ * share of the time from a sound arriving to its packet leaving
+ */
+static int benchmark(const QCommandLineParser &parser)
+{
+    const int rate = 44100;
+    int seconds = qMax(parser.value("benchmark").toInt(), 10);
+    double bpm = qBound(60.0, parser.value("bpm").toDouble(), 180.0);
+    int fps = LifxTransitionEngine::DEFAULT_FRAME_RATE;
+    int colors = qMax(parser.value("colors").toInt(), 1);
+
+    QVector<float> pcm(rate * seconds);
+    QVector<qint64> clicks;
+    QRandomGenerator random(1);
+    for (auto &sample : pcm)
+        sample = static_cast<float>(random.generateDouble() - 0.5) * 0.04f;
+    for (double at = rate * 0.37; at < pcm.size(); at += 60.0 / bpm * rate) {
+        qint64 click = static_cast<qint64>(at);
+        clicks.append(click);
+        for (int k = 0; k < 2000 && click + k < pcm.size(); k++)
+            pcm[click + k] += 0.8f * std::exp(-k / 300.0f) * std::sin(2 * M_PI * 80 * k / rate);
+    }
+
+    LifxAudioAnalyzer analyzer(rate);
+    analyzer.addBand(20, 150);
+    analyzer.addBand(150, 2000);
+    analyzer.addBand(2000, 8000);
+
+    QVector<qint64> detections;
+    QVector<qint64> predictions;
+    qint64 predicted = -1;
+    float tempo = 0;
+    analyzer.setSink([&](const LifxAudioHop &hop) {
+        if (hop.onset) {
+            qint64 click = clickBefore(clicks, hop.position);
+            if (click >= 0 && hop.position - click < rate / 10)
+                detections.append(hop.position - click);
+        }
+        if (hop.nextBeat >= 0 && hop.nextBeat != predicted) {
+            predicted = hop.nextBeat;
+            predictions.append(predicted);
+        }
+        tempo = hop.bpm;
+    });
+    for (int i = 0; i < pcm.size(); i += rate / 100)
+        analyzer.process(pcm.constData() + i, qMin(rate / 100, pcm.size() - i));
+
+    // Where each beat was predicted against the click, counting only the last prediction of each
+    double beatError = 0;
+    int beats = 0;
+    for (int i = 0; i < predictions.size(); i++) {
+        if (i + 1 < predictions.size() && std::abs(predictions[i + 1] - predictions[i]) < rate / 10)
+            continue;
+        qint64 nearest = -1;
+        for (auto click : clicks) {
+            if (nearest < 0 || std::abs(click - predictions[i]) < std::abs(nearest - predictions[i]))
+                nearest = click;
+        }
+        beatError += std::abs(predictions[i] - nearest);
+        beats++;
+    }
+
+    double detectMean = 0, detectWorst = 0;
+    for (auto d : detections) {
+        detectMean += d;
+        detectWorst = qMax(detectWorst, static_cast<double>(d));
+    }
+    detectMean = detections.isEmpty() ? 0 : detectMean / detections.size() * 1000 / rate;
+    detectWorst = detectWorst * 1000 / rate;
+
+    QVector<lx_hsbk_t> from(colors), to(colors), out(colors);
+    QVector<uint16_t> weights(colors, LifxTransitionEngine::WEIGHT_ONE / 2);
+    for (int i = 0; i < colors; i++) {
+        from[i] = { static_cast<uint16_t>(i * 97), 65535, 0, 3500 };
+        to[i] = { static_cast<uint16_t>(i * 31), 65535, 65535, 3500 };
+    }
+    QElapsedTimer cost;
+    cost.start();
+    for (int i = 0; i < 1000; i++)
+        LifxTransitionEngine::interpolate(from.constData(), to.constData(), weights.constData(), out.data(), colors);
+    double interpolate = cost.nsecsElapsed() / 1000.0 / 1000;
+
+    LifxAudioAnalyzerStats stats = analyzer.stats();
+    double frame = 1000.0 / fps;
+    double hop = static_cast<double>(stats.meanHop) / 1000000;
+    double worstHop = static_cast<double>(stats.maxHop) / 1000000;
+
+    printf("%d s click track at %.1f BPM, found %.2f BPM, %d of %d clicks detected\n", seconds, bpm, tempo, detections.size(), clicks.size());
+    printf("analysis kernel %s, transition kernel %s\n\n", qPrintable(LifxAudioAnalyzer::kernel()), qPrintable(LifxTransitionEngine::interpolationKernel()));
+    printf("%-34s %10s %10s\n", "stage", "mean ms", "worst ms");
+    printf("%-34s %10.3f %10.3f\n", "sound reaching analyzer to onset", detectMean, detectWorst);
+    printf("%-34s %10.3f %10.3f\n", "analysis of the hop", hop, worstHop);
+    printf("%-34s %10.3f %10.3f\n", "wait for the engine frame", frame / 2, frame);
+    printf("%-34s %10.3f %10.3f\n", qPrintable(QString("interpolating %1 colors").arg(colors)), interpolate / 1000, interpolate / 1000);
+    printf("%-34s %10.3f %10.3f\n\n", "audio to packet", detectMean + hop + frame / 2 + interpolate / 1000,
+           detectWorst + worstHop + frame + interpolate / 1000);
+    printf("Beats are predicted a beat ahead and sent early by the light latency, %d predicted beats\n", beats);
+    printf("landed %.3f ms from their clicks on average\n", beats ? beatError / beats * 1000 / rate : 0.0);
+    return 0;
+}
+
+/*
+ * Maps each --band group:low:high[:flash] onto the bulbs of the group,
+ * or the bulbs of that name
+ */
+static bool mapBands(LifxManager &manager, LifxAudio &audio, const QStringList &bands)
+{
+    int hue = 0;
+
+    for (const auto &band : bands) {
+        QStringList parts = band.split(':');
+        if (parts.size() < 3) {
+            fprintf(stderr, "Bands are name:low:high or name:low:high:flash, not %s\n", qPrintable(band));
+            return false;
+        }
+
+        QString name = parts[0];
+        QVector<LifxBulb*> bulbs;
+        LifxGroup *group = manager.getGroupByName(name);
+        if (group)
+            bulbs = group->bulbs();
+        else
+            bulbs = manager.getBulbsByName(name).toVector();
+        if (bulbs.isEmpty()) {
+            fprintf(stderr, "No group or bulb named %s\n", qPrintable(name));
+            return false;
+        }
+
+        HSBK color;
+        color.hsvColorWheel(static_cast<uint16_t>(hue), 100, 100);
+        hue = (hue + 120) % 360;
+        audio.mapBand(parts[1].toFloat(), parts[2].toFloat(), bulbs, color, parts.size() > 3 && parts[3] == "flash");
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("Drives groups of bulbs from a WAV file or PCM on stdin");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("wav", "WAV file to play against the clock", "file"));
+    parser.addOption(QCommandLineOption("stdin", "Read signed 16 bit PCM from stdin at this rate, stereo", "hz"));
+    parser.addOption(QCommandLineOption("band", "A band driving a group or bulb, name:low:high or name:low:high:flash, repeatable", "band"));
+    parser.addOption(QCommandLineOption("output-latency", "Millis from reading audio to hearing it", "msecs", "0"));
+    parser.addOption(QCommandLineOption("light-latency", "Millis from an update to the light showing it, default two frames and 20", "msecs"));
+    parser.addOption(QCommandLineOption("discover", "Seconds to discover bulbs before starting", "secs", "3"));
+    parser.addOption(QCommandLineOption("benchmark", "Measure each stage from audio to packet on a click track this many seconds long", "secs"));
+    parser.addOption(QCommandLineOption("bpm", "Tempo of the benchmark click track", "bpm", "120"));
+    parser.addOption(QCommandLineOption("colors", "Colors the benchmark interpolates a frame", "count", "1000"));
+    parser.process(app);
+
+    if (parser.isSet("benchmark"))
+        return benchmark(parser);
+    if (parser.isSet("wav") == parser.isSet("stdin") || parser.values("band").isEmpty())
+        parser.showHelp(1);
+
+    LifxManager manager;
+    LifxTransitionEngine engine(&manager);
+    LifxAudio audio(&engine);
+    QTimer report;
+
+    audio.setOutputLatency(parser.value("output-latency").toInt());
+    if (parser.isSet("light-latency"))
+        audio.setLightLatency(parser.value("light-latency").toInt());
+
+    QObject::connect(&audio, &LifxAudio::finished, &app, &QCoreApplication::quit);
+    QObject::connect(&report, &QTimer::timeout, [&]() {
+        LifxAudioStats stats = audio.stats();
+        float bpm = audio.analyzer() ? audio.analyzer()->bpm() : 0;
+        printf("%6.1f BPM  %8llu updates  %6llu late  handoff %6.1f ms mean %6.1f worst  lands %+6.1f ms  engine frame %5lld us\n",
+               bpm, static_cast<unsigned long long>(stats.updates), static_cast<unsigned long long>(stats.late),
+               stats.meanHandoff / 1000.0, stats.maxHandoff / 1000.0, stats.meanError / 1000.0,
+               static_cast<long long>(engine.stats().lastFrame / 1000));
+        fflush(stdout);
+    });
+
+    QTimer::singleShot(parser.value("discover").toInt() * 1000, [&]() {
+        bool opened;
+        if (!mapBands(manager, audio, parser.values("band"))) {
+            app.exit(1);
+            return;
+        }
+        if (parser.isSet("wav"))
+            opened = audio.openWav(parser.value("wav"));
+        else
+            opened = audio.openStdin(parser.value("stdin").toInt(), 2);
+        if (!opened) {
+            app.exit(1);
+            return;
+        }
+        report.start(1000);
+    });
+    manager.discover();
+    return app.exec();
+}
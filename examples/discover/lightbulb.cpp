@@ -82,7 +82,7 @@ void LightBulb::paintEvent(QPaintEvent* e)
     if (!m_state)
         m_color = QColor("black");
         
-    m_text =  QString("%1\n%2\nRSSI: %3\nr:%4 g:%5 b:%6").arg(m_bulb->label()).arg(m_bulb->address().toString().mid(7)).arg(m_bulb->rssi()).arg(m_bulb->color().red()).arg(m_bulb->color().green()).arg(m_bulb->color().blue());
+    m_text =  QString("%1\n%2\nRSSI: %3\nr:%4 g:%5 b:%6").arg(m_bulb->label()).arg(m_bulb->addressToString(false)).arg(m_bulb->rssi()).arg(m_bulb->color().red()).arg(m_bulb->color().green()).arg(m_bulb->color().blue());
     m_label = m_bulb->label();
     m_color = m_bulb->color();
     m_state = m_bulb->isOn();
@@ -0,0 +1,160 @@
+/*
+ * Times fleet scans and lookups over a large simulated fleet
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QtCore>
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <random>
+
+#include "lifxfleet.h"
+#include "lifxbulb.h"
+#include "lifxquery.h"
+
+/*
+ * Runs work rounds times and returns the fastest, in nanos. The result
+ * of the last round is left in result so the work can't be skipped.
+ */
+template<typename Work>
+static qint64 fastest(int rounds, qint64 &result, Work work)
+{
+    QElapsedTimer timer;
+    qint64 best = std::numeric_limits<qint64>::max();
+
+    for (int r = 0; r < rounds; r++) {
+        timer.start();
+        result = work();
+        best = qMin(best, timer.nsecsElapsed());
+    }
+    return best;
+}
+
+/*
+ * One row of the table, nanos shown as micros
+ */
+static void printRow(const char *what, const char *how, qint64 nanos, qint64 result)
+{
+    printf("%-22s %-34s %12.1f %10lld\n", what, how, nanos / 1000.0, static_cast<long long>(result));
+}
+
+/*
+ * Fills a fleet with bulbs the way discovery would, MACs sharing the
+ * LIFX prefix, about half of them on, and keeps the QMap of bulb
+ * pointers the manager used to look them up by for comparison. Each
+ * scan and lookup is timed both ways and has to agree.
+ */
+static int benchmark(int devices, int rounds)
+{
+    std::mt19937 random(31);
+    LifxFleet fleet(devices);
+    QVector<LifxBulb*> bulbs;
+    QMap<uint64_t, LifxBulb*> byTarget;
+    QVector<uint64_t> targets;
+    QElapsedTimer timer;
+
+    timer.start();
+    bulbs.reserve(devices);
+    targets.reserve(devices);
+    for (int i = 0; i < devices; i++) {
+        uint64_t target = 0xd073d5000000ULL + (random() & 0xffffff);
+        if (fleet.indexOf(target) >= 0) {
+            i--;
+            continue;
+        }
+        LifxBulb *bulb = new LifxBulb(&fleet, target);
+        lx_dev_color_t *color = fleet.color(bulb->fleetIndex());
+        color->hue = static_cast<uint16_t>(random());
+        color->saturation = static_cast<uint16_t>(random());
+        color->brightness = static_cast<uint16_t>(random());
+        color->kelvin = 3500;
+        fleet.setPower(bulb->fleetIndex(), (random() & 1) ? 65535 : 0);
+        fleet.setCapabilities(bulb->fleetIndex(), (random() % 4) ? LifxFleet::Color : 0);
+        bulbs.append(bulb);
+        byTarget.insert(target, bulb);
+        targets.append(target);
+    }
+    qint64 build = timer.nsecsElapsed();
+
+    // Looked up in an order unrelated to discovery
+    std::shuffle(targets.begin(), targets.end(), random);
+
+    printf("%d simulated devices, fastest of %d rounds, fleet built in %.1f ms\n\n", devices, rounds, build / 1000000.0);
+    printf("%-22s %-34s %12s %10s\n", "operation", "how", "us", "result");
+
+    qint64 mapOn, fleetOn, mapFound, fleetFound, matched;
+
+    qint64 nanos = fastest(rounds, mapOn, [&]() {
+        qint64 on = 0;
+        for (auto bulb : byTarget)
+            if (bulb->isOn())
+                on++;
+        return on;
+    });
+    printRow("count powered on", "QMap of bulbs, isOn()", nanos, mapOn);
+
+    nanos = fastest(rounds, fleetOn, [&]() { return static_cast<qint64>(fleet.countOn()); });
+    printRow("count powered on", "LifxFleet::countOn()", nanos, fleetOn);
+
+    nanos = fastest(rounds, mapFound, [&]() {
+        qint64 found = 0;
+        for (auto target : targets)
+            if (byTarget.value(target, nullptr))
+                found++;
+        return found;
+    });
+    printRow("look up every MAC", "QMap::value()", nanos, mapFound);
+
+    nanos = fastest(rounds, fleetFound, [&]() {
+        qint64 found = 0;
+        for (auto target : targets)
+            if (fleet.indexOf(target) >= 0)
+                found++;
+        return found;
+    });
+    printRow("look up every MAC", "LifxFleet::indexOf()", nanos, fleetFound);
+
+    LifxQuery query;
+    query.isOn().hasCapability(LifxFleet::Color).where(LifxQuery::Brightness, LifxQuery::Greater, 32767);
+    nanos = fastest(rounds, matched, [&]() {
+        return static_cast<qint64>(query.evaluate(&fleet, LifxBitmap(fleet.size(), true)).count());
+    });
+    printRow("on, color, over half", "LifxQuery::evaluate()", nanos, matched);
+
+    qDeleteAll(bulbs);
+
+    if (mapOn != fleetOn || mapFound != fleetFound || fleetFound != devices) {
+        fprintf(stderr, "\nThe fleet and the map disagree\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("Times counting and looking up bulbs in a simulated fleet, against a QMap of bulbs");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("devices", "Simulated bulbs in the fleet", "count", "100000"));
+    parser.addOption(QCommandLineOption("rounds", "Rounds timed, the fastest is shown", "count", "10"));
+    parser.process(app);
+
+    return benchmark(qBound(1, parser.value("devices").toInt(), 0x7fffff), qMax(parser.value("rounds").toInt(), 1));
+}
@@ -0,0 +1,223 @@
+/*
+ * Plays images or raw video on a layout, and measures each stage
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QtCore>
+#include <QtGui/QtGui>
+#include <cstdio>
+
+#include "lifxmanager.h"
+#include "lifxlayout.h"
+#include "lifximagemapper.h"
+#include "hsbk.h"
+
+/*
+ * Parses WIDTHxHEIGHT
+ */
+static bool parseSize(const QString &text, int &width, int &height)
+{
+    QStringList parts = text.split('x');
+    bool wok = false, hok = false;
+
+    if (parts.size() == 2) {
+        width = parts[0].toInt(&wok);
+        height = parts[1].toInt(&hok);
+    }
+    return wok && hok && width > 0 && height > 0;
+}
+
+/*
+ * One row of the stage table, nanos shown as millis
+ */
+static void printStage(const char *stage, qint64 mean, qint64 worst)
+{
+    printf("%-34s %10.3f %10.3f\n", stage, mean / 1000000.0, worst / 1000000.0);
+}
+
+/*
+ * Maps a moving pattern, kept as PNGs in memory so decoding costs what
+ * it would from disk, onto a layout of 8x8 tiles with as many points as
+ * asked, rounded up to whole tiles. The layout isn't bound, so every
+ * point counts as changed every frame and nothing is sent, the worst
+ * case for every stage but the last.
+ */
+static int benchmark(const QCommandLineParser &parser)
+{
+    int points = qMax(parser.value("points").toInt(), 1);
+    int frames = qMax(parser.value("benchmark").toInt(), 1);
+    int fps = qMax(parser.value("fps").toInt(), 1);
+    int width, height;
+
+    if (!parseSize(parser.value("size"), width, height)) {
+        fprintf(stderr, "The size is WIDTHxHEIGHT, not %s\n", qPrintable(parser.value("size")));
+        return 1;
+    }
+
+    LifxLayout layout;
+    int tiles = (points + 63) / 64;
+    for (int t = 0; t < tiles; t++)
+        layout.addTile(0xd073d5000000 + t, 0, (t % 8) * 8, (t / 8) * 8, 0, 1);
+
+    LifxImageMapper mapper(nullptr, &layout);
+    mapper.setFilter(parser.value("filter") == "area" ? LifxImageMapper::Area : LifxImageMapper::Box);
+
+    // A few distinct frames, encoded once, decoded in turn
+    QVector<QByteArray> encoded;
+    for (int f = 0; f < 8; f++) {
+        QImage image(width, height, QImage::Format_RGB888);
+        for (int y = 0; y < height; y++) {
+            uchar *line = image.scanLine(y);
+            for (int x = 0; x < width; x++, line += 3) {
+                line[0] = static_cast<uchar>(x + f * 16);
+                line[1] = static_cast<uchar>(y * 2 + f * 8);
+                line[2] = static_cast<uchar>((x + y) / 4);
+            }
+        }
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+        encoded.append(png);
+    }
+
+    // Decoding is timed here, as it runs on the decoder thread when playing
+    QElapsedTimer timer;
+    qint64 decode = 0;
+    qint64 worstDecode = 0;
+    for (int f = 0; f < frames; f++) {
+        QImage image;
+        timer.start();
+        image.loadFromData(encoded[f % encoded.size()], "PNG");
+        image = image.convertToFormat(QImage::Format_RGB888);
+        qint64 nanos = timer.nsecsElapsed();
+        decode += nanos;
+        worstDecode = qMax(worstDecode, nanos);
+        mapper.processRgb(image.constScanLine(0), image.width(), image.height(), image.bytesPerLine());
+    }
+    decode /= frames;
+
+    LifxImageMapperStats stats = mapper.stats();
+    qint64 budget = 1000000000LL / fps;
+
+    printf("%d frames of %dx%d onto %d points, %s filter, conversion kernel %s\n\n", frames, width, height,
+           layout.size(), parser.value("filter") == "area" ? "area" : "box", qPrintable(HSBK::conversionKernel()));
+    printf("%-34s %10s %10s\n", "stage", "mean ms", "worst ms");
+    printStage("decoding the PNG, decoder thread", decode, worstDecode);
+    printStage("sampling", stats.mean.sample, stats.worst.sample);
+    printStage("comparing", stats.mean.compare, stats.worst.compare);
+    printStage("converting to HSBK", stats.mean.convert, stats.worst.convert);
+    printStage("sending", stats.mean.send, stats.worst.send);
+    qint64 mean = stats.mean.sample + stats.mean.compare + stats.mean.convert + stats.mean.send;
+    qint64 worst = stats.worst.sample + stats.worst.compare + stats.worst.convert + stats.worst.send;
+    printStage("frame thread", mean, worst);
+    printf("\nAt %d fps a frame has %.3f ms, the frame thread %s and the decoder %s\n", fps, budget / 1000000.0,
+           worst < budget ? "keeps up" : "falls behind", decode < budget ? "keeps up" : "falls behind");
+    return 0;
+}
+
+/*
+ * Every file in a directory, in name order, or the file itself
+ */
+static QStringList sequence(const QString &path)
+{
+    QFileInfo info(path);
+    QStringList files;
+
+    if (!info.isDir())
+        return QStringList() << path;
+
+    for (const auto &entry : QDir(path).entryInfoList(QDir::Files, QDir::Name))
+        files.append(entry.filePath());
+    return files;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("Plays images, or raw RGB video on stdin, on a layout");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("layout", "Layout saved by LifxLayout::save()", "file"));
+    parser.addOption(QCommandLineOption("images", "A directory of images played in name order, or one image", "path"));
+    parser.addOption(QCommandLineOption("stdin", "Read raw RGB frames of this size from stdin", "WIDTHxHEIGHT"));
+    parser.addOption(QCommandLineOption("raw-size", "Size of .rgb and .raw files in the sequence", "WIDTHxHEIGHT"));
+    parser.addOption(QCommandLineOption("fps", "Frames a second for images", "fps", QString::number(LifxImageMapper::DEFAULT_FRAME_RATE)));
+    parser.addOption(QCommandLineOption("loop", "Play the images again and again"));
+    parser.addOption(QCommandLineOption("filter", "box or area", "filter", "box"));
+    parser.addOption(QCommandLineOption("threshold", "Change on an 8 bit channel a point ignores", "levels",
+                                        QString::number(LifxImageMapper::DEFAULT_THRESHOLD)));
+    parser.addOption(QCommandLineOption("duration", "Transition millis given to the lights", "msecs", "0"));
+    parser.addOption(QCommandLineOption("discover", "Seconds to discover bulbs before starting", "secs", "3"));
+    parser.addOption(QCommandLineOption("benchmark", "Time each stage over this many frames", "frames"));
+    parser.addOption(QCommandLineOption("points", "Points in the benchmark layout", "count", "2000"));
+    parser.addOption(QCommandLineOption("size", "Size of the benchmark frames", "WIDTHxHEIGHT", "1920x1080"));
+    parser.process(app);
+
+    if (parser.isSet("benchmark"))
+        return benchmark(parser);
+    if (!parser.isSet("layout") || parser.isSet("images") == parser.isSet("stdin"))
+        parser.showHelp(1);
+
+    LifxManager manager;
+    LifxLayout layout;
+    LifxImageMapper mapper(&manager, &layout);
+    QTimer report;
+    int width, height;
+
+    if (!layout.load(parser.value("layout")))
+        return 1;
+    mapper.setFilter(parser.value("filter") == "area" ? LifxImageMapper::Area : LifxImageMapper::Box);
+    mapper.setThreshold(parser.value("threshold").toInt());
+    mapper.setDuration(parser.value("duration").toUInt());
+    if (parser.isSet("raw-size") || parser.isSet("stdin")) {
+        QString size = parser.isSet("stdin") ? parser.value("stdin") : parser.value("raw-size");
+        if (!parseSize(size, width, height)) {
+            fprintf(stderr, "Sizes are WIDTHxHEIGHT, not %s\n", qPrintable(size));
+            return 1;
+        }
+        mapper.setRawSize(width, height);
+    }
+
+    QObject::connect(&mapper, &LifxImageMapper::finished, &app, &QCoreApplication::quit);
+    QObject::connect(&report, &QTimer::timeout, [&]() {
+        LifxImageMapperStats stats = mapper.stats();
+        printf("%8llu frames  %6llu dropped  %6llu late  %10llu points  decode %6.2f  sample %6.2f  compare %5.2f  convert %5.2f  send %5.2f ms\n",
+               static_cast<unsigned long long>(stats.frames), static_cast<unsigned long long>(stats.dropped),
+               static_cast<unsigned long long>(stats.late), static_cast<unsigned long long>(stats.points),
+               stats.mean.decode / 1000000.0, stats.mean.sample / 1000000.0, stats.mean.compare / 1000000.0,
+               stats.mean.convert / 1000000.0, stats.mean.send / 1000000.0);
+        fflush(stdout);
+    });
+
+    QTimer::singleShot(parser.value("discover").toInt() * 1000, [&]() {
+        bool opened;
+        printf("%d of %d points found\n", layout.bind(&manager), layout.size());
+        if (parser.isSet("images"))
+            opened = mapper.openSequence(sequence(parser.value("images")), parser.value("fps").toInt(), parser.isSet("loop"));
+        else
+            opened = mapper.openStdin();
+        if (!opened) {
+            app.exit(1);
+            return;
+        }
+        report.start(1000);
+    });
+    manager.discover();
+    return app.exec();
+}
@@ -0,0 +1,140 @@
+/*
+ * Times the batch color kernels the library picked for this CPU
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QtCore>
+#include <cstdio>
+#include <limits>
+#include <random>
+
+#include "hsbk.h"
+#include "lifxtransitionengine.h"
+
+/*
+ * FNV-1a over the output, equal between kernels when they agree
+ */
+static quint32 checksum(const void *data, size_t bytes)
+{
+    const uchar *p = static_cast<const uchar*>(data);
+    quint32 hash = 2166136261u;
+
+    for (size_t i = 0; i < bytes; i++) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Runs work rounds times and returns the fastest, in nanos per pixel
+ */
+template<typename Work>
+static double fastest(int rounds, int pixels, Work work)
+{
+    QElapsedTimer timer;
+    qint64 best = std::numeric_limits<qint64>::max();
+
+    for (int r = 0; r < rounds; r++) {
+        timer.start();
+        work();
+        best = qMin(best, timer.nsecsElapsed());
+    }
+    return static_cast<double>(best) / pixels;
+}
+
+/*
+ * One row of the table
+ */
+static void printRow(const QString &kernel, const char *stage, double nanos, quint32 sum)
+{
+    printf("%-8s %-24s %10.2f   %08x\n", qPrintable(kernel), stage, nanos, sum);
+    fflush(stdout);
+}
+
+/*
+ * Times each conversion, and the transition engine's interpolation, on
+ * the same random pixels whichever kernel is in use. The input is
+ * seeded, so the checksums only differ if the kernels do.
+ */
+static void benchmark(int pixels, int rounds)
+{
+    std::mt19937 random(29);
+    QVector<lx_rgb8_t> rgb(pixels);
+    QVector<lx_rgb8_t> back(pixels);
+    QVector<lx_hsbk_t> hsbk(pixels);
+    QVector<lx_hsbk_t> from(pixels);
+    QVector<lx_hsbk_t> to(pixels);
+    QVector<lx_hsbk_t> mixed(pixels);
+    QVector<uint16_t> weights(pixels);
+
+    for (int i = 0; i < pixels; i++) {
+        rgb[i] = { static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()) };
+        from[i] = { static_cast<uint16_t>(random()), static_cast<uint16_t>(random()), static_cast<uint16_t>(random()), 3500 };
+        to[i] = { static_cast<uint16_t>(random()), static_cast<uint16_t>(random()), static_cast<uint16_t>(random()), 6500 };
+        weights[i] = static_cast<uint16_t>(random() % (LifxTransitionEngine::WEIGHT_ONE + 1));
+    }
+
+    double nanos = fastest(rounds, pixels, [&]() { HSBK::convertRgbToHsbk(rgb.constData(), hsbk.data(), pixels); });
+    printRow(HSBK::conversionKernel(), "RGB to HSBK", nanos, checksum(hsbk.constData(), hsbk.size() * sizeof(lx_hsbk_t)));
+
+    nanos = fastest(rounds, pixels, [&]() { HSBK::convertHsbkToRgb(hsbk.constData(), back.data(), pixels); });
+    printRow(HSBK::conversionKernel(), "HSBK to RGB", nanos, checksum(back.constData(), back.size() * sizeof(lx_rgb8_t)));
+
+    nanos = fastest(rounds, pixels, [&]() {
+        LifxTransitionEngine::interpolate(from.constData(), to.constData(), weights.constData(), mixed.data(), pixels);
+    });
+    printRow(LifxTransitionEngine::interpolationKernel(), "interpolate", nanos, checksum(mixed.constData(), mixed.size() * sizeof(lx_hsbk_t)));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("Times the RGB and HSBK conversion and interpolation kernels in nanos per pixel. "
+                                     "The widest kernel the CPU has is timed, then the scalar one, which "
+                                     "QTLIFX_NO_SIMD=1 in the environment forces.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("pixels", "Pixels converted each round", "count", "1048576"));
+    parser.addOption(QCommandLineOption("rounds", "Rounds timed, the fastest is shown", "count", "20"));
+    parser.addOption(QCommandLineOption("no-header", "Leave out the table header"));
+    parser.process(app);
+
+    int pixels = qMax(parser.value("pixels").toInt(), 1);
+    int rounds = qMax(parser.value("rounds").toInt(), 1);
+
+    if (!parser.isSet("no-header"))
+        printf("%-8s %-24s %10s   %s\n", "kernel", "stage", "ns/pixel", "checksum");
+    benchmark(pixels, rounds);
+
+    // The kernel is picked once per process, so scalar needs a run of its own
+    if (HSBK::conversionKernel() != "scalar") {
+        QProcess scalar;
+        QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+        env.insert("QTLIFX_NO_SIMD", "1");
+        scalar.setProcessEnvironment(env);
+        scalar.setProcessChannelMode(QProcess::ForwardedChannels);
+        scalar.start(QCoreApplication::applicationFilePath(), QStringList() << "--no-header"
+                     << "--pixels" << QString::number(pixels) << "--rounds" << QString::number(rounds));
+        if (!scalar.waitForFinished(-1) || scalar.exitCode() != 0) {
+            fprintf(stderr, "The scalar run failed\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Compiles a cue list into a show file
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <QtCore/QtCore>
+#include <cstdio>
+
+#include "lifxmanager.h"
+#include "lifxshowcompiler.h"
+#include "lifxshowfile.h"
+
+static const char *kindName(LifxShowIssue::Kind kind)
+{
+    switch (kind) {
+    case LifxShowIssue::Unresolved:
+        return "unresolved";
+    case LifxShowIssue::Postponed:
+        return "postponed";
+    case LifxShowIssue::Dropped:
+        return "dropped";
+    case LifxShowIssue::OverBudget:
+        return "over budget";
+    }
+    return "";
+}
+
+static int compileShow(const QCommandLineParser &parser)
+{
+    LifxShowCompiler compiler;
+    LifxShow show;
+    QStringList args = parser.positionalArguments();
+
+    if (!compiler.loadFleetCache(parser.value("cache")) || compiler.bulbCount() == 0) {
+        fprintf(stderr, "No bulbs in the fleet cache %s, run with --discover first\n", qPrintable(parser.value("cache")));
+        return 1;
+    }
+    if (!compiler.loadCues(args[0]))
+        return 1;
+
+    compiler.setRateLimit(parser.value("rate").toInt());
+    compiler.setFrameBudget(parser.value("frame-budget").toInt());
+    compiler.setResolution(parser.value("resolution").toInt());
+    compiler.setFadeTolerance(parser.value("tolerance").toInt());
+
+    bool compiled = compiler.compile(show);
+    for (const auto &entry : compiler.issues())
+        printf("%s:%d: %s: %s\n", qPrintable(args[0]), entry.line, kindName(entry.kind), qPrintable(entry.message));
+
+    LifxShowCompileStats stats = compiler.stats();
+    printf("%d cues, %d left out, %d bulb changes, %d folded into fades, %d postponed, %d dropped\n",
+           stats.cues, stats.unresolved, stats.changes, stats.faded, stats.postponed, stats.dropped);
+    printf("%d frames, %d messages, %d frames over budget\n", stats.frames, stats.messages, stats.overBudget);
+
+    if (!compiled) {
+        fprintf(stderr, "Nothing to write\n");
+        return 1;
+    }
+    if (!LifxShowFile::write(args[1], &show, parser.value("keyframes").toInt()))
+        return 1;
+
+    printf("Wrote %s, %lld millis long\n", qPrintable(args[1]), static_cast<long long>(show.length()));
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+
+    parser.setApplicationDescription("Compiles a .csv or .json cue list into a show file for LifxShowFile");
+    parser.addHelpOption();
+    parser.addPositionalArgument("cues", "Cue list, .csv or .json");
+    parser.addPositionalArgument("show", "Show file to write");
+    parser.addOption(QCommandLineOption("cache", "Fleet cache naming the bulbs", "file", "fleet.json"));
+    parser.addOption(QCommandLineOption("discover", "Discover bulbs for this many seconds and write the fleet cache, then compile if cues are given", "secs"));
+    parser.addOption(QCommandLineOption("rate", "Most messages a second per bulb, 0 for no limit", "count", "20"));
+    parser.addOption(QCommandLineOption("frame-budget", "Warn about frames sending more messages than this, 0 to not check", "count", "0"));
+    parser.addOption(QCommandLineOption("resolution", "Frame grid in millis", "msecs", "10"));
+    parser.addOption(QCommandLineOption("tolerance", "How far off a straight line a step may be and still join a fade", "value", "512"));
+    parser.addOption(QCommandLineOption("keyframes", "Most frames between keyframes in the show file", "count", "100"));
+    parser.process(app);
+
+    bool compile = parser.positionalArguments().size() == 2;
+    if (!compile && !parser.isSet("discover"))
+        parser.showHelp(1);
+
+    if (!parser.isSet("discover"))
+        return compileShow(parser);
+
+    LifxManager manager;
+    QTimer::singleShot(parser.value("discover").toInt() * 1000, [&]() {
+        if (!LifxShowCompiler::saveFleetCache(&manager, parser.value("cache")))
+            app.exit(1);
+        else if (compile)
+            app.exit(compileShow(parser));
+        else
+            app.exit(0);
+    });
+    manager.discover();
+    return app.exec();
+}
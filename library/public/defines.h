@@ -187,6 +187,218 @@ typedef struct {
     uint32_t duration;      /**< Duration in millis for how long the next transition will take */
 } lx_dev_color_t;
 
+/**
+ * \struct lx_hsbk_t
+ * \brief (PRIVATE) A bare HSBK color as used in the multizone and tile messages
+ *
+ * Unlike lx_dev_color_t, there is no reserved byte or duration, so an
+ * array of these is exactly what goes on the wire.
+ */
+typedef struct {
+    uint16_t hue;           /**< Hue value */
+    uint16_t saturation;    /**< Saturation value */
+    uint16_t brightness;    /**< Brightness value */
+    uint16_t kelvin;        /**< Kelvin color temperature */
+} lx_hsbk_t;
+
+/**
+ * \struct lx_rgb8_t
+ * \brief (PRIVATE) A packed 8 bit per channel RGB pixel, as found in images and video frames
+ */
+typedef struct {
+    uint8_t r;              /**< Red */
+    uint8_t g;              /**< Green */
+    uint8_t b;              /**< Blue */
+} lx_rgb8_t;
+
+/**
+ * \def MAX_EXTENDED_ZONES
+ * \brief The number of zones a single extended multizone message can carry
+ */
+#define MAX_EXTENDED_ZONES  82
+
+/**
+ * \struct lx_dev_extended_zones_t
+ * \brief (PRIVATE) The payload for a SET_EXTENDED_COLOR_ZONES message
+ *
+ * Sets up to 82 zones starting at zone_index. The apply field decides
+ * whether the strip shows the new colors now, or holds them until a
+ * later message with apply set.
+ */
+typedef struct {
+    uint32_t duration;                      /**< Duration in millis for the transition */
+    uint8_t apply;                          /**< One of the MULTIZONE_ apply values */
+    uint16_t zone_index;                    /**< The first zone to set */
+    uint8_t colors_count;                   /**< Number of valid entries in colors */
+    lx_hsbk_t colors[MAX_EXTENDED_ZONES];   /**< The zone colors */
+} lx_dev_extended_zones_t;
+
+/**
+ * \struct lx_dev_extended_zones_state_t
+ * \brief (PRIVATE) The payload of a STATE_EXTENDED_COLOR_ZONES reply
+ *
+ * Strips longer than 82 zones reply with more than one of these.
+ */
+typedef struct {
+    uint16_t zones_count;                   /**< Total number of zones on the device */
+    uint16_t zone_index;                    /**< The first zone in this reply */
+    uint8_t colors_count;                   /**< Number of valid entries in colors */
+    lx_hsbk_t colors[MAX_EXTENDED_ZONES];   /**< The zone colors */
+} lx_dev_extended_zones_state_t;
+
+/**
+ * \struct lx_dev_waveform_t
+ * \brief (PRIVATE) The payload for a SET_WAVEFORM message
+ *
+ * Asks the bulb to run an effect on its own, moving between its current
+ * color and the color in this struct following the waveform curve.
+ */
+typedef struct {
+    uint8_t reserved;       /**< Reserved bytes, not used by this class */
+    uint8_t transient;      /**< If 1, the bulb returns to the original color when the waveform completes */
+    uint16_t hue;           /**< Hue value the waveform moves towards */
+    uint16_t saturation;    /**< Saturation value the waveform moves towards */
+    uint16_t brightness;    /**< Brightness value the waveform moves towards */
+    uint16_t kelvin;        /**< Kelvin value the waveform moves towards */
+    uint32_t period;        /**< Duration of a single cycle in millis */
+    float cycles;           /**< Number of cycles to run */
+    int16_t skew_ratio;     /**< Shifts the waveform peak, or sets the duty cycle for PULSE */
+    uint8_t waveform;       /**< The curve, see LifxWaveform::Waveform */
+} lx_dev_waveform_t;
+
+/**
+ * \struct lx_dev_waveform_optional_t
+ * \brief (PRIVATE) The payload for a SET_WAVEFORM_OPTIONAL message
+ *
+ * The same as lx_dev_waveform_t, but the bulb will only change the
+ * fields which have the matching set_ flag enabled.
+ */
+typedef struct {
+    uint8_t reserved;       /**< Reserved bytes, not used by this class */
+    uint8_t transient;      /**< If 1, the bulb returns to the original color when the waveform completes */
+    uint16_t hue;           /**< Hue value the waveform moves towards */
+    uint16_t saturation;    /**< Saturation value the waveform moves towards */
+    uint16_t brightness;    /**< Brightness value the waveform moves towards */
+    uint16_t kelvin;        /**< Kelvin value the waveform moves towards */
+    uint32_t period;        /**< Duration of a single cycle in millis */
+    float cycles;           /**< Number of cycles to run */
+    int16_t skew_ratio;     /**< Shifts the waveform peak, or sets the duty cycle for PULSE */
+    uint8_t waveform;       /**< The curve, see LifxWaveform::Waveform */
+    uint8_t set_hue;        /**< If 1, hue is changed */
+    uint8_t set_saturation; /**< If 1, saturation is changed */
+    uint8_t set_brightness; /**< If 1, brightness is changed */
+    uint8_t set_kelvin;     /**< If 1, kelvin is changed */
+} lx_dev_waveform_optional_t;
+
+/**
+ * \def TILE_PIXELS
+ * \brief The number of colors in a single Set64 or State64 message, one full 8x8 tile
+ */
+#define TILE_PIXELS         64
+
+/**
+ * \def MAX_CHAIN_TILES
+ * \brief The number of tiles described by a single STATE_DEVICE_CHAIN reply
+ */
+#define MAX_CHAIN_TILES     16
+
+/**
+ * \struct lx_tile_t
+ * \brief (PRIVATE) A single tile entry in a STATE_DEVICE_CHAIN reply
+ */
+typedef struct {
+    int16_t accel_meas_x;               /**< Accelerometer, used to work out orientation */
+    int16_t accel_meas_y;               /**< Accelerometer, used to work out orientation */
+    int16_t accel_meas_z;               /**< Accelerometer, used to work out orientation */
+    int16_t reserved1;                  /**< Reserved bytes, not used by this class */
+    float user_x;                       /**< Position of the tile as set in the app */
+    float user_y;                       /**< Position of the tile as set in the app */
+    uint8_t width;                      /**< Pixels across the tile */
+    uint8_t height;                     /**< Pixels down the tile */
+    uint8_t reserved2;                  /**< Reserved bytes, not used by this class */
+    uint32_t device_version_vendor;     /**< Vendor ID */
+    uint32_t device_version_product;    /**< Product ID */
+    uint32_t reserved3;                 /**< Reserved bytes, not used by this class */
+    uint64_t firmware_build;            /**< Firmware build time */
+    uint64_t reserved4;                 /**< Reserved bytes, not used by this class */
+    uint16_t firmware_version_minor;    /**< Firmware minor version */
+    uint16_t firmware_version_major;    /**< Firmware major version */
+    uint32_t reserved5;                 /**< Reserved bytes, not used by this class */
+} lx_tile_t;
+
+/**
+ * \struct lx_dev_device_chain_t
+ * \brief (PRIVATE) The payload of a STATE_DEVICE_CHAIN reply
+ */
+typedef struct {
+    uint8_t start_index;                        /**< Index of the first tile described */
+    lx_tile_t tile_devices[MAX_CHAIN_TILES];    /**< The tiles, only tile_devices_count are valid */
+    uint8_t tile_devices_count;                 /**< Number of tiles in the chain */
+} lx_dev_device_chain_t;
+
+/**
+ * \struct lx_dev_get64_t
+ * \brief (PRIVATE) The payload for a GET64 message
+ */
+typedef struct {
+    uint8_t tile_index;     /**< First tile to read */
+    uint8_t length;         /**< Number of tiles to read, one STATE64 comes back for each */
+    uint8_t reserved;       /**< Frame buffer index, always 0 for reads */
+    uint8_t x;              /**< Starting column */
+    uint8_t y;              /**< Starting row */
+    uint8_t width;          /**< Width of the tile */
+} lx_dev_get64_t;
+
+/**
+ * \struct lx_dev_set64_t
+ * \brief (PRIVATE) The payload for a SET64 message
+ *
+ * Writes 64 colors into one of the tile frame buffers. Frame buffer 0
+ * is what the tile shows, anything else is an off screen copy which
+ * can be moved to 0 with COPY_FRAME_BUFFER.
+ */
+typedef struct {
+    uint8_t tile_index;                 /**< First tile to write */
+    uint8_t length;                     /**< Number of tiles to write the same colors to */
+    uint8_t fb_index;                   /**< Frame buffer to write to */
+    uint8_t x;                          /**< Starting column */
+    uint8_t y;                          /**< Starting row */
+    uint8_t width;                      /**< Width of the tile, colors wrap at this */
+    uint32_t duration;                  /**< Duration in millis for the transition */
+    lx_hsbk_t colors[TILE_PIXELS];      /**< The pixel colors, row major */
+} lx_dev_set64_t;
+
+/**
+ * \struct lx_dev_state64_t
+ * \brief (PRIVATE) The payload of a STATE64 reply
+ */
+typedef struct {
+    uint8_t tile_index;                 /**< The tile these colors came from */
+    uint8_t reserved;                   /**< Reserved bytes, not used by this class */
+    uint8_t x;                          /**< Starting column */
+    uint8_t y;                          /**< Starting row */
+    uint8_t width;                      /**< Width of the tile */
+    lx_hsbk_t colors[TILE_PIXELS];      /**< The pixel colors, row major */
+} lx_dev_state64_t;
+
+/**
+ * \struct lx_dev_copy_frame_buffer_t
+ * \brief (PRIVATE) The payload for a COPY_FRAME_BUFFER message
+ */
+typedef struct {
+    uint8_t tile_index;     /**< First tile to copy on */
+    uint8_t length;         /**< Number of tiles to copy on */
+    uint8_t src_fb_index;   /**< Frame buffer to copy from */
+    uint8_t dst_fb_index;   /**< Frame buffer to copy to, 0 is the visible one */
+    uint8_t src_x;          /**< Source column */
+    uint8_t src_y;          /**< Source row */
+    uint8_t dst_x;          /**< Destination column */
+    uint8_t dst_y;          /**< Destination row */
+    uint8_t width;          /**< Columns to copy */
+    uint8_t height;         /**< Rows to copy */
+    uint32_t duration;      /**< Duration in millis for the transition */
+} lx_dev_copy_frame_buffer_t;
+
 typedef struct {
     uint64_t value;
 } lx_dev_echo_t;
@@ -246,6 +458,28 @@ namespace LIFX_DEFINES {
     static constexpr uint16_t STATE_HEV_CYCLE_CONFIG = 147;
     static constexpr uint16_t GET_LAST_HEV_CYCLE_RESULT = 148;
     static constexpr uint16_t STATE_LAST_HEV_CYCLE_RESULT = 149;
+
+    // Multizone
+    static constexpr uint16_t SET_EXTENDED_COLOR_ZONES = 510;
+    static constexpr uint16_t GET_EXTENDED_COLOR_ZONES = 511;
+    static constexpr uint16_t STATE_EXTENDED_COLOR_ZONES = 512;
+
+    // Multizone apply values
+    static constexpr uint8_t MULTIZONE_NO_APPLY = 0;
+    static constexpr uint8_t MULTIZONE_APPLY = 1;
+    static constexpr uint8_t MULTIZONE_APPLY_ONLY = 2;
+
+    // Tile
+    static constexpr uint16_t GET_DEVICE_CHAIN = 701;
+    static constexpr uint16_t STATE_DEVICE_CHAIN = 702;
+    static constexpr uint16_t GET64 = 707;
+    static constexpr uint16_t STATE64 = 711;
+    static constexpr uint16_t SET64 = 715;
+    static constexpr uint16_t COPY_FRAME_BUFFER = 716;
+
+    // Tile frame buffers
+    static constexpr uint8_t TILE_VISIBLE_FB = 0;
+    static constexpr uint8_t TILE_BACK_FB = 1;
 };
 
 static QMap<int, QString> defines_names_map {
@@ -294,4 +528,13 @@ static QMap<int, QString> defines_names_map {
     { LIFX_DEFINES::STATE_HEV_CYCLE_CONFIG, QString("STATE_HEV_CYCLE_CONFIG") },
     { LIFX_DEFINES::GET_LAST_HEV_CYCLE_RESULT, QString("GET_LAST_HEV_CYCLE_RESULT") },
     { LIFX_DEFINES::STATE_LAST_HEV_CYCLE_RESULT, QString("STATE_LAST_HEV_CYCLE_RESULT") },
+    { LIFX_DEFINES::SET_EXTENDED_COLOR_ZONES, QString("SET_EXTENDED_COLOR_ZONES") },
+    { LIFX_DEFINES::GET_EXTENDED_COLOR_ZONES, QString("GET_EXTENDED_COLOR_ZONES") },
+    { LIFX_DEFINES::STATE_EXTENDED_COLOR_ZONES, QString("STATE_EXTENDED_COLOR_ZONES") },
+    { LIFX_DEFINES::GET_DEVICE_CHAIN, QString("GET_DEVICE_CHAIN") },
+    { LIFX_DEFINES::STATE_DEVICE_CHAIN, QString("STATE_DEVICE_CHAIN") },
+    { LIFX_DEFINES::GET64, QString("GET64") },
+    { LIFX_DEFINES::STATE64, QString("STATE64") },
+    { LIFX_DEFINES::SET64, QString("SET64") },
+    { LIFX_DEFINES::COPY_FRAME_BUFFER, QString("COPY_FRAME_BUFFER") },
 };
@@ -61,6 +61,7 @@ public:
      * Sets the S value to the range 0 to 65535
      */
     uint16_t s(uint16_t v) { m_hsbk.saturation = v; return v; }
+    uint16_t s(float v);
     /**
      * \fn uint16_t b(uint16_t v)
      * \param v The B value of the HSBK as a uint16_t
@@ -117,10 +118,14 @@ public:
      * returns the raw data directly.
      */
     lx_dev_color_t getHSBK() const { return m_hsbk; }
-    QColor getQColor();
+    QColor getQColor() const;
     void setColor(QString color);
     void hsvColorWheel(uint16_t degrees, float spct, float vpct);
     static QStringList colors();
+
+    static void convertRgbToHsbk(const lx_rgb8_t *rgb, lx_hsbk_t *hsbk, int count, uint16_t kelvin = 3500);
+    static void convertHsbkToRgb(const lx_hsbk_t *hsbk, lx_rgb8_t *rgb, int count);
+    static QString conversionKernel();
     
 private:
     lx_dev_color_t m_hsbk;                                      //!< The color struct used by the LIFX protocol
@@ -0,0 +1,171 @@
+/*
+ * Drives bulbs from music, read as PCM from a WAV file or stdin
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXAUDIO_H
+#define LIFXAUDIO_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+#include "lifxaudioanalyzer.h"
+
+class LifxBulb;
+class LifxTransitionEngine;
+
+/**
+ * \struct LifxAudioStats
+ * How the audio pipeline is keeping up
+ */
+struct LifxAudioStats {
+    quint64 frames = 0;         //!< Sample frames read
+    quint64 updates = 0;        //!< Band and beat changes handed to the transition engine
+    quint64 late = 0;           //!< Updates handed over after they were due, the lead couldn't cover the light latency
+    qint64 lastHandoff = 0;     //!< Micros from the audio arriving to its update reaching the engine, the last one
+    qint64 maxHandoff = 0;      //!< Longest handoff in micros
+    qint64 meanHandoff = 0;     //!< Mean handoff in micros
+    qint64 meanError = 0;       //!< Mean micros the light is expected to land after the sound, negative for early
+};
+
+/**
+ * \class LifxAudio
+ * \brief (PUBLIC) Music in, light changes out, landing on the beat
+ *
+ * Reads 8, 16, 24 or 32 bit integer or float PCM from a WAV file, played
+ * at its own rate against the clock, or raw signed 16 bit little endian
+ * PCM from stdin as it arrives. Channels are mixed to mono and given to a
+ * LifxAudioAnalyzer.
+ *
+ * mapBand() ties a frequency band to a list of bulbs, for instance a
+ * group's, or to a run of zones on a strip. The band's level scales the
+ * brightness of the color given, and a band mapped with flashOnBeat goes
+ * to full on each predicted beat.
+ *
+ * Every update is handed to the LifxTransitionEngine at the time the
+ * sound it came from will be heard, less the light latency. Sound is
+ * heard outputLatency() after it is read here, the player's buffer, and
+ * a change is shown lightLatency() after the engine gets it, a frame or
+ * two and the network. When the output latency is the larger the update
+ * is held until then. Beats are predicted a beat ahead, so they land on
+ * time even when it isn't. Anything else that can't be held long enough
+ * goes at once and counts as late in stats().
+ *
+ * With a null engine the audio is still analyzed and beat() emitted, but
+ * nothing is sent.
+ */
+class Q_DECL_EXPORT LifxAudio : public QObject
+{
+    Q_OBJECT
+
+public:
+    LifxAudio(LifxTransitionEngine *engine, QObject *parent = nullptr);
+    ~LifxAudio();
+
+    bool openWav(const QString &path);
+    bool openStdin(int sampleRate, int channels = 2);
+    void close();
+    bool isOpen() const { return m_analyzer != nullptr; }              //!< Returns true while reading
+
+    int mapBand(float lowHz, float highHz, const QVector<LifxBulb*> &bulbs, const HSBK &color, bool flashOnBeat = false);
+    int mapBand(float lowHz, float highHz, LifxBulb *strip, int firstZone, int zoneCount, const HSBK &color, bool flashOnBeat = false);
+    void clearMappings();
+
+    void setOutputLatency(int msecs) { m_outputLatency = qMax(msecs, 0); }    //!< Sets millis from reading a sample to it being heard
+    int outputLatency() const { return m_outputLatency; }                       //!< Returns millis from reading a sample to it being heard
+    void setLightLatency(int msecs) { m_lightLatency = qMax(msecs, 0); }      //!< Sets millis from an update reaching the engine to the light showing it
+    int lightLatency() const { return m_lightLatency; }                         //!< Returns millis from an update reaching the engine to the light showing it
+
+    LifxAudioAnalyzer* analyzer() const { return m_analyzer; }         //!< Returns the analyzer while open, to tune or read its stats
+    LifxAudioStats stats() const { return m_stats; }                   //!< Returns counts and latencies since the last open
+
+signals:
+    void beat(float bpm);
+    void finished();
+
+private slots:
+    void readWav();
+    void readStdin();
+    void dispatch();
+
+private:
+    /*
+     * A band driving some bulbs or zones
+     */
+    struct Mapping {
+        float lowHz;
+        float highHz;
+        QVector<LifxBulb*> bulbs;   //!< Whole bulbs, or
+        LifxBulb *strip;            //!< a strip's zones first to first + count
+        int first;
+        int count;
+        lx_hsbk_t color;
+        bool flashOnBeat;
+        int band;                   //!< Index in the analyzer
+        qint64 flashed;             //!< m_clock micros of the last beat flash, -1 for none
+        int sent;                   //!< Brightness last handed over, -1 for none
+    };
+
+    /*
+     * An update waiting until it is due
+     */
+    struct Event {
+        qint64 due;                 //!< m_clock micros to hand it over
+        qint64 arrived;             //!< m_clock micros the audio arrived
+        qint64 heard;               //!< m_clock micros the audio is heard
+        int mapping;                //!< Index in m_mappings, -1 for a beat
+        float level;                //!< 0 to 1
+    };
+
+    bool begin(int sampleRate, int channels);
+    void decode(const char *data, int frames);
+    void hop(const LifxAudioHop &hop);
+    void schedule(const Event &event);
+    void rearm();
+    qint64 arrival(qint64 sample) const;
+    qint64 now() const { return m_clock.nsecsElapsed() / 1000; }
+
+    LifxTransitionEngine *m_engine;     //!< Gets the updates
+    LifxAudioAnalyzer *m_analyzer;      //!< While open
+    QElapsedTimer m_clock;              //!< Time base in micros
+    QFile m_file;                       //!< WAV being read
+    QTimer *m_readTimer;                //!< Paces the WAV
+    QSocketNotifier *m_notifier;        //!< Stdin has data
+    QTimer *m_dispatchTimer;            //!< Fires when the next update is due
+    int m_rate;                         //!< Samples a second
+    int m_channels;                     //!< Interleaved channels
+    int m_bits;                         //!< Bits a sample
+    bool m_float;                       //!< Samples are IEEE float
+    qint64 m_dataLeft;                  //!< WAV bytes still to read
+    qint64 m_started;                   //!< m_clock micros the WAV started
+    qint64 m_anchorSample;              //!< Sample which arrived at m_anchorTime
+    qint64 m_anchorTime;                //!< m_clock micros
+    QByteArray m_partial;               //!< Bytes of a frame read from stdin
+    QVector<float> m_mono;              //!< Scratch, decoded samples
+    QVector<Mapping> m_mappings;        //!< Bands to lights
+    QList<Event> m_events;              //!< Waiting, by due time
+    qint64 m_scheduledBeat;             //!< Sample of the beat waiting in m_events, -1 for none
+    QHash<LifxBulb*, QVector<lx_hsbk_t>> m_strips;     //!< Zone targets per mapped strip
+    int m_outputLatency;                //!< Millis
+    int m_lightLatency;                 //!< Millis
+    LifxAudioStats m_stats;             //!< Counts
+    qint64 m_totalHandoff;              //!< Sum of handoffs, for the mean
+    qint64 m_totalError;                //!< Sum of errors, for the mean
+};
+
+#endif // LIFXAUDIO_H
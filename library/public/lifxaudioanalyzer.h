@@ -0,0 +1,156 @@
+/*
+ * Turns PCM into band levels, onsets and beats
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXAUDIOANALYZER_H
+#define LIFXAUDIOANALYZER_H
+
+#include <QtCore/QtCore>
+
+#include <functional>
+
+/**
+ * \struct LifxAudioHop
+ * What one analysis hop found, valid only during the callback
+ */
+struct LifxAudioHop {
+    qint64 position;            //!< Sample just past the end of the hop
+    int bandCount;              //!< Entries in levels
+    const float *levels;        //!< Level per band, 0 to 1, jumps to 1 on the band's onset and then releases
+    quint32 onsets;             //!< Bit per band that had an onset this hop
+    float flux;                 //!< Spectral flux of the hop
+    bool onset;                 //!< An onset across the whole spectrum
+    bool beat;                  //!< A predicted beat fell within the hop
+    float bpm;                  //!< Tempo, 0 until it locks
+    qint64 nextBeat;            //!< Sample of the next predicted beat, -1 until the tempo locks
+};
+
+/**
+ * \struct LifxAudioAnalyzerStats
+ * What the analyzer has cost
+ */
+struct LifxAudioAnalyzerStats {
+    quint64 hops = 0;           //!< Hops analyzed
+    quint64 onsets = 0;         //!< Onsets found
+    quint64 beats = 0;          //!< Beats reported
+    qint64 lastHop = 0;         //!< Nanoseconds the last hop took
+    qint64 maxHop = 0;          //!< Longest hop in nanoseconds
+    qint64 meanHop = 0;         //!< Mean hop in nanoseconds
+};
+
+/**
+ * \class LifxAudioAnalyzer
+ * \brief (PUBLIC) Windowed FFT, band levels, onsets and tempo from mono PCM
+ *
+ * Samples pushed with process() are analyzed every hop() samples over
+ * the last fftSize(): a Hann window, a radix 2 FFT, magnitudes, the sum
+ * of magnitudes in each band added with addBand(), and spectral flux.
+ * The window, butterflies, magnitudes, flux and band sums run with SSE
+ * or AVX2 when the CPU has them, and agree with the scalar kernel to
+ * rounding. Setting QTLIFX_NO_SIMD in the environment forces scalar.
+ *
+ * An onset is flux above 1.5 times its mean over the last second, and
+ * rising, at most one every 100 millis. The tempo is the strongest autocorrelation of the flux over
+ * the last six seconds between 60 and 180 BPM, found once a second. Once
+ * it locks, beats are predicted a period apart, pulled onto onsets that
+ * land near them, so nextBeat is known a beat ahead of the audio.
+ *
+ * Each band's level is its sum over a slowly decaying peak, so quiet and
+ * loud music both use the range. A band's own onset, its sum well above
+ * its recent mean, sets its level to 1, and levels fall back over the
+ * release time.
+ *
+ * The analysis runs in the caller's thread, from process(). At 44.1kHz
+ * with the defaults a hop is 512 samples, 11.6 millis, and the onset of
+ * a sound is seen between a hop and half a window after it reaches the
+ * analyzer.
+ */
+class LifxAudioAnalyzer
+{
+public:
+    typedef std::function<void(const LifxAudioHop &hop)> Sink;
+
+    LifxAudioAnalyzer(int sampleRate, int fftSize = 1024, int hop = 512);
+
+    void setSink(Sink sink) { m_sink = sink; }                  //!< Sets what gets each hop
+    int addBand(float lowHz, float highHz);
+    int bandCount() const { return m_bands.size(); }            //!< Returns the bands added
+    void setRelease(int msecs);
+    void reset();
+
+    void process(const float *samples, int count);
+
+    int sampleRate() const { return m_rate; }                   //!< Returns samples a second
+    int fftSize() const { return m_size; }                      //!< Returns samples in each window
+    int hop() const { return m_hop; }                           //!< Returns samples between analyses
+    qint64 position() const { return m_position; }              //!< Returns samples pushed
+    float bpm() const { return m_bpm; }                         //!< Returns the tempo, 0 until it locks
+    LifxAudioAnalyzerStats stats() const { return m_stats; }   //!< Returns counts and costs
+
+    static QString kernel();
+
+private:
+    /*
+     * Bins a band sums, with its running state
+     */
+    struct Band {
+        int low;            //!< First bin
+        int high;           //!< One past the last bin
+        float peak;         //!< Decaying peak sum
+        float mean;         //!< Running mean sum, for band onsets
+        int quiet;          //!< Hops since the band's last onset
+    };
+
+    void analyze();
+    void fft();
+    void track(float flux, bool onset);
+
+    Sink m_sink;                        //!< Gets each hop
+    int m_rate;                         //!< Samples a second
+    int m_size;                         //!< Window, a power of 2
+    int m_hop;                          //!< Samples between analyses
+    qint64 m_position;                  //!< Samples pushed
+    int m_pending;                      //!< Samples since the last analysis
+    int m_write;                        //!< Next slot in m_ring
+    float m_release;                    //!< Level kept per hop when falling
+    QVector<float> m_ring;              //!< Last m_size samples
+    QVector<float> m_window;            //!< Hann window
+    QVector<float> m_twiddleRe;         //!< Twiddles, stage h at h - 1
+    QVector<float> m_twiddleIm;         //!< Twiddles, stage h at h - 1
+    QVector<int> m_reverse;             //!< Bit reversed index per bin
+    QVector<float> m_re;                //!< FFT real parts
+    QVector<float> m_im;                //!< FFT imaginary parts
+    QVector<float> m_magnitude;         //!< This hop's magnitude per bin
+    QVector<float> m_previous;          //!< Last hop's magnitude per bin
+    QVector<Band> m_bands;              //!< Bands added
+    QVector<float> m_levels;            //!< Level per band
+    QVector<float> m_flux;              //!< Flux history, a ring of m_fluxSize
+    int m_fluxSize;                     //!< Hops of flux kept for tempo
+    int m_fluxWrite;                    //!< Next slot in m_flux
+    float m_lastFlux;                   //!< Flux of the previous hop
+    float m_fluxMean;                   //!< Running mean flux over about a second
+    int m_sinceOnset;                   //!< Hops since the last onset
+    int m_sinceTempo;                   //!< Hops since the tempo was last found
+    float m_bpm;                        //!< Tempo, 0 until locked
+    double m_period;                    //!< Samples a beat
+    double m_nextBeat;                  //!< Sample of the next predicted beat, -1 until locked
+    LifxAudioAnalyzerStats m_stats;     //!< Counts
+    qint64 m_totalNanos;                //!< Sum of hop times, for the mean
+};
+
+#endif // LIFXAUDIOANALYZER_H
@@ -0,0 +1,192 @@
+/*
+ * C++20 coroutine support for bulb requests
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXAWAIT_H
+#define LIFXAWAIT_H
+
+#ifdef LIFX_ENABLE_COROUTINES
+
+#include <QtCore/QtCore>
+#include <coroutine>
+#include <exception>
+#include <functional>
+
+#include "hsbk.h"
+
+/**
+ * \struct LifxColorResult
+ * What co_await LifxManager::getColor() gives back
+ */
+struct LifxColorResult {
+    bool ok = false;        //!< True if the bulb answered
+    HSBK color;             //!< The color the bulb reported
+};
+
+/**
+ * \class LifxTask
+ * \brief (PUBLIC) Return type for a coroutine which drives bulbs
+ *
+ * The coroutine starts running as soon as it is called, and runs on
+ * the thread of the event loop which delivers the replies. Nothing
+ * waits for it to finish, so it must not outlive the LifxManager it
+ * uses. When the manager is destroyed, every request still waiting is
+ * completed as failed, which resumes its coroutine one last time.
+ *
+ * \code
+ * LifxTask setAll(LifxManager *manager, QList<LifxBulb*> bulbs, HSBK color)
+ * {
+ *     QVector<LifxAckAwaiter> sets;
+ *     for (auto bulb : bulbs)
+ *         sets.append(manager->setColorAcked(bulb, color));
+ *     QVector<bool> acked = co_await lifxWhenAll(sets);
+ * }
+ * \endcode
+ */
+class LifxTask
+{
+public:
+    struct promise_type {
+        LifxTask get_return_object() { return LifxTask(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/**
+ * \class LifxAwaiter
+ * \brief (PUBLIC) One bulb request which a coroutine can co_await
+ *
+ * Holds the function which sends the request. Nothing is sent until
+ * the awaiter is awaited (or started by lifxWhenAll()), and the
+ * coroutine resumes from the manager's reply handling, not a thread
+ * or a timer of its own. The request timeout and retries are handled
+ * by the manager.
+ */
+template<typename T>
+class LifxAwaiter
+{
+public:
+    typedef std::function<void(std::function<void(T)>)> Start;
+
+    LifxAwaiter() : m_suspended(false), m_finished(false) {}
+    explicit LifxAwaiter(Start start) : m_start(start), m_result(), m_suspended(false), m_finished(false) {}
+
+    bool await_ready() const { return !m_start; }
+
+    /*
+     * Returns false, and so does not suspend at all, when the request
+     * finished before the send returned (a null bulb, for instance).
+     */
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        m_handle = handle;
+        m_start([this](T result) {
+            m_result = result;
+            m_finished = true;
+            if (m_suspended)
+                m_handle.resume();
+        });
+
+        if (m_finished)
+            return false;
+
+        m_suspended = true;
+        return true;
+    }
+
+    T await_resume() const { return m_result; }
+
+    void start(std::function<void(T)> done) const      //!< Sends the request with a callback instead of awaiting it
+    {
+        if (m_start)
+            m_start(done);
+        else
+            done(T());
+    }
+
+private:
+    Start m_start;                          //!< Sends the request
+    T m_result;                             //!< Filled in just before the coroutine resumes
+    std::coroutine_handle<> m_handle;       //!< The waiting coroutine
+    bool m_suspended;                       //!< True once the coroutine is actually suspended
+    bool m_finished;                        //!< True once the result is in
+};
+
+typedef LifxAwaiter<LifxColorResult> LifxColorAwaiter;
+typedef LifxAwaiter<bool> LifxAckAwaiter;
+
+/**
+ * \class LifxWhenAll
+ * \brief (PUBLIC) Awaits a list of requests at once
+ *
+ * Every request is sent before the coroutine suspends, and it resumes
+ * once when the last one finishes. The results are in the same order
+ * as the awaiters.
+ */
+template<typename T>
+class LifxWhenAll
+{
+public:
+    explicit LifxWhenAll(const QVector<LifxAwaiter<T>> &awaiters) : m_awaiters(awaiters), m_remaining(0) {}
+
+    bool await_ready() const { return m_awaiters.isEmpty(); }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        m_handle = handle;
+        m_results.resize(m_awaiters.size());
+        // One extra count held by us, so requests finishing during the loop can't resume early
+        m_remaining = m_awaiters.size() + 1;
+
+        for (int i = 0; i < m_awaiters.size(); i++) {
+            m_awaiters[i].start([this, i](T result) {
+                m_results[i] = result;
+                if (--m_remaining == 0)
+                    m_handle.resume();
+            });
+        }
+
+        return --m_remaining != 0;
+    }
+
+    QVector<T> await_resume() const { return m_results; }
+
+private:
+    QVector<LifxAwaiter<T>> m_awaiters;     //!< The requests, not yet sent
+    QVector<T> m_results;                   //!< One result per request
+    std::coroutine_handle<> m_handle;       //!< The waiting coroutine
+    int m_remaining;                        //!< Requests still out, plus one while sending
+};
+
+/**
+ * \fn LifxWhenAll<T> lifxWhenAll(const QVector<LifxAwaiter<T>> &awaiters)
+ * \param awaiters The requests to send together
+ * \return An awaitable which gives back a QVector of the results
+ */
+template<typename T>
+LifxWhenAll<T> lifxWhenAll(const QVector<LifxAwaiter<T>> &awaiters)
+{
+    return LifxWhenAll<T>(awaiters);
+}
+
+#endif // LIFX_ENABLE_COROUTINES
+
+#endif // LIFXAWAIT_H
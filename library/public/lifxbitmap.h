@@ -0,0 +1,67 @@
+/*
+ * One bit per fleet row, used for indexes and query results
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXBITMAP_H
+#define LIFXBITMAP_H
+
+#include <QtCore/QtCore>
+
+/**
+ * \class LifxBitmap
+ * \brief (PUBLIC) A set of fleet rows stored as one bit per row
+ *
+ * Bit i is row i in a LifxFleet. Combining two bitmaps works on 64 rows
+ * at a time, so intersecting the bulbs that are on with the bulbs in a
+ * group costs size() / 64 operations no matter how many match.
+ *
+ * Bits past size() are always 0.
+ */
+class LifxBitmap
+{
+public:
+    LifxBitmap(int size = 0, bool value = false);
+    ~LifxBitmap();
+
+    void resize(int size);
+    int size() const { return m_size; }                             //!< Returns the number of rows covered
+    void fill(bool value);
+
+    void set(int index, bool value = true);
+    bool test(int index) const;
+    int count() const;
+    bool isEmpty() const;
+    QVector<int> indexes() const;
+
+    LifxBitmap& operator&=(const LifxBitmap &other);
+    LifxBitmap& operator|=(const LifxBitmap &other);
+    LifxBitmap& subtract(const LifxBitmap &other);
+    bool operator==(const LifxBitmap &other) const;
+
+    int wordCount() const { return m_words.size(); }                //!< Returns the number of 64 bit words
+    quint64* words() { return m_words.data(); }                     //!< Direct access to the words, bit i is bit (i % 64) of word i / 64
+    const quint64* words() const { return m_words.constData(); }    //!< Read only access to the words
+
+private:
+    void clearTail();
+
+    QVector<quint64> m_words;       //!< The bits, 64 rows per word
+    int m_size;                     //!< Number of rows, bits past this are kept 0
+};
+
+#endif // LIFXBITMAP_H
@@ -0,0 +1,50 @@
+/*
+ * The effects that come with the library
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXBUILTINEFFECTS_H
+#define LIFXBUILTINEFFECTS_H
+
+#include <QtCore/QtCore>
+
+#include "lifxeffect.h"
+
+/**
+ * \class LifxBuiltinEffects
+ * \brief (PUBLIC) Makes the effects built into the library
+ *
+ * They are LifxEffect like any plugin's, and LifxEffectRunner lists them
+ * first. The parameters each takes, set with LifxEffect::setParameter(),
+ *
+ * chase: hue (degrees), width (layout units), period (millis to cross),
+ * dx, dy, dz (direction).
+ *
+ * twinkle: hue (degrees), saturation (percent), rate (sparks a point a
+ * second), decay (millis for a spark to halve).
+ *
+ * rainbow: wavelength (layout units), period (millis to move one
+ * wavelength), brightness (percent), dx, dy, dz (direction).
+ */
+class LifxBuiltinEffects
+{
+public:
+    static QStringList names();
+    static LifxEffect* create(const QString &name);
+};
+
+#endif // LIFXBUILTINEFFECTS_H
@@ -29,6 +29,9 @@
 #include "defines.h"
 #include "lifxproduct.h"
 #include "hsbk.h"
+#include "lifxwaveform.h"
+#include "lifxframebuffer.h"
+#include "lifxfleet.h"
 
 /**
  * \class LifxBulb
@@ -60,11 +63,21 @@
  * 
  * This library doesn't keep the LIGHT_STATE structure, but instead
  * copies the contents into the SET_COLOR structure and maintains that. 
+ * 
+ * While a waveform is running on the bulb, the SET_COLOR structure holds
+ * the color the bulb will be left at when it completes, and color() follows
+ * the waveform curve so it stays accurate without asking the bulb.
+ * 
+ * The power, SET_COLOR structure, address, port, RSSI and MAC live in a
+ * row of a LifxFleet, so fleet wide operations can scan them without
+ * visiting every bulb. The manager creates bulbs over its own fleet, a
+ * default constructed bulb owns a private fleet of one.
  */
 class LifxBulb
 {
 public:
     LifxBulb();
+    LifxBulb(LifxFleet *fleet, uint64_t target);
     ~LifxBulb();
     
     bool operator==(const LifxBulb &bulb);
@@ -94,53 +107,95 @@ public:
     void setDiscoveryActive(bool discovery);
     void setBrightness(uint16_t brightness);
     void setRSSI(float rssi);
+    void setWaveform(const LifxWaveform &waveform);
+    void setZoneState(lx_dev_extended_zones_state_t *state);
+    void setDeviceChain(lx_dev_device_chain_t *chain);
+    void setTileState(lx_dev_state64_t *state);
+    void confirmPower(uint16_t power);
+    void invalidateColor();
+    void invalidatePower();
     uint64_t echoRequest(bool generate);
     bool echoPending(bool state) { m_pendingEcho = state; return m_pendingEcho; }   //!< Set the flag that says we sent an echo request to the bulb
     bool echoPending() { return m_pendingEcho; }                                    //!< Get the flag indicating whether we are waiting for an echo
     
-    QHostAddress& address() { return m_address; }   //!< Returns the IP address associated with this bulb
+    QHostAddress address() const { return QHostAddress(m_fleet->ipv4(m_index)); }  //!< Returns the IP address associated with this bulb
     uint8_t service() const { return m_service; }   //!< Returns the service which was set by STATE_SERVICE
-    uint8_t* target() { return m_target; }          //!< Returns the MAC as an array of ints
-    uint64_t targetAsLong();                        //!< Convienence function which turns the MAC into a number for indexing
-    uint32_t port() const { return m_port; }        //!< Returns IP Port this bulb is listening to
+    uint8_t* target() { return m_fleet->targetBytes(m_index); }  //!< Returns the MAC as an array of ints
+    uint64_t targetAsLong() const;                  //!< Convienence function which turns the MAC into a number for indexing
+    uint32_t port() const { return m_fleet->port(m_index); }     //!< Returns IP Port this bulb is listening to
     uint16_t major() const { return m_major; }      //!< Returns the major part of the version #
     uint16_t minor() const { return m_minor; }      //!< Returns the minor part of the version #
     QString label() const { return m_label; }       //!< Returns the bulb name
-    uint16_t power() const { return m_power; }
-    uint16_t brightness() const { return m_deviceColor->brightness; }
-    uint16_t kelvin() const { return m_deviceColor->kelvin; }
-    uint32_t duration() const { return m_deviceColor->duration; }
+    uint16_t power() const { return m_fleet->power(m_index); }
+    uint16_t brightness() const { return deviceColor()->brightness; }
+    uint16_t kelvin() const { return deviceColor()->kelvin; }
+    uint32_t duration() const { return deviceColor()->duration; }
     QString group() const { return m_group; }
     uint32_t pid() const { return m_pid; }
     uint32_t vid() const { return m_vid; }
     bool inDiscovery() const { return m_inDiscovery; }
-    QColor color() const { return m_color; }
-    int rssi() const { return m_rssi; }
+    QColor color() const;
+    HSBK expectedColor() const;
+    bool waveformActive() const { return m_waveform.isActive(); }    //!< True while a SET_WAVEFORM effect is running on the bulb
+    const LifxWaveform& waveform() const { return m_waveform; }      //!< Returns the last waveform sent to this bulb
+    bool colorConfirmed(qint64 window) const;
+    bool powerConfirmed(uint16_t power, qint64 window) const;
+    HSBK confirmedColor() const;
+    qint64 confirmedAge() const;
+    int rssi() const { return m_fleet->rssi(m_index); }
+    void touch() { m_fleet->touch(m_index); }                        //!< Records that a packet just arrived from this bulb
+    qint64 lastSeen() const { return m_fleet->lastSeen(m_index); }   //!< Returns when the bulb last sent anything on the fleet clock, -1 if never
+    void markSent() { m_fleet->markSent(m_index); }                  //!< Records that a packet just went to this bulb
+    qint64 lastSent() const { return m_fleet->lastSent(m_index); }   //!< Returns when a packet last went to this bulb on the fleet clock, -1 if never
+    LifxFleet* fleet() const { return m_fleet; }                     //!< Returns the fleet this bulb's state is kept in
+    int fleetIndex() const { return m_index; }                       //!< Returns the row in fleet() for this bulb
+    LifxProduct* product() const { return m_product; }             //!< Returns the product details, nullptr if products.json wasn't provided
+    bool isMultizone() const;
+    int zoneCount() const { return m_zones.size(); }                //!< Returns the number of zones on a strip, 0 if unknown or not a strip
+    LifxFrameBuffer& zones() { return m_zones; }                    //!< The zone frame buffer, write new zone colors here then ask the manager to send them
+    bool isMatrix() const;
+    int tileCount() const { return m_tileChain.size(); }            //!< Returns the number of tiles in the chain, 0 if unknown or not a matrix device
+    int tileWidth(int tile) const;
+    int tileHeight(int tile) const;
+    LifxFrameBuffer& tiles() { return m_tiles; }                    //!< The tile frame buffer, TILE_PIXELS per tile in chain order
+    lx_hsbk_t* tilePixels(int tile);
+    void setTilePixel(int tile, int x, int y, const HSBK &color);
 
     QString macToString() const;
+    static uint64_t macToTarget(const QString &mac, bool *ok = nullptr);
+    static QString targetToMac(uint64_t target);
     QString addressToString(bool isIPV6) const;
     lx_dev_color_t* toDeviceColor() const;
 
 private:
-    QHostAddress m_address;         //!< The QHostAddress with the bulbs IP address
+    Q_DISABLE_COPY(LifxBulb)
+    void init();
+    lx_dev_color_t* deviceColor() const { return m_fleet->color(m_index); }     //!< The SET_COLOR struct in the fleet row
+
+    LifxFleet *m_fleet;             //!< Holds the hot state for this bulb
+    int m_index;                    //!< The row in m_fleet
+    bool m_ownsFleet;               //!< True if m_fleet was created for this bulb alone
     QString m_label;                //!< The QString label returned as part of the STATE_LABEL reply
     QString m_group;                //!< The group that this bulb belongs to
     QColor m_color;                 //!< The color object this bulb is currently set to
     uint8_t m_service;              //!< The service value in the header
-    uint32_t m_port;                //!< The IP port we are communicating with
-    uint8_t m_target[8];            //!< The MAC, encoded as a UINT64, where bytes 7 and 8 are 0
     uint64_t m_build;               //!< The build timestamp from the bulb (not used in this library)
     uint16_t m_major;               //!< The major version
     uint16_t m_minor;               //!< The minor version
-    uint16_t m_power;               //!< The current bulb power output (0 means OFF, all other values are considered ON)
     uint32_t m_vid;                 //!< The vendor ID the bulb, should generally always be 1
     uint32_t m_pid;                 //!< The product ID from the bulb, can be used to determine capabilities from the JSON
-    lx_dev_color_t *m_deviceColor;  //!< The color structure as returned from the bulb
     LifxProduct *m_product;         //!< A container class with static product details from LIFX
     bool m_inDiscovery;             //!< Flag indicating whether the bulb has been completely discovered yet
     bool m_pendingEcho;             //!< An echo request for this bulb has been sent
     uint64_t m_echoSemaphore;       //!< This is the random value we will use to validate the echo did what we needed it to
-    int m_rssi;                   //!< The returned RSSI value from the bulb. This converts from raw to a scale from 0 - 16
+    LifxWaveform m_waveform;        //!< The last waveform sent, used to model the color while the bulb runs it
+    LifxFrameBuffer m_zones;        //!< Zone colors for multizone devices, empty otherwise
+    QVector<lx_tile_t> m_tileChain; //!< The tiles reported by STATE_DEVICE_CHAIN
+    LifxFrameBuffer m_tiles;        //!< Tile pixels for matrix devices, the sent copy tracks the back frame buffer
+    lx_dev_color_t m_confirmedColor;    //!< The color the bulb last reported in a LIGHT_STATE
+    uint16_t m_confirmedPower;          //!< The power the bulb last reported
+    QElapsedTimer m_colorConfirmed;     //!< Started when m_confirmedColor was reported, invalid once a change is sent
+    QElapsedTimer m_powerConfirmed;     //!< Started when m_confirmedPower was reported, invalid once a change is sent
 };
 
 QDebug operator<<(QDebug debug, const LifxBulb &bulb);
@@ -0,0 +1,58 @@
+/*
+ * A set of bulbs returned by a query
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXBULBSET_H
+#define LIFXBULBSET_H
+
+#include <QtCore/QtCore>
+
+#include "lifxbulb.h"
+#include "lifxbitmap.h"
+
+/**
+ * \class LifxBulbSet
+ * \brief (PUBLIC) The bulbs which matched a LifxQuery
+ *
+ * Holds both the fleet rows, so sets can be combined cheaply, and the
+ * bulb pointers in row order, so the set can be walked or passed to the
+ * manager functions which act on many bulbs. The pointers are the same
+ * ones the manager uses.
+ */
+class LifxBulbSet
+{
+public:
+    LifxBulbSet();
+    LifxBulbSet(const LifxBitmap &rows, const QVector<LifxBulb*> &fleetBulbs);
+    ~LifxBulbSet();
+
+    int size() const { return m_bulbs.size(); }                     //!< Returns the number of bulbs in the set
+    bool isEmpty() const { return m_bulbs.isEmpty(); }              //!< Returns true if nothing matched
+    bool contains(LifxBulb *bulb) const { return bulb && m_rows.test(bulb->fleetIndex()); }     //!< Returns true if bulb is in the set
+    const QVector<LifxBulb*>& bulbs() const { return m_bulbs; }     //!< Returns the bulbs in fleet row order
+    const LifxBitmap& rows() const { return m_rows; }               //!< Returns the fleet rows of the bulbs
+
+    QVector<LifxBulb*>::const_iterator begin() const { return m_bulbs.constBegin(); }     //!< Allows range based for loops
+    QVector<LifxBulb*>::const_iterator end() const { return m_bulbs.constEnd(); }         //!< Allows range based for loops
+
+private:
+    LifxBitmap m_rows;              //!< Fleet rows in the set
+    QVector<LifxBulb*> m_bulbs;     //!< The bulbs for m_rows
+};
+
+#endif // LIFXBULBSET_H
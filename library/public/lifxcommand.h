@@ -0,0 +1,83 @@
+/*
+ * A bulb command which can be queued from any thread
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXCOMMAND_H
+#define LIFXCOMMAND_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+
+/**
+ * \class LifxCommand
+ * \brief (PUBLIC) One change to one bulb, in a form that can be copied between threads
+ *
+ * Built with the static functions, then handed to LifxManager::submit().
+ * It is plain data (no pointers, no Qt shared data) so queueing one is
+ * a 32 byte copy. The bulb is named by its target, which is the same
+ * on every thread.
+ */
+class LifxCommand
+{
+public:
+    /**
+     * \enum Type
+     * What the command does, each maps to a LifxManager slot
+     */
+    enum Type {
+        None,           /**< Does nothing */
+        Color,          /**< changeBulbColor() */
+        Brightness,     /**< changeBulbBrightness() */
+        Power,          /**< changeBulbState() */
+        Refresh,        /**< getColorForBulb() */
+        Waveform,       /**< changeBulbWaveform(), only in a LifxCommandBatch which holds the waveform */
+    };
+
+    LifxCommand();
+
+    static LifxCommand color(uint64_t target, const HSBK &color, uint32_t duration = 400, int source = 0, bool ackRequired = false);
+    static LifxCommand brightness(uint64_t target, uint16_t brightness, int source = 0, bool ackRequired = false);
+    static LifxCommand power(uint64_t target, bool on, int source = 0, bool ackRequired = false);
+    static LifxCommand refresh(uint64_t target, int source = 0);
+    static LifxCommand waveform(uint64_t target, int source = 0, bool ackRequired = false);
+
+    Type type() const { return static_cast<Type>(m_type); }    //!< Returns what the command does
+    uint64_t target() const { return m_target; }                //!< Returns the MAC of the bulb as a 64bit number
+    HSBK hsbk() const { return HSBK(m_hue, m_saturation, m_brightness, m_kelvin); }    //!< Returns the color for Color commands
+    uint16_t brightnessValue() const { return m_brightness; }   //!< Returns the brightness for Brightness commands
+    bool on() const { return m_on; }                            //!< Returns the new state for Power commands
+    uint32_t duration() const { return m_duration; }            //!< Returns the transition time in millis
+    int source() const { return m_source; }                     //!< Returns the source field for the packet
+    bool ackRequired() const { return m_ack; }                  //!< Returns true if the bulb should ACK
+
+private:
+    uint64_t m_target;          //!< Bulb MAC
+    uint32_t m_duration;        //!< Transition time in millis
+    int32_t m_source;           //!< Packet source field
+    uint16_t m_hue;             //!< Color hue
+    uint16_t m_saturation;      //!< Color saturation
+    uint16_t m_brightness;      //!< Color or Brightness brightness
+    uint16_t m_kelvin;          //!< Color kelvin
+    uint8_t m_type;             //!< Type
+    bool m_on;                  //!< Power state
+    bool m_ack;                 //!< ACK required
+};
+
+#endif // LIFXCOMMAND_H
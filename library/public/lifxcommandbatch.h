@@ -0,0 +1,94 @@
+/*
+ * A set of bulb commands sent together
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXCOMMANDBATCH_H
+#define LIFXCOMMANDBATCH_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+#include "lifxbulb.h"
+#include "lifxcommand.h"
+#include "lifxwaveform.h"
+
+/**
+ * \struct LifxBatchResult
+ * What LifxManager::submit() did with a LifxCommandBatch
+ */
+struct LifxBatchResult {
+    int sent = 0;               //!< Datagrams written to the socket
+    int suppressed = 0;         //!< Commands skipped because the bulb already showed that state
+    int failed = 0;             //!< Commands for a null bulb, or datagrams the socket refused
+    qint64 skew = 0;            //!< Nanoseconds from the start of the first send to the end of the last
+};
+
+/**
+ * \class LifxCommandBatch
+ * \brief (PUBLIC) Many bulb commands which go out back to back
+ *
+ * Build the batch with the set functions, which can be chained, then
+ * hand it to LifxManager::submit(). Every command is encoded into one
+ * buffer before anything is sent, so the time between the first and
+ * last bulb seeing its change is only the time it takes the socket to
+ * take the datagrams, which submit() reports as the skew.
+ *
+ * \code
+ * LifxCommandBatch batch;
+ * for (int i = 0; i < bulbs.size(); i++)
+ *     batch.setColor(bulbs[i], colors[i]);
+ * LifxBatchResult result = manager->submit(batch);
+ * \endcode
+ *
+ * A batch is used from the thread the manager lives on, it holds
+ * LifxBulb pointers so nothing has to be looked up again on submit.
+ */
+class LifxCommandBatch
+{
+public:
+    LifxCommandBatch(int source = 0, bool ackRequired = false);
+
+    LifxCommandBatch& setColor(LifxBulb *bulb, const HSBK &color, uint32_t duration = 400);
+    LifxCommandBatch& setBrightness(LifxBulb *bulb, uint16_t brightness);
+    LifxCommandBatch& setPower(LifxBulb *bulb, bool on);
+    LifxCommandBatch& setWaveform(LifxBulb *bulb, const LifxWaveform &waveform);
+    LifxCommandBatch& refresh(LifxBulb *bulb);
+    LifxCommandBatch& add(LifxBulb *bulb, const LifxCommand &command);
+
+    void reserve(int size);
+    void clear();
+    int size() const { return m_bulbs.size(); }                     //!< Returns the number of commands
+    bool isEmpty() const { return m_bulbs.isEmpty(); }              //!< Returns true if there are no commands
+    int source() const { return m_source; }                         //!< Returns the source field for every packet
+    bool ackRequired() const { return m_ackRequired; }              //!< Returns true if every bulb should ACK
+
+    LifxBulb* bulb(int index) const { return m_bulbs[index]; }                  //!< Returns the bulb for a command
+    const LifxCommand& command(int index) const { return m_commands[index]; }   //!< Returns a command
+    LifxWaveform waveform(int index) const;
+
+private:
+    QVector<LifxBulb*> m_bulbs;             //!< One bulb per command
+    QVector<LifxCommand> m_commands;        //!< The commands, in send order
+    QVector<int> m_waveformIndex;           //!< Per command, its entry in m_waveforms or -1
+    QVector<LifxWaveform> m_waveforms;      //!< Waveforms for the Waveform commands
+    int m_source;                           //!< Source field for every packet
+    bool m_ackRequired;                     //!< ACK required for every packet
+};
+
+#endif // LIFXCOMMANDBATCH_H
@@ -0,0 +1,88 @@
+/*
+ * Bounded lock free queue of bulb commands
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXCOMMANDQUEUE_H
+#define LIFXCOMMANDQUEUE_H
+
+#include <QtCore/QtCore>
+#include <atomic>
+
+#include "lifxcommand.h"
+
+/**
+ * \class LifxCommandQueue
+ * \brief (PUBLIC) Fixed size queue any number of threads can push to and pop from
+ *
+ * This is a bounded array queue where every cell carries a sequence
+ * number (D. Vyukov's design). A push or pop claims a position with a
+ * compare and swap on the tail or head counter, then uses the cell's
+ * sequence to hand the command over, so no thread ever takes a lock or
+ * waits on another one. The capacity is rounded up to a power of 2.
+ *
+ * When the queue is full, the OverflowPolicy decides what happens:
+ * RejectNewest fails the push, DropOldest throws away the oldest queued
+ * command to make room. Either way dropped() counts the lost commands.
+ */
+class LifxCommandQueue
+{
+public:
+    /**
+     * \enum OverflowPolicy
+     * What push() does when there is no room
+     */
+    enum OverflowPolicy {
+        RejectNewest,   /**< The new command is not queued and push() returns false */
+        DropOldest,     /**< The oldest queued command is discarded for the new one */
+    };
+
+    LifxCommandQueue(int capacity = 4096, OverflowPolicy policy = RejectNewest);
+    ~LifxCommandQueue();
+
+    bool push(const LifxCommand &command);
+    bool pop(LifxCommand &command);
+    int popBatch(LifxCommand *commands, int max);
+
+    int capacity() const { return m_mask + 1; }                             //!< Returns the most commands the queue holds
+    int sizeApprox() const;
+    void setOverflowPolicy(OverflowPolicy policy) { m_policy.store(policy); }   //!< Changes what happens when the queue is full
+    OverflowPolicy overflowPolicy() const { return static_cast<OverflowPolicy>(m_policy.load()); }  //!< Returns what happens when the queue is full
+    quint64 dropped() const { return m_dropped.load(std::memory_order_relaxed); }   //!< Returns the number of commands lost to overflow
+
+private:
+    Q_DISABLE_COPY(LifxCommandQueue)
+    bool tryPush(const LifxCommand &command);
+
+    /**
+     * \struct Cell
+     * One queue entry, sequence says whose turn it is to use it
+     */
+    struct Cell {
+        std::atomic<size_t> sequence;
+        LifxCommand command;
+    };
+
+    Cell *m_cells;                                  //!< The ring of cells
+    size_t m_mask;                                  //!< capacity - 1
+    std::atomic<int> m_policy;                      //!< OverflowPolicy
+    std::atomic<quint64> m_dropped;                 //!< Commands lost to overflow
+    alignas(64) std::atomic<size_t> m_tail;         //!< Next position to push, on its own cache line
+    alignas(64) std::atomic<size_t> m_head;         //!< Next position to pop, on its own cache line
+};
+
+#endif // LIFXCOMMANDQUEUE_H
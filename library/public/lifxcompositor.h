@@ -0,0 +1,159 @@
+/*
+ * Blends layers of bulb colors from several producers
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXCOMPOSITOR_H
+#define LIFXCOMPOSITOR_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+#include "lifxcommandbatch.h"
+
+class LifxManager;
+class LifxBulb;
+class LifxCompositor;
+
+/**
+ * \class LifxLayer
+ * \brief (PUBLIC) One producer's colors, made and owned by a LifxCompositor
+ *
+ * Holds a color and an alpha per bulb. A bulb the layer hasn't set, or
+ * set with alpha 0, shows whatever is underneath. The whole layer also
+ * has an opacity, which can be faded, so a layer can come and go without
+ * bulbs jumping.
+ */
+class LifxLayer
+{
+public:
+    /**
+     * \enum Blend
+     * How the layer combines with what is under it
+     */
+    enum Blend {
+        Replace,        /**< The layer's color, faded in by alpha */
+        AddBrightness,  /**< Adds the layer's brightness, hue and saturation are left alone */
+        Mask,           /**< Scales brightness by the layer's brightness, black hides what is under it */
+    };
+
+    QString name() const { return m_name; }                 //!< Returns the name given to addLayer()
+    int priority() const { return m_priority; }             //!< Returns the priority, higher is on top
+    Blend blend() const { return m_blend; }                 //!< Returns how the layer combines with those under it
+
+    void setColor(LifxBulb *bulb, const HSBK &color, uint16_t alpha = 65535);
+    void clear(LifxBulb *bulb);
+    void clear();
+    void setOpacity(float opacity, int msecs = 0);
+    float opacity() const { return m_opacity; }             //!< Returns the opacity as of the last frame
+    bool isRemoved() const { return m_removed; }            //!< Returns true once removeLayer() was called
+
+private:
+    friend class LifxCompositor;
+
+    LifxLayer(LifxCompositor *compositor, const QString &name, int priority, Blend blend);
+    float opacityAt(qint64 now) const;
+
+    LifxCompositor *m_compositor;   //!< Owner
+    QString m_name;                 //!< Name for debugging
+    int m_priority;                 //!< Higher is on top
+    Blend m_blend;                  //!< How it combines
+    QVector<lx_hsbk_t> m_colors;    //!< Color per fleet row
+    QVector<uint16_t> m_alpha;      //!< Alpha per fleet row, 0 where unset
+    float m_opacity;                //!< Opacity as of the last frame
+    float m_fadeFrom;               //!< Opacity the current fade started at
+    float m_fadeTo;                 //!< Opacity the current fade ends at
+    qint64 m_fadeStart;             //!< Compositor clock millis the fade started
+    int m_fadeLength;               //!< Millis the fade lasts
+    bool m_removed;                 //!< Deleted once faded out
+};
+
+/**
+ * \struct LifxCompositorStats
+ * What the compositor has been doing
+ */
+struct LifxCompositorStats {
+    quint64 frames = 0;         //!< Frames composited
+    quint64 sent = 0;           //!< Bulb colors sent
+    quint64 unchanged = 0;      //!< Covered bulbs not sent because the output didn't change
+    qint64 lastFrame = 0;       //!< Nanoseconds the last frame took
+};
+
+/**
+ * \class LifxCompositor
+ * \brief (PUBLIC) Blends layers from several producers into one color per bulb
+ *
+ * Without it, when an alert, a scheduled scene and a running effect all
+ * want the same bulb, whichever called last wins. Each producer gets a
+ * LifxLayer from addLayer() and writes to that instead of the manager.
+ * Each frame, if anything changed, the layers are blended bottom up in
+ * priority order, and only the bulbs whose result changed go out, in
+ * one LifxCommandBatch with a duration of one frame.
+ *
+ * The bottom of the stack for each bulb is the color it had when a layer
+ * first covered it, so fading every layer away puts it back. Layers fade
+ * in with addLayer() and out with removeLayer(), which only deletes the
+ * layer after the frame that shows it gone. A bulb no layer covers is
+ * left alone.
+ */
+class Q_DECL_EXPORT LifxCompositor : public QObject
+{
+    Q_OBJECT
+
+public:
+    LifxCompositor(LifxManager *manager, QObject *parent = nullptr);
+    ~LifxCompositor();
+
+    LifxLayer* addLayer(const QString &name, int priority, LifxLayer::Blend blend = LifxLayer::Replace, int fadeIn = 0);
+    void removeLayer(LifxLayer *layer, int fadeOut = 0);
+    void setPriority(LifxLayer *layer, int priority);
+    QList<LifxLayer*> layers() const { return m_layers; }              //!< Returns the layers bottom to top
+
+    void setFrameRate(int fps);
+    int frameRate() const { return m_fps; }                             //!< Returns frames a second
+    LifxCompositorStats stats() const { return m_stats; }              //!< Returns counts since the compositor was made
+
+public slots:
+    void frame();
+
+private:
+    friend class LifxLayer;
+
+    void touch(LifxBulb *bulb);
+    void update() { m_dirty = true; }
+    qint64 now() const { return m_clock.elapsed(); }
+    void sortLayers();
+
+    LifxManager *m_manager;             //!< Sends the frames
+    QTimer *m_timer;                    //!< Frame timer, runs while there are layers
+    QElapsedTimer m_clock;              //!< Time base for layer fades
+    int m_fps;                          //!< Frames a second
+    bool m_dirty;                       //!< Something changed since the last frame
+    QList<LifxLayer*> m_layers;         //!< Bottom to top
+    QVector<LifxBulb*> m_bulbs;         //!< Bulb per fleet row, nullptr for rows no layer has touched
+    QVector<lx_hsbk_t> m_base;          //!< Color under every layer, per row
+    QVector<lx_hsbk_t> m_out;           //!< This frame's result per row
+    QVector<lx_hsbk_t> m_sent;          //!< Last result sent per row
+    QVector<bool> m_hasSent;            //!< m_sent is valid
+    QVector<uint16_t> m_weights;        //!< Scratch, one layer's alpha times opacity per row
+    QVector<bool> m_covered;            //!< Scratch, some layer has alpha on the row
+    LifxCommandBatch m_batch;           //!< Changed bulbs for this frame
+    LifxCompositorStats m_stats;        //!< Counts
+};
+
+#endif // LIFXCOMPOSITOR_H
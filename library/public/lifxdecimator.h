@@ -0,0 +1,128 @@
+/*
+ * Turns dense color streams into timed transitions
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXDECIMATOR_H
+#define LIFXDECIMATOR_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+
+#include <functional>
+
+/**
+ * \struct LifxDecimatorStats
+ * What the decimator did to one stream
+ */
+struct LifxDecimatorStats {
+    quint64 samples = 0;        //!< Colors pushed
+    quint64 commands = 0;       //!< SET_COLORs given to the sink
+    int maxError = 0;           //!< Furthest any sample was from what the bulb showed, in HSBK units
+
+    double reduction() const { return commands ? static_cast<double>(samples) / commands : 0; }     //!< Returns samples per command sent
+};
+
+/**
+ * \class LifxDecimator
+ * \brief (PUBLIC) Fits straight line fades to a stream of colors
+ *
+ * Effects tend to compute a color every few tens of millis and send each
+ * one, when the bulb can fade on its own given a duration. Colors pushed
+ * here, per bulb with the time they are meant for, are held until they
+ * stop lying on a straight line from the color the bulb was last sent.
+ * Then one command goes to the sink: fade to the last color that fit,
+ * starting at the time the line started, over the time the line covers.
+ * A sample fits if every HSBK field is within tolerance() of the line at
+ * that sample's time, hue measured the short way round as the bulb fades
+ * it. A line that stays within tolerance() of where the bulb already is
+ * sends nothing.
+ *
+ * A command can only be sent once the next sample shows where its line
+ * ends, so a line covers at most maxSegment() millis, and the start the
+ * sink is given can be that far behind the newest sample. The sink is
+ * given the start time so it can be put into a LifxShow for the player
+ * to send on time, or submitted straight away.
+ *
+ * For an effect played live, either compute maxSegment() ahead of the
+ * clock, or setLatency(). With a latency, a line is sent as soon as it
+ * covers that many millis, without waiting for the next sample, so the
+ * lights trail the effect by at most the latency. A sink submitting
+ * straight away should treat a start in the past as now.
+ */
+class LifxDecimator
+{
+public:
+    typedef std::function<void(uint64_t target, qint64 start, const HSBK &color, uint32_t duration)> Sink;
+
+    LifxDecimator(Sink sink = nullptr);
+
+    void setSink(Sink sink) { m_sink = sink; }                              //!< Sets where commands go
+    void setTolerance(int tolerance) { m_tolerance = qMax(tolerance, 0); }  //!< Sets how far in HSBK units a sample may be from the fade and still fit
+    int tolerance() const { return m_tolerance; }                           //!< Returns how far a sample may be from the fade
+    void setMaxSegment(int msecs) { m_maxSegment = qMax(msecs, 1); }        //!< Sets the longest fade one command covers
+    int maxSegment() const { return m_maxSegment; }                         //!< Returns the longest fade one command covers
+    void setLatency(int msecs) { m_latency = qMax(msecs, 0); }              //!< Sets how long a line may stay open, 0 waits for the sample after it
+    int latency() const { return m_latency; }                               //!< Returns how long a line may stay open, 0 if it waits for the sample after it
+
+    void push(uint64_t target, qint64 msecs, const HSBK &color);
+    void push(uint64_t target, qint64 msecs, const lx_hsbk_t &color);
+    void flush(uint64_t target);
+    void flush();
+    void remove(uint64_t target);
+
+    LifxDecimatorStats stats(uint64_t target) const { return m_streams.value(target).stats; }  //!< Returns what has been done to one bulb's stream
+    LifxDecimatorStats stats() const;
+    QList<uint64_t> streams() const { return m_streams.keys(); }            //!< Returns every bulb with a stream
+
+private:
+    /**
+     * \struct Sample
+     * One pushed color
+     */
+    struct Sample {
+        qint64 time;            //!< Millis the color is meant for
+        lx_hsbk_t color;        //!< Color
+    };
+
+    /**
+     * \struct Stream
+     * One bulb's open line
+     */
+    struct Stream {
+        bool anchored = false;      //!< A color has been sent
+        qint64 anchorTime = 0;      //!< When the bulb got to the anchor color
+        lx_hsbk_t anchor;           //!< Last color sent
+        QVector<Sample> pending;    //!< Samples on the open line
+        int pendingError = 0;       //!< Worst error on the open line
+        LifxDecimatorStats stats;   //!< Counts
+    };
+
+    int fit(const Stream &stream, const Sample &end) const;
+    void close(uint64_t target, Stream &stream);
+    static int distance(const lx_hsbk_t &a, const lx_hsbk_t &b);
+
+    Sink m_sink;                            //!< Where commands go
+    int m_tolerance;                        //!< HSBK units a sample may be off the line
+    int m_maxSegment;                       //!< Longest line in millis
+    int m_latency;                          //!< Millis a line may stay open, 0 for no limit
+    QHash<uint64_t, Stream> m_streams;      //!< Open line per bulb
+};
+
+#endif // LIFXDECIMATOR_H
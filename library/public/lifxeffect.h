@@ -0,0 +1,93 @@
+/*
+ * The interface every effect, built in or plugin, implements
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXEFFECT_H
+#define LIFXEFFECT_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+
+class LifxLayout;
+
+/**
+ * \def LIFX_EFFECT_ABI
+ * Version of LifxEffectFrame and LifxEffect. A plugin built against a
+ * different version is not loaded.
+ */
+#define LIFX_EFFECT_ABI     1
+
+/**
+ * \struct LifxEffectFrame
+ * Everything an effect gets for one frame
+ *
+ * Plain data and pointers, so it looks the same to a plugin built apart
+ * from the library. The positions and colors have count entries, one per
+ * layout point.
+ */
+struct LifxEffectFrame {
+    qint64 msecs;                   //!< Millis from the effect starting to this frame being sent
+    int delta;                      //!< Millis from the last frame rendered to this one
+    quint64 frame;                  //!< Frames this effect has rendered
+    int count;                      //!< Points in the layout
+    const float *x;                 //!< Point positions
+    const float *y;                 //!< Point positions
+    const float *z;                 //!< Point positions
+    const LifxLayout *layout;       //!< The layout, for effects built with the library
+    const lx_hsbk_t *previous;      //!< Colors the effect wrote last frame
+    lx_hsbk_t *out;                 //!< Colors to write, holds the previous frame on entry
+};
+
+/**
+ * \class LifxEffect
+ * \brief (PUBLIC) An effect, a function of position, time and the last frame
+ *
+ * render() is called once a frame, a frame ahead of it being sent, on a
+ * thread the LifxEffectRunner keeps for the effect, and is timed.
+ * setParameter() is called on that thread too, between renders, and
+ * start() on the runner's thread while no render is running. render()
+ * should write every entry of out and return, not block or allocate. An
+ * effect taking longer than its budget is run less often, and one which
+ * doesn't get back under it is stopped.
+ *
+ * A plugin is a shared object exporting, with C linkage,
+ *
+ * \code
+ * extern "C" Q_DECL_EXPORT int qtlifx_effect_abi() { return LIFX_EFFECT_ABI; }
+ * extern "C" Q_DECL_EXPORT int qtlifx_effect_count() { return 1; }
+ * extern "C" Q_DECL_EXPORT const char* qtlifx_effect_name(int index) { return "sparkle"; }
+ * extern "C" Q_DECL_EXPORT LifxEffect* qtlifx_effect_create(const char *name) { return new Sparkle(); }
+ * extern "C" Q_DECL_EXPORT void qtlifx_effect_destroy(LifxEffect *effect) { delete effect; }
+ * \endcode
+ *
+ * and is loaded with LifxEffectRunner::loadPlugin(). Effects are made and
+ * deleted by the plugin, so it may be built with its own allocator.
+ */
+class LifxEffect
+{
+public:
+    virtual ~LifxEffect() {}
+
+    virtual const char* name() const = 0;                                   //!< Returns the effect's name
+    virtual void start(const LifxLayout &layout) { Q_UNUSED(layout) }       //!< Called before the first frame, and when the layout changes size
+    virtual void render(const LifxEffectFrame &frame) = 0;                  //!< Writes frame.out
+    virtual void setParameter(const char *key, double value) { Q_UNUSED(key) Q_UNUSED(value) }    //!< Sets an effect specific parameter
+};
+
+#endif // LIFXEFFECT_H
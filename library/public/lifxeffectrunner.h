@@ -0,0 +1,195 @@
+/*
+ * Loads effects and runs them on layouts within a CPU budget
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXEFFECTRUNNER_H
+#define LIFXEFFECTRUNNER_H
+
+#include <QtCore/QtCore>
+
+#include "lifxeffect.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class LifxManager;
+class LifxLayout;
+
+/**
+ * \struct LifxEffectStats
+ * How one running effect is doing
+ */
+struct LifxEffectStats {
+    QString name;               //!< Effect name
+    quint64 renders = 0;        //!< Frames rendered
+    quint64 skipped = 0;        //!< Frames skipped while throttled
+    quint64 late = 0;           //!< Renders not done by the frame they were for, dropped
+    qint64 lastUsecs = 0;       //!< Micros the last render took
+    qint64 meanUsecs = 0;       //!< Moving average of render micros
+    qint64 worstUsecs = 0;      //!< Longest render
+    int budgetUsecs = 0;        //!< Budget a render
+    int divisor = 1;            //!< Renders every divisor frames
+    bool disabled = false;      //!< Stopped for going over budget
+};
+
+/**
+ * \class LifxEffectRunner
+ * \brief (PUBLIC) Runs LifxEffects on layouts, and keeps slow ones from stalling the rest
+ *
+ * Knows the built in effects and any loaded from plugins with
+ * loadPlugin(). start() puts an effect on a LifxLayout, then every frame
+ * each running effect renders into its layout, which is sent with a
+ * duration of the frame interval.
+ *
+ * Each effect renders on a thread of its own, a frame ahead. A frame
+ * asks for the next render and sends the one asked for last time, so
+ * this object's thread, usually the manager's, never waits on an effect.
+ * A render not done by the frame it was for is dropped and counted as
+ * late.
+ *
+ * Every render is timed against the effect's budget. An effect over it
+ * twice running is rendered every other frame, then every fourth, up to
+ * every MAX_DIVISOR frames, with the bulbs fading across the gap. One
+ * still over budget then, or one render over BUDGET_KILL times its
+ * budget, finished or not, is disabled and effectDisabled() emitted. An
+ * effect well under budget for a second gets its rate back a step at a
+ * time.
+ *
+ * A disabled effect is stopped and destroyed, but keeps its id and stats
+ * until stop(). The frame timer stops when no effect is left enabled.
+ * One stuck in render() is left to finish on its thread and destroyed
+ * then, and if it is still stuck when the runner goes, its plugin is
+ * never unloaded.
+ *
+ * Effects read their layout's points while rendering, so don't move or
+ * add points while one runs on it. Give each running effect its own
+ * layout, two on one overwrite each other, use a LifxCompositor to
+ * blend.
+ */
+class Q_DECL_EXPORT LifxEffectRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DEFAULT_BUDGET = 2000;     //!< Micros a render, by default
+    static constexpr int MAX_DIVISOR = 8;           //!< Most frames between renders before disabling
+    static constexpr int BUDGET_KILL = 10;          //!< One render this many budgets long disables at once
+
+    LifxEffectRunner(LifxManager *manager, QObject *parent = nullptr);
+    ~LifxEffectRunner();
+
+    bool loadPlugin(const QString &path);
+    int loadPlugins(const QString &dir);
+    QStringList effects() const;
+    LifxEffect* create(const QString &name);
+    void destroy(LifxEffect *effect);
+
+    int start(const QString &name, LifxLayout *layout, int budgetUsecs = DEFAULT_BUDGET);
+    bool setParameter(int id, const QString &key, double value);
+    void stop(int id);
+    void stopAll();
+    QList<int> running() const { return m_running.keys(); }            //!< Returns the ids of running effects
+    LifxEffectStats stats(int id) const;
+
+    void setFrameRate(int fps);
+    int frameRate() const { return m_fps; }                             //!< Returns frames a second
+
+signals:
+    void effectThrottled(int id, int divisor);
+    void effectDisabled(int id, const QString &name, qint64 usecs);
+
+public slots:
+    void frame();
+
+private:
+    typedef int (*AbiFn)();
+    typedef int (*CountFn)();
+    typedef const char* (*NameFn)(int);
+    typedef LifxEffect* (*CreateFn)(const char*);
+    typedef void (*DestroyFn)(LifxEffect*);
+
+    /*
+     * The thread an effect renders on. The thread holds a reference, so
+     * one stuck in render() can be left behind. Everything but the lock
+     * and flags belongs to the thread while busy is set.
+     */
+    struct Worker {
+        std::thread thread;
+        std::mutex lock;                        //!< Guards the flags and parameters
+        std::condition_variable wake;           //!< Signals a render or quit, and the thread going idle
+        bool requested = false;                 //!< frame is ready to render
+        bool busy = false;                      //!< Requested or rendering
+        bool done = false;                      //!< out holds a render not yet sent
+        bool quit = false;                      //!< Asks the thread to finish
+        bool abandoned = false;                 //!< The thread destroys the effect when it finishes
+        LifxEffect *effect = nullptr;
+        DestroyFn destroy = nullptr;            //!< For an abandoned plugin effect, nullptr to delete
+        LifxEffectFrame frame;                  //!< What to render
+        QVector<lx_hsbk_t> previous;            //!< The last render
+        QVector<lx_hsbk_t> out;                 //!< The render in progress or done
+        QVector<QPair<QByteArray, double>> parameters;  //!< setParameter() calls for the thread to make
+        qint64 posted = 0;                      //!< Runner clock nanos the render was asked for
+        qint64 usecs = 0;                       //!< Micros the last render took
+    };
+
+    /*
+     * A loaded plugin
+     */
+    struct Plugin {
+        QLibrary *library;
+        QStringList names;
+        CreateFn create;
+        DestroyFn destroy;
+    };
+
+    /*
+     * An effect on a layout
+     */
+    struct Running {
+        LifxEffect *effect = nullptr;           //!< nullptr once disabled
+        LifxLayout *layout = nullptr;
+        std::shared_ptr<Worker> worker;
+        qint64 started = 0;
+        qint64 lastRender = 0;                  //!< Millis the last render asked for was for
+        bool late = false;                      //!< The render in flight missed its frame
+        int overruns = 0;
+        int underruns = 0;
+        LifxEffectStats stats;
+    };
+
+    bool budget(Running &run, qint64 usecs);
+    void disable(int id, Running &run, qint64 usecs);
+    void retire(Running &run, qint64 waitUsecs);
+    bool idle() const;
+    static void renderer(std::shared_ptr<Worker> worker);
+
+    LifxManager *m_manager;                 //!< Sends the frames
+    QTimer *m_timer;                        //!< Frame timer, runs while effects do
+    QElapsedTimer m_clock;                  //!< Time base for effects
+    int m_fps;                              //!< Frames a second
+    quint64 m_frame;                        //!< Frames since the runner was made
+    int m_nextId;                           //!< Id for the next start()
+    QList<Plugin> m_plugins;                //!< Loaded plugins
+    QHash<LifxEffect*, DestroyFn> m_owners; //!< Plugin that made each live effect, nullptr for built in
+    QMap<int, Running> m_running;           //!< Running effects by id
+    QList<std::shared_ptr<Worker>> m_abandoned;     //!< Workers left stuck in render()
+};
+
+#endif // LIFXEFFECTRUNNER_H
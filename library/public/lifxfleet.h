@@ -0,0 +1,128 @@
+/*
+ * Flat storage for the frequently used state of every known bulb
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXFLEET_H
+#define LIFXFLEET_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "lifxbitmap.h"
+
+/**
+ * \class LifxFleet
+ * \brief (PUBLIC) Struct of arrays storage for the hot state of every bulb
+ *
+ * Each bulb is a row, identified by a dense index from 0 to size() - 1.
+ * The fields that are read or written for every bulb on a fleet wide
+ * operation (power, color, address, last seen, RSSI) are each kept in
+ * their own contiguous array, so a scan of one field walks one block
+ * of memory instead of chasing a pointer per bulb.
+ *
+ * The MAC (target) to index lookup is an open addressing hash table
+ * with linear probing, kept at most half full.
+ *
+ * Product capabilities are kept as one LifxBitmap per capability, so
+ * they can be combined with other row sets without looking at the rows.
+ *
+ * LifxBulb is a handle over one row. Rows are never removed, and an
+ * index stays valid for the life of the fleet. Pointers returned by
+ * color() and target() are only valid until the next add().
+ */
+class LifxFleet
+{
+public:
+    /**
+     * \enum Capability
+     * Product features from products.json, used as bit flags
+     */
+    enum Capability {
+        Color = 0x01,
+        Infrared = 0x02,
+        Multizone = 0x04,
+        Matrix = 0x08,
+        Chain = 0x10,
+    };
+
+    LifxFleet(int capacity = 0);
+    ~LifxFleet();
+
+    int add(uint64_t target = 0);
+    int indexOf(uint64_t target) const;
+    void setTarget(int index, uint64_t target);
+    void reserve(int capacity);
+    int size() const { return m_targets.size(); }                          //!< Returns the number of rows
+
+    uint64_t target(int index) const { return m_targets[index]; }         //!< Returns the MAC as a 64bit number
+    uint8_t* targetBytes(int index) { return reinterpret_cast<uint8_t*>(&m_targets[index]); }   //!< Returns the MAC as the 8 byte wire target
+    const uint8_t* targetBytes(int index) const { return reinterpret_cast<const uint8_t*>(&m_targets[index]); }   //!< Returns the MAC as the 8 byte wire target
+    uint16_t power(int index) const { return m_power[index]; }            //!< Returns the power level
+    void setPower(int index, uint16_t power) { m_power[index] = power; }  //!< Sets the power level
+    lx_dev_color_t* color(int index) { return &m_colors[index]; }         //!< Returns the SET_COLOR struct for the row
+    const lx_dev_color_t* color(int index) const { return &m_colors[index]; }   //!< Returns the SET_COLOR struct for the row
+    quint32 ipv4(int index) const { return m_ipv4[index]; }               //!< Returns the IPv4 address, 0 if unknown
+    quint16 port(int index) const { return m_ports[index]; }              //!< Returns the UDP port
+    void setAddress(int index, quint32 ipv4) { m_ipv4[index] = ipv4; }    //!< Sets the IPv4 address
+    void setPort(int index, quint16 port) { m_ports[index] = port; }      //!< Sets the UDP port
+    int rssi(int index) const { return m_rssi[index]; }                   //!< Returns the signal strength
+    void setRSSI(int index, int rssi) { m_rssi[index] = static_cast<qint16>(rssi); }   //!< Sets the signal strength
+    qint64 lastSeen(int index) const { return m_lastSeen[index]; }        //!< Returns when a packet last came from the row, on the fleet clock, -1 if never
+    void touch(int index) { m_lastSeen[index] = now(); }                  //!< Records that a packet arrived from the row now
+    qint64 lastSent(int index) const { return m_lastSent[index]; }        //!< Returns when a packet last went to the row, on the fleet clock, -1 if never
+    void markSent(int index) { m_lastSent[index] = now(); }               //!< Records that a packet went to the row now
+    qint64 now() const { return m_clock.elapsed(); }                      //!< Millis on the fleet clock
+    int capabilities(int index) const { return m_capabilities[index]; }   //!< Returns the Capability flags for the row
+    void setCapabilities(int index, int capabilities);
+
+    const uint16_t* powerColumn() const { return m_power.constData(); }           //!< The power of every row
+    const lx_dev_color_t* colorColumn() const { return m_colors.constData(); }    //!< The color of every row
+    const quint32* ipv4Column() const { return m_ipv4.constData(); }              //!< The IPv4 address of every row
+    const qint64* lastSeenColumn() const { return m_lastSeen.constData(); }       //!< The last seen time of every row
+    const qint16* rssiColumn() const { return m_rssi.constData(); }               //!< The signal strength of every row
+
+    const LifxBitmap& capabilityRows(Capability capability) const;
+    LifxBitmap poweredOnRows() const;
+
+    int countOn() const;
+    QVector<int> notSeenSince(qint64 msecs) const;
+
+private:
+    int probe(uint64_t target) const;
+    void insertKey(uint64_t target, int index);
+    void removeKey(uint64_t target);
+    void rehash(int capacity);
+
+    QVector<uint64_t> m_keys;           //!< Hash table targets, 0 is an empty slot
+    QVector<int> m_slots;               //!< Hash table row index for the matching key
+    int m_keyCount;                     //!< Number of keys in the hash table
+
+    QVector<uint64_t> m_targets;        //!< MAC of each row, 0 if not known yet
+    QVector<uint16_t> m_power;          //!< Power of each row
+    QVector<lx_dev_color_t> m_colors;   //!< SET_COLOR struct for each row
+    QVector<quint32> m_ipv4;            //!< IPv4 address of each row
+    QVector<quint16> m_ports;           //!< UDP port of each row
+    QVector<qint64> m_lastSeen;         //!< Fleet clock time of the last packet from each row
+    QVector<qint64> m_lastSent;         //!< Fleet clock time of the last packet to each row
+    QVector<qint16> m_rssi;             //!< Signal strength of each row
+    QVector<quint8> m_capabilities;     //!< Capability flags of each row
+    LifxBitmap m_capabilityRows[5];     //!< Rows with each Capability, in bit order
+    QElapsedTimer m_clock;              //!< Monotonic clock for m_lastSeen
+};
+
+#endif // LIFXFLEET_H
@@ -0,0 +1,73 @@
+/*
+ * Host side copy of the colors on a multizone or matrix device
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXFRAMEBUFFER_H
+#define LIFXFRAMEBUFFER_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+
+/**
+ * \class LifxFrameBuffer
+ * \brief (PUBLIC) A contiguous array of HSBK colors with change tracking
+ *
+ * Keeps two copies of the device colors. The frame is what the application
+ * writes, and the sent copy is what the device was last told to show (or
+ * reported showing). Only the parts of the frame which differ from the
+ * sent copy need to go out on the wire.
+ *
+ * The pixels are lx_hsbk_t, laid out one after the other, which is exactly
+ * the wire format. Effects can write the frame directly through data().
+ */
+class LifxFrameBuffer
+{
+public:
+    LifxFrameBuffer(int size = 0);
+    ~LifxFrameBuffer();
+
+    void resize(int size);
+    int size() const { return m_frame.size(); }                     //!< Returns the number of pixels in the buffer
+
+    lx_hsbk_t* data() { return m_frame.data(); }                    //!< Direct access to the frame for effects to write into
+    const lx_hsbk_t* data() const { return m_frame.constData(); }   //!< Read only access to the frame
+    const lx_hsbk_t* sent() const { return m_sent.constData(); }    //!< Read only access to what the device was last sent
+
+    void setPixel(int index, const HSBK &color);
+    void setPixels(int index, const lx_hsbk_t *colors, int count);
+    lx_hsbk_t pixel(int index) const;
+    void fill(const HSBK &color);
+
+    void setConfirmed(int index, const lx_hsbk_t *colors, int count);
+    bool isDirty() const;
+    bool isDirty(int start, int count) const;
+    QVector<QPair<int,int>> dirtyRanges(int maxLength) const;
+    void markClean(int start, int count);
+    void markDirty();
+
+private:
+    bool differs(int index) const;
+
+    QVector<lx_hsbk_t> m_frame;     //!< The colors the application wants
+    QVector<lx_hsbk_t> m_sent;      //!< The colors the device was last sent or reported
+    bool m_forceDirty;              //!< Treat every pixel as changed, used when the sent copy can't be trusted
+};
+
+#endif // LIFXFRAMEBUFFER_H
@@ -23,6 +23,7 @@
 #include <QtCore/QtCore>
 
 #include "lifxbulb.h"
+#include "lifxbitmap.h"
 
 /**
  * \class LifxGroup
@@ -45,13 +46,25 @@ public:
      * \param bulb Pointer to a LifxBulb class
      * \brief adds a bulb to this group
      */
-    void addBulb(LifxBulb *bulb) { m_bulbs.push_back(bulb); }
+    void addBulb(LifxBulb *bulb);
+    /**
+     * \fn void removeBulb(LifxBulb *bulb)
+     * \param bulb Pointer to a LifxBulb class
+     * \brief removes a bulb from this group, used when a bulb moves to another group
+     */
+    void removeBulb(LifxBulb *bulb);
     /**
      * \fn QString label() const
      * \return QString group name
      * \brief Returns the group name
      */
     QString label() const { return m_label; }
+    /**
+     * \fn void setLabel(QString label)
+     * \param label The new group name
+     * \brief Changes the group name when a bulb reports the group was renamed
+     */
+    void setLabel(QString label) { m_label = label; }
     /**
      * \fn QByteArray uuid() const
      * \return Returns the QByteArray UUID assigned to this group
@@ -76,16 +89,24 @@ public:
      * \return A bool indicating whether a bulb is in the vector
      * \brief Checks the group for a bulb, returns true if the bulb is in the group, false otherwise
      */
-    bool contains(LifxBulb *bulb) { return m_bulbs.contains(bulb); }
+    bool contains(LifxBulb *bulb) const { return m_members.contains(bulb); }
     /**
      * \fn QVector<LifxBulb*>& bulbs()
      * \return The vector of bulbs in this group
      * \brief Returns the bulbs list this group owns as a reference
      */
     QVector<LifxBulb*>& bulbs() { return m_bulbs; }
+    /**
+     * \fn const LifxBitmap& rows() const
+     * \return The fleet rows of the bulbs in this group
+     * \brief Used by LifxQuery to narrow a query to this group without visiting the bulbs
+     */
+    const LifxBitmap& rows() const { return m_rows; }
     
 private:
     QVector<LifxBulb*> m_bulbs;     //!< Vector with all bulbs that exist in this group
+    QSet<LifxBulb*> m_members;      //!< The same bulbs as m_bulbs, for constant time contains()
+    LifxBitmap m_rows;              //!< The fleet rows of the same bulbs
     QString m_label;                //!< The group name/label
     QByteArray m_uuid;              //!< Group assigned UUID, used for map storage later
     uint64_t m_timestamp;           //!< Assigned timestamp of last time group was modified, currently not used
@@ -0,0 +1,237 @@
+/*
+ * Drives a layout's bulbs, strips and tiles from images and video frames
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXIMAGEMAPPER_H
+#define LIFXIMAGEMAPPER_H
+
+#include <QtCore/QtCore>
+#include <QtGui/QtGui>
+
+#include "defines.h"
+#include "lifxcommandbatch.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class LifxManager;
+class LifxLayout;
+class LifxBulb;
+
+/**
+ * \struct LifxImageStageTimes
+ * Nanos spent in each stage of a frame
+ */
+struct LifxImageStageTimes {
+    qint64 decode = 0;          //!< Reading the file or stdin and converting to RGB
+    qint64 sample = 0;          //!< Filtering the image down to one color per point
+    qint64 compare = 0;         //!< Finding the points that changed past the threshold
+    qint64 convert = 0;         //!< RGB to HSBK for the changed points
+    qint64 send = 0;            //!< Writing the batch and frame buffers and handing them to the manager
+
+    qint64 total() const { return decode + sample + compare + convert + send; }     //!< Returns the whole frame
+};
+
+/**
+ * \struct LifxImageMapperStats
+ * How the image pipeline is keeping up
+ */
+struct LifxImageMapperStats {
+    quint64 frames = 0;         //!< Frames mapped and sent
+    quint64 dropped = 0;        //!< Frames skipped because a later one was already due
+    quint64 late = 0;           //!< Frames mapped after the next was due, the decoder fell behind
+    quint64 points = 0;         //!< Point updates sent, a point that didn't change isn't counted
+    LifxImageStageTimes last;   //!< The last frame
+    LifxImageStageTimes mean;   //!< Mean over every frame
+    LifxImageStageTimes worst;  //!< Slowest of every frame, stage by stage
+};
+
+/**
+ * \class LifxImageMapper
+ * \brief (PUBLIC) Images in, one color per layout point out
+ *
+ * The image is laid over the layout's x and y, by default across the
+ * points' bounding box, or setRegion() to place it. Each point takes the
+ * part of the image under its footprint, a square as wide as the gap to
+ * its nearest neighbour unless setFootprint() gives one size for all.
+ *
+ * With the Box filter the footprint is snapped to whole pixels and they
+ * are averaged, with Area the pixels on its edges count by how much of
+ * them it covers, which is smoother when the image has few pixels for
+ * each point. The spans and weights are worked out once for each image
+ * size, so a frame costs about one pass over the pixels covered.
+ *
+ * Points whose color moved no more than threshold() on every channel
+ * since it was last sent are left alone. The rest are converted to HSBK
+ * in one batch, whole bulbs go in one LifxCommandBatch and zones and
+ * tile pixels into their device's frame buffer, sent with one update
+ * per device.
+ *
+ * Frames come from processImage() directly, from a list of image files
+ * played at a frame rate, read ahead on a thread of their own so a slow
+ * PNG doesn't hold up the next frame, or as raw RGB from stdin. A frame
+ * still waiting when a later one is ready and due is dropped rather than
+ * sent late, and counted in stats() with the time spent in each stage.
+ *
+ * The layout must be bound with LifxLayout::bind(). Call invalidate()
+ * after moving or adding points.
+ */
+class Q_DECL_EXPORT LifxImageMapper : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * \enum Filter
+     * How the pixels under a point are combined
+     */
+    enum Filter {
+        Box,        /**< Average of the whole pixels under the footprint */
+        Area,       /**< Average weighted by how much of each pixel the footprint covers */
+    };
+
+    static constexpr int DEFAULT_FRAME_RATE = 30;      //!< Frames a second for openSequence()
+    static constexpr int DEFAULT_THRESHOLD = 2;        //!< Change on an 8 bit channel a point ignores
+    static constexpr int PREFETCH = 4;                 //!< Frames decoded ahead of the one showing
+
+    LifxImageMapper(LifxManager *manager, LifxLayout *layout, QObject *parent = nullptr);
+    ~LifxImageMapper();
+
+    bool processImage(const QImage &image);
+    bool processRgb(const uchar *rgb, int width, int height, int bytesPerLine);
+
+    bool openSequence(const QStringList &files, int fps = DEFAULT_FRAME_RATE, bool loop = false);
+    bool openStdin();
+    void close();
+    bool isOpen() const { return m_playing || m_notifier != nullptr; }   //!< Returns true while a sequence or stdin is being read
+
+    void setFilter(Filter filter) { m_filter = filter; invalidate(); }     //!< Sets how pixels are combined
+    Filter filter() const { return m_filter; }                             //!< Returns how pixels are combined
+    void setRegion(float left, float top, float right, float bottom);
+    void clearRegion() { m_autoRegion = true; invalidate(); }              //!< Goes back to the points' bounding box
+    void setFootprint(float size) { m_footprint = qMax(size, 0.0f); invalidate(); }    //!< Sets every point's footprint in layout units, 0 for the nearest neighbour gap
+    float footprint() const { return m_footprint; }                        //!< Returns the footprint in layout units, 0 for the nearest neighbour gap
+    void setThreshold(int levels) { m_threshold = qBound(0, levels, 255); }     //!< Sets the change on an 8 bit channel a point ignores, 0 sends every change
+    int threshold() const { return m_threshold; }                          //!< Returns the change on an 8 bit channel a point ignores
+    void setKelvin(uint16_t kelvin) { m_kelvin = kelvin; }                 //!< Sets the white point for the RGB to HSBK conversion
+    void setDuration(uint32_t msecs) { m_duration = msecs; }               //!< Sets the transition time the bulbs are given
+    void setRawSize(int width, int height);
+    void invalidate();
+    void resend();
+
+    LifxImageMapperStats stats() const;
+    void resetStats();
+
+signals:
+    void finished();
+
+private slots:
+    void nextFrame();
+    void readStdin();
+
+private:
+    /*
+     * The pixels under one point. For Area every pixel inside the
+     * footprint has the same weight, only the edges differ.
+     */
+    struct Span {
+        int column;
+        int columns;
+        int row;
+        int rows;
+        float left;                 //!< Weight of the first column, Area only
+        float inner;                //!< Weight of the columns between
+        float right;                //!< Weight of the last column
+        float top;                  //!< The same for rows
+        float middle;
+        float bottom;
+    };
+
+    /*
+     * A frame from the decoder thread
+     */
+    struct Decoded {
+        qint64 index;               //!< Frame number since openSequence(), -1 after the last
+        QImage image;
+        qint64 decode;              //!< Nanos to read it
+    };
+
+    void plan(int width, int height);
+    void footprints();
+    void weights(float low, float high, int limit, int &first, int &count, float &lowEdge, float &inner, float &highEdge) const;
+    bool map(const uchar *rgb, int width, int height, int bytesPerLine, qint64 decode);
+    void sampleBox(const uchar *rgb, int bytesPerLine);
+    void sampleArea(const uchar *rgb, int bytesPerLine);
+    int compare();
+    void send(int count);
+    void record(const LifxImageStageTimes &times);
+    void decoder(QStringList files, bool loop, QSize rawSize);
+    void stopDecoder();
+    bool loadRaw(const QString &path, QSize size, QImage &image) const;
+
+    LifxManager *m_manager;             //!< Sends the updates
+    LifxLayout *m_layout;               //!< Where the points are
+    Filter m_filter;                    //!< How pixels are combined
+    bool m_autoRegion;                  //!< The region is the points' bounding box
+    float m_left;                       //!< Layout x of the image's left edge
+    float m_top;                        //!< Layout y of the image's top row
+    float m_right;                      //!< Layout x of the image's right edge
+    float m_bottom;                     //!< Layout y of the image's bottom row
+    float m_footprint;                  //!< Layout units, 0 for the nearest neighbour gap
+    int m_threshold;                    //!< 8 bit levels
+    uint16_t m_kelvin;                  //!< White point of the conversion
+    uint32_t m_duration;                //!< Millis
+    int m_rawWidth;                     //!< Size of raw frames, the decoder gets a copy
+    int m_rawHeight;
+    bool m_planned;                     //!< m_spans matches m_planWidth by m_planHeight and the layout
+    int m_planWidth;
+    int m_planHeight;
+    int m_planPoints;
+    QVector<float> m_size;              //!< Footprint per point, layout units
+    QVector<Span> m_spans;              //!< Pixels per point
+    QVector<lx_rgb8_t> m_rgb;           //!< Sampled color per point
+    QVector<lx_rgb8_t> m_sent;          //!< Color per point when last sent
+    QVector<quint8> m_pending;          //!< Point hasn't been sent since the plan or resend()
+    QVector<int> m_changed;             //!< Points to send this frame
+    QVector<lx_rgb8_t> m_changedRgb;    //!< Their colors, packed for the conversion
+    QVector<lx_hsbk_t> m_changedHsbk;
+    QSet<LifxBulb*> m_zoneBulbs;        //!< Strips touched this frame
+    QSet<LifxBulb*> m_tileBulbs;        //!< Tile chains touched this frame
+    LifxCommandBatch m_batch;           //!< Whole bulbs this frame
+    LifxImageMapperStats m_stats;       //!< Counts
+    LifxImageStageTimes m_total;        //!< Sum of every frame's stages, for the mean
+    QElapsedTimer m_clock;              //!< Time base for sequences
+
+    QTimer *m_frameTimer;               //!< Fires when the next sequence frame is due
+    int m_fps;                          //!< Sequence frames a second
+    qint64 m_shown;                     //!< Index of the last sequence frame mapped
+    bool m_playing;                     //!< A sequence is open
+    std::thread m_decoder;              //!< Reads the sequence ahead
+    std::mutex m_lock;                  //!< Guards m_queue and m_stop
+    std::condition_variable m_wake;     //!< Signals room in m_queue, or m_stop
+    std::deque<Decoded> m_queue;        //!< Decoded frames, oldest first
+    bool m_stop;                        //!< Asks the decoder to finish
+
+    QSocketNotifier *m_notifier;        //!< Stdin has data
+    QByteArray m_partial;               //!< Bytes read from stdin not yet a whole frame
+    qint64 m_readNanos;                 //!< Spent reading the stdin frame being put together
+};
+
+#endif // LIFXIMAGEMAPPER_H
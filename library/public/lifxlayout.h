@@ -0,0 +1,125 @@
+/*
+ * Where every bulb, zone and tile pixel is
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXLAYOUT_H
+#define LIFXLAYOUT_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+#include "lifxcommandbatch.h"
+
+#include <functional>
+
+class LifxManager;
+class LifxBulb;
+
+/**
+ * \class LifxLayout
+ * \brief (PUBLIC) A position for every light in the house, and effects that use them
+ *
+ * A layout is a list of points. Each is a whole bulb, one zone of a
+ * strip, or one pixel of a tile, with an x, y and z in whatever units
+ * suit (metres are a good choice). Describe the house once, save() it,
+ * and load() it at start up.
+ *
+ * The positions are kept as three float arrays, so an Effect, a function
+ * of position and time, runs over every point in one tight loop into a
+ * color array with one entry per point. send() then puts whole bulbs
+ * into one LifxCommandBatch, and zones and tile pixels into each device's
+ * frame buffer, so every strip and tile chain changes with one message.
+ *
+ * Points name their device by MAC, call bind() after discovery to look
+ * the bulbs up. Points whose bulb isn't known are skipped by send().
+ * Points whose color is the one they were last sent are skipped too, so
+ * an effect run every frame only costs messages where it moves. A strip
+ * or tile chain is only updated if one of its points changed.
+ */
+class LifxLayout
+{
+public:
+    /**
+     * \enum Kind
+     * What a point lights
+     */
+    enum Kind {
+        Bulb,           /**< The whole bulb */
+        Zone,           /**< One zone of a strip, index is the zone */
+        TilePixel,      /**< One tile pixel, index is the pixel in LifxBulb::tiles() */
+    };
+
+    /**
+     * An effect writes one color per point for the time msecs
+     */
+    typedef std::function<void(const LifxLayout &layout, qint64 msecs, lx_hsbk_t *out)> Effect;
+
+    LifxLayout();
+
+    int addBulb(uint64_t target, float x, float y, float z = 0);
+    int addZone(uint64_t target, int zone, float x, float y, float z = 0);
+    int addStrip(uint64_t target, int zones, float x1, float y1, float z1, float x2, float y2, float z2);
+    int addTile(uint64_t target, int tile, float x, float y, float z, float pitch, int width = 8, int height = 8);
+    void clear();
+
+    int size() const { return m_x.size(); }                             //!< Returns the number of points
+    const float* x() const { return m_x.constData(); }                  //!< Returns every point's x
+    const float* y() const { return m_y.constData(); }                  //!< Returns every point's y
+    const float* z() const { return m_z.constData(); }                  //!< Returns every point's z
+    Kind kind(int point) const { return static_cast<Kind>(m_kind[point]); }    //!< Returns what a point lights
+    uint64_t target(int point) const { return m_target[point]; }        //!< Returns the MAC of a point's device
+    int index(int point) const { return m_index[point]; }               //!< Returns the zone or pixel of a point, 0 for a bulb
+    LifxBulb* bulb(int point) const { return m_bulbs[point]; }          //!< Returns a point's device after bind(), nullptr if unknown
+    void project(float dx, float dy, float dz, float *out, float *low = nullptr, float *high = nullptr) const;
+
+    int bind(LifxManager *manager);
+    void evaluate(const Effect &effect, qint64 msecs);
+    const lx_hsbk_t* colors() const { return m_colors.constData(); }   //!< Returns the colors from the last evaluate()
+    lx_hsbk_t* colors() { return m_colors.data(); }                     //!< Returns the colors send() uses, to write directly
+    void write(const lx_hsbk_t *colors, LifxCommandBatch &batch, uint32_t duration);
+    void send(LifxManager *manager, uint32_t duration);
+    void resend();
+
+    bool save(const QString &path) const;
+    bool load(const QString &path);
+
+    static Effect gradient(const HSBK &from, const HSBK &to, float dx, float dy, float dz = 0);
+    static Effect wave(const HSBK &color, float dx, float dy, float dz, float wavelength, int period);
+    static Effect chase(const HSBK &color, const HSBK &background, float dx, float dy, float dz, float width, int period);
+    static Effect rainbow(float dx, float dy, float dz, float wavelength, int period, uint16_t brightness = 65535, uint16_t kelvin = 3500);
+
+private:
+    int add(uint64_t target, Kind kind, int index, float x, float y, float z);
+
+    QVector<float> m_x;                 //!< X per point
+    QVector<float> m_y;                 //!< Y per point
+    QVector<float> m_z;                 //!< Z per point
+    QVector<quint8> m_kind;             //!< Kind per point
+    QVector<int> m_index;               //!< Zone or pixel per point
+    QVector<uint64_t> m_target;         //!< Device MAC per point
+    QVector<LifxBulb*> m_bulbs;         //!< Device per point after bind(), nullptr if unknown
+    QSet<LifxBulb*> m_zoneBulbs;        //!< Strips with a zone written since the last send()
+    QSet<LifxBulb*> m_tileBulbs;        //!< Tile chains with a pixel written since the last send()
+    QVector<lx_hsbk_t> m_colors;        //!< Color per point
+    QVector<lx_hsbk_t> m_sent;          //!< Color per point when last written
+    QVector<bool> m_hasSent;            //!< m_sent is valid
+    LifxCommandBatch m_batch;           //!< Whole bulbs for send()
+};
+
+#endif // LIFXLAYOUT_H
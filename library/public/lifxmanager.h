@@ -28,6 +28,20 @@
 #include "lifxpacket.h"
 #include "lifxgroup.h"
 #include "hsbk.h"
+#include "lifxwaveform.h"
+#include "lifxfleet.h"
+#include "lifxquery.h"
+#include "lifxbulbset.h"
+#include "lifxsnapshotring.h"
+#include "lifxcommandqueue.h"
+#include "lifxcommandbatch.h"
+#include "lifxscene.h"
+#include "lifxreconciler.h"
+
+#include "lifxawait.h"
+
+#include <atomic>
+#include <functional>
 
 /**
  * \class LifxManager
@@ -65,16 +79,53 @@ public:
     
     void discoverBulb(QHostAddress address, int port);
     LifxBulb* getBulbByName(QString &name);
+    QList<LifxBulb*> getBulbsByName(QString &name);
+    LifxBulb* getBulbByAddress(const QHostAddress &address);
     LifxBulb* getBulbByMac(uint64_t target);
     LifxGroup* getGroupByName(QString &name);
     LifxGroup* getGroupByUUID(QByteArray &uuid);
     LifxProtocol *getProtocol() { return m_protocol; }
+    LifxFleet *fleet() const { return m_fleet; }                       //!< Returns the flat state storage for every known bulb
+    LifxBulbSet query(const LifxQuery &query) const;
+    LifxBulbSet allBulbs() const;
+    LifxSnapshotHandle snapshot() const { return m_snapshots->acquire(); }     //!< Returns the latest published fleet state, safe from any thread
+    bool submit(const LifxCommand &command);
+    LifxBatchResult submit(const LifxCommandBatch &batch);
+    void setCommandOverflowPolicy(LifxCommandQueue::OverflowPolicy policy) { m_commands->setOverflowPolicy(policy); }   //!< Sets what submit() does when the queue is full, safe from any thread
+    quint64 droppedCommands() const { return m_commands->dropped(); }          //!< Returns the number of commands lost because the queue was full, safe from any thread
+    int pendingCommands() const { return m_commands->sizeApprox(); }           //!< Returns about how many submitted commands are waiting, safe from any thread
     QList<LifxBulb*> getBulbsByPID(int pid);
     void enableDebug(bool debug) { m_debug = debug; }
     void enableBulbEcho(QString &name, int timeout, QByteArray echoing);
     void enableBulbEcho(uint64_t target, int timeout, QByteArray echoing);
     void disableEcho(QString name);
     void disableEcho(uint64_t target);
+    void setSuppressionWindow(int msecs);
+    int suppressionWindow() const { return m_suppressionWindow; }      //!< Returns how recent a bulb report must be to skip a send, in millis
+    quint64 suppressedMessages() const { return m_suppressed; }         //!< Returns the number of sends skipped because the bulb already showed that state
+    void resetSuppressedMessages() { m_suppressed = 0; }                //!< Sets the suppressed message counter back to 0
+    int applyScene(const LifxScene &scene, int source = 0);
+    void captureState(std::function<void(const LifxScene&, const QList<LifxBulb*>&)> done, int timeout = 1000, int retries = 2);
+    void restoreState(const LifxScene &state, uint32_t duration, std::function<void(const QList<LifxBulb*>&)> done, int timeout = 1000, int retries = 2);
+    void setDesiredState(LifxBulb *bulb, const HSBK &color, bool on = true, uint32_t duration = 400);
+    void setDesiredState(const LifxScene &scene);
+    QHash<LifxBulb*, LifxSceneEntry> sceneStates(const LifxScene &scene) const;
+    void clearDesiredState(LifxBulb *bulb);
+    void clearDesiredState();
+    void setReconcileBudget(int packetsPerSecond) { m_reconciler->setBudget(packetsPerSecond); }        //!< Sets the most messages a second the reconciler sends across every bulb
+    void setReconcileVerifyInterval(int msecs) { m_reconciler->setVerifyInterval(msecs); }             //!< Sets how often bulbs already in their desired state are polled, 0 for never
+    LifxReconcileStats reconcileStats() const { return m_reconciler->stats(); }                      //!< Returns how the bulbs with a desired state are doing
+    void setBulbRateLimit(int messagesPerSecond);
+    int bulbRateLimit() const { return m_bulbInterval > 0 ? 1000 / m_bulbInterval : 0; }   //!< Returns the most messages per second a scene sends one bulb, 0 if unlimited
+    void requestColor(LifxBulb *bulb, std::function<void(bool, HSBK)> done, int timeout = 1000, int retries = 2);
+    void changeBulbColorAcked(LifxBulb *bulb, HSBK color, uint32_t duration, std::function<void(bool)> done, int timeout = 1000, int retries = 2);
+    void changeBulbStateAcked(LifxBulb *bulb, bool state, std::function<void(bool)> done, int timeout = 1000, int retries = 2);
+    int pendingRequests() const { return m_requests.size(); }          //!< Returns the number of requests still waiting on a bulb reply
+#ifdef LIFX_ENABLE_COROUTINES
+    LifxColorAwaiter getColor(LifxBulb *bulb, int timeout = 1000, int retries = 2);
+    LifxAckAwaiter setColorAcked(LifxBulb *bulb, HSBK color, uint32_t duration = 400, int timeout = 1000, int retries = 2);
+    LifxAckAwaiter setStateAcked(LifxBulb *bulb, bool state, int timeout = 1000, int retries = 2);
+#endif
     
 public slots:
     void discover();
@@ -89,6 +140,8 @@ public slots:
     void changeGroupColor(QByteArray &uuid, QColor color, int source = 0, bool ackRequired = false);
     void changeGroupColor(QByteArray &uuid, HSBK color, int source = 0, bool ackRequired = false);
     void changeGroupState(QByteArray &uuid, bool state, int source = 0, bool ackRequired = false);
+    void changeBulbSetColor(const LifxBulbSet &bulbs, HSBK color, uint32_t duration = 400, int source = 0, bool ackRequired = false);
+    void changeBulbSetState(const LifxBulbSet &bulbs, bool state, int source = 0, bool ackRequired = false);
     void setProductCapabilities(QJsonDocument &doc);
     void changeBulbState(uint64_t target, bool state, int source = 0, bool ackRequired = false);
     void changeBulbState(LifxBulb* bulb, bool state, int source = 0, bool ackRequired = false);
@@ -100,7 +153,25 @@ public slots:
     void updateState(uint64_t target);
     void getColorForBulb(LifxBulb *bulb, int source = 0);
     void getColorForBulb(uint64_t target, int source = 0);
-
+    void changeBulbWaveform(uint64_t target, LifxWaveform waveform, int source = 0, bool ackRequired = false);
+    void changeBulbWaveform(LifxBulb *bulb, LifxWaveform waveform, int source = 0, bool ackRequired = false);
+    void changeGroupWaveform(QByteArray &uuid, LifxWaveform waveform, int source = 0, bool ackRequired = false);
+    void pulseBulb(LifxBulb *bulb, HSBK color, uint32_t period = 1000, float cycles = 1, int source = 0, bool ackRequired = false);
+    void breatheBulb(LifxBulb *bulb, HSBK color, uint32_t period = 1000, float cycles = 1, int source = 0, bool ackRequired = false);
+    void strobeBulb(LifxBulb *bulb, HSBK color, uint32_t period = 100, float cycles = 10, int source = 0, bool ackRequired = false);
+    void pulseGroup(QByteArray &uuid, HSBK color, uint32_t period = 1000, float cycles = 1, int source = 0, bool ackRequired = false);
+    void breatheGroup(QByteArray &uuid, HSBK color, uint32_t period = 1000, float cycles = 1, int source = 0, bool ackRequired = false);
+    void strobeGroup(QByteArray &uuid, HSBK color, uint32_t period = 100, float cycles = 10, int source = 0, bool ackRequired = false);
+    void changeBulbZones(uint64_t target, uint32_t duration = 0, bool apply = true, int source = 0, bool ackRequired = false);
+    void changeBulbZones(LifxBulb *bulb, uint32_t duration = 0, bool apply = true, int source = 0, bool ackRequired = false);
+    void applyBulbZones(LifxBulb *bulb, int source = 0, bool ackRequired = false);
+    void getZonesForBulb(LifxBulb *bulb, int source = 0);
+    void getZonesForBulb(uint64_t target, int source = 0);
+    void changeBulbTiles(uint64_t target, uint32_t duration = 0, int source = 0, bool ackRequired = false);
+    void changeBulbTiles(LifxBulb *bulb, uint32_t duration = 0, int source = 0, bool ackRequired = false);
+    void getTilesForBulb(LifxBulb *bulb, int source = 0);
+    void getTilesForBulb(uint64_t target, int source = 0);
+    void publishSnapshot();
 
 signals:
     void bulbDiscoveryFinished(LifxBulb *bulb);
@@ -113,21 +184,78 @@ signals:
     void bulbGroupChange(LifxGroup *group);
     void bulbPowerChange(LifxBulb *bulb);
     void bulbRSSIChange(LifxBulb *bulb);
+    void bulbZonesChange(LifxBulb *bulb);
+    void bulbTilesChange(LifxBulb *bulb);
+    void snapshotPublished(quint64 generation);
     void messageTimeout();
     void ack(uint32_t uniqueId);
+    void bulbConverged(LifxBulb *bulb, qint64 msecs);
+
+private slots:
+    void drainCommands();
+    void expireRequests();
+    void reconcile();
 
 private:
     void echoFunction(LifxBulb *bulb, int timeout, QByteArray echoing);
+    LifxBulb* bulbFor(uint64_t target) const;
+    void changeBulbAddress(LifxBulb *bulb, const QHostAddress &address, int port = -1);
+    void moveBulbToGroup(LifxBulb *bulb, LifxGroup *group);
+    void stageProduct(LifxBulb *bulb);
+    void packetsRead();
+    bool suppressColor(LifxBulb *bulb, bool ackRequired);
+    bool suppressPower(LifxBulb *bulb, uint16_t power, bool ackRequired);
+    /**
+     * \struct PendingRequest
+     * A message sent to one bulb that is waiting on its reply
+     */
+    struct PendingRequest {
+        uint64_t target;                                //!< Bulb the message went to
+        uint16_t reply;                                 //!< Packet type which completes the request
+        std::function<uint8_t()> send;                  //!< Sends the message again, returns its sequence
+        std::function<void(LifxPacket*)> done;          //!< Called with the reply, or nullptr on timeout
+        qint64 deadline;                                //!< Fleet clock time the current attempt times out
+        int timeout;                                    //!< Millis to wait for each attempt
+        int retries;                                    //!< Attempts left after this one
+    };
+
+    void trackRequest(LifxBulb *bulb, uint16_t reply, std::function<uint8_t()> send, std::function<void(LifxPacket*)> done, int timeout, int retries);
+    void sendRequest(PendingRequest &request);
+    void completeRequest(uint64_t target, LifxPacket *packet);
+    void scheduleRequestTimer();
+    static quint64 requestKey(uint64_t target, uint8_t sequence) { return (target << 8) | sequence; }
+
+    static constexpr int CAPTURE_CHUNK = 64;        //!< Bulbs polled at once by captureState()
+    static constexpr int CAPTURE_PACE = 10;         //!< Millis between captureState() polls
+    static constexpr int RECONCILE_INTERVAL = 100;  //!< Millis between reconcile() passes
     
     LifxProtocol *m_protocol;
-    QMap<uint64_t, LifxBulb*> m_bulbs;
-    QMap<QByteArray, LifxGroup*> m_groups;
-    QMultiMap<int, LifxBulb*> m_bulbsByPID;
+    LifxFleet *m_fleet;
+    QVector<LifxBulb*> m_bulbs;
+    QHash<QByteArray, LifxGroup*> m_groups;
+    QMultiHash<int, LifxBulb*> m_bulbsByPID;
+    QMultiHash<QString, LifxBulb*> m_bulbsByLabel;
+    QHash<quint32, LifxBulb*> m_bulbsByAddress;
+    QHash<QString, LifxGroup*> m_groupsByLabel;
+    QHash<LifxBulb*, LifxGroup*> m_groupForBulb;
     QMap<int, QJsonObject> m_productObjects;
     QMap<uint64_t, QTimer*> m_echoTimers;
-    QMutex m_mutex;
+    LifxSnapshotRing *m_snapshots;
+    LifxSnapshot m_staging;
+    bool m_snapshotDirty;
+    bool m_groupsChanged;
+    LifxCommandQueue *m_commands;
+    std::atomic<bool> m_drainScheduled;
+    QHash<quint64, PendingRequest> m_requests;
+    QMultiMap<qint64, quint64> m_requestDeadlines;
+    QTimer *m_requestTimer;
+    LifxReconciler *m_reconciler;
+    QTimer *m_reconcileTimer;
     bool m_debug;
     uint32_t m_uniqueId;
+    int m_suppressionWindow;
+    int m_bulbInterval;
+    quint64 m_suppressed;
 };
 
 Q_DECLARE_METATYPE(LifxManager);
@@ -26,6 +26,7 @@
 
 #include "defines.h"
 #include "lifxbulb.h"
+#include "lifxwaveform.h"
 
 /**
  * \class LifxPacket
@@ -49,9 +50,11 @@ public:
     void setPayload(QByteArray ba);
     void setDatagram(char *data, int len, QHostAddress &addr, quint16 port);
     void setDatagram(QNetworkDatagram &datagram);
+    void setSequence(uint8_t sequence);
 
     uint16_t size() { return m_size; }
     uint16_t type() { return m_type; }
+    uint8_t sequence() const { return m_header.sequence; }     //!< Returns the sequence number, replies carry the one from the request
     QHostAddress address() const { return m_address; }
     QByteArray datagram();
     QByteArray payload() const { return m_payload; }
@@ -71,6 +74,13 @@ public:
     uint16_t getWifiInfoForBulb(LifxBulb *bulb, int source = 0, bool ackRequired = false);
     uint16_t setBulbColor(LifxBulb *bulb, int source = 0, bool ackRequired = false);
     uint16_t setBulbPower(LifxBulb *bulb, int source = 0, bool ackRequired = false);
+    uint16_t setBulbWaveform(LifxBulb *bulb, const LifxWaveform &waveform, int source = 0, bool ackRequired = false);
+    uint16_t getBulbExtendedZones(LifxBulb *bulb, int source = 0, bool ackRequired = false);
+    uint16_t setBulbExtendedZones(LifxBulb *bulb, int index, int count, uint32_t duration, uint8_t apply, int source = 0, bool ackRequired = false);
+    uint16_t getDeviceChain(LifxBulb *bulb, int source = 0, bool ackRequired = false);
+    uint16_t getTileState64(LifxBulb *bulb, int tileIndex, int length, int source = 0, bool ackRequired = false);
+    uint16_t setTileState64(LifxBulb *bulb, int tileIndex, uint8_t fbIndex, uint32_t duration, int source = 0, bool ackRequired = false);
+    uint16_t copyTileFrameBuffer(LifxBulb *bulb, int tileIndex, int length, uint8_t srcIndex, uint8_t dstIndex, uint32_t duration, int source = 0, bool ackRequired = false);
     uint16_t rebootBulb(LifxBulb *bulb);
     void echoBulb(LifxBulb *bulb, QByteArray bytes, int source = 0);
 
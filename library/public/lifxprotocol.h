@@ -28,6 +28,10 @@
 #include "lifxpacket.h"
 #include "lifxgroup.h"
 
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#endif
+
 /**
  * \class LifxProtocol
  * \brief (PRIVATE) The UDP protocol manager for sending/receiving bulb data
@@ -59,6 +63,11 @@ public:
     uint16_t setBulbColor(LifxBulb *bulb, QColor color, int source = 0, bool ackRequired = false);
     uint16_t setBulbState(LifxBulb *bulb, bool state, int source = 0, bool ackRequired = false);
     void setGroupState(LifxGroup *group, bool state, int source = 0, bool ackRequired = false);
+    uint16_t setBulbWaveform(LifxBulb *bulb, const LifxWaveform &waveform, int source = 0, bool ackRequired = false);
+    void setGroupWaveform(LifxGroup *group, const LifxWaveform &waveform, int source = 0, bool ackRequired = false);
+    int setBulbZones(LifxBulb *bulb, uint32_t duration, bool apply = true, int source = 0, bool ackRequired = false);
+    uint16_t applyBulbZones(LifxBulb *bulb, int source = 0, bool ackRequired = false);
+    int setBulbTiles(LifxBulb *bulb, uint32_t duration, int source = 0, bool ackRequired = false);
     uint16_t rebootBulb(LifxBulb *bulb);
     
     uint16_t getPowerForBulb(LifxBulb *bulb, int source = 0);
@@ -68,8 +77,20 @@ public:
     uint16_t getColorForBulb(LifxBulb *bulb, int source = 0);
     uint16_t getGroupForBulb(LifxBulb *bulb, int source = 0);
     uint16_t getWifiInfoForBulb(LifxBulb *bulb, int source = 0);
+    uint16_t getZonesForBulb(LifxBulb *bulb, int source = 0);
+    uint16_t getDeviceChainForBulb(LifxBulb *bulb, int source = 0);
+    uint16_t getTilesForBulb(LifxBulb *bulb, int source = 0);
     
     void echoRequest(LifxBulb *bulb, QByteArray echoing);
+    void queueDatagram(LifxPacket &packet, LifxBulb *bulb);
+    int flushDatagrams(qint64 *skew = nullptr);
+    int queuedDatagrams() const { return m_queued.size(); }    //!< Returns the number of datagrams waiting for flushDatagrams()
+    uint8_t lastSequence() const { return m_sequence; }     //!< Returns the sequence number of the last packet sent to a bulb
+    qintptr socketDescriptor() const { return m_socket ? m_socket->socketDescriptor() : -1; }   //!< Returns the native socket, for sending from another thread
+#ifdef Q_OS_LINUX
+    int socketFamily() const;
+    static socklen_t socketAddress(const QHostAddress &address, quint16 port, int family, sockaddr_storage *storage);
+#endif
 
 protected slots:
     void readDatagram();
@@ -78,9 +99,27 @@ signals:
     void datagramAvailable();
     void discoveryFailed();
     void newPacket(LifxPacket *packet);
+    void packetsRead();
     
 private:
+    qint64 send(LifxPacket &packet, LifxBulb *bulb);
+    int sendQueued();
+
+    /**
+     * \struct QueuedDatagram
+     * Where one datagram sits in m_queue, and where it goes
+     */
+    struct QueuedDatagram {
+        int offset;             //!< Start in m_queue
+        int size;               //!< Length in bytes
+        QHostAddress address;   //!< Bulb address
+        quint16 port;           //!< Bulb port
+    };
+
     QUdpSocket *m_socket;
+    uint8_t m_sequence;         //!< Sequence number of the last packet sent, wraps at 255
+    QByteArray m_queue;         //!< Encoded datagrams waiting for flushDatagrams(), back to back
+    QVector<QueuedDatagram> m_queued;   //!< One entry per datagram in m_queue
 };
 
 Q_DECLARE_METATYPE(LifxProtocol);
@@ -0,0 +1,107 @@
+/*
+ * Predicate queries over the bulb fleet
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXQUERY_H
+#define LIFXQUERY_H
+
+#include <QtCore/QtCore>
+
+#include "lifxfleet.h"
+#include "lifxbitmap.h"
+
+/**
+ * \class LifxQuery
+ * \brief (PUBLIC) A set of conditions every matching bulb must meet
+ *
+ * Conditions are added with the builder functions and are all ANDed
+ * together, e.g. every color bulb in "Kitchen" which is on and below
+ * half brightness
+ *
+ *     LifxQuery query;
+ *     query.hasCapability(LifxFleet::Color).isOn().inGroup("Kitchen")
+ *          .where(LifxQuery::Brightness, LifxQuery::Less, 32768);
+ *     LifxBulbSet bulbs = manager->query(query);
+ *
+ * Power, capability and group conditions are answered from bitmaps, 64
+ * bulbs at a time. Value conditions are compiled so that all the
+ * conditions on one field become a single range, and each range is then
+ * checked with one pass over that field's column in the LifxFleet,
+ * skipping blocks of bulbs that have already been ruled out.
+ */
+class LifxQuery
+{
+public:
+    /**
+     * \enum Field
+     * The per bulb values which can be compared
+     */
+    enum Field {
+        Hue,            /**< 0 - 65535 */
+        Saturation,     /**< 0 - 65535 */
+        Brightness,     /**< 0 - 65535 */
+        Kelvin,         /**< Color temperature */
+        Power,          /**< 0 is off, 65535 is on */
+        RSSI,           /**< Signal strength in dBm */
+        Age,            /**< Millis since the bulb last sent anything, never heard from is the largest possible age */
+    };
+    /**
+     * \enum Compare
+     * How the field is compared to the value
+     */
+    enum Compare {
+        Less,
+        LessEqual,
+        Equal,
+        NotEqual,
+        GreaterEqual,
+        Greater,
+    };
+
+    LifxQuery();
+    ~LifxQuery();
+
+    LifxQuery& isOn();
+    LifxQuery& isOff();
+    LifxQuery& hasCapability(LifxFleet::Capability capability);
+    LifxQuery& lacksCapability(LifxFleet::Capability capability);
+    LifxQuery& inGroup(const QString &label);
+    LifxQuery& where(Field field, Compare compare, qint64 value);
+
+    QStringList groups() const { return m_groups; }                 //!< Returns the group labels a bulb must be in
+    LifxBitmap evaluate(const LifxFleet *fleet, LifxBitmap candidates) const;
+
+private:
+    /**
+     * \struct Condition
+     * One where() call
+     */
+    struct Condition {
+        Field field;
+        Compare compare;
+        qint64 value;
+    };
+
+    int m_power;                    //!< 1 for on, 0 for off, -1 if power doesn't matter
+    int m_required;                 //!< Capability flags a bulb must have
+    int m_excluded;                 //!< Capability flags a bulb must not have
+    QStringList m_groups;           //!< Group labels a bulb must be in
+    QVector<Condition> m_conditions;    //!< Value conditions in the order they were added
+};
+
+#endif // LIFXQUERY_H
@@ -0,0 +1,129 @@
+/*
+ * Converges bulbs on a desired state
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXRECONCILER_H
+#define LIFXRECONCILER_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+#include "lifxbulb.h"
+#include "lifxcommandbatch.h"
+
+/**
+ * \struct LifxReconcileStats
+ * How well the bulbs are keeping to their desired state
+ */
+struct LifxReconcileStats {
+    int desired = 0;                //!< Bulbs with a desired state
+    int converged = 0;              //!< Bulbs whose last report matches it
+    int diverged = 0;               //!< Bulbs still being worked on, not counting offline ones
+    int offline = 0;                //!< Diverged bulbs which stopped answering, retried at the longest backoff
+    quint64 packets = 0;            //!< Messages sent by the reconciler
+    quint64 convergences = 0;       //!< Times a bulb reached its desired state
+    qint64 lastConvergence = 0;     //!< Millis the most recent convergence took
+    qint64 meanConvergence = 0;     //!< Mean millis from divergence to convergence
+    qint64 maxConvergence = 0;      //!< Longest millis from divergence to convergence
+};
+
+/**
+ * \class LifxReconciler
+ * \brief (PRIVATE) The desired, observed and last attempt model behind LifxManager::setDesiredState()
+ *
+ * Keeps per fleet row the desired color and power, when the row went
+ * out of step, and when it was last sent to. Each call to plan() looks
+ * at what every bulb last reported, and adds to a batch only the
+ * messages needed where the two differ. A bulb which doesn't answer is
+ * retried with an exponential backoff, and every message counts against
+ * a token bucket shared by the whole fleet.
+ *
+ * A color is judged only once its transition is over, by polling the
+ * bulb, so a long fade isn't restarted by resending it. A bulb which
+ * answers but never matches, one that can't show the color asked for,
+ * stays on the backoff rather than counting as offline.
+ *
+ * Rows that converged are left alone, apart from an optional slow poll
+ * to notice a bulb that was changed from somewhere else.
+ */
+class LifxReconciler
+{
+public:
+    static constexpr int ATTEMPT_TIMEOUT = 1000;        //!< Millis to wait for a reply before the first retry
+    static constexpr int MAX_BACKOFF = 60000;           //!< Longest wait between retries
+    static constexpr int OFFLINE_ATTEMPTS = 4;          //!< Unanswered attempts in a row before a bulb is counted offline
+    static constexpr int COLOR_TOLERANCE = 256;         //!< How far a reported HSBK field may be from the desired one
+
+    LifxReconciler();
+
+    void setDesired(int row, const HSBK &color, bool on, uint32_t duration, qint64 now);
+    void clearDesired(int row);
+    void clear();
+    bool hasDesired(int row) const;
+    bool isOffline(int row) const;
+    void wake(int row, qint64 now);
+    int desiredCount() const { return m_desiredCount; }             //!< Returns the number of rows with a desired state
+
+    void setBudget(int packetsPerSecond);
+    int budget() const { return m_budget; }                         //!< Returns the most messages sent a second
+    void setVerifyInterval(int msecs) { m_verifyInterval = qMax(msecs, 0); }   //!< Sets how often converged bulbs are polled, 0 for never
+    int verifyInterval() const { return m_verifyInterval; }         //!< Returns how often converged bulbs are polled
+
+    void plan(const QVector<LifxBulb*> &bulbs, qint64 now, LifxCommandBatch &batch, QVector<QPair<LifxBulb*, qint64>> &converged);
+    LifxReconcileStats stats() const;
+
+private:
+    /**
+     * \enum Flag
+     * Per row state bits
+     */
+    enum Flag {
+        HasDesired = 0x01,      /**< The row has a desired state */
+        DesiredOn = 0x02,       /**< The desired power is on */
+        Converged = 0x04,       /**< The last report matched */
+        AwaitingPoll = 0x08,    /**< A color was sent, poll once its transition is over */
+    };
+
+    void ensureRow(int row);
+    bool sameColor(const HSBK &reported, const lx_hsbk_t &desired) const;
+    qint64 backoff(int attempts) const;
+
+    QVector<quint8> m_flags;            //!< Flag bits per row
+    QVector<lx_hsbk_t> m_color;         //!< Desired color per row
+    QVector<uint32_t> m_duration;       //!< Desired transition per row
+    QVector<qint64> m_divergedSince;    //!< When the row last went out of step
+    QVector<qint64> m_nextAttempt;      //!< Earliest time to send to the row again
+    QVector<qint64> m_verifyAt;         //!< When a converged row is next polled
+    QVector<quint16> m_attempts;        //!< Attempts since the row went out of step
+    QVector<quint16> m_missed;          //!< Attempts in a row the bulb didn't answer
+    QVector<qint64> m_sentAt;           //!< When the row was last sent to, -1 for not since it went out of step
+    int m_desiredCount;                 //!< Rows with HasDesired
+    int m_cursor;                       //!< Row the next plan() starts at, so a short budget is shared out fairly
+    int m_budget;                       //!< Messages a second
+    int m_verifyInterval;               //!< Millis between polls of converged rows
+    double m_tokens;                    //!< Messages that may be sent now
+    qint64 m_refilled;                  //!< When m_tokens was last topped up
+    quint64 m_packets;                  //!< Messages sent
+    quint64 m_convergences;             //!< Convergences counted
+    qint64 m_lastConvergence;           //!< Millis the last convergence took
+    qint64 m_totalConvergence;          //!< Sum of every convergence time, for the mean
+    qint64 m_maxConvergence;            //!< Longest convergence time
+};
+
+#endif // LIFXRECONCILER_H
@@ -0,0 +1,83 @@
+/*
+ * A named set of bulb and group states
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXSCENE_H
+#define LIFXSCENE_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+#include "lifxbulb.h"
+
+/**
+ * \struct LifxSceneEntry
+ * The state one bulb, or every bulb in one group, should be in
+ */
+struct LifxSceneEntry {
+    uint64_t target = 0;        //!< Bulb MAC as a 64bit number, 0 for a group entry
+    QByteArray group;           //!< Group UUID, empty for a bulb entry
+    HSBK color;                 //!< Color while on
+    bool on = true;             //!< Power
+    uint32_t duration = 400;    //!< Transition time in millis
+};
+
+/**
+ * \class LifxScene
+ * \brief (PUBLIC) A named lighting state for some or all of the bulbs
+ *
+ * A scene lists bulbs and groups with the color, power and transition
+ * each should end up with. Hand it to LifxManager::applyScene(), which
+ * only sends what differs from what the bulbs last reported. A bulb
+ * entry wins over the entry for the group it's in.
+ *
+ * toBinary() and fromBinary() store a scene in a compact little endian
+ * format, 22 bytes per bulb entry, for saving to a file or settings.
+ */
+class LifxScene
+{
+public:
+    static constexpr quint32 MAGIC = 0x4e53584c;     //!< "LXSN" at the start of the binary form
+    static constexpr quint8 VERSION = 1;             //!< Binary format version
+
+    LifxScene(const QString &name = QString());
+
+    void setName(const QString &name) { m_name = name; }           //!< Sets the scene name
+    QString name() const { return m_name; }                         //!< Returns the scene name
+
+    void setBulb(uint64_t target, const HSBK &color, bool on = true, uint32_t duration = 400);
+    void setBulb(LifxBulb *bulb, const HSBK &color, bool on = true, uint32_t duration = 400);
+    void setGroup(const QByteArray &uuid, const HSBK &color, bool on = true, uint32_t duration = 400);
+    void clear() { m_entries.clear(); }                             //!< Removes every entry
+    int size() const { return m_entries.size(); }                   //!< Returns the number of entries
+    bool isEmpty() const { return m_entries.isEmpty(); }            //!< Returns true if there are no entries
+    const QVector<LifxSceneEntry>& entries() const { return m_entries; }   //!< Returns the entries in the order they were set
+
+    QByteArray toBinary() const;
+    static LifxScene fromBinary(const QByteArray &data, bool *ok = nullptr);
+
+private:
+    void setEntry(const LifxSceneEntry &entry);
+
+    QString m_name;                     //!< Scene name
+    QVector<LifxSceneEntry> m_entries;  //!< One per bulb or group
+};
+
+QDebug operator<<(QDebug debug, const LifxScene &scene);
+#endif // LIFXSCENE_H
@@ -0,0 +1,105 @@
+/*
+ * Timed frames of bulb changes for the show player
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXSHOW_H
+#define LIFXSHOW_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+
+/**
+ * \struct LifxShowRecord
+ * What one bulb does in one frame
+ */
+struct LifxShowRecord {
+    /**
+     * \enum Flag
+     * Which parts of the record are sent
+     */
+    enum Flag : quint8 {
+        Color = 0x01,       /**< Send color and duration */
+        Power = 0x02,       /**< Send power */
+        On = 0x04,          /**< The power to send is on */
+    };
+
+    quint16 bulb;           //!< Index into LifxShowSource::bulbs()
+    quint8 flags;           //!< Flag bits
+    lx_hsbk_t color;        //!< Color, if Color is set
+    uint32_t duration;      //!< Transition in millis, if Color is set
+};
+
+/**
+ * \class LifxShowSource
+ * \brief (PUBLIC) Where LifxShowPlayer gets its frames
+ *
+ * A show is a table of bulbs, and frames in time order, each holding at
+ * most one record per bulb. readFrame() is called from the player thread,
+ * in frame order apart from the first call after a seek, and must not
+ * allocate, block or touch QObjects. Everything else is called from the
+ * thread that starts the player.
+ */
+class LifxShowSource
+{
+public:
+    virtual ~LifxShowSource() {}
+
+    virtual QVector<uint64_t> bulbs() const = 0;                        //!< Returns the MAC of each bulb, records index into it
+    virtual int frameCount() const = 0;                                 //!< Returns the number of frames
+    virtual qint64 frameTime(int frame) const = 0;                      //!< Returns the millis from the start of the show frame plays at
+    virtual int readFrame(int frame, LifxShowRecord *records) = 0;      //!< Fills records with frame, which holds at most bulbs().size(), returns how many
+    virtual int findFrame(qint64 msecs) const;
+};
+
+/**
+ * \class LifxShow
+ * \brief (PUBLIC) A show held in memory
+ *
+ * Built up with setColor() and setPower() in any order. Changes to the
+ * same bulb at the same time are folded into one record, the later
+ * call wins.
+ */
+class LifxShow : public LifxShowSource
+{
+public:
+    LifxShow();
+
+    int addBulb(uint64_t target);
+    void setColor(qint64 msecs, uint64_t target, const HSBK &color, uint32_t duration = 0);
+    void setPower(qint64 msecs, uint64_t target, bool on);
+    void clear();
+    qint64 length() const { return m_times.isEmpty() ? 0 : m_times.last(); }   //!< Returns the time of the last frame
+
+    QVector<uint64_t> bulbs() const override { return m_bulbs; }
+    int frameCount() const override { return m_times.size(); }
+    qint64 frameTime(int frame) const override { return m_times[frame]; }
+    int readFrame(int frame, LifxShowRecord *records) override;
+    const QVector<LifxShowRecord>& frame(int frame) const { return m_frames[frame]; }    //!< Returns the records of frame
+
+private:
+    LifxShowRecord& record(qint64 msecs, int bulb);
+
+    QVector<uint64_t> m_bulbs;                  //!< Bulb table
+    QHash<uint64_t, int> m_bulbIndex;           //!< Bulb MAC to index in m_bulbs
+    QVector<qint64> m_times;                    //!< Frame times, ascending
+    QVector<QVector<LifxShowRecord>> m_frames;  //!< Records for the frame at the same index in m_times
+};
+
+#endif // LIFXSHOW_H
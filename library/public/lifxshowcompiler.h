@@ -0,0 +1,169 @@
+/*
+ * Compiles designer cue lists into show files
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXSHOWCOMPILER_H
+#define LIFXSHOWCOMPILER_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+#include "lifxshow.h"
+
+class LifxManager;
+
+/**
+ * \struct LifxCue
+ * One line of a cue list
+ */
+struct LifxCue {
+    qint64 time = 0;            //!< Millis from the start of the show
+    QString target;             //!< Group name, bulb label, MAC, or * for every bulb
+    bool hasColor = false;      //!< The cue sets a color
+    HSBK color;                 //!< Color, if hasColor
+    uint32_t fade = 0;          //!< Millis to fade to color over
+    int power = -1;             //!< 1 for on, 0 for off, -1 to leave alone
+    int line = 0;               //!< Line or entry number in the cue list, for the report
+};
+
+/**
+ * \struct LifxShowIssue
+ * Something the compiler had to change or couldn't do
+ */
+struct LifxShowIssue {
+    /**
+     * \enum Kind
+     * What went wrong
+     */
+    enum Kind {
+        Unresolved,     /**< The cue's target or color is unknown, it was left out */
+        Postponed,      /**< The bulb's rate limit moved the change later */
+        Dropped,        /**< The bulb's rate limit left no room before the next change */
+        OverBudget,     /**< The frame has more messages than the frame budget */
+    };
+
+    Kind kind;              //!< What went wrong
+    int line;               //!< Cue list line, 0 for a whole frame
+    qint64 time;            //!< Show time in millis
+    QString message;        //!< Readable description
+};
+
+/**
+ * \struct LifxShowCompileStats
+ * What compile() did
+ */
+struct LifxShowCompileStats {
+    int cues = 0;           //!< Cues read
+    int unresolved = 0;     //!< Cues left out
+    int changes = 0;        //!< Per bulb changes after expanding groups and labels
+    int faded = 0;          //!< Changes folded into a single fade
+    int postponed = 0;      //!< Changes moved by the rate limit
+    int dropped = 0;        //!< Changes lost to the rate limit
+    int frames = 0;         //!< Frames in the show
+    int messages = 0;       //!< Messages the show sends
+    int overBudget = 0;     //!< Frames over the frame budget
+};
+
+/**
+ * \class LifxShowCompiler
+ * \brief (PUBLIC) Turns a cue list into a LifxShow, ready for LifxShowFile::write()
+ *
+ * Cue lists name bulbs the way a designer sees them, by group or label,
+ * so they are resolved against a fleet cache: a JSON file listing each
+ * bulb's MAC, label and group, written by saveFleetCache() from a
+ * manager that has finished discovery. Nothing is sent while compiling.
+ *
+ * Then, per bulb:
+ * - a run of changes stepping along a straight line, like a fade drawn
+ *   as a cue every 50 millis, becomes one SET_COLOR with the run's
+ *   duration, the bulb does the fade itself
+ * - changes closer together than the rate limit allows are moved later,
+ *   keeping the time the fade ends, or dropped if the next change gets
+ *   there first
+ *
+ * Changes are grouped into frames on a resolution() grid. Anything the
+ * compiler changed, and every frame that sends more than frameBudget()
+ * messages at once, is listed in issues().
+ */
+class LifxShowCompiler
+{
+public:
+    LifxShowCompiler();
+
+    bool loadFleetCache(const QString &path);
+    static bool saveFleetCache(LifxManager *manager, const QString &path);
+    void addBulb(uint64_t target, const QString &label, const QString &group);
+    int bulbCount() const { return m_targets.size(); }                  //!< Returns the bulbs in the fleet cache
+
+    bool loadCues(const QString &path);
+    void addCue(const LifxCue &cue) { m_cues.append(cue); }             //!< Adds a cue made in code
+    const QVector<LifxCue>& cues() const { return m_cues; }             //!< Returns the cues read so far
+
+    void setRateLimit(int messagesPerSecond) { m_rateLimit = qMax(messagesPerSecond, 0); }  //!< Sets the most messages a second one bulb is sent, 0 for no limit
+    int rateLimit() const { return m_rateLimit; }                       //!< Returns the most messages a second one bulb is sent
+    void setFrameBudget(int messages) { m_frameBudget = qMax(messages, 0); }                //!< Sets the most messages one frame should send, 0 to not check
+    int frameBudget() const { return m_frameBudget; }                   //!< Returns the most messages one frame should send
+    void setResolution(int msecs) { m_resolution = qMax(msecs, 1); }    //!< Sets the grid in millis changes are rounded to
+    int resolution() const { return m_resolution; }                     //!< Returns the grid in millis changes are rounded to
+    void setFadeTolerance(int tolerance) { m_tolerance = qMax(tolerance, 0); }  //!< Sets how far off a straight line a step may be and still join a fade
+    int fadeTolerance() const { return m_tolerance; }                   //!< Returns how far off a straight line a step may be
+
+    bool compile(LifxShow &show);
+    const QVector<LifxShowIssue>& issues() const { return m_issues; }   //!< Returns what the last compile() changed or left out
+    LifxShowCompileStats stats() const { return m_stats; }              //!< Returns counts from the last compile()
+
+private:
+    /**
+     * \struct Change
+     * One cue as it applies to one bulb
+     */
+    struct Change {
+        qint64 time;            //!< Millis from the start of the show
+        bool color;             //!< Sets a color
+        lx_hsbk_t hsbk;         //!< Color, if color
+        uint32_t fade;          //!< Fade in millis, if color
+        int power;              //!< 1 on, 0 off, -1 unchanged
+        int line;               //!< Cue list line
+    };
+
+    bool parseCsv(QFile &file);
+    bool parseJson(const QByteArray &data);
+    bool parseColor(const QString &text, HSBK &color) const;
+    QVector<int> resolve(const QString &target) const;
+    void foldFades(QVector<Change> &changes);
+    void limitRate(int bulb, QVector<Change> &changes);
+    bool onLine(const lx_hsbk_t &from, const lx_hsbk_t &to, const lx_hsbk_t &at, double fraction) const;
+    void issue(LifxShowIssue::Kind kind, int line, qint64 time, const QString &message);
+
+    QVector<uint64_t> m_targets;                //!< Bulb MACs in the fleet cache
+    QVector<QString> m_labels;                  //!< Label per bulb
+    QMultiHash<QString, int> m_byLabel;         //!< Lower case label to bulb
+    QMultiHash<QString, int> m_byGroup;         //!< Lower case group name to bulb
+    QHash<uint64_t, int> m_byTarget;            //!< MAC to bulb
+    QVector<LifxCue> m_cues;                    //!< Cue list
+    int m_rateLimit;                            //!< Messages a second per bulb
+    int m_frameBudget;                          //!< Messages per frame
+    int m_resolution;                           //!< Frame grid in millis
+    int m_tolerance;                            //!< Fade fit tolerance per HSBK field
+    QVector<LifxShowIssue> m_loadIssues;        //!< Cues loadCues() had to leave out
+    QVector<LifxShowIssue> m_issues;            //!< Report from the last compile()
+    LifxShowCompileStats m_stats;               //!< Counts from the last compile()
+};
+
+#endif // LIFXSHOWCOMPILER_H
@@ -0,0 +1,107 @@
+/*
+ * Pre-rendered shows in a memory mapped file
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXSHOWFILE_H
+#define LIFXSHOWFILE_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "lifxshow.h"
+
+/**
+ * \class LifxShowFile
+ * \brief (PUBLIC) A show played straight out of a memory mapped file
+ *
+ * The file is little endian, and laid out as
+ *
+ * - a 64 byte header: "LXSH", version, counts and section offsets
+ * - the bulb table, one 64bit MAC per bulb
+ * - the frame data
+ * - the frame table, 16 bytes per frame: data offset, time in millis
+ *   and record count
+ * - the keyframe index, the frame number of each keyframe
+ * - the keyframe states, every bulb's color and duration as they were
+ *   just before each keyframe
+ *
+ * A frame is its records in bulb order. Each record is the gap since
+ * the last bulb as a varint, a tag byte with the LifxShowRecord flags
+ * in the low 3 bits and a bit for each of hue, saturation, brightness,
+ * kelvin and duration that changed since that bulb's last record, then
+ * the changed values: zigzag varint deltas for the colors, a varint for
+ * the duration. A bulb fading one field costs 3 or 4 bytes.
+ *
+ * open() maps the file and checks the tables once, after that
+ * readFrame() only decodes, into per bulb state that was allocated by
+ * open(). Reading in order decodes each frame once. Any other read
+ * binary searches the keyframe index and decodes forward from the
+ * nearest keyframe, at most keyframeInterval() frames. Memory use is
+ * the bulb state plus whatever pages the kernel keeps mapped, no matter
+ * how long the show is.
+ */
+class LifxShowFile : public LifxShowSource
+{
+public:
+    static constexpr quint32 MAGIC = 0x4853584c;        //!< "LXSH" at the start of the file
+    static constexpr quint16 VERSION = 1;               //!< File format version
+    static constexpr int HEADER_SIZE = 64;              //!< Bytes in the header
+    static constexpr int FRAME_ENTRY_SIZE = 16;         //!< Bytes per frame table entry
+    static constexpr int STATE_SIZE = 12;               //!< Bytes per bulb in a keyframe state
+    static constexpr int MAX_BULBS = 65535;             //!< Most bulbs in a show, a frame's record count is 16 bits
+
+    LifxShowFile();
+    ~LifxShowFile();
+
+    bool open(const QString &path);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }                   //!< Returns true if a show is mapped
+    int keyframeInterval() const { return m_keyframeInterval; }         //!< Returns the most frames between keyframes
+    qint64 length() const { return m_frameCount ? frameTime(m_frameCount - 1) : 0; }   //!< Returns the time of the last frame
+
+    QVector<uint64_t> bulbs() const override { return m_bulbs; }
+    int frameCount() const override { return m_frameCount; }
+    qint64 frameTime(int frame) const override;
+    int readFrame(int frame, LifxShowRecord *records) override;
+
+    static bool write(const QString &path, LifxShowSource *show, int keyframeInterval = 100);
+
+private:
+    Q_DISABLE_COPY(LifxShowFile)
+    int decode(int frame, LifxShowRecord *records);
+    int keyframeFor(int frame) const;
+    void restore(int keyframe);
+
+    QFile m_file;                       //!< The open show
+    const uchar *m_data;                //!< Start of the mapping
+    qint64 m_size;                      //!< Bytes mapped
+    int m_frameCount;                   //!< Frames in the show
+    int m_keyframeCount;                //!< Entries in the keyframe index
+    int m_keyframeInterval;             //!< Most frames between keyframes, from the header
+    const uchar *m_frames;              //!< Frame table
+    const uchar *m_keyframes;           //!< Keyframe index
+    const uchar *m_states;              //!< Keyframe states
+    const uchar *m_records;             //!< Frame data
+    qint64 m_recordsSize;               //!< Bytes of frame data
+    QVector<uint64_t> m_bulbs;          //!< Bulb table
+    QVector<lx_hsbk_t> m_color;         //!< Each bulb's last color, while decoding
+    QVector<uint32_t> m_duration;       //!< Each bulb's last duration, while decoding
+    int m_next;                         //!< Frame the decoder state is ready for
+};
+
+#endif // LIFXSHOWFILE_H
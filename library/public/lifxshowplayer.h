@@ -0,0 +1,176 @@
+/*
+ * Plays a show on a thread of its own, to the millisecond
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXSHOWPLAYER_H
+#define LIFXSHOWPLAYER_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "lifxshow.h"
+
+#include <atomic>
+#include <thread>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#endif
+
+class LifxManager;
+
+/**
+ * \struct LifxJitterHistogram
+ * How late frames went out, in microseconds
+ *
+ * Bucket 0 counts frames up to 1us late, bucket i those more than
+ * 2^(i-1) and up to 2^i us late, the last bucket everything later.
+ */
+struct LifxJitterHistogram {
+    static constexpr int BUCKETS = 22;      //!< Up to about 2 seconds late
+
+    quint64 buckets[BUCKETS] = {};          //!< Frames per bucket
+    quint64 frames = 0;                     //!< Frames measured
+    qint64 worst = 0;                       //!< Latest frame
+    qint64 total = 0;                       //!< Sum of every lateness, for the mean
+
+    qint64 mean() const { return frames ? total / static_cast<qint64>(frames) : 0; }     //!< Returns the mean lateness
+    qint64 percentile(double fraction) const;
+    static qint64 bucketLimit(int bucket) { return static_cast<qint64>(1) << bucket; }           //!< Returns the most lateness counted in bucket
+    static int bucketFor(qint64 usecs);
+};
+
+/**
+ * \class LifxShowPlayer
+ * \brief (PUBLIC) Sends the frames of a LifxShowSource at their times
+ *
+ * QTimer is only as good as the event loop, so a busy GUI thread makes
+ * a show stutter by tens of millis. The player runs a thread of its own
+ * which sleeps to each frame's absolute deadline with clock_nanosleep()
+ * on CLOCK_MONOTONIC, so errors don't add up over a long show. Each frame
+ * is read and encoded before the deadline, then goes out with one
+ * sendmmsg() on the manager's socket.
+ *
+ * A frame that wakes up more than maxLateness() after its deadline is
+ * never sent late. With Drop it is thrown away, with Merge its changes
+ * are folded into the next frame that makes its deadline, so a bulb
+ * still ends up where the show says. Every frame's lateness goes into
+ * jitter(), and jitterPublished() is emitted about once a second.
+ *
+ * Packets skip the manager entirely and no reply is asked for. The
+ * bulbs' confirmed color and power are forgotten when the show starts
+ * and ends, so a scene or the reconciler sends afterwards rather than
+ * trusting what the bulbs said before the show. Their stored color is
+ * not updated, call LifxManager::updateState() afterwards if that
+ * matters. Bulbs are looked up when start() is
+ * called, those the manager doesn't know yet are left out. On systems
+ * other than Linux the frames go through LifxManager::submit() instead,
+ * with the same timing on the player thread.
+ */
+class Q_DECL_EXPORT LifxShowPlayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * \enum LatePolicy
+     * What happens to a frame that missed its deadline
+     */
+    enum LatePolicy {
+        Drop,       /**< The frame is not sent */
+        Merge,      /**< The frame is sent along with the next one */
+    };
+
+    LifxShowPlayer(LifxManager *manager, QObject *parent = nullptr);
+    ~LifxShowPlayer();
+
+    bool start(LifxShowSource *show, qint64 from = 0);
+    void stop();
+    bool isPlaying() const { return m_playing.load(); }                    //!< Returns true while the player thread is running
+
+    void setLatePolicy(LatePolicy policy) { m_policy = policy; }            //!< Sets what happens to late frames, takes effect on the next start()
+    LatePolicy latePolicy() const { return m_policy; }                      //!< Returns what happens to late frames
+    void setMaxLateness(int usecs) { m_maxLateness = qMax(usecs, 0); }      //!< Sets how late a frame may be and still be sent, takes effect on the next start()
+    int maxLateness() const { return m_maxLateness; }                       //!< Returns how late in micros a frame may be and still be sent
+    void setSource(int source) { m_source = source; }                       //!< Sets the source field of the packets, takes effect on the next start()
+    void setRealtimePriority(int priority) { m_priority = priority; }       //!< Runs the player thread SCHED_FIFO at priority if more than 0, needs the privilege
+
+    qint64 position() const { return m_position.load(std::memory_order_relaxed); }     //!< Returns the time of the last frame reached, safe from any thread
+    quint64 framesSent() const { return m_framesSent.load(std::memory_order_relaxed); }        //!< Returns frames sent on time
+    quint64 framesDropped() const { return m_framesDropped.load(std::memory_order_relaxed); }  //!< Returns late frames thrown away
+    quint64 framesMerged() const { return m_framesMerged.load(std::memory_order_relaxed); }    //!< Returns late frames folded into a later one
+    quint64 datagramsSent() const { return m_datagrams.load(std::memory_order_relaxed); }      //!< Returns packets the socket took
+    LifxJitterHistogram jitter() const;
+    void resetJitter();
+
+signals:
+    void jitterPublished();
+    void finished();
+
+private slots:
+    void forgetState();
+
+private:
+    void run(qint64 from);
+    void sleepUntil(qint64 deadline);
+    void gather(const LifxShowRecord *records, int count);
+    int dispatch();
+    void record(qint64 lateness);
+    static qint64 monotonicNanos();
+
+    static constexpr int COLOR_SIZE = sizeof(lx_protocol_header_t) + sizeof(lx_dev_color_t);    //!< Bytes in a SET_COLOR datagram
+    static constexpr int POWER_SIZE = sizeof(lx_protocol_header_t) + sizeof(uint16_t);          //!< Bytes in a SET_POWER datagram
+
+    LifxManager *m_manager;             //!< Owner of the socket and the bulbs
+    LifxShowSource *m_show;             //!< Show being played
+    std::thread m_thread;               //!< Player thread
+    std::atomic<bool> m_playing;        //!< Player thread is running
+    std::atomic<bool> m_stop;           //!< Asks the player thread to stop
+    LatePolicy m_policy;                //!< What happens to late frames
+    int m_maxLateness;                  //!< Micros a frame may be late
+    int m_source;                       //!< Packet source field
+    int m_priority;                     //!< SCHED_FIFO priority, 0 to leave the thread alone
+
+    QVector<uint64_t> m_targets;        //!< Bulb MAC per show bulb
+    QVector<bool> m_resolved;           //!< Show bulb has an address
+    QByteArray m_colorPackets;          //!< One SET_COLOR per show bulb, patched in place each frame
+    QByteArray m_powerPackets;          //!< One SET_POWER per show bulb, patched in place each frame
+    QVector<quint8> m_pending;          //!< LifxShowRecord flags waiting to go per show bulb
+    QVector<int> m_pendingBulbs;        //!< Show bulbs with pending flags, in the order they were added
+    int m_pendingCount;                 //!< Used entries in m_pendingBulbs
+    QVector<LifxShowRecord> m_records;  //!< Frame being read
+#ifdef Q_OS_LINUX
+    int m_fd;                               //!< Manager's socket
+    QVector<sockaddr_storage> m_addresses;  //!< Address per show bulb
+    QVector<socklen_t> m_addressLengths;    //!< Length of each of m_addresses
+    QVector<iovec> m_vectors;               //!< Color then power buffer per show bulb
+    QVector<mmsghdr> m_messages;            //!< Messages for one sendmmsg(), two per show bulb at most
+#endif
+
+    std::atomic<qint64> m_position;
+    std::atomic<quint64> m_framesSent;
+    std::atomic<quint64> m_framesDropped;
+    std::atomic<quint64> m_framesMerged;
+    std::atomic<quint64> m_datagrams;
+    std::atomic<quint64> m_buckets[LifxJitterHistogram::BUCKETS];  //!< Lateness histogram, written only by the player thread
+    std::atomic<quint64> m_jitterFrames;
+    std::atomic<qint64> m_worst;
+    std::atomic<qint64> m_total;
+};
+
+#endif // LIFXSHOWPLAYER_H
@@ -0,0 +1,59 @@
+/*
+ * Picks the SIMD level every kernel table in the library uses
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXSIMD_H
+#define LIFXSIMD_H
+
+#include <QtCore/QtCore>
+
+/**
+ * \def LIFX_X86_KERNELS
+ * Defined where the SSE4.1 and AVX2 kernels can be built, x86 with GCC
+ * or Clang. Include immintrin.h under it.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LIFX_X86_KERNELS
+#endif
+
+/**
+ * \class LifxSimd
+ * \brief (PRIVATE) The one place the CPU is checked for SIMD support
+ *
+ * The color conversion, transition engine and audio analyzer kernels
+ * all pick their variant from level(), so QTLIFX_NO_SIMD and the CPU
+ * checks mean the same thing everywhere. The answer is worked out once.
+ */
+class LifxSimd
+{
+public:
+    /**
+     * \enum Level
+     * The widest kernels that may be used
+     */
+    enum Level {
+        Scalar,     /**< Plain C++, also forced by QTLIFX_NO_SIMD in the environment */
+        Sse41,      /**< SSE4.1 */
+        Avx2,       /**< AVX2 */
+    };
+
+    static Level level();
+    static const char* name(Level level);
+};
+
+#endif // LIFXSIMD_H
@@ -0,0 +1,89 @@
+/*
+ * Immutable copy of the fleet state for other threads to read
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXSNAPSHOT_H
+#define LIFXSNAPSHOT_H
+
+#include <QtCore/QtCore>
+
+#include "lifxfleet.h"
+#include "lifxbitmap.h"
+
+/**
+ * \struct LifxSnapshotGroup
+ * A group as it was when the snapshot was published
+ */
+struct LifxSnapshotGroup {
+    QString label;          /**< Group name */
+    QByteArray uuid;        /**< Group UUID */
+    LifxBitmap rows;        /**< Fleet rows of the bulbs in the group */
+};
+
+/**
+ * \class LifxSnapshot
+ * \brief (PUBLIC) The state of every bulb, group and product at one point in time
+ *
+ * A snapshot holds a copy of the LifxFleet columns, plus the per bulb
+ * details which don't live in the fleet (label, group, product). Rows
+ * are the same as in the fleet. Once published a snapshot never changes,
+ * so it can be read from any thread without locking.
+ *
+ * The copies are Qt implicitly shared, so publishing costs a reference
+ * count per column. The manager thread pays for the copy instead, the
+ * first time it writes to a column after publishing.
+ *
+ * Get one from LifxManager::snapshot(), and let the handle go when done.
+ */
+class LifxSnapshot
+{
+public:
+    LifxSnapshot();
+    ~LifxSnapshot();
+
+    quint64 generation() const { return m_generation; }     //!< Returns a number which goes up by one with every published snapshot
+    qint64 published() const { return m_published; }        //!< Returns when this was published, on the fleet clock
+    const LifxFleet& fleet() const { return m_fleet; }      //!< Returns the fleet columns, use with LifxQuery::evaluate() or the column accessors
+    int size() const { return m_fleet.size(); }             //!< Returns the number of bulbs
+
+    QString label(int row) const { return row < m_labels.size() ? m_labels[row] : QString(); }                //!< Returns the bulb label
+    QString group(int row) const { return row < m_groupLabels.size() ? m_groupLabels[row] : QString(); }      //!< Returns the label of the group the bulb is in
+    int pid(int row) const { return row < m_pids.size() ? m_pids[row] : 0; }                                  //!< Returns the product ID
+    QString productName(int row) const { return row < m_productNames.size() ? m_productNames[row] : QString(); }  //!< Returns the product name from products.json
+    const QVector<LifxSnapshotGroup>& groups() const { return m_groups; }   //!< Returns every group
+
+    void setLabel(int row, const QString &label);
+    void setGroup(int row, const QString &label);
+    void setProduct(int row, int pid, const QString &name);
+    void setGroups(const QVector<LifxSnapshotGroup> &groups) { m_groups = groups; }     //!< Replaces the group list
+    void setFleet(const LifxFleet &fleet, quint64 generation);
+
+private:
+    void ensureRow(int row);
+
+    quint64 m_generation;                   //!< Publish counter
+    qint64 m_published;                     //!< Fleet clock time of publishing
+    LifxFleet m_fleet;                      //!< Copy of the fleet columns
+    QVector<QString> m_labels;              //!< Bulb label for each row
+    QVector<QString> m_groupLabels;         //!< Group label for each row
+    QVector<int> m_pids;                    //!< Product ID for each row
+    QVector<QString> m_productNames;        //!< Product name for each row
+    QVector<LifxSnapshotGroup> m_groups;    //!< The groups
+};
+
+#endif // LIFXSNAPSHOT_H
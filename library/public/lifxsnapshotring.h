@@ -0,0 +1,104 @@
+/*
+ * Publishes fleet snapshots to reader threads without locking
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXSNAPSHOTRING_H
+#define LIFXSNAPSHOTRING_H
+
+#include <QtCore/QtCore>
+#include <atomic>
+
+#include "lifxsnapshot.h"
+
+/**
+ * \class LifxSnapshotHandle
+ * \brief (PUBLIC) Keeps a published LifxSnapshot alive while it is read
+ *
+ * The snapshot can't be reused for a newer one until the handle is
+ * destroyed or release() is called, so keep handles short lived. A
+ * handle can be moved, but not copied.
+ */
+class LifxSnapshotHandle
+{
+public:
+    LifxSnapshotHandle();
+    LifxSnapshotHandle(LifxSnapshotHandle &&other);
+    LifxSnapshotHandle& operator=(LifxSnapshotHandle &&other);
+    ~LifxSnapshotHandle();
+
+    bool isNull() const { return m_snapshot == nullptr; }               //!< Returns true if the handle doesn't hold a snapshot
+    const LifxSnapshot* data() const { return m_snapshot; }             //!< Returns the snapshot
+    const LifxSnapshot* operator->() const { return m_snapshot; }       //!< Returns the snapshot
+    const LifxSnapshot& operator*() const { return *m_snapshot; }       //!< Returns the snapshot
+    void release();
+
+private:
+    friend class LifxSnapshotRing;
+    Q_DISABLE_COPY(LifxSnapshotHandle)
+    LifxSnapshotHandle(const LifxSnapshot *snapshot, std::atomic<int> *readers);
+
+    const LifxSnapshot *m_snapshot;     //!< The held snapshot
+    std::atomic<int> *m_readers;        //!< Reader count of the slot holding m_snapshot
+};
+
+/**
+ * \class LifxSnapshotRing
+ * \brief (PUBLIC) A small ring of snapshots, one of which is current
+ *
+ * One thread publishes and any number of threads acquire. Readers never
+ * lock or wait: they bump the reader count of the current slot and check
+ * it is still current, retrying if a publish got in between. The
+ * publisher fills a slot nobody is reading and then makes it current.
+ * If every other slot is still being read, publish() gives up and the
+ * caller tries again later, readers keep seeing the previous snapshot.
+ *
+ * The reader count and the current slot are sequentially consistent
+ * atomics. A reader's increment followed by its check of the current
+ * slot, and the publisher's switch of the current slot followed by its
+ * check of the reader count, must not be reordered or both sides could
+ * decide the same slot is theirs.
+ */
+class LifxSnapshotRing
+{
+public:
+    LifxSnapshotRing();
+    ~LifxSnapshotRing();
+
+    LifxSnapshotHandle acquire() const;
+    bool publish(const LifxSnapshot &staging, const LifxFleet &fleet);
+    quint64 generation() const { return m_generation; }     //!< Returns the generation of the last publish, only meaningful on the publishing thread
+
+private:
+    Q_DISABLE_COPY(LifxSnapshotRing)
+    static const int SLOTS = 4;     //!< One current, the rest for readers that are slow to let go
+
+    /**
+     * \struct Slot
+     * A snapshot and the number of handles holding it
+     */
+    struct Slot {
+        LifxSnapshot snapshot;
+        mutable std::atomic<int> readers;
+    };
+
+    Slot m_slots[SLOTS];            //!< The snapshots
+    std::atomic<int> m_current;     //!< Index of the current slot
+    quint64 m_generation;           //!< Publish counter
+};
+
+#endif // LIFXSNAPSHOTRING_H
@@ -0,0 +1,133 @@
+/*
+ * Host side fades for bulbs and zones
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXTRANSITIONENGINE_H
+#define LIFXTRANSITIONENGINE_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+#include "lifxcommandbatch.h"
+
+class LifxManager;
+class LifxBulb;
+class LifxScene;
+
+/**
+ * \struct LifxTransitionStats
+ * What the transition engine has been doing
+ */
+struct LifxTransitionStats {
+    quint64 frames = 0;         //!< Frames run
+    quint64 colors = 0;         //!< Bulb and zone colors interpolated
+    int active = 0;             //!< Fades running now
+    qint64 lastFrame = 0;       //!< Nanoseconds the last frame took, interpolation and handing off to the manager
+    qint64 maxFrame = 0;        //!< Longest frame in nanoseconds
+    qint64 meanFrame = 0;       //!< Mean frame in nanoseconds
+};
+
+/**
+ * \class LifxTransitionEngine
+ * \brief (PUBLIC) Fades bulbs and zones from the host, a frame at a time
+ *
+ * The bulbs fade on their own, but only from whatever they show now, and
+ * a strip fades every zone over the same time. The engine does the fades
+ * the bulbs can't: a cross fade between scenes, zones each with their
+ * own target, and hue that always takes the short way across 0/65535.
+ *
+ * Every fade's start and end colors sit in two contiguous arrays. Each
+ * frame gets the fraction done per slot, then interpolates the whole
+ * array at once, with SSE4.1 or AVX2 when the CPU has them (see
+ * interpolate()). The results go out in one LifxCommandBatch for whole
+ * bulbs, and through LifxBulb::zones() and LifxManager::changeBulbZones()
+ * for strips. Each is sent with a duration of one frame, so the bulb
+ * smooths between frames.
+ *
+ * Starting a fade on a bulb which is already fading replaces the old
+ * one, starting from wherever it had got to. The engine runs on the
+ * manager's thread.
+ */
+class Q_DECL_EXPORT LifxTransitionEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DEFAULT_FRAME_RATE = 30;       //!< Frames a second unless setFrameRate() is called
+    static constexpr int WEIGHT_ONE = 1 << 15;          //!< interpolate() weight which gives the end color
+
+    LifxTransitionEngine(LifxManager *manager, QObject *parent = nullptr);
+    ~LifxTransitionEngine();
+
+    void setFrameRate(int fps);
+    int frameRate() const { return m_fps; }                             //!< Returns frames a second
+
+    void fade(LifxBulb *bulb, const HSBK &to, int msecs);
+    void fade(LifxBulb *bulb, const HSBK &from, const HSBK &to, int msecs);
+    void fadeZones(LifxBulb *bulb, const lx_hsbk_t *to, int count, int msecs);
+    void crossFade(const LifxScene &scene, int msecs);
+    void cancel(LifxBulb *bulb);
+    void cancel();
+    bool isFading(LifxBulb *bulb) const;
+    int activeCount() const { return m_runs.size(); }                   //!< Returns the number of fades running
+
+    LifxTransitionStats stats() const;
+    void resetStats();
+
+    static void interpolate(const lx_hsbk_t *from, const lx_hsbk_t *to, const uint16_t *weights, lx_hsbk_t *out, int count);
+    static QString interpolationKernel();
+
+signals:
+    void fadeFinished(LifxBulb *bulb);
+
+private slots:
+    void frame();
+
+private:
+    /**
+     * \struct Run
+     * One fade, over count slots starting at first
+     */
+    struct Run {
+        LifxBulb *bulb;         //!< Bulb being faded, nullptr once finished or cancelled
+        int first;              //!< First slot
+        int count;              //!< Slots, 1 for a bulb, the zone count for a strip
+        bool zones;             //!< Fades the bulb's zones rather than its color
+        qint64 start;           //!< m_clock millis the fade started
+        int length;             //!< Millis the fade lasts
+    };
+
+    int begin(LifxBulb *bulb, int count, bool zones, int msecs);
+    void compact();
+
+    LifxManager *m_manager;             //!< Sends the frames
+    QTimer *m_timer;                    //!< Frame timer, runs only while there are fades
+    QElapsedTimer m_clock;              //!< Time base for the fades
+    int m_fps;                          //!< Frames a second
+    QVector<Run> m_runs;                //!< Fades running
+    QVector<lx_hsbk_t> m_from;          //!< Start color per slot
+    QVector<lx_hsbk_t> m_to;            //!< End color per slot
+    QVector<lx_hsbk_t> m_out;           //!< This frame's color per slot
+    QVector<uint16_t> m_weights;        //!< This frame's fraction done per slot, out of WEIGHT_ONE
+    LifxCommandBatch m_batch;           //!< Whole bulb colors for this frame
+    LifxTransitionStats m_stats;        //!< Counts
+    qint64 m_totalNanos;                //!< Sum of every frame time, for the mean
+};
+
+#endif // LIFXTRANSITIONENGINE_H
@@ -0,0 +1,115 @@
+/*
+ * LIFX waveform effect description and host side model
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIFXWAVEFORM_H
+#define LIFXWAVEFORM_H
+
+#include <QtCore/QtCore>
+
+#include "defines.h"
+#include "hsbk.h"
+
+/**
+ * \class LifxWaveform
+ * \brief (PUBLIC) Describes a SET_WAVEFORM effect and models it on the host
+ *
+ * The bulbs can run pulses, breathes and strobes on their own when given
+ * a SET_WAVEFORM (or SET_WAVEFORM_OPTIONAL) message. This means one packet
+ * per bulb per effect instead of streaming SET_COLOR messages at the bulb.
+ *
+ * Because the bulb does the work, we never hear about the intermediate
+ * colors. This class runs the same curve locally once it has been started
+ * so the LifxBulb can report what the bulb should be showing at any
+ * point in time without polling it.
+ *
+ * If any of the hue, saturation, brightness or kelvin fields are turned
+ * off with setOptional(), the SET_WAVEFORM_OPTIONAL message is used and
+ * the bulb keeps its current value for those fields.
+ */
+class LifxWaveform
+{
+public:
+    /**
+     * \enum Waveform
+     * The curve the bulb follows between the original and the new color.
+     * The numeric values are the ones used on the wire.
+     */
+    enum Waveform {
+        Saw = 0,        /**< Ramp to the new color, then jump back */
+        Sine = 1,       /**< Smoothly to the new color and back */
+        HalfSine = 2,   /**< Half a sine wave to the new color and back */
+        Triangle = 3,   /**< Linear to the new color and back */
+        Pulse = 4,      /**< Switch between the two colors, skew sets the duty cycle */
+    };
+
+    LifxWaveform(HSBK color = HSBK(), Waveform waveform = Sine, uint32_t period = 1000, float cycles = 1, bool transient = true, int16_t skew = 0);
+    ~LifxWaveform();
+
+    static LifxWaveform pulse(HSBK color, uint32_t period = 1000, float cycles = 1);
+    static LifxWaveform breathe(HSBK color, uint32_t period = 1000, float cycles = 1);
+    static LifxWaveform strobe(HSBK color, uint32_t period = 100, float cycles = 10);
+
+    void setColor(HSBK color) { m_color = color.getHSBK(); }             //!< The color the waveform moves towards
+    void setWaveform(Waveform waveform) { m_waveform = waveform; }       //!< The curve to follow
+    void setPeriod(uint32_t period) { m_period = period; }               //!< Length of a single cycle in millis
+    void setCycles(float cycles) { m_cycles = cycles; }                  //!< Number of cycles to run, may be fractional
+    void setTransient(bool transient) { m_transient = transient; }       //!< If true, the bulb returns to the original color when done
+    void setSkewRatio(int16_t skew) { m_skew = skew; }                   //!< Shifts the peak of the curve, or the duty cycle for a Pulse
+    void setOptional(bool hue, bool saturation, bool brightness, bool kelvin);
+
+    HSBK color() const;
+    Waveform waveform() const { return m_waveform; }        //!< Returns the curve type
+    uint32_t period() const { return m_period; }            //!< Returns the period in millis
+    float cycles() const { return m_cycles; }               //!< Returns the number of cycles
+    bool transient() const { return m_transient; }          //!< Returns true if the original color is restored at the end
+    int16_t skewRatio() const { return m_skew; }            //!< Returns the raw skew ratio as sent to the bulb
+    bool isOptional() const;
+    qint64 length() const;
+
+    void start(const lx_dev_color_t &origin);
+    void stop();
+    bool isActive() const;
+    lx_dev_color_t colorAt(qint64 elapsed) const;
+    lx_dev_color_t currentColor() const;
+    lx_dev_color_t finalColor() const;
+
+    lx_dev_waveform_t toDeviceWaveform() const;
+    lx_dev_waveform_optional_t toDeviceWaveformOptional() const;
+
+private:
+    float curve(float phase) const;
+    lx_dev_color_t target() const;
+
+    lx_dev_color_t m_color;         //!< The color the waveform moves towards
+    lx_dev_color_t m_origin;        //!< The color the bulb was showing when the waveform started
+    Waveform m_waveform;            //!< The curve type
+    uint32_t m_period;              //!< Millis per cycle
+    float m_cycles;                 //!< Number of cycles
+    bool m_transient;               //!< Return to m_origin when complete
+    int16_t m_skew;                 //!< Skew ratio, -32768 to 32767 where 0 is centered
+    bool m_setHue;                  //!< Hue is changed by this waveform
+    bool m_setSaturation;           //!< Saturation is changed by this waveform
+    bool m_setBrightness;           //!< Brightness is changed by this waveform
+    bool m_setKelvin;               //!< Kelvin is changed by this waveform
+    QElapsedTimer m_timer;          //!< Started when the waveform was sent to the bulb
+};
+
+QDebug operator<<(QDebug debug, const LifxWaveform &waveform);
+
+#endif // LIFXWAVEFORM_H
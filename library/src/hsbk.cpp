@@ -185,15 +185,15 @@ HSBK & HSBK::operator=(const HSBK& color)
 }
 
 /**
- * \fn QColor HSBK::getQColor()
+ * \fn QColor HSBK::getQColor() const
  * \return Returns a QColor representation of this object
  * 
  * Attempts to map an HSBK to a QColor
  */
-QColor HSBK::getQColor()
+QColor HSBK::getQColor() const
 {
     QColor c;
-    uint16_t max = std::numeric_limits<uint16_t>::max();
+    qreal max = std::numeric_limits<uint16_t>::max();
     
     c.setHsvF(m_hsbk.hue / max, m_hsbk.saturation / max, m_hsbk.brightness / max);
     return c;
@@ -220,25 +220,38 @@ uint16_t HSBK::b(float v)
     return m_hsbk.brightness;
 }
 
+/**
+ * \fn uint16_t HSBK::s(float v)
+ * \param v The saturation expressed as a percentage, between 0 and 1
+ * \return Returns the newly assigned saturation
+ */
+uint16_t HSBK::s(float v)
+{
+    if (v > 1)
+        v = 1;
+    if (v < 0)
+        v = 0;
+
+    m_hsbk.saturation = qRound(v * 65535.0f);
+    return m_hsbk.saturation;
+}
+
 /**
  * \fn uint16_t HSBK::h(float v)
  * \param v The 360 degree color wheel to convert from
  * \return Returns the new uint16_t h value after conversion
  * 
  * This takes the 360 degree color wheel and converts it to a full
- * uint16_t. I cheated and precalc'd the multiplier to make it easier
- * though it's to some extent an approximation.
+ * uint16_t, rounded to the nearest value, where 360 is 65535.
  */
 uint16_t HSBK::h(float v)
 {
-    float multiplier = 182.042;
-    
     if (v > 360.0)
         v = 0;
     if (v < 0.0)
         v = 0;
     
-    m_hsbk.hue = v * multiplier;
+    m_hsbk.hue = qRound(v * 65535.0f / 360.0f);
     return m_hsbk.hue;
 }
 
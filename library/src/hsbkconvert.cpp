@@ -0,0 +1,468 @@
+/*
+ * HSBK batch color conversion
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hsbk.h"
+#include "lifxsimd.h"
+
+#ifdef LIFX_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/*
+ * All of the kernels produce exactly the same output. The math is done in
+ * integers with round half up, hue is on a 0 to 65535 wheel where 65535
+ * is 360 degrees, and saturation and brightness are 0 to 65535.
+ *
+ * RGB to HSBK
+ *   B = max * 257
+ *   S = round(delta * 65535 / max)
+ *   H = round(N * 65535 / (6 * delta)), N being the position in sixths
+ *       of the wheel times delta
+ *
+ * HSBK to RGB is the usual sector/fraction HSV form, with every product
+ * scaled back to 16 bits with round(x / 65535).
+ *
+ * The SIMD kernels get the quotients for variable divisors from a float
+ * division, then correct them by one using the integer remainder, which
+ * is enough since the float estimate is never more than one off.
+ */
+namespace {
+
+typedef void (*RgbToHsbkKernel)(const lx_rgb8_t*, lx_hsbk_t*, int, uint16_t);
+typedef void (*HsbkToRgbKernel)(const lx_hsbk_t*, lx_rgb8_t*, int);
+
+/*
+ * round(x / 65535) for 0 <= x <= 65535 * 65535, without a divide
+ */
+inline uint32_t roundDiv65535(uint32_t x)
+{
+    x += 32767;
+    return (x + 1 + (x >> 16)) >> 16;
+}
+
+inline void rgbToHsbkPixel(const lx_rgb8_t &in, lx_hsbk_t &out, uint16_t kelvin)
+{
+    int32_t r = in.r;
+    int32_t g = in.g;
+    int32_t b = in.b;
+    int32_t mx = qMax(r, qMax(g, b));
+    int32_t mn = qMin(r, qMin(g, b));
+    int32_t delta = mx - mn;
+    int32_t n;
+
+    if (mx == r)
+        n = g - b + (g < b ? 6 * delta : 0);
+    else if (mx == g)
+        n = 2 * delta + b - r;
+    else
+        n = 4 * delta + r - g;
+
+    out.brightness = static_cast<uint16_t>(mx * 257);
+    out.saturation = static_cast<uint16_t>((delta * 131070 + mx) / qMax(2 * mx, 1));
+    out.hue = static_cast<uint16_t>((n * 131070 + 6 * delta) / qMax(12 * delta, 1));
+    out.kelvin = kelvin;
+}
+
+inline void hsbkToRgbPixel(const lx_hsbk_t &in, lx_rgb8_t &out)
+{
+    uint32_t h = in.hue;
+    uint32_t s = in.saturation;
+    uint32_t v = in.brightness;
+    uint32_t h6 = h * 6;
+    uint32_t sector = (h6 + 1 + (h6 >> 16)) >> 16;
+    uint32_t f = h6 - sector * 65535;
+
+    uint32_t p = roundDiv65535(v * (65535 - s));
+    uint32_t q = roundDiv65535(v * (65535 - roundDiv65535(s * f)));
+    uint32_t t = roundDiv65535(v * (65535 - roundDiv65535(s * (65535 - f))));
+
+    uint8_t v8 = static_cast<uint8_t>(roundDiv65535(v * 255));
+    uint8_t p8 = static_cast<uint8_t>(roundDiv65535(p * 255));
+    uint8_t q8 = static_cast<uint8_t>(roundDiv65535(q * 255));
+    uint8_t t8 = static_cast<uint8_t>(roundDiv65535(t * 255));
+
+    switch (sector) {
+        case 1: out.r = q8; out.g = v8; out.b = p8; break;
+        case 2: out.r = p8; out.g = v8; out.b = t8; break;
+        case 3: out.r = p8; out.g = q8; out.b = v8; break;
+        case 4: out.r = t8; out.g = p8; out.b = v8; break;
+        case 5: out.r = v8; out.g = p8; out.b = q8; break;
+        default: out.r = v8; out.g = t8; out.b = p8; break;
+    }
+}
+
+void rgbToHsbkScalar(const lx_rgb8_t *rgb, lx_hsbk_t *hsbk, int count, uint16_t kelvin)
+{
+    for (int i = 0; i < count; i++)
+        rgbToHsbkPixel(rgb[i], hsbk[i], kelvin);
+}
+
+void hsbkToRgbScalar(const lx_hsbk_t *hsbk, lx_rgb8_t *rgb, int count)
+{
+    for (int i = 0; i < count; i++)
+        hsbkToRgbPixel(hsbk[i], rgb[i]);
+}
+
+#ifdef LIFX_X86_KERNELS
+
+/*
+ * SSE4.1, 4 pixels at a time
+ */
+__attribute__((target("sse4.1")))
+inline __m128i divSse(__m128i num, __m128i den)
+{
+    __m128i q = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num), _mm_cvtepi32_ps(den)));
+    __m128i r = _mm_sub_epi32(num, _mm_mullo_epi32(q, den));
+
+    q = _mm_sub_epi32(q, _mm_cmpgt_epi32(r, _mm_sub_epi32(den, _mm_set1_epi32(1))));
+    q = _mm_add_epi32(q, _mm_cmplt_epi32(r, _mm_setzero_si128()));
+    return q;
+}
+
+__attribute__((target("sse4.1")))
+inline __m128i roundDiv65535Sse(__m128i x)
+{
+    x = _mm_add_epi32(x, _mm_set1_epi32(32767));
+    return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(x, _mm_set1_epi32(1)), _mm_srli_epi32(x, 16)), 16);
+}
+
+__attribute__((target("sse4.1")))
+void rgbToHsbkSse41(const lx_rgb8_t *rgb, lx_hsbk_t *hsbk, int count, uint16_t kelvin)
+{
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i k = _mm_set1_epi32(static_cast<int32_t>(kelvin) << 16);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(rgb + i);
+        int32_t last;
+        memcpy(&last, bytes + 8, 4);
+        __m128i px = _mm_insert_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(bytes)), last, 2);
+        px = _mm_shuffle_epi8(px, spread);
+
+        __m128i r = _mm_and_si128(px, byteMask);
+        __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), byteMask);
+        __m128i b = _mm_srli_epi32(px, 16);
+        __m128i mx = _mm_max_epi32(r, _mm_max_epi32(g, b));
+        __m128i mn = _mm_min_epi32(r, _mm_min_epi32(g, b));
+        __m128i delta = _mm_sub_epi32(mx, mn);
+        __m128i delta2 = _mm_add_epi32(delta, delta);
+        __m128i delta6 = _mm_add_epi32(delta2, _mm_add_epi32(delta2, delta2));
+
+        __m128i nr = _mm_add_epi32(_mm_sub_epi32(g, b), _mm_and_si128(_mm_cmplt_epi32(g, b), delta6));
+        __m128i ng = _mm_add_epi32(delta2, _mm_sub_epi32(b, r));
+        __m128i nb = _mm_add_epi32(_mm_add_epi32(delta2, delta2), _mm_sub_epi32(r, g));
+        __m128i isR = _mm_cmpeq_epi32(mx, r);
+        __m128i isG = _mm_cmpeq_epi32(mx, g);
+        __m128i n = _mm_blendv_epi8(_mm_blendv_epi8(nb, ng, isG), nr, isR);
+
+        __m128i bright = _mm_add_epi32(_mm_slli_epi32(mx, 8), mx);
+        __m128i sat = divSse(_mm_add_epi32(_mm_mullo_epi32(delta, _mm_set1_epi32(131070)), mx),
+                             _mm_max_epi32(_mm_add_epi32(mx, mx), one));
+        __m128i hue = divSse(_mm_add_epi32(_mm_mullo_epi32(n, _mm_set1_epi32(131070)), delta6),
+                             _mm_max_epi32(_mm_add_epi32(delta6, delta6), one));
+
+        __m128i hs = _mm_or_si128(hue, _mm_slli_epi32(sat, 16));
+        __m128i bk = _mm_or_si128(bright, k);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hsbk + i), _mm_unpacklo_epi32(hs, bk));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(hsbk + i + 2), _mm_unpackhi_epi32(hs, bk));
+    }
+    rgbToHsbkScalar(rgb + i, hsbk + i, count - i, kelvin);
+}
+
+__attribute__((target("sse4.1")))
+void hsbkToRgbSse41(const lx_hsbk_t *hsbk, lx_rgb8_t *rgb, int count)
+{
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m128i wordMask = _mm_set1_epi32(0xffff);
+    const __m128i max16 = _mm_set1_epi32(65535);
+    const __m128i c255 = _mm_set1_epi32(255);
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hsbk + i));
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hsbk + i + 2));
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        c = _mm_shuffle_epi32(c, _MM_SHUFFLE(3, 1, 2, 0));
+
+        __m128i hs = _mm_unpacklo_epi64(a, c);
+        __m128i bk = _mm_unpackhi_epi64(a, c);
+        __m128i h = _mm_and_si128(hs, wordMask);
+        __m128i s = _mm_srli_epi32(hs, 16);
+        __m128i v = _mm_and_si128(bk, wordMask);
+
+        __m128i h6 = _mm_mullo_epi32(h, _mm_set1_epi32(6));
+        __m128i sector = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(h6, _mm_set1_epi32(1)), _mm_srli_epi32(h6, 16)), 16);
+        __m128i f = _mm_sub_epi32(h6, _mm_mullo_epi32(sector, max16));
+
+        __m128i p = roundDiv65535Sse(_mm_mullo_epi32(v, _mm_sub_epi32(max16, s)));
+        __m128i q = roundDiv65535Sse(_mm_mullo_epi32(v, _mm_sub_epi32(max16, roundDiv65535Sse(_mm_mullo_epi32(s, f)))));
+        __m128i t = roundDiv65535Sse(_mm_mullo_epi32(v, _mm_sub_epi32(max16, roundDiv65535Sse(_mm_mullo_epi32(s, _mm_sub_epi32(max16, f))))));
+
+        __m128i v8 = roundDiv65535Sse(_mm_mullo_epi32(v, c255));
+        __m128i p8 = roundDiv65535Sse(_mm_mullo_epi32(p, c255));
+        __m128i q8 = roundDiv65535Sse(_mm_mullo_epi32(q, c255));
+        __m128i t8 = roundDiv65535Sse(_mm_mullo_epi32(t, c255));
+
+        __m128i s1 = _mm_cmpeq_epi32(sector, _mm_set1_epi32(1));
+        __m128i s2 = _mm_cmpeq_epi32(sector, _mm_set1_epi32(2));
+        __m128i s3 = _mm_cmpeq_epi32(sector, _mm_set1_epi32(3));
+        __m128i s4 = _mm_cmpeq_epi32(sector, _mm_set1_epi32(4));
+        __m128i s5 = _mm_cmpeq_epi32(sector, _mm_set1_epi32(5));
+
+        __m128i r = v8;
+        r = _mm_blendv_epi8(r, q8, s1);
+        r = _mm_blendv_epi8(r, p8, _mm_or_si128(s2, s3));
+        r = _mm_blendv_epi8(r, t8, s4);
+
+        __m128i g = t8;
+        g = _mm_blendv_epi8(g, v8, _mm_or_si128(s1, s2));
+        g = _mm_blendv_epi8(g, q8, s3);
+        g = _mm_blendv_epi8(g, p8, _mm_or_si128(s4, s5));
+
+        __m128i b = p8;
+        b = _mm_blendv_epi8(b, t8, s2);
+        b = _mm_blendv_epi8(b, v8, _mm_or_si128(s3, s4));
+        b = _mm_blendv_epi8(b, q8, s5);
+
+        __m128i px = _mm_or_si128(r, _mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(b, 16)));
+        px = _mm_shuffle_epi8(px, pack);
+        memcpy(rgb + i, &px, 12);
+    }
+    hsbkToRgbScalar(hsbk + i, rgb + i, count - i);
+}
+
+/*
+ * AVX2, 8 pixels at a time. Same steps as the SSE4.1 kernel.
+ */
+__attribute__((target("avx2")))
+inline __m256i divAvx2(__m256i num, __m256i den)
+{
+    __m256i q = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(num), _mm256_cvtepi32_ps(den)));
+    __m256i r = _mm256_sub_epi32(num, _mm256_mullo_epi32(q, den));
+
+    q = _mm256_sub_epi32(q, _mm256_cmpgt_epi32(r, _mm256_sub_epi32(den, _mm256_set1_epi32(1))));
+    q = _mm256_add_epi32(q, _mm256_cmpgt_epi32(_mm256_setzero_si256(), r));
+    return q;
+}
+
+__attribute__((target("avx2")))
+inline __m256i roundDiv65535Avx2(__m256i x)
+{
+    x = _mm256_add_epi32(x, _mm256_set1_epi32(32767));
+    return _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(x, _mm256_set1_epi32(1)), _mm256_srli_epi32(x, 16)), 16);
+}
+
+__attribute__((target("avx2")))
+void rgbToHsbkAvx2(const lx_rgb8_t *rgb, lx_hsbk_t *hsbk, int count, uint16_t kelvin)
+{
+    const __m256i spread = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                            4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i k = _mm256_set1_epi32(static_cast<int32_t>(kelvin) << 16);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        // 8 pixels are 24 bytes, the second load overlaps the first by 8
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(rgb + i);
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 8));
+        __m256i px = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), spread);
+
+        __m256i r = _mm256_and_si256(px, byteMask);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), byteMask);
+        __m256i b = _mm256_srli_epi32(px, 16);
+        __m256i mx = _mm256_max_epi32(r, _mm256_max_epi32(g, b));
+        __m256i mn = _mm256_min_epi32(r, _mm256_min_epi32(g, b));
+        __m256i delta = _mm256_sub_epi32(mx, mn);
+        __m256i delta2 = _mm256_add_epi32(delta, delta);
+        __m256i delta6 = _mm256_add_epi32(delta2, _mm256_add_epi32(delta2, delta2));
+
+        __m256i nr = _mm256_add_epi32(_mm256_sub_epi32(g, b), _mm256_and_si256(_mm256_cmpgt_epi32(b, g), delta6));
+        __m256i ng = _mm256_add_epi32(delta2, _mm256_sub_epi32(b, r));
+        __m256i nb = _mm256_add_epi32(_mm256_add_epi32(delta2, delta2), _mm256_sub_epi32(r, g));
+        __m256i isR = _mm256_cmpeq_epi32(mx, r);
+        __m256i isG = _mm256_cmpeq_epi32(mx, g);
+        __m256i n = _mm256_blendv_epi8(_mm256_blendv_epi8(nb, ng, isG), nr, isR);
+
+        __m256i bright = _mm256_add_epi32(_mm256_slli_epi32(mx, 8), mx);
+        __m256i sat = divAvx2(_mm256_add_epi32(_mm256_mullo_epi32(delta, _mm256_set1_epi32(131070)), mx),
+                              _mm256_max_epi32(_mm256_add_epi32(mx, mx), one));
+        __m256i hue = divAvx2(_mm256_add_epi32(_mm256_mullo_epi32(n, _mm256_set1_epi32(131070)), delta6),
+                              _mm256_max_epi32(_mm256_add_epi32(delta6, delta6), one));
+
+        __m256i hs = _mm256_or_si256(hue, _mm256_slli_epi32(sat, 16));
+        __m256i bk = _mm256_or_si256(bright, k);
+        __m256i out0 = _mm256_unpacklo_epi32(hs, bk);
+        __m256i out1 = _mm256_unpackhi_epi32(hs, bk);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(hsbk + i), _mm256_permute2x128_si256(out0, out1, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(hsbk + i + 4), _mm256_permute2x128_si256(out0, out1, 0x31));
+    }
+    rgbToHsbkSse41(rgb + i, hsbk + i, count - i, kelvin);
+}
+
+__attribute__((target("avx2")))
+void hsbkToRgbAvx2(const lx_hsbk_t *hsbk, lx_rgb8_t *rgb, int count)
+{
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m256i wordMask = _mm256_set1_epi32(0xffff);
+    const __m256i max16 = _mm256_set1_epi32(65535);
+    const __m256i c255 = _mm256_set1_epi32(255);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i a = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hsbk + i)), split);
+        __m256i c = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hsbk + i + 4)), split);
+
+        __m256i hs = _mm256_permute2x128_si256(a, c, 0x20);
+        __m256i bk = _mm256_permute2x128_si256(a, c, 0x31);
+        __m256i h = _mm256_and_si256(hs, wordMask);
+        __m256i s = _mm256_srli_epi32(hs, 16);
+        __m256i v = _mm256_and_si256(bk, wordMask);
+
+        __m256i h6 = _mm256_mullo_epi32(h, _mm256_set1_epi32(6));
+        __m256i sector = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(h6, _mm256_set1_epi32(1)), _mm256_srli_epi32(h6, 16)), 16);
+        __m256i f = _mm256_sub_epi32(h6, _mm256_mullo_epi32(sector, max16));
+
+        __m256i p = roundDiv65535Avx2(_mm256_mullo_epi32(v, _mm256_sub_epi32(max16, s)));
+        __m256i q = roundDiv65535Avx2(_mm256_mullo_epi32(v, _mm256_sub_epi32(max16, roundDiv65535Avx2(_mm256_mullo_epi32(s, f)))));
+        __m256i t = roundDiv65535Avx2(_mm256_mullo_epi32(v, _mm256_sub_epi32(max16, roundDiv65535Avx2(_mm256_mullo_epi32(s, _mm256_sub_epi32(max16, f))))));
+
+        __m256i v8 = roundDiv65535Avx2(_mm256_mullo_epi32(v, c255));
+        __m256i p8 = roundDiv65535Avx2(_mm256_mullo_epi32(p, c255));
+        __m256i q8 = roundDiv65535Avx2(_mm256_mullo_epi32(q, c255));
+        __m256i t8 = roundDiv65535Avx2(_mm256_mullo_epi32(t, c255));
+
+        __m256i s1 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(1));
+        __m256i s2 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(2));
+        __m256i s3 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(3));
+        __m256i s4 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(4));
+        __m256i s5 = _mm256_cmpeq_epi32(sector, _mm256_set1_epi32(5));
+
+        __m256i r = v8;
+        r = _mm256_blendv_epi8(r, q8, s1);
+        r = _mm256_blendv_epi8(r, p8, _mm256_or_si256(s2, s3));
+        r = _mm256_blendv_epi8(r, t8, s4);
+
+        __m256i g = t8;
+        g = _mm256_blendv_epi8(g, v8, _mm256_or_si256(s1, s2));
+        g = _mm256_blendv_epi8(g, q8, s3);
+        g = _mm256_blendv_epi8(g, p8, _mm256_or_si256(s4, s5));
+
+        __m256i b = p8;
+        b = _mm256_blendv_epi8(b, t8, s2);
+        b = _mm256_blendv_epi8(b, v8, _mm256_or_si256(s3, s4));
+        b = _mm256_blendv_epi8(b, q8, s5);
+
+        __m256i px = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(b, 16)));
+        px = _mm256_shuffle_epi8(px, pack);
+        __m128i lo = _mm256_castsi256_si128(px);
+        __m128i hi = _mm256_extracti128_si256(px, 1);
+        memcpy(rgb + i, &lo, 12);
+        memcpy(rgb + i + 4, &hi, 12);
+    }
+    hsbkToRgbSse41(hsbk + i, rgb + i, count - i);
+}
+
+#endif
+
+/*
+ * Picks the widest kernel the CPU supports, once.
+ */
+struct ConversionKernels {
+    RgbToHsbkKernel toHsbk;
+    HsbkToRgbKernel toRgb;
+    const char *name;
+
+    ConversionKernels() : toHsbk(rgbToHsbkScalar), toRgb(hsbkToRgbScalar), name(LifxSimd::name(LifxSimd::level()))
+    {
+#ifdef LIFX_X86_KERNELS
+        switch (LifxSimd::level()) {
+            case LifxSimd::Avx2:
+                toHsbk = rgbToHsbkAvx2;
+                toRgb = hsbkToRgbAvx2;
+                break;
+            case LifxSimd::Sse41:
+                toHsbk = rgbToHsbkSse41;
+                toRgb = hsbkToRgbSse41;
+                break;
+            case LifxSimd::Scalar:
+                break;
+        }
+#endif
+    }
+};
+
+const ConversionKernels& kernels()
+{
+    static const ConversionKernels k;
+    return k;
+}
+
+}
+
+/**
+ * \fn void HSBK::convertRgbToHsbk(const lx_rgb8_t *rgb, lx_hsbk_t *hsbk, int count, uint16_t kelvin)
+ * \param rgb Array of count RGB pixels
+ * \param hsbk Array of count HSBK colors to write, may not overlap rgb
+ * \param count Number of pixels to convert
+ * \param kelvin The kelvin value to put in every output color
+ *
+ * Converts a whole frame at once, using SSE4.1 or AVX2 when the CPU has
+ * them. The output is identical whichever kernel runs.
+ */
+void HSBK::convertRgbToHsbk(const lx_rgb8_t *rgb, lx_hsbk_t *hsbk, int count, uint16_t kelvin)
+{
+    if (rgb == nullptr || hsbk == nullptr || count <= 0)
+        return;
+
+    kernels().toHsbk(rgb, hsbk, count, kelvin);
+}
+
+/**
+ * \fn void HSBK::convertHsbkToRgb(const lx_hsbk_t *hsbk, lx_rgb8_t *rgb, int count)
+ * \param hsbk Array of count HSBK colors
+ * \param rgb Array of count RGB pixels to write, may not overlap hsbk
+ * \param count Number of pixels to convert
+ *
+ * The inverse of convertRgbToHsbk(). Kelvin is ignored.
+ */
+void HSBK::convertHsbkToRgb(const lx_hsbk_t *hsbk, lx_rgb8_t *rgb, int count)
+{
+    if (rgb == nullptr || hsbk == nullptr || count <= 0)
+        return;
+
+    kernels().toRgb(hsbk, rgb, count);
+}
+
+/**
+ * \fn QString HSBK::conversionKernel()
+ * \return The name of the kernel the batch conversions use, scalar, sse4.1 or avx2
+ *
+ * Setting QTLIFX_NO_SIMD in the environment forces the scalar kernel.
+ */
+QString HSBK::conversionKernel()
+{
+    return QString(kernels().name);
+}
@@ -0,0 +1,543 @@
+/*
+ * Drives bulbs from music, read as PCM from a WAV file or stdin
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxaudio.h"
+#include "lifxbulb.h"
+#include "lifxtransitionengine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unistd.h>
+
+namespace {
+
+const int FLASH_RELEASE = 200000;      // Micros for a beat flash to fall to a tenth
+
+}
+
+LifxAudio::LifxAudio(LifxTransitionEngine *engine, QObject *parent) : QObject(parent),
+    m_engine(engine), m_analyzer(nullptr), m_notifier(nullptr), m_rate(0), m_channels(0), m_bits(16),
+    m_float(false), m_dataLeft(0), m_started(0), m_anchorSample(0), m_anchorTime(0), m_scheduledBeat(-1),
+    m_outputLatency(0), m_totalHandoff(0), m_totalError(0)
+{
+    // Two engine frames, one to be picked up and one to fade over, and the network
+    int rate = m_engine ? m_engine->frameRate() : LifxTransitionEngine::DEFAULT_FRAME_RATE;
+    m_lightLatency = 2 * 1000 / rate + 20;
+
+    m_readTimer = new QTimer(this);
+    m_readTimer->setTimerType(Qt::PreciseTimer);
+    m_readTimer->setInterval(10);
+    connect(m_readTimer, &QTimer::timeout, this, &LifxAudio::readWav);
+
+    m_dispatchTimer = new QTimer(this);
+    m_dispatchTimer->setTimerType(Qt::PreciseTimer);
+    m_dispatchTimer->setSingleShot(true);
+    connect(m_dispatchTimer, &QTimer::timeout, this, &LifxAudio::dispatch);
+
+    m_clock.start();
+}
+
+LifxAudio::~LifxAudio()
+{
+    close();
+}
+
+/*
+ * Makes the analyzer for a new stream and adds every mapped band to it
+ */
+bool LifxAudio::begin(int sampleRate, int channels)
+{
+    if (sampleRate < 8000 || sampleRate > 192000 || channels < 1 || channels > 8) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unsupported stream," << sampleRate << "Hz" << channels << "channels";
+        return false;
+    }
+
+    close();
+    m_rate = sampleRate;
+    m_channels = channels;
+
+    // About 23 millis a window and 12 a hop whatever the rate
+    int size = 1024;
+    while (size * 44100 < sampleRate * 1024)
+        size *= 2;
+    while (size > 256 && size * 44100 > sampleRate * 2048)
+        size /= 2;
+    m_analyzer = new LifxAudioAnalyzer(sampleRate, size, size / 2);
+    m_analyzer->setSink([this](const LifxAudioHop &h) { hop(h); });
+    for (auto &mapping : m_mappings) {
+        mapping.band = m_analyzer->addBand(mapping.lowHz, mapping.highHz);
+        mapping.flashed = -1;
+        mapping.sent = -1;
+    }
+
+    m_stats = LifxAudioStats();
+    m_totalHandoff = 0;
+    m_totalError = 0;
+    m_anchorSample = 0;
+    m_anchorTime = now();
+    m_scheduledBeat = -1;
+    m_partial.clear();
+    return true;
+}
+
+/**
+ * \fn bool LifxAudio::openWav(const QString &path)
+ * \param path A PCM WAV file
+ * \return true if the file is a WAV this can read
+ *
+ * The file is read at its own rate from now, as if it were playing.
+ * Start the player at the same time, and set outputLatency() to its
+ * buffer.
+ */
+bool LifxAudio::openWav(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to open" << path;
+        return false;
+    }
+
+    QByteArray riff = file.read(12);
+    if (riff.size() < 12 || !riff.startsWith("RIFF") || riff.mid(8, 4) != "WAVE") {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "is not a WAV file";
+        return false;
+    }
+
+    int format = 0, channels = 0, rate = 0, bits = 0;
+    qint64 data = -1, dataBytes = 0;
+    while (data < 0) {
+        QByteArray chunk = file.read(8);
+        if (chunk.size() < 8)
+            break;
+
+        quint32 length = qFromLittleEndian<quint32>(chunk.constData() + 4);
+        if (chunk.startsWith("fmt ")) {
+            QByteArray fmt = file.read(length + (length & 1));
+            if (fmt.size() < 16)
+                break;
+            format = qFromLittleEndian<quint16>(fmt.constData());
+            channels = qFromLittleEndian<quint16>(fmt.constData() + 2);
+            rate = static_cast<int>(qFromLittleEndian<quint32>(fmt.constData() + 4));
+            bits = qFromLittleEndian<quint16>(fmt.constData() + 14);
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format at the start of the sub format GUID
+            if (format == 0xfffe && fmt.size() >= 26)
+                format = qFromLittleEndian<quint16>(fmt.constData() + 24);
+        }
+        else if (chunk.startsWith("data")) {
+            data = file.pos();
+            dataBytes = length;
+        }
+        else if (!file.seek(file.pos() + length + (length & 1))) {
+            break;
+        }
+    }
+
+    bool pcm = format == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+    bool ieee = format == 3 && bits == 32;
+    if (data < 0 || (!pcm && !ieee)) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "is not 8, 16, 24 or 32 bit PCM or 32 bit float";
+        return false;
+    }
+    file.close();
+
+    if (!begin(rate, channels))
+        return false;
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly) || !m_file.seek(data)) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to reopen" << path;
+        close();
+        return false;
+    }
+    m_bits = bits;
+    m_float = ieee;
+    m_dataLeft = qMin(dataBytes, m_file.size() - data);
+    m_started = now();
+    m_readTimer->start();
+    return true;
+}
+
+/**
+ * \fn bool LifxAudio::openStdin(int sampleRate, int channels)
+ * \param sampleRate Samples a second
+ * \param channels Interleaved channels
+ * \return true if the stream could be started
+ *
+ * Reads signed 16 bit little endian PCM from stdin as it arrives, from a
+ * player that also writes it to stdout, for instance. A sample is taken
+ * to arrive when it is read.
+ */
+bool LifxAudio::openStdin(int sampleRate, int channels)
+{
+    if (!begin(sampleRate, channels))
+        return false;
+
+    m_bits = 16;
+    m_float = false;
+    m_notifier = new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &LifxAudio::readStdin);
+    return true;
+}
+
+/**
+ * \fn void LifxAudio::close()
+ *
+ * Stops reading. Updates still waiting are dropped, and the bulbs keep
+ * whatever they were last given.
+ */
+void LifxAudio::close()
+{
+    if (m_analyzer == nullptr)
+        return;
+
+    m_readTimer->stop();
+    m_file.close();
+    delete m_notifier;
+    m_notifier = nullptr;
+
+    m_events.clear();
+    m_dispatchTimer->stop();
+    delete m_analyzer;
+    m_analyzer = nullptr;
+}
+
+/**
+ * \fn int LifxAudio::mapBand(float lowHz, float highHz, const QVector<LifxBulb*> &bulbs, const HSBK &color, bool flashOnBeat)
+ * \param lowHz Lowest frequency in the band
+ * \param highHz Highest frequency in the band
+ * \param bulbs Bulbs the band drives, LifxGroup::bulbs() for a group
+ * \param color Color at full level, the level scales its brightness
+ * \param flashOnBeat Go to full brightness on each predicted beat
+ * \return The mapping's index, -1 on failure
+ */
+int LifxAudio::mapBand(float lowHz, float highHz, const QVector<LifxBulb*> &bulbs, const HSBK &color, bool flashOnBeat)
+{
+    Mapping mapping;
+    mapping.lowHz = lowHz;
+    mapping.highHz = highHz;
+    mapping.bulbs = bulbs;
+    mapping.bulbs.removeAll(nullptr);
+    mapping.strip = nullptr;
+    mapping.first = 0;
+    mapping.count = 0;
+    mapping.color = { color.h(), color.s(), color.b(), color.k() };
+    mapping.flashOnBeat = flashOnBeat;
+    mapping.band = m_analyzer ? m_analyzer->addBand(lowHz, highHz) : -1;
+    mapping.flashed = -1;
+    mapping.sent = -1;
+
+    if (m_analyzer && mapping.band < 0)
+        return -1;
+    m_mappings.append(mapping);
+    return m_mappings.size() - 1;
+}
+
+/**
+ * \fn int LifxAudio::mapBand(float lowHz, float highHz, LifxBulb *strip, int firstZone, int zoneCount, const HSBK &color, bool flashOnBeat)
+ * \param lowHz Lowest frequency in the band
+ * \param highHz Highest frequency in the band
+ * \param strip A multizone bulb whose zones are known
+ * \param firstZone First zone the band drives
+ * \param zoneCount Zones the band drives
+ * \param color Color at full level, the level scales its brightness
+ * \param flashOnBeat Go to full brightness on each predicted beat
+ * \return The mapping's index, -1 on failure
+ *
+ * Several bands can share a strip, each on its own zones. The strip gets
+ * one zone fade for all of them.
+ */
+int LifxAudio::mapBand(float lowHz, float highHz, LifxBulb *strip, int firstZone, int zoneCount, const HSBK &color, bool flashOnBeat)
+{
+    if (strip == nullptr || strip->zoneCount() == 0) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Needs a strip whose zones are known";
+        return -1;
+    }
+
+    firstZone = qBound(0, firstZone, strip->zoneCount() - 1);
+    zoneCount = qBound(1, zoneCount, strip->zoneCount() - firstZone);
+
+    int index = mapBand(lowHz, highHz, QVector<LifxBulb*>(), color, flashOnBeat);
+    if (index < 0)
+        return -1;
+
+    Mapping &mapping = m_mappings[index];
+    mapping.strip = strip;
+    mapping.first = firstZone;
+    mapping.count = zoneCount;
+    if (!m_strips.contains(strip)) {
+        QVector<lx_hsbk_t> zones(strip->zoneCount());
+        memcpy(zones.data(), strip->zones().data(), zones.size() * sizeof(lx_hsbk_t));
+        m_strips.insert(strip, zones);
+    }
+    return index;
+}
+
+/**
+ * \fn void LifxAudio::clearMappings()
+ *
+ * While open, this also restarts the analysis, losing the tempo.
+ */
+void LifxAudio::clearMappings()
+{
+    m_mappings.clear();
+    m_strips.clear();
+    m_events.clear();
+    m_scheduledBeat = -1;
+
+    if (m_analyzer) {
+        LifxAudioAnalyzer *old = m_analyzer;
+        m_analyzer = new LifxAudioAnalyzer(old->sampleRate(), old->fftSize(), old->hop());
+        m_analyzer->setSink([this](const LifxAudioHop &h) { hop(h); });
+        delete old;
+    }
+}
+
+/*
+ * m_clock micros a sample arrived, or will at the rate it is coming in
+ */
+qint64 LifxAudio::arrival(qint64 sample) const
+{
+    return m_anchorTime + (sample - m_anchorSample) * 1000000 / m_rate;
+}
+
+/*
+ * The WAV timer, reads whatever should have played by now
+ */
+void LifxAudio::readWav()
+{
+    int frameBytes = m_channels * m_bits / 8;
+    qint64 due = (now() - m_started) * m_rate / 1000000;
+    qint64 frames = qMin(due - static_cast<qint64>(m_stats.frames), m_dataLeft / frameBytes);
+
+    if (frames > 0) {
+        QByteArray bytes = m_file.read(frames * frameBytes);
+        frames = bytes.size() / frameBytes;
+        m_dataLeft -= frames * frameBytes;
+
+        // The last sample read is the one playing now
+        m_anchorSample = static_cast<qint64>(m_stats.frames) + frames;
+        m_anchorTime = m_started + m_anchorSample * 1000000 / m_rate;
+        decode(bytes.constData(), static_cast<int>(frames));
+    }
+
+    if (m_dataLeft < frameBytes || m_file.atEnd()) {
+        close();
+        emit finished();
+    }
+}
+
+/*
+ * Stdin has data, read what there is without blocking
+ */
+void LifxAudio::readStdin()
+{
+    char buffer[32768];
+    ssize_t got = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+
+    if (got <= 0) {
+        close();
+        emit finished();
+        return;
+    }
+
+    int frameBytes = m_channels * 2;
+    m_partial.append(buffer, static_cast<int>(got));
+    int frames = m_partial.size() / frameBytes;
+    if (frames == 0)
+        return;
+
+    m_anchorSample = static_cast<qint64>(m_stats.frames) + frames;
+    m_anchorTime = now();
+    decode(m_partial.constData(), frames);
+    m_partial.remove(0, frames * frameBytes);
+}
+
+/*
+ * Mixes frames of interleaved samples down to mono and analyzes them
+ */
+void LifxAudio::decode(const char *data, int frames)
+{
+    int bytes = m_bits / 8;
+    float scale = 1.0f / m_channels;
+
+    m_mono.resize(frames);
+    for (int f = 0; f < frames; f++) {
+        float sum = 0;
+        for (int c = 0; c < m_channels; c++, data += bytes) {
+            switch (m_bits) {
+                case 8:
+                    sum += (static_cast<uint8_t>(*data) - 128) / 128.0f;
+                    break;
+                case 16:
+                    sum += qFromLittleEndian<qint16>(data) / 32768.0f;
+                    break;
+                case 24:
+                    sum += ((static_cast<uint8_t>(data[0]) | static_cast<uint8_t>(data[1]) << 8 | static_cast<int8_t>(data[2]) * 65536)) / 8388608.0f;
+                    break;
+                default:
+                    if (m_float) {
+                        quint32 raw = qFromLittleEndian<quint32>(data);
+                        float value;
+                        memcpy(&value, &raw, sizeof(value));
+                        sum += value;
+                    }
+                    else {
+                        sum += qFromLittleEndian<qint32>(data) / 2147483648.0f;
+                    }
+                    break;
+            }
+        }
+        m_mono[f] = sum * scale;
+    }
+
+    m_stats.frames += frames;
+    m_analyzer->process(m_mono.constData(), frames);
+}
+
+/*
+ * The analyzer finished a hop, queue its levels for when it will be heard,
+ * and the next beat for when that will be
+ */
+void LifxAudio::hop(const LifxAudioHop &hop)
+{
+    qint64 arrived = arrival(hop.position);
+    qint64 heard = arrived + m_outputLatency * 1000;
+
+    for (int i = 0; i < m_mappings.size(); i++) {
+        const Mapping &mapping = m_mappings[i];
+        if (mapping.band >= 0 && mapping.band < hop.bandCount)
+            schedule({ heard - m_lightLatency * 1000, arrived, heard, i, hop.levels[mapping.band] });
+    }
+
+    if (hop.nextBeat >= 0 && hop.bpm > 0 && std::abs(hop.nextBeat - m_scheduledBeat) > m_analyzer->hop() / 4) {
+        qint64 beatHeard = arrival(hop.nextBeat) + m_outputLatency * 1000;
+        qint64 half = static_cast<qint64>(30000000 / hop.bpm);
+
+        // A beat which moved replaces the one waiting, the next one is added
+        for (int i = m_events.size() - 1; i >= 0; i--) {
+            if (m_events[i].mapping < 0 && std::abs(m_events[i].heard - beatHeard) < half)
+                m_events.removeAt(i);
+        }
+        m_scheduledBeat = hop.nextBeat;
+        schedule({ beatHeard - m_lightLatency * 1000, arrived, beatHeard, -1, hop.bpm });
+    }
+
+    // Handed over from the timer, not from inside the analyzer, so a slot on beat() may close()
+    rearm();
+}
+
+void LifxAudio::schedule(const Event &event)
+{
+    auto at = std::upper_bound(m_events.begin(), m_events.end(), event.due, [](qint64 due, const Event &e) { return due < e.due; });
+    m_events.insert(static_cast<int>(at - m_events.begin()), event);
+}
+
+/**
+ * \fn void LifxAudio::dispatch()
+ *
+ * Hands every update that is due to the transition engine, the latest
+ * for each mapping, then waits for the next
+ */
+void LifxAudio::dispatch()
+{
+    qint64 time = now();
+    QVector<int> levels(m_mappings.size(), -1);
+    float bpm = -1;
+
+    while (!m_events.isEmpty() && m_events.first().due <= time) {
+        Event event = m_events.takeFirst();
+        qint64 handoff = time - event.arrived;
+
+        if (time - event.due > 1000)
+            m_stats.late++;
+        m_stats.updates++;
+        m_stats.lastHandoff = handoff;
+        m_stats.maxHandoff = qMax(m_stats.maxHandoff, handoff);
+        m_totalHandoff += handoff;
+        m_totalError += time + m_lightLatency * 1000 - event.heard;
+        m_stats.meanHandoff = m_totalHandoff / static_cast<qint64>(m_stats.updates);
+        m_stats.meanError = m_totalError / static_cast<qint64>(m_stats.updates);
+
+        if (event.mapping < 0) {
+            bpm = event.level;
+            for (int i = 0; i < m_mappings.size(); i++) {
+                if (m_mappings[i].flashOnBeat) {
+                    m_mappings[i].flashed = event.heard;
+                    levels[i] = 65535;
+                }
+            }
+            continue;
+        }
+
+        const Mapping &mapping = m_mappings[event.mapping];
+        float level = event.level;
+        if (mapping.flashed >= 0 && event.heard >= mapping.flashed)
+            level = qMax(level, static_cast<float>(std::pow(0.1, static_cast<double>(event.heard - mapping.flashed) / FLASH_RELEASE)));
+        levels[event.mapping] = static_cast<int>(std::lround(qBound(0.0f, level, 1.0f) * 65535));
+    }
+
+    // Without an engine the analysis still runs, there is just nowhere to send it
+    if (m_engine) {
+        uint32_t fade = static_cast<uint32_t>(1000 / m_engine->frameRate());
+        QSet<LifxBulb*> strips;
+        for (int i = 0; i < m_mappings.size(); i++) {
+            Mapping &mapping = m_mappings[i];
+            int level = levels[i];
+
+            // Small changes aren't worth a packet
+            if (level < 0 || (mapping.sent >= 0 && std::abs(level - mapping.sent) < 512 && level != 65535))
+                continue;
+            mapping.sent = level;
+
+            uint16_t brightness = static_cast<uint16_t>(mapping.color.brightness * static_cast<uint32_t>(level) / 65535);
+            if (mapping.strip) {
+                lx_hsbk_t *zones = m_strips[mapping.strip].data();
+                for (int z = mapping.first; z < mapping.first + mapping.count; z++) {
+                    zones[z] = mapping.color;
+                    zones[z].brightness = brightness;
+                }
+                strips.insert(mapping.strip);
+            }
+            else {
+                HSBK color(mapping.color.hue, mapping.color.saturation, brightness, mapping.color.kelvin);
+                for (auto bulb : mapping.bulbs)
+                    m_engine->fade(bulb, color, fade);
+            }
+        }
+        for (auto strip : strips) {
+            const QVector<lx_hsbk_t> &zones = m_strips[strip];
+            m_engine->fadeZones(strip, zones.constData(), zones.size(), fade);
+        }
+    }
+
+    rearm();
+    if (bpm >= 0)
+        emit beat(bpm);
+}
+
+/*
+ * Sets the dispatch timer for the first update waiting
+ */
+void LifxAudio::rearm()
+{
+    if (m_events.isEmpty())
+        m_dispatchTimer->stop();
+    else
+        m_dispatchTimer->start(static_cast<int>(qMax<qint64>(0, (m_events.first().due - now() + 999) / 1000)));
+}
@@ -0,0 +1,652 @@
+/*
+ * Turns PCM into band levels, onsets and beats
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxaudioanalyzer.h"
+#include "lifxsimd.h"
+
+#include <cmath>
+
+#ifdef LIFX_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/*
+ * The kernels do the same arithmetic in the same order per element, only
+ * the sums are added in a different order, so results agree to rounding.
+ */
+namespace {
+
+typedef void (*MultiplyKernel)(float*, const float*, int);
+typedef void (*ButterflyKernel)(float*, float*, const float*, const float*, int, int);
+typedef void (*MagnitudeKernel)(const float*, const float*, float*, int);
+typedef float (*FluxKernel)(const float*, float*, int);
+typedef float (*SumKernel)(const float*, int);
+
+void multiplyScalar(float *data, const float *by, int count)
+{
+    for (int i = 0; i < count; i++)
+        data[i] *= by[i];
+}
+
+/*
+ * One radix 2 stage over n points, butterflies h apart, twiddles for
+ * the stage in wr and wi
+ */
+void butterflyScalar(float *re, float *im, const float *wr, const float *wi, int n, int h)
+{
+    for (int k = 0; k < n; k += 2 * h) {
+        for (int j = 0; j < h; j++) {
+            int a = k + j;
+            int b = a + h;
+            float tr = wr[j] * re[b] - wi[j] * im[b];
+            float ti = wr[j] * im[b] + wi[j] * re[b];
+
+            re[b] = re[a] - tr;
+            im[b] = im[a] - ti;
+            re[a] = re[a] + tr;
+            im[a] = im[a] + ti;
+        }
+    }
+}
+
+void magnitudeScalar(const float *re, const float *im, float *out, int count)
+{
+    for (int i = 0; i < count; i++)
+        out[i] = std::sqrt(re[i] * re[i] + im[i] * im[i]);
+}
+
+/*
+ * Sum of the rises from previous to now, previous becomes now
+ */
+float fluxScalar(const float *now, float *previous, int count)
+{
+    float sum = 0;
+
+    for (int i = 0; i < count; i++) {
+        sum += std::max(now[i] - previous[i], 0.0f);
+        previous[i] = now[i];
+    }
+    return sum;
+}
+
+float sumScalar(const float *data, int count)
+{
+    float sum = 0;
+
+    for (int i = 0; i < count; i++)
+        sum += data[i];
+    return sum;
+}
+
+#ifdef LIFX_X86_KERNELS
+
+/*
+ * SSE, 4 floats at a time
+ */
+__attribute__((target("sse4.1")))
+inline float horizontalSse(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse4.1")))
+void multiplySse41(float *data, const float *by, int count)
+{
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), _mm_loadu_ps(by + i)));
+    multiplyScalar(data + i, by + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+void butterflySse41(float *re, float *im, const float *wr, const float *wi, int n, int h)
+{
+    if (h < 4) {
+        butterflyScalar(re, im, wr, wi, n, h);
+        return;
+    }
+
+    for (int k = 0; k < n; k += 2 * h) {
+        float *ar = re + k, *ai = im + k, *br = re + k + h, *bi = im + k + h;
+
+        for (int j = 0; j < h; j += 4) {
+            __m128 cr = _mm_loadu_ps(wr + j), ci = _mm_loadu_ps(wi + j);
+            __m128 xr = _mm_loadu_ps(br + j), xi = _mm_loadu_ps(bi + j);
+            __m128 yr = _mm_loadu_ps(ar + j), yi = _mm_loadu_ps(ai + j);
+            __m128 tr = _mm_sub_ps(_mm_mul_ps(cr, xr), _mm_mul_ps(ci, xi));
+            __m128 ti = _mm_add_ps(_mm_mul_ps(cr, xi), _mm_mul_ps(ci, xr));
+
+            _mm_storeu_ps(br + j, _mm_sub_ps(yr, tr));
+            _mm_storeu_ps(bi + j, _mm_sub_ps(yi, ti));
+            _mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+            _mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+        }
+    }
+}
+
+__attribute__((target("sse4.1")))
+void magnitudeSse41(const float *re, const float *im, float *out, int count)
+{
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 r = _mm_loadu_ps(re + i), m = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(out + i, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m))));
+    }
+    magnitudeScalar(re + i, im + i, out + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+float fluxSse41(const float *now, float *previous, int count)
+{
+    __m128 sum = _mm_setzero_ps();
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(now + i);
+        sum = _mm_add_ps(sum, _mm_max_ps(_mm_sub_ps(v, _mm_loadu_ps(previous + i)), _mm_setzero_ps()));
+        _mm_storeu_ps(previous + i, v);
+    }
+    return horizontalSse(sum) + fluxScalar(now + i, previous + i, count - i);
+}
+
+__attribute__((target("sse4.1")))
+float sumSse41(const float *data, int count)
+{
+    __m128 sum = _mm_setzero_ps();
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4)
+        sum = _mm_add_ps(sum, _mm_loadu_ps(data + i));
+    return horizontalSse(sum) + sumScalar(data + i, count - i);
+}
+
+/*
+ * AVX2, 8 floats at a time
+ */
+__attribute__((target("avx2")))
+inline float horizontalAvx2(__m256 v)
+{
+    __m128 low = _mm256_castps256_ps128(v);
+    __m128 high = _mm256_extractf128_ps(v, 1);
+
+    low = _mm_add_ps(low, high);
+    low = _mm_add_ps(low, _mm_movehl_ps(low, low));
+    low = _mm_add_ss(low, _mm_shuffle_ps(low, low, 1));
+    return _mm_cvtss_f32(low);
+}
+
+__attribute__((target("avx2")))
+void multiplyAvx2(float *data, const float *by, int count)
+{
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), _mm256_loadu_ps(by + i)));
+    multiplySse41(data + i, by + i, count - i);
+}
+
+__attribute__((target("avx2")))
+void butterflyAvx2(float *re, float *im, const float *wr, const float *wi, int n, int h)
+{
+    if (h < 8) {
+        butterflySse41(re, im, wr, wi, n, h);
+        return;
+    }
+
+    for (int k = 0; k < n; k += 2 * h) {
+        float *ar = re + k, *ai = im + k, *br = re + k + h, *bi = im + k + h;
+
+        for (int j = 0; j < h; j += 8) {
+            __m256 cr = _mm256_loadu_ps(wr + j), ci = _mm256_loadu_ps(wi + j);
+            __m256 xr = _mm256_loadu_ps(br + j), xi = _mm256_loadu_ps(bi + j);
+            __m256 yr = _mm256_loadu_ps(ar + j), yi = _mm256_loadu_ps(ai + j);
+            __m256 tr = _mm256_sub_ps(_mm256_mul_ps(cr, xr), _mm256_mul_ps(ci, xi));
+            __m256 ti = _mm256_add_ps(_mm256_mul_ps(cr, xi), _mm256_mul_ps(ci, xr));
+
+            _mm256_storeu_ps(br + j, _mm256_sub_ps(yr, tr));
+            _mm256_storeu_ps(bi + j, _mm256_sub_ps(yi, ti));
+            _mm256_storeu_ps(ar + j, _mm256_add_ps(yr, tr));
+            _mm256_storeu_ps(ai + j, _mm256_add_ps(yi, ti));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+void magnitudeAvx2(const float *re, const float *im, float *out, int count)
+{
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 r = _mm256_loadu_ps(re + i), m = _mm256_loadu_ps(im + i);
+        _mm256_storeu_ps(out + i, _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(r, r), _mm256_mul_ps(m, m))));
+    }
+    magnitudeSse41(re + i, im + i, out + i, count - i);
+}
+
+__attribute__((target("avx2")))
+float fluxAvx2(const float *now, float *previous, int count)
+{
+    __m256 sum = _mm256_setzero_ps();
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 v = _mm256_loadu_ps(now + i);
+        sum = _mm256_add_ps(sum, _mm256_max_ps(_mm256_sub_ps(v, _mm256_loadu_ps(previous + i)), _mm256_setzero_ps()));
+        _mm256_storeu_ps(previous + i, v);
+    }
+    return horizontalAvx2(sum) + fluxSse41(now + i, previous + i, count - i);
+}
+
+__attribute__((target("avx2")))
+float sumAvx2(const float *data, int count)
+{
+    __m256 sum = _mm256_setzero_ps();
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+        sum = _mm256_add_ps(sum, _mm256_loadu_ps(data + i));
+    return horizontalAvx2(sum) + sumSse41(data + i, count - i);
+}
+
+#endif
+
+/*
+ * Picks the widest kernels the CPU supports, once.
+ */
+struct AudioKernels {
+    MultiplyKernel multiply;
+    ButterflyKernel butterfly;
+    MagnitudeKernel magnitude;
+    FluxKernel flux;
+    SumKernel sum;
+    const char *name;
+
+    AudioKernels() : multiply(multiplyScalar), butterfly(butterflyScalar), magnitude(magnitudeScalar),
+        flux(fluxScalar), sum(sumScalar), name(LifxSimd::name(LifxSimd::level()))
+    {
+#ifdef LIFX_X86_KERNELS
+        switch (LifxSimd::level()) {
+            case LifxSimd::Avx2:
+                multiply = multiplyAvx2;
+                butterfly = butterflyAvx2;
+                magnitude = magnitudeAvx2;
+                flux = fluxAvx2;
+                sum = sumAvx2;
+                break;
+            case LifxSimd::Sse41:
+                multiply = multiplySse41;
+                butterfly = butterflySse41;
+                magnitude = magnitudeSse41;
+                flux = fluxSse41;
+                sum = sumSse41;
+                break;
+            case LifxSimd::Scalar:
+                break;
+        }
+#endif
+    }
+};
+
+const AudioKernels& kernels()
+{
+    static const AudioKernels k;
+    return k;
+}
+
+}
+
+LifxAudioAnalyzer::LifxAudioAnalyzer(int sampleRate, int fftSize, int hop) :
+    m_rate(qMax(sampleRate, 1000)), m_position(0), m_pending(0), m_write(0), m_fluxWrite(0),
+    m_lastFlux(0), m_fluxMean(0), m_sinceOnset(0), m_sinceTempo(0), m_bpm(0), m_period(0),
+    m_nextBeat(-1), m_totalNanos(0)
+{
+    m_size = 64;
+    while (m_size < fftSize && m_size < 16384)
+        m_size *= 2;
+    if (m_size != fftSize)
+        qWarning() << __PRETTY_FUNCTION__ << ": FFT size" << fftSize << "isn't a power of 2 from 64 to 16384, using" << m_size;
+    m_hop = qBound(1, hop, m_size);
+
+    m_ring.fill(0, m_size);
+    m_re.resize(m_size);
+    m_im.resize(m_size);
+    m_magnitude.resize(m_size / 2 + 1);
+    m_previous.fill(0, m_size / 2 + 1);
+
+    m_window.resize(m_size);
+    for (int i = 0; i < m_size; i++)
+        m_window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2 * M_PI * i / m_size));
+
+    m_twiddleRe.resize(m_size);
+    m_twiddleIm.resize(m_size);
+    for (int h = 1; h < m_size; h *= 2) {
+        for (int j = 0; j < h; j++) {
+            m_twiddleRe[h - 1 + j] = static_cast<float>(std::cos(-M_PI * j / h));
+            m_twiddleIm[h - 1 + j] = static_cast<float>(std::sin(-M_PI * j / h));
+        }
+    }
+
+    int bits = 0;
+    while ((1 << bits) < m_size)
+        bits++;
+    m_reverse.resize(m_size);
+    for (int i = 0; i < m_size; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        m_reverse[i] = r;
+    }
+
+    m_fluxSize = qMax(16, static_cast<int>(6.0 * m_rate / m_hop));
+    m_flux.fill(0, m_fluxSize);
+    setRelease(200);
+}
+
+/**
+ * \fn int LifxAudioAnalyzer::addBand(float lowHz, float highHz)
+ * \param lowHz Lowest frequency in the band
+ * \param highHz Highest frequency in the band
+ * \return The band's index in LifxAudioHop::levels, -1 if there are already 32
+ */
+int LifxAudioAnalyzer::addBand(float lowHz, float highHz)
+{
+    if (m_bands.size() >= 32) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Only 32 bands are supported";
+        return -1;
+    }
+
+    float binHz = static_cast<float>(m_rate) / m_size;
+    Band band;
+    band.low = qBound(1, static_cast<int>(std::floor(qMin(lowHz, highHz) / binHz)), m_size / 2);
+    band.high = qBound(band.low + 1, static_cast<int>(std::ceil(qMax(lowHz, highHz) / binHz)) + 1, m_size / 2 + 1);
+    band.peak = 0;
+    band.mean = 0;
+    band.quiet = 0;
+    m_bands.append(band);
+    m_levels.append(0);
+    return m_bands.size() - 1;
+}
+
+/**
+ * \fn void LifxAudioAnalyzer::setRelease(int msecs)
+ * \param msecs Millis for a band's level to fall to a tenth once its sound stops
+ */
+void LifxAudioAnalyzer::setRelease(int msecs)
+{
+    double hopMsecs = 1000.0 * m_hop / m_rate;
+    m_release = static_cast<float>(std::pow(0.1, hopMsecs / qMax(msecs, 1)));
+}
+
+/**
+ * \fn void LifxAudioAnalyzer::reset()
+ *
+ * Forgets the audio so far, the tempo, and the band levels. Bands stay.
+ */
+void LifxAudioAnalyzer::reset()
+{
+    m_position = 0;
+    m_pending = 0;
+    m_write = 0;
+    m_ring.fill(0);
+    m_previous.fill(0);
+    m_flux.fill(0);
+    m_fluxWrite = 0;
+    m_lastFlux = 0;
+    m_fluxMean = 0;
+    m_sinceOnset = 0;
+    m_sinceTempo = 0;
+    m_bpm = 0;
+    m_period = 0;
+    m_nextBeat = -1;
+    m_levels.fill(0);
+    for (auto &band : m_bands) {
+        band.peak = 0;
+        band.mean = 0;
+        band.quiet = 0;
+    }
+}
+
+/**
+ * \fn void LifxAudioAnalyzer::process(const float *samples, int count)
+ * \param samples Mono samples, -1 to 1
+ * \param count Number of samples
+ *
+ * Calls the sink once for every hop completed
+ */
+void LifxAudioAnalyzer::process(const float *samples, int count)
+{
+    while (count > 0) {
+        int take = qMin(qMin(count, m_hop - m_pending), m_size - m_write);
+
+        memcpy(m_ring.data() + m_write, samples, take * sizeof(float));
+        m_write = (m_write + take) % m_size;
+        m_pending += take;
+        m_position += take;
+        samples += take;
+        count -= take;
+
+        if (m_pending == m_hop) {
+            m_pending = 0;
+            analyze();
+        }
+    }
+}
+
+/*
+ * In place radix 2 FFT of m_re and m_im, already in bit reversed order
+ */
+void LifxAudioAnalyzer::fft()
+{
+    const AudioKernels &k = kernels();
+
+    for (int h = 1; h < m_size; h *= 2)
+        k.butterfly(m_re.data(), m_im.data(), m_twiddleRe.constData() + h - 1, m_twiddleIm.constData() + h - 1, m_size, h);
+}
+
+void LifxAudioAnalyzer::analyze()
+{
+    const AudioKernels &k = kernels();
+    QElapsedTimer cost;
+    int bins = m_size / 2 + 1;
+
+    cost.start();
+
+    // Oldest sample first, windowed, into bit reversed order
+    memcpy(m_im.data(), m_ring.constData() + m_write, (m_size - m_write) * sizeof(float));
+    memcpy(m_im.data() + m_size - m_write, m_ring.constData(), m_write * sizeof(float));
+    k.multiply(m_im.data(), m_window.constData(), m_size);
+    for (int i = 0; i < m_size; i++)
+        m_re[m_reverse[i]] = m_im[i];
+    m_im.fill(0);
+    fft();
+
+    k.magnitude(m_re.constData(), m_im.constData(), m_magnitude.data(), bins);
+    float flux = k.flux(m_magnitude.constData(), m_previous.data(), bins) / m_size;
+
+    int refractory = qMax(1, static_cast<int>(std::ceil(0.1 * m_rate / m_hop)));
+    float meanWeight = qMax(static_cast<float>(m_hop) / m_rate, 1.0f / (m_stats.hops + 1));
+    float peakDecay = static_cast<float>(std::pow(0.5, static_cast<double>(m_hop) / m_rate / 4));
+    quint32 onsets = 0;
+
+    for (int b = 0; b < m_bands.size(); b++) {
+        Band &band = m_bands[b];
+        float sum = k.sum(m_magnitude.constData() + band.low, band.high - band.low);
+        float level;
+
+        band.peak = qMax(sum, band.peak * peakDecay);
+        level = band.peak > 0 ? sum / band.peak : 0;
+        band.quiet++;
+        if (sum > 2 * band.mean && sum > 0.2f * band.peak && band.quiet >= refractory) {
+            onsets |= 1u << b;
+            band.quiet = 0;
+            level = 1;
+        }
+        band.mean += (sum - band.mean) * 0.1f;
+        m_levels[b] = qMax(level, m_levels[b] * m_release);
+    }
+
+    m_sinceOnset++;
+    // The mean needs half a second to settle before anything stands out from it
+    bool settled = m_position >= m_rate / 2;
+    bool onset = settled && flux > 1.5f * m_fluxMean && flux > m_lastFlux && flux > 1e-6f && m_sinceOnset >= refractory;
+    if (onset) {
+        m_sinceOnset = 0;
+        m_stats.onsets++;
+    }
+    m_fluxMean += (flux - m_fluxMean) * meanWeight;
+    m_lastFlux = flux;
+
+    bool beat = false;
+    if (m_nextBeat >= 0) {
+        while (m_nextBeat < m_position) {
+            beat = true;
+            m_nextBeat += m_period;
+        }
+    }
+    track(flux, onset);
+    if (beat)
+        m_stats.beats++;
+
+    m_stats.hops++;
+    m_stats.lastHop = cost.nsecsElapsed();
+    m_stats.maxHop = qMax(m_stats.maxHop, m_stats.lastHop);
+    m_totalNanos += m_stats.lastHop;
+    m_stats.meanHop = m_totalNanos / static_cast<qint64>(m_stats.hops);
+
+    if (m_sink) {
+        LifxAudioHop hop;
+        hop.position = m_position;
+        hop.bandCount = m_bands.size();
+        hop.levels = m_levels.constData();
+        hop.onsets = onsets;
+        hop.flux = flux;
+        hop.onset = onset;
+        hop.beat = beat;
+        hop.bpm = m_bpm;
+        hop.nextBeat = m_nextBeat >= 0 ? static_cast<qint64>(m_nextBeat) : -1;
+        m_sink(hop);
+    }
+}
+
+/*
+ * Keeps the flux history, finds the tempo once a second, and pulls the
+ * predicted beats onto onsets near them
+ */
+void LifxAudioAnalyzer::track(float flux, bool onset)
+{
+    double hopsPerSecond = static_cast<double>(m_rate) / m_hop;
+
+    m_flux[m_fluxWrite] = flux;
+    m_fluxWrite = (m_fluxWrite + 1) % m_fluxSize;
+
+    if (++m_sinceTempo >= hopsPerSecond && m_position >= static_cast<qint64>(m_rate) * 3) {
+        m_sinceTempo = 0;
+
+        // Only what has been heard, the zeros before the audio started would drag the mean
+        int filled = static_cast<int>(qMin<quint64>(m_stats.hops + 1, m_fluxSize));
+        int oldest = (m_fluxWrite - filled + m_fluxSize) % m_fluxSize;
+        QVector<float> history(filled);
+        float mean = 0;
+        for (int i = 0; i < filled; i++) {
+            history[i] = m_flux[(oldest + i) % m_fluxSize];
+            mean += history[i];
+        }
+        mean /= filled;
+        for (auto &v : history)
+            v -= mean;
+
+        int lowLag = qMax(1, static_cast<int>(std::floor(hopsPerSecond * 60 / 180)));
+        int highLag = qMin(filled / 2, static_cast<int>(std::ceil(hopsPerSecond * 60 / 60)));
+        QVector<float> acf(highLag + 2, 0);
+        float energy = 0;
+        for (int i = 0; i < filled; i++)
+            energy += history[i] * history[i];
+        for (int lag = lowLag - 1; lag <= highLag + 1; lag++) {
+            float sum = 0;
+            for (int i = 0; i + lag < filled; i++)
+                sum += history[i] * history[i + lag];
+            acf[lag] = sum;
+        }
+
+        // A gentle preference for tempos near 120, so halves and doubles don't win on noise
+        int best = -1;
+        float bestScore = 0;
+        for (int lag = lowLag; lag <= highLag; lag++) {
+            double octaves = std::log2(60 * hopsPerSecond / lag / 120);
+            float score = acf[lag] * static_cast<float>(std::exp(-0.5 * octaves * octaves));
+            if (score > bestScore) {
+                bestScore = score;
+                best = lag;
+            }
+        }
+
+        // Flux repeats at twice the beat period too, take the faster tempo if it is nearly as strong
+        int half = best / 2;
+        if (half >= lowLag && half + 1 <= highLag) {
+            int faster = acf[half] > acf[half + 1] ? half : half + 1;
+            if (acf[faster] > 0.5f * acf[best])
+                best = faster;
+        }
+
+        if (best > 0 && energy > 0 && acf[best] > 0.1f * energy) {
+            double lag = best;
+            float left = acf[best - 1], right = acf[best + 1];
+            float curve = left - 2 * acf[best] + right;
+            if (curve < 0)
+                lag += 0.5 * (left - right) / curve;
+            m_period = lag * m_hop;
+            m_bpm = static_cast<float>(60 * hopsPerSecond / lag);
+        }
+        else {
+            m_bpm = 0;
+            m_period = 0;
+            m_nextBeat = -1;
+        }
+    }
+
+    if (!onset || m_period <= 0)
+        return;
+
+    // The onset is somewhere in the newest hop
+    double at = m_position - m_hop / 2.0;
+    if (m_nextBeat < 0) {
+        m_nextBeat = at + m_period;
+        while (m_nextBeat < m_position)
+            m_nextBeat += m_period;
+        return;
+    }
+
+    double last = m_nextBeat - m_period;
+    double nearest = std::fabs(at - last) < std::fabs(at - m_nextBeat) ? last : m_nextBeat;
+    if (std::fabs(at - nearest) < 0.15 * m_period)
+        m_nextBeat += (at - nearest) / 2;
+}
+
+/**
+ * \fn QString LifxAudioAnalyzer::kernel()
+ * \return The name of the kernels the analysis uses, scalar, sse4.1 or avx2
+ */
+QString LifxAudioAnalyzer::kernel()
+{
+    return QString(kernels().name);
+}
@@ -0,0 +1,218 @@
+/*
+ * One bit per fleet row, used for indexes and query results
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxbitmap.h"
+
+/**
+ * \fn LifxBitmap::LifxBitmap(int size, bool value)
+ * \param size Number of rows
+ * \param value Initial value of every bit
+ */
+LifxBitmap::LifxBitmap(int size, bool value) : m_size(0)
+{
+    resize(size);
+    fill(value);
+}
+
+LifxBitmap::~LifxBitmap()
+{
+}
+
+/**
+ * \fn void LifxBitmap::resize(int size)
+ * \param size The new number of rows
+ *
+ * New rows are 0, rows past the new size are dropped
+ */
+void LifxBitmap::resize(int size)
+{
+    if (size < 0)
+        size = 0;
+
+    m_words.resize((size + 63) / 64);
+    if (size > m_size) {
+        int first = m_size / 64;
+        // The tail of the old last word is already 0, only whole new words need clearing
+        for (int i = (m_size % 64) ? first + 1 : first; i < m_words.size(); i++)
+            m_words[i] = 0;
+    }
+    m_size = size;
+    clearTail();
+}
+
+/**
+ * \fn void LifxBitmap::fill(bool value)
+ * \param value The value to set every bit to
+ */
+void LifxBitmap::fill(bool value)
+{
+    quint64 word = value ? ~0ULL : 0ULL;
+
+    for (int i = 0; i < m_words.size(); i++)
+        m_words[i] = word;
+
+    clearTail();
+}
+
+void LifxBitmap::clearTail()
+{
+    if (m_size % 64)
+        m_words[m_words.size() - 1] &= (1ULL << (m_size % 64)) - 1;
+}
+
+/**
+ * \fn void LifxBitmap::set(int index, bool value)
+ * \param index The row to change, the bitmap grows if needed
+ * \param value The new bit value
+ */
+void LifxBitmap::set(int index, bool value)
+{
+    if (index < 0)
+        return;
+
+    if (index >= m_size) {
+        if (!value)
+            return;
+        resize(index + 1);
+    }
+
+    if (value)
+        m_words[index / 64] |= 1ULL << (index % 64);
+    else
+        m_words[index / 64] &= ~(1ULL << (index % 64));
+}
+
+/**
+ * \fn bool LifxBitmap::test(int index) const
+ * \param index The row to check
+ * \return The bit for index, false if index is out of range
+ */
+bool LifxBitmap::test(int index) const
+{
+    if (index < 0 || index >= m_size)
+        return false;
+
+    return (m_words[index / 64] >> (index % 64)) & 1;
+}
+
+/**
+ * \fn int LifxBitmap::count() const
+ * \return The number of rows which are set
+ */
+int LifxBitmap::count() const
+{
+    int count = 0;
+
+    for (int i = 0; i < m_words.size(); i++)
+        count += qPopulationCount(m_words[i]);
+
+    return count;
+}
+
+/**
+ * \fn bool LifxBitmap::isEmpty() const
+ * \return True if no rows are set
+ */
+bool LifxBitmap::isEmpty() const
+{
+    for (int i = 0; i < m_words.size(); i++) {
+        if (m_words[i])
+            return false;
+    }
+    return true;
+}
+
+/**
+ * \fn QVector<int> LifxBitmap::indexes() const
+ * \return The rows which are set, in ascending order
+ */
+QVector<int> LifxBitmap::indexes() const
+{
+    QVector<int> result;
+
+    result.reserve(count());
+    for (int i = 0; i < m_words.size(); i++) {
+        quint64 word = m_words[i];
+        while (word) {
+            result.append(i * 64 + qCountTrailingZeroBits(word));
+            word &= word - 1;
+        }
+    }
+    return result;
+}
+
+/**
+ * \fn LifxBitmap& LifxBitmap::operator&=(const LifxBitmap &other)
+ * \param other The rows to keep
+ * \return This bitmap, holding only rows set in both
+ *
+ * Rows past the end of other are treated as 0
+ */
+LifxBitmap& LifxBitmap::operator&=(const LifxBitmap &other)
+{
+    int common = qMin(m_words.size(), other.m_words.size());
+
+    for (int i = 0; i < common; i++)
+        m_words[i] &= other.m_words[i];
+    for (int i = common; i < m_words.size(); i++)
+        m_words[i] = 0;
+
+    return *this;
+}
+
+/**
+ * \fn LifxBitmap& LifxBitmap::operator|=(const LifxBitmap &other)
+ * \param other The rows to add
+ * \return This bitmap, grown to cover other if needed
+ */
+LifxBitmap& LifxBitmap::operator|=(const LifxBitmap &other)
+{
+    if (other.m_size > m_size)
+        resize(other.m_size);
+
+    for (int i = 0; i < other.m_words.size(); i++)
+        m_words[i] |= other.m_words[i];
+
+    return *this;
+}
+
+/**
+ * \fn LifxBitmap& LifxBitmap::subtract(const LifxBitmap &other)
+ * \param other The rows to remove
+ * \return This bitmap, without any row set in other
+ */
+LifxBitmap& LifxBitmap::subtract(const LifxBitmap &other)
+{
+    int common = qMin(m_words.size(), other.m_words.size());
+
+    for (int i = 0; i < common; i++)
+        m_words[i] &= ~other.m_words[i];
+
+    return *this;
+}
+
+/**
+ * \fn bool LifxBitmap::operator==(const LifxBitmap &other) const
+ * \param other The bitmap to compare to
+ * \return True if both have the same size and rows set
+ */
+bool LifxBitmap::operator==(const LifxBitmap &other) const
+{
+    return m_size == other.m_size && m_words == other.m_words;
+}
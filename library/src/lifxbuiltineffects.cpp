@@ -0,0 +1,222 @@
+/*
+ * The effects that come with the library
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxbuiltineffects.h"
+#include "lifxlayout.h"
+#include "hsbk.h"
+
+#include <cmath>
+
+namespace {
+
+inline float fraction(float value)
+{
+    return value - std::floor(value);
+}
+
+inline lx_hsbk_t wheel(float degrees, float spct, float vpct)
+{
+    HSBK color;
+
+    color.hsvColorWheel(static_cast<uint16_t>(std::lround(fraction(degrees / 360) * 360)) % 360, spct, vpct);
+    return { color.h(), color.s(), color.b(), color.k() };
+}
+
+/*
+ * A soft band sweeping across the layout, LifxLayout::chase() with its
+ * closure rebuilt when a parameter changes
+ */
+class ChaseEffect : public LifxEffect
+{
+public:
+    const char* name() const override { return "chase"; }
+
+    void setParameter(const char *key, double value) override
+    {
+        QByteArray k(key);
+
+        if (k == "hue")
+            m_hue = static_cast<float>(value);
+        else if (k == "width")
+            m_width = static_cast<float>(value);
+        else if (k == "period")
+            m_period = static_cast<int>(value);
+        else if (k == "dx")
+            m_dx = static_cast<float>(value);
+        else if (k == "dy")
+            m_dy = static_cast<float>(value);
+        else if (k == "dz")
+            m_dz = static_cast<float>(value);
+        else
+            return;
+        m_effect = nullptr;
+    }
+
+    void render(const LifxEffectFrame &frame) override
+    {
+        if (!m_effect) {
+            lx_hsbk_t band = wheel(m_hue, 100, 100);
+            m_effect = LifxLayout::chase(HSBK(band.hue, band.saturation, band.brightness, band.kelvin),
+                                         HSBK(band.hue, band.saturation, 0, band.kelvin),
+                                         m_dx, m_dy, m_dz, m_width, m_period);
+        }
+        m_effect(*frame.layout, frame.msecs, frame.out);
+    }
+
+private:
+    LifxLayout::Effect m_effect;
+    float m_hue = 240;
+    float m_width = 1;
+    int m_period = 3000;
+    float m_dx = 1;
+    float m_dy = 0;
+    float m_dz = 0;
+};
+
+/*
+ * Points flash at random and fade out, each frame decays the last
+ */
+class TwinkleEffect : public LifxEffect
+{
+public:
+    const char* name() const override { return "twinkle"; }
+
+    void setParameter(const char *key, double value) override
+    {
+        QByteArray k(key);
+
+        if (k == "hue")
+            m_hue = static_cast<float>(value);
+        else if (k == "saturation")
+            m_saturation = static_cast<float>(value);
+        else if (k == "rate")
+            m_rate = qMax(value, 0.0);
+        else if (k == "decay")
+            m_decay = qMax(value, 1.0);
+    }
+
+    void render(const LifxEffectFrame &frame) override
+    {
+        lx_hsbk_t spark = wheel(m_hue, m_saturation, 100);
+        double keep = std::pow(0.5, frame.delta / m_decay);
+        double chance = m_rate * frame.delta / 1000;
+        QRandomGenerator *random = QRandomGenerator::global();
+
+        for (int i = 0; i < frame.count; i++) {
+            uint16_t brightness = static_cast<uint16_t>(frame.previous[i].brightness * keep);
+
+            if (chance > 0 && random->generateDouble() < chance)
+                brightness = 65535;
+            frame.out[i] = spark;
+            frame.out[i].brightness = brightness;
+        }
+    }
+
+private:
+    float m_hue = 45;
+    float m_saturation = 20;
+    double m_rate = 0.3;
+    double m_decay = 400;
+};
+
+/*
+ * HSBK::hsvColorWheel() laid across the layout and scrolling. The wheel is
+ * made once into a table a degree apart, so a frame is a lookup a point.
+ */
+class RainbowEffect : public LifxEffect
+{
+public:
+    const char* name() const override { return "rainbow"; }
+
+    void setParameter(const char *key, double value) override
+    {
+        QByteArray k(key);
+
+        if (k == "wavelength")
+            m_wavelength = static_cast<float>(value);
+        else if (k == "period")
+            m_period = qMax(static_cast<int>(value), 1);
+        else if (k == "brightness") {
+            m_brightness = static_cast<float>(value);
+            m_wheel.clear();
+        }
+        else if (k == "dx")
+            m_dx = static_cast<float>(value);
+        else if (k == "dy")
+            m_dy = static_cast<float>(value);
+        else if (k == "dz")
+            m_dz = static_cast<float>(value);
+    }
+
+    void render(const LifxEffectFrame &frame) override
+    {
+        if (m_wheel.isEmpty()) {
+            m_wheel.resize(360);
+            for (int d = 0; d < 360; d++)
+                m_wheel[d] = wheel(d, 100, m_brightness);
+        }
+
+        float k = m_wavelength > 0 ? 360 / m_wavelength : 0;
+        float phase = 360 * static_cast<float>(frame.msecs % m_period) / m_period;
+
+        m_distance.resize(frame.count);
+        frame.layout->project(m_dx, m_dy, m_dz, m_distance.data());
+        for (int i = 0; i < frame.count; i++) {
+            int degree = static_cast<int>(fraction((m_distance[i] * k - phase) / 360) * 360);
+            frame.out[i] = m_wheel[qMin(degree, 359)];
+        }
+    }
+
+private:
+    QVector<lx_hsbk_t> m_wheel;
+    QVector<float> m_distance;
+    float m_wavelength = 4;
+    int m_period = 5000;
+    float m_brightness = 100;
+    float m_dx = 1;
+    float m_dy = 0;
+    float m_dz = 0;
+};
+
+}
+
+/**
+ * \fn QStringList LifxBuiltinEffects::names()
+ * \return The names create() knows
+ */
+QStringList LifxBuiltinEffects::names()
+{
+    return { "chase", "twinkle", "rainbow" };
+}
+
+/**
+ * \fn LifxEffect* LifxBuiltinEffects::create(const QString &name)
+ * \param name One of names()
+ * \return A new effect the caller deletes, nullptr if name isn't built in
+ */
+LifxEffect* LifxBuiltinEffects::create(const QString &name)
+{
+    if (name == "chase")
+        return new ChaseEffect();
+    if (name == "twinkle")
+        return new TwinkleEffect();
+    if (name == "rainbow")
+        return new RainbowEffect();
+    return nullptr;
+}
@@ -26,23 +26,46 @@
  */
 LifxBulb::LifxBulb()
 {
-    m_port = 0;
+    m_fleet = new LifxFleet(1);
+    m_ownsFleet = true;
+    m_index = m_fleet->add();
+    init();
+}
+
+/**
+ * \fn LifxBulb::LifxBulb(LifxFleet *fleet, uint64_t target)
+ * \param fleet The fleet which stores the state of this bulb
+ * \param target The MAC as a 64bit number
+ * 
+ * Creates a handle over the fleet row for target, adding the row if
+ * needed. The fleet must outlive the bulb.
+ */
+LifxBulb::LifxBulb(LifxFleet *fleet, uint64_t target)
+{
+    m_fleet = fleet;
+    m_ownsFleet = false;
+    m_index = m_fleet->add(target);
+    init();
+}
+
+void LifxBulb::init()
+{
     m_major = 0;
     m_minor = 0;
     m_label = "Unknown";
-    m_power = 0;
     m_vid = 0;
     m_pid = 0;
     m_inDiscovery = true;
-    m_rssi = -100;
-    m_deviceColor = (lx_dev_color_t*)malloc(sizeof(lx_dev_color_t));
-    memset(m_deviceColor, 0, sizeof(lx_dev_color_t));
-    memset(m_target, 0, 8);
+    m_product = nullptr;
+    m_confirmedPower = 0;
+    memset(&m_confirmedColor, 0, sizeof(lx_dev_color_t));
 }
 
 LifxBulb::~LifxBulb()
 {
-    free(m_deviceColor);
+    delete m_product;
+    if (m_ownsFleet)
+        delete m_fleet;
 }
 
 /**
@@ -65,8 +88,8 @@ void LifxBulb::setDiscoveryActive(bool discovery)
  */
 void LifxBulb::setAddress(QHostAddress address, uint32_t port)
 {
-    m_address = address;
-    m_port = port;
+    setAddress(address);
+    setPort(port);
 }
 
 /**
@@ -79,11 +102,18 @@ void LifxBulb::setAddress(QHostAddress address, uint32_t port)
  */
 void LifxBulb::setAddress(QHostAddress address)
 {
-    if (address != m_address) {
-        if (!m_address.isNull()) {
-            qWarning() << __PRETTY_FUNCTION__ << ":" << m_label << "replacing" << m_address << "with" << address;
+    bool ok = false;
+    quint32 ipv4 = address.toIPv4Address(&ok);
+
+    if (!ok) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << m_label << "ignoring non IPv4 address" << address;
+        return;
+    }
+    if (ipv4 != m_fleet->ipv4(m_index)) {
+        if (m_fleet->ipv4(m_index) != 0) {
+            qWarning() << __PRETTY_FUNCTION__ << ":" << m_label << "replacing" << addressToString(false) << "with" << address;
         }
-        m_address = address;
+        m_fleet->setAddress(m_index, ipv4);
     }
 }
 
@@ -97,7 +127,7 @@ void LifxBulb::setAddress(QHostAddress address)
  */
 void LifxBulb::setPort(uint32_t port)
 {
-    m_port = port;
+    m_fleet->setPort(m_index, static_cast<quint16>(port));
 }
 
 /**
@@ -122,7 +152,10 @@ void LifxBulb::setService(uint8_t service)
  */
 void LifxBulb::setTarget(uint8_t *target)
 {
-    memcpy(m_target, target, 8);
+    uint64_t t;
+
+    memcpy(&t, target, 8);
+    m_fleet->setTarget(m_index, t);
 }
 
 /**
@@ -133,7 +166,7 @@ void LifxBulb::setTarget(uint8_t *target)
  */
 void LifxBulb::setPower(uint16_t power)
 {
-    m_power = power;
+    m_fleet->setPower(m_index, power);
 }
 
 /**
@@ -144,13 +177,53 @@ void LifxBulb::setPower(uint16_t power)
  */
 QString LifxBulb::macToString() const
 {
+    const uint8_t *mac = m_fleet->targetBytes(m_index);
+
     return QString("%1:%2:%3:%4:%5:%6")
-                    .arg(m_target[0], 2, 16, QLatin1Char('0'))
-                    .arg(m_target[1], 2, 16, QLatin1Char('0'))
-                    .arg(m_target[2], 2, 16, QLatin1Char('0'))
-                    .arg(m_target[3], 2, 16, QLatin1Char('0'))
-                    .arg(m_target[4], 2, 16, QLatin1Char('0'))
-                    .arg(m_target[5], 2, 16, QLatin1Char('0'));
+                    .arg(mac[0], 2, 16, QLatin1Char('0'))
+                    .arg(mac[1], 2, 16, QLatin1Char('0'))
+                    .arg(mac[2], 2, 16, QLatin1Char('0'))
+                    .arg(mac[3], 2, 16, QLatin1Char('0'))
+                    .arg(mac[4], 2, 16, QLatin1Char('0'))
+                    .arg(mac[5], 2, 16, QLatin1Char('0'));
+}
+
+/**
+ * \fn uint64_t LifxBulb::macToTarget(const QString &mac, bool *ok)
+ * \param mac A MAC like d0:73:d5:01:02:03, the colons are optional
+ * \param ok If not null, set to false if mac can't be read
+ * \return The MAC as the 64bit number targetAsLong() uses
+ */
+uint64_t LifxBulb::macToTarget(const QString &mac, bool *ok)
+{
+    QByteArray bytes = QByteArray::fromHex(QString(mac).remove(':').toLatin1());
+    uint8_t raw[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    uint64_t target = 0;
+
+    if (ok)
+        *ok = bytes.size() == 6;
+    if (bytes.size() != 6)
+        return 0;
+
+    memcpy(raw, bytes.constData(), 6);
+    memcpy(&target, raw, sizeof(target));
+    return target;
+}
+
+/**
+ * \fn QString LifxBulb::targetToMac(uint64_t target)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \return The MAC with colons, the form macToTarget() and the fleet cache use
+ */
+QString LifxBulb::targetToMac(uint64_t target)
+{
+    uint8_t raw[8];
+    QStringList octets;
+
+    memcpy(raw, &target, sizeof(raw));
+    for (int i = 0; i < 6; i++)
+        octets.append(QString("%1").arg(raw[i], 2, 16, QChar('0')));
+    return octets.join(':');
 }
 
 /**
@@ -164,10 +237,10 @@ QString LifxBulb::addressToString(bool isIPV6) const
 {
     if (!isIPV6) {
         bool conversionOK = false;
-        QHostAddress temp(m_address.toIPv4Address(&conversionOK));
+        QHostAddress temp(address().toIPv4Address(&conversionOK));
         return temp.toString();
     }
-    return m_address.toString();
+    return address().toString();
 }
 
 /**
@@ -184,19 +257,17 @@ bool LifxBulb::operator==(const LifxBulb &bulb)
 {
     bool rval = true;
     
-    for (int i = 0; i < 8; i++) {
-        if (m_target[i] != bulb.m_target[i])
-            return false;
-    }
+    if (targetAsLong() != bulb.targetAsLong())
+        return false;
     
-    rval &= (m_address == bulb.m_address);
+    rval &= (address() == bulb.address());
     rval &= (m_label == bulb.m_label);
     rval &= (m_color == bulb.m_color);
     rval &= (m_service == bulb.m_service);
-    rval &= (m_port == bulb.m_port);
+    rval &= (port() == bulb.port());
     rval &= (m_major == bulb.m_major);
     rval &= (m_minor == bulb.m_minor);
-    rval &= (m_power == bulb.m_power);
+    rval &= (power() == bulb.power());
     rval &= (m_build == bulb.m_build);
     return rval;
 }
@@ -213,8 +284,10 @@ bool LifxBulb::operator==(const LifxBulb &bulb)
  */
 bool LifxBulb::operator==(const uint8_t* array)
 {
+    const uint8_t *mac = m_fleet->targetBytes(m_index);
+
     for (int i = 0; i < 6; i++) {
-        if (m_target[i] != array[i])
+        if (mac[i] != array[i])
             return false;
     }
         
@@ -222,7 +295,7 @@ bool LifxBulb::operator==(const uint8_t* array)
 }
 
 /**
- * \fn uint64_t LifxBulb::targetAsLong()
+ * \fn uint64_t LifxBulb::targetAsLong() const
  * \return Returns the 64bit numeric representation of the mac address field
  * 
  * This number is effectively a UUID for the bulb and will be unique to each
@@ -230,11 +303,9 @@ bool LifxBulb::operator==(const uint8_t* array)
  * as we may not have a bulb name at every point in the process. The bulbs
  * should be handled by name by consumers of this API.
  */
-uint64_t LifxBulb::targetAsLong()
+uint64_t LifxBulb::targetAsLong() const
 {
-    uint64_t target;
-    memcpy(&target, m_target, sizeof(uint64_t));
-    return target;
+    return m_fleet->target(m_index);
 }
 
 /**
@@ -268,7 +339,7 @@ void LifxBulb::setRSSI(float signal)
     int rssi = static_cast<int>(qFloor(10 * std::log10(signal) + 0.5));
 
     if (rssi == 200) {
-        m_rssi = -100;
+        m_fleet->setRSSI(m_index, -100);
     }
 
     if (rssi > 0) {
@@ -276,29 +347,29 @@ void LifxBulb::setRSSI(float signal)
             case 4:
             case 5:
             case 6:
-                m_rssi = -90;
+                m_fleet->setRSSI(m_index, -90);
                 break;
             case 7:
             case 8:
             case 9:
             case 10:
             case 11:
-                m_rssi = -80;
+                m_fleet->setRSSI(m_index, -80);
                 break;
             case 12:
             case 13:
             case 14:
             case 15:
             case 16:
-                m_rssi = -70;
+                m_fleet->setRSSI(m_index, -70);
                 break;
             default:
-                m_rssi = -60;
+                m_fleet->setRSSI(m_index, -60);
                 break;
         }
     }
     else {
-        m_rssi = rssi;
+        m_fleet->setRSSI(m_index, rssi);
     }
 }
 
@@ -318,7 +389,7 @@ void LifxBulb::setLabel(QString label)
  */
 void LifxBulb::setDuration(uint32_t duration)
 {
-    m_deviceColor->duration = duration;
+    deviceColor()->duration = duration;
 }
 
 /**
@@ -328,7 +399,7 @@ void LifxBulb::setDuration(uint32_t duration)
  */
 bool LifxBulb::isOn() const
 {
-    if (m_power)
+    if (power())
         return true;
     
     return false;
@@ -339,10 +410,12 @@ bool LifxBulb::isOn() const
  * \param color A pointer to a lightstate struct
  * 
  * This works a bit different than translating directly from a QColor. It will
- * store the original value into the m_deviceColor member variable, but it will
+ * store the original value into the device color, but it will
  * also set the m_color QColor object to the reasonable approximation values. The
  * reasonable approx values are determined by finding the percentage of max for
  * each value and using that as the qreal value which is then set into the QColor.
+ * 
+ * While a waveform is running, only the power is taken from the reply.
  */
 void LifxBulb::setDevColor(lx_dev_lightstate_t* color)
 {
@@ -358,12 +431,112 @@ void LifxBulb::setDevColor(lx_dev_lightstate_t* color)
     if (color->brightness > 0)
         v = ((qreal)color->brightness / (qreal)std::numeric_limits<uint16_t>::max());
     
-    m_deviceColor->brightness = color->brightness;
-    m_deviceColor->hue = color->hue;
-    m_deviceColor->saturation = color->saturation;
-    m_deviceColor->kelvin = color->kelvin;
-    m_power = color->power;
+    setPower(color->power);
+    confirmPower(color->power);
+
+    // Mid waveform, the bulb reports where it is on the curve, not where it will end up
+    if (m_waveform.isActive())
+        return;
+
+    deviceColor()->brightness = color->brightness;
+    deviceColor()->hue = color->hue;
+    deviceColor()->saturation = color->saturation;
+    deviceColor()->kelvin = color->kelvin;
     m_color.setHsvF(h, s, v);
+
+    m_confirmedColor = *deviceColor();
+    m_colorConfirmed.start();
+}
+
+/**
+ * \fn void LifxBulb::confirmPower(uint16_t power)
+ * \param power The power level the bulb reported
+ * 
+ * Records the power as confirmed by the bulb, now.
+ */
+void LifxBulb::confirmPower(uint16_t power)
+{
+    m_confirmedPower = power;
+    m_powerConfirmed.start();
+}
+
+/**
+ * \fn void LifxBulb::invalidateColor()
+ * 
+ * Called when a color change goes out. Until the bulb reports again
+ * we can't say what it shows, it may be part way through the change.
+ */
+void LifxBulb::invalidateColor()
+{
+    m_colorConfirmed.invalidate();
+}
+
+/**
+ * \fn void LifxBulb::invalidatePower()
+ * 
+ * Called when a power change goes out, see invalidateColor()
+ */
+void LifxBulb::invalidatePower()
+{
+    m_powerConfirmed.invalidate();
+}
+
+/**
+ * \fn bool LifxBulb::colorConfirmed(qint64 window) const
+ * \param window How old in millis the confirmation may be
+ * \return True if the bulb reported the color we want within window millis
+ * 
+ * The color we want is the one that would be sent next. Duration is
+ * not compared, once the bulb reports the target color there is no
+ * transition left for a duration to change.
+ */
+bool LifxBulb::colorConfirmed(qint64 window) const
+{
+    if (!m_colorConfirmed.isValid() || m_colorConfirmed.elapsed() > window)
+        return false;
+
+    if (m_waveform.isActive())
+        return false;
+
+    return m_confirmedColor.hue == deviceColor()->hue &&
+           m_confirmedColor.saturation == deviceColor()->saturation &&
+           m_confirmedColor.brightness == deviceColor()->brightness &&
+           m_confirmedColor.kelvin == deviceColor()->kelvin;
+}
+
+/**
+ * \fn bool LifxBulb::powerConfirmed(uint16_t power, qint64 window) const
+ * \param power The power level we want
+ * \param window How old in millis the confirmation may be
+ * \return True if the bulb reported being on or off to match power within window millis
+ */
+bool LifxBulb::powerConfirmed(uint16_t power, qint64 window) const
+{
+    if (!m_powerConfirmed.isValid() || m_powerConfirmed.elapsed() > window)
+        return false;
+
+    return (m_confirmedPower != 0) == (power != 0);
+}
+
+/**
+ * \fn HSBK LifxBulb::confirmedColor() const
+ * \return The color the bulb last reported, see confirmedAge() for how long ago
+ */
+HSBK LifxBulb::confirmedColor() const
+{
+    return HSBK(m_confirmedColor.hue, m_confirmedColor.saturation, m_confirmedColor.brightness, m_confirmedColor.kelvin);
+}
+
+/**
+ * \fn qint64 LifxBulb::confirmedAge() const
+ * \return Millis since the bulb last reported its color, or -1 if it hasn't since the last change was sent
+ */
+qint64 LifxBulb::confirmedAge() const
+{
+    if (!m_colorConfirmed.isValid())
+        return -1;
+
+    return m_colorConfirmed.elapsed();
 }
 
 /**
@@ -374,7 +547,8 @@ void LifxBulb::setDevColor(lx_dev_lightstate_t* color)
  */
 void LifxBulb::setBrightness(uint16_t brightness)
 {
-    m_deviceColor->brightness = brightness;
+    m_waveform.stop();
+    deviceColor()->brightness = brightness;
 }
 
 /**
@@ -386,10 +560,11 @@ void LifxBulb::setBrightness(uint16_t brightness)
  */
 void LifxBulb::setColor(lx_dev_color_t &color)
 {
-    uint16_t max = std::numeric_limits<uint16_t>::max();
+    qreal max = std::numeric_limits<uint16_t>::max();
     m_color.setHsvF(color.hue / max, color.saturation / max, color.brightness / max);
     
-    memcpy(&m_deviceColor, &color, sizeof(lx_dev_color_t));
+    m_waveform.stop();
+    memcpy(deviceColor(), &color, sizeof(lx_dev_color_t));
 }
 
 /**
@@ -404,7 +579,8 @@ void LifxBulb::setColor(HSBK &color)
     m_color = color.getQColor();
     lx_dev_color_t c = color.getHSBK();
     
-    memcpy(m_deviceColor, &c, sizeof(lx_dev_color_t));
+    m_waveform.stop();
+    memcpy(deviceColor(), &c, sizeof(lx_dev_color_t));
 }
 
 
@@ -421,14 +597,17 @@ void LifxBulb::setColor(HSBK &color)
  */
 void LifxBulb::setColor(QColor &color)
 {
-    uint16_t h = color.hsvHueF() * std::numeric_limits<uint16_t>::max();
-    uint16_t s = color.hsvSaturationF() * std::numeric_limits<uint16_t>::max();
-    uint16_t v = color.valueF() * std::numeric_limits<uint16_t>::max();
+    qreal max = std::numeric_limits<uint16_t>::max();
+    // Grays have no hue, and QColor reports -1 for them
+    uint16_t h = color.hsvHueF() < 0 ? 0 : qRound(color.hsvHueF() * max);
+    uint16_t s = qRound(color.hsvSaturationF() * max);
+    uint16_t v = qRound(color.valueF() * max);
     
+    m_waveform.stop();
     m_color = color;
-    m_deviceColor->brightness = v;
-    m_deviceColor->saturation = s;
-    m_deviceColor->hue = h;
+    deviceColor()->brightness = v;
+    deviceColor()->saturation = s;
+    deviceColor()->hue = h;
 }
 
 /**
@@ -438,7 +617,59 @@ void LifxBulb::setColor(QColor &color)
  */
 void LifxBulb::setKelvin(uint16_t kelvin)
 {
-    m_deviceColor->kelvin = kelvin;
+    deviceColor()->kelvin = kelvin;
+}
+
+/**
+ * \fn void LifxBulb::setWaveform(const LifxWaveform &waveform)
+ * \param waveform The waveform being sent to the bulb
+ * 
+ * Starts modelling the waveform from the color the bulb is showing now.
+ * The device color is moved to the color the bulb will be left at when
+ * the waveform completes, which is the original color for a transient
+ * waveform.
+ */
+void LifxBulb::setWaveform(const LifxWaveform &waveform)
+{
+    lx_dev_color_t origin = m_waveform.isActive() ? m_waveform.currentColor() : *deviceColor();
+    uint32_t duration = deviceColor()->duration;
+    qreal max = std::numeric_limits<uint16_t>::max();
+
+    m_waveform = waveform;
+    m_waveform.start(origin);
+    invalidateColor();
+    *deviceColor() = m_waveform.finalColor();
+    deviceColor()->duration = duration;
+    m_color.setHsvF(deviceColor()->hue / max, deviceColor()->saturation / max, deviceColor()->brightness / max);
+}
+
+/**
+ * \fn HSBK LifxBulb::expectedColor() const
+ * \return The color the bulb should be showing right now
+ * 
+ * This is the last known color, unless a waveform is running, in which
+ * case it is the point on the waveform curve the bulb should be at.
+ */
+HSBK LifxBulb::expectedColor() const
+{
+    lx_dev_color_t c = m_waveform.isActive() ? m_waveform.currentColor() : *deviceColor();
+    return HSBK(c.hue, c.saturation, c.brightness, c.kelvin);
+}
+
+/**
+ * \fn QColor LifxBulb::color() const
+ * \return The QColor representation of what the bulb should be showing
+ */
+QColor LifxBulb::color() const
+{
+    if (m_waveform.isActive()) {
+        qreal max = std::numeric_limits<uint16_t>::max();
+        lx_dev_color_t c = m_waveform.currentColor();
+        QColor color;
+        color.setHsvF(c.hue / max, c.saturation / max, c.brightness / max);
+        return color;
+    }
+    return m_color;
 }
 
 /**
@@ -448,7 +679,7 @@ void LifxBulb::setKelvin(uint16_t kelvin)
  */
 lx_dev_color_t* LifxBulb::toDeviceColor() const
 {
-    return m_deviceColor;
+    return deviceColor();
 }
 
 /**
@@ -545,12 +776,155 @@ void LifxBulb::setProduct(QJsonObject& obj)
                     }
                 }
             }
+            delete m_product;
             m_product = product;
+            m_fleet->setCapabilities(m_index, (product->colorCapable() ? LifxFleet::Color : 0) |
+                                              (product->irCapable() ? LifxFleet::Infrared : 0) |
+                                              (product->multizoneCapable() ? LifxFleet::Multizone : 0) |
+                                              (product->matrixCapable() ? LifxFleet::Matrix : 0) |
+                                              (product->canChain() ? LifxFleet::Chain : 0));
             qDebug() << __PRETTY_FUNCTION__ << ": Bulb" << m_label << ":" << product;
         }
     }
 }
 
+/**
+ * \fn bool LifxBulb::isMultizone() const
+ * \return True if products.json says this is a strip or beam with zones
+ */
+bool LifxBulb::isMultizone() const
+{
+    if (m_product)
+        return m_product->multizoneCapable();
+
+    return false;
+}
+
+/**
+ * \fn void LifxBulb::setZoneState(lx_dev_extended_zones_state_t *state)
+ * \param state The STATE_EXTENDED_COLOR_ZONES payload from the device
+ * 
+ * Sizes the zone buffer from the reported zone count and stores the
+ * reported colors as both the frame and the confirmed device state.
+ */
+void LifxBulb::setZoneState(lx_dev_extended_zones_state_t *state)
+{
+    m_zones.resize(state->zones_count);
+    m_zones.setConfirmed(state->zone_index, state->colors, qMin<int>(state->colors_count, MAX_EXTENDED_ZONES));
+}
+
+/**
+ * \fn bool LifxBulb::isMatrix() const
+ * \return True if products.json says this is a tile, candle or other matrix device
+ */
+bool LifxBulb::isMatrix() const
+{
+    if (m_product)
+        return m_product->matrixCapable();
+
+    return false;
+}
+
+/**
+ * \fn void LifxBulb::setDeviceChain(lx_dev_device_chain_t *chain)
+ * \param chain The STATE_DEVICE_CHAIN payload from the device
+ * 
+ * Records the tiles in the chain and sizes the tile buffer to hold
+ * TILE_PIXELS for each of them. If the chain changed size, every
+ * tile is resent on the next update.
+ */
+void LifxBulb::setDeviceChain(lx_dev_device_chain_t *chain)
+{
+    int count = chain->tile_devices_count;
+
+    m_tileChain.resize(count);
+    for (int i = 0; i < MAX_CHAIN_TILES; i++) {
+        int index = chain->start_index + i;
+        if (index >= count)
+            break;
+        m_tileChain[index] = chain->tile_devices[i];
+    }
+    m_tiles.resize(count * TILE_PIXELS);
+}
+
+/**
+ * \fn void LifxBulb::setTileState(lx_dev_state64_t *state)
+ * \param state A STATE64 payload from the device
+ * 
+ * The reply reads the visible frame buffer, but updates are written to
+ * the back buffer first, which we know nothing about. So the colors are
+ * put in the frame for effects to start from, and the sent copy is left
+ * alone. The first update after discovery writes every tile.
+ */
+void LifxBulb::setTileState(lx_dev_state64_t *state)
+{
+    if (state->tile_index >= m_tileChain.size())
+        return;
+
+    int start = state->tile_index * TILE_PIXELS + state->y * state->width + state->x;
+    int count = TILE_PIXELS - (state->y * state->width + state->x);
+    m_tiles.setPixels(start, state->colors, count);
+}
+
+/**
+ * \fn int LifxBulb::tileWidth(int tile) const
+ * \param tile Index of the tile in the chain
+ * \return The number of pixels across the tile, 0 if the tile doesn't exist
+ */
+int LifxBulb::tileWidth(int tile) const
+{
+    if (tile < 0 || tile >= m_tileChain.size())
+        return 0;
+
+    return m_tileChain[tile].width;
+}
+
+/**
+ * \fn int LifxBulb::tileHeight(int tile) const
+ * \param tile Index of the tile in the chain
+ * \return The number of pixels down the tile, 0 if the tile doesn't exist
+ */
+int LifxBulb::tileHeight(int tile) const
+{
+    if (tile < 0 || tile >= m_tileChain.size())
+        return 0;
+
+    return m_tileChain[tile].height;
+}
+
+/**
+ * \fn lx_hsbk_t* LifxBulb::tilePixels(int tile)
+ * \param tile Index of the tile in the chain
+ * \return Pointer to the TILE_PIXELS colors for the tile, row major, or nullptr if the tile doesn't exist
+ * 
+ * All tiles are laid out one after the other, so an effect can also
+ * write the whole chain at once through tiles().data().
+ */
+lx_hsbk_t* LifxBulb::tilePixels(int tile)
+{
+    if (tile < 0 || tile >= m_tileChain.size())
+        return nullptr;
+
+    return m_tiles.data() + tile * TILE_PIXELS;
+}
+
+/**
+ * \fn void LifxBulb::setTilePixel(int tile, int x, int y, const HSBK &color)
+ * \param tile Index of the tile in the chain
+ * \param x Column on the tile
+ * \param y Row on the tile
+ * \param color The new color
+ */
+void LifxBulb::setTilePixel(int tile, int x, int y, const HSBK &color)
+{
+    int width = tileWidth(tile);
+
+    if (x < 0 || y < 0 || x >= width || y >= tileHeight(tile) || y * width + x >= TILE_PIXELS)
+        return;
+
+    m_tiles.setPixel(tile * TILE_PIXELS + y * width + x, color);
+}
+
 uint64_t LifxBulb::echoRequest(bool generate)
 {
     if (generate)
@@ -0,0 +1,48 @@
+/*
+ * A set of bulbs returned by a query
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxbulbset.h"
+
+LifxBulbSet::LifxBulbSet()
+{
+}
+
+/**
+ * \fn LifxBulbSet::LifxBulbSet(const LifxBitmap &rows, const QVector<LifxBulb*> &fleetBulbs)
+ * \param rows The fleet rows in the set
+ * \param fleetBulbs Every bulb, indexed by fleet row
+ *
+ * Rows without a bulb are dropped from the set
+ */
+LifxBulbSet::LifxBulbSet(const LifxBitmap &rows, const QVector<LifxBulb*> &fleetBulbs) : m_rows(rows)
+{
+    QVector<int> indexes = rows.indexes();
+
+    m_bulbs.reserve(indexes.size());
+    for (int index : indexes) {
+        if (index < fleetBulbs.size() && fleetBulbs[index] != nullptr)
+            m_bulbs.append(fleetBulbs[index]);
+        else
+            m_rows.set(index, false);
+    }
+}
+
+LifxBulbSet::~LifxBulbSet()
+{
+}
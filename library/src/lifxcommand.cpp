@@ -0,0 +1,129 @@
+/*
+ * A bulb command which can be queued from any thread
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxcommand.h"
+
+LifxCommand::LifxCommand() :
+    m_target(0), m_duration(0), m_source(0), m_hue(0), m_saturation(0),
+    m_brightness(0), m_kelvin(0), m_type(None), m_on(false), m_ack(false)
+{
+}
+
+/**
+ * \fn LifxCommand LifxCommand::color(uint64_t target, const HSBK &color, uint32_t duration, int source, bool ackRequired)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param color The HSBK color to set the bulb to
+ * \param duration The uint32_t value in millis to slow the transition down
+ * \param source An option source field to help identify the byte stream messages
+ * \param ackRequired True if the bulb should ACK the message
+ * \return A Color command
+ */
+LifxCommand LifxCommand::color(uint64_t target, const HSBK &color, uint32_t duration, int source, bool ackRequired)
+{
+    LifxCommand command;
+
+    command.m_type = Color;
+    command.m_target = target;
+    command.m_hue = color.h();
+    command.m_saturation = color.s();
+    command.m_brightness = color.b();
+    command.m_kelvin = color.k();
+    command.m_duration = duration;
+    command.m_source = source;
+    command.m_ack = ackRequired;
+    return command;
+}
+
+/**
+ * \fn LifxCommand LifxCommand::brightness(uint64_t target, uint16_t brightness, int source, bool ackRequired)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param brightness The new brightness, the rest of the color is kept
+ * \param source An option source field to help identify the byte stream messages
+ * \param ackRequired True if the bulb should ACK the message
+ * \return A Brightness command
+ */
+LifxCommand LifxCommand::brightness(uint64_t target, uint16_t brightness, int source, bool ackRequired)
+{
+    LifxCommand command;
+
+    command.m_type = Brightness;
+    command.m_target = target;
+    command.m_brightness = brightness;
+    command.m_source = source;
+    command.m_ack = ackRequired;
+    return command;
+}
+
+/**
+ * \fn LifxCommand LifxCommand::power(uint64_t target, bool on, int source, bool ackRequired)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param on True to turn the bulb on, false for off
+ * \param source An option source field to help identify the byte stream messages
+ * \param ackRequired True if the bulb should ACK the message
+ * \return A Power command
+ */
+LifxCommand LifxCommand::power(uint64_t target, bool on, int source, bool ackRequired)
+{
+    LifxCommand command;
+
+    command.m_type = Power;
+    command.m_target = target;
+    command.m_on = on;
+    command.m_source = source;
+    command.m_ack = ackRequired;
+    return command;
+}
+
+/**
+ * \fn LifxCommand LifxCommand::refresh(uint64_t target, int source)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param source An option source field to help identify the byte stream messages
+ * \return A Refresh command, which asks the bulb for its color
+ */
+LifxCommand LifxCommand::refresh(uint64_t target, int source)
+{
+    LifxCommand command;
+
+    command.m_type = Refresh;
+    command.m_target = target;
+    command.m_source = source;
+    return command;
+}
+
+/**
+ * \fn LifxCommand LifxCommand::waveform(uint64_t target, int source, bool ackRequired)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param source An option source field to help identify the byte stream messages
+ * \param ackRequired True if the bulb should ACK the message
+ * \return A Waveform command
+ *
+ * The waveform doesn't fit in a command, so this only marks the slot in
+ * a LifxCommandBatch, which keeps the waveform alongside it. Submitted
+ * on its own, it does nothing.
+ */
+LifxCommand LifxCommand::waveform(uint64_t target, int source, bool ackRequired)
+{
+    LifxCommand command;
+
+    command.m_type = Waveform;
+    command.m_target = target;
+    command.m_source = source;
+    command.m_ack = ackRequired;
+    return command;
+}
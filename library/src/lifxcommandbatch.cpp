@@ -0,0 +1,159 @@
+/*
+ * A set of bulb commands sent together
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxcommandbatch.h"
+
+/**
+ * \fn LifxCommandBatch::LifxCommandBatch(int source, bool ackRequired)
+ * \param source An option source field to help identify the byte stream messages
+ * \param ackRequired True if every bulb should ACK its message
+ */
+LifxCommandBatch::LifxCommandBatch(int source, bool ackRequired) : m_source(source), m_ackRequired(ackRequired)
+{
+}
+
+/**
+ * \fn LifxCommandBatch& LifxCommandBatch::setColor(LifxBulb *bulb, const HSBK &color, uint32_t duration)
+ * \param bulb The bulb to change
+ * \param color The HSBK color to set the bulb to
+ * \param duration The uint32_t value in millis to slow the transition down
+ * \return The batch, so calls can be chained
+ */
+LifxCommandBatch& LifxCommandBatch::setColor(LifxBulb *bulb, const HSBK &color, uint32_t duration)
+{
+    m_bulbs.append(bulb);
+    m_commands.append(LifxCommand::color(bulb ? bulb->targetAsLong() : 0, color, duration, m_source, m_ackRequired));
+    m_waveformIndex.append(-1);
+    return *this;
+}
+
+/**
+ * \fn LifxCommandBatch& LifxCommandBatch::setBrightness(LifxBulb *bulb, uint16_t brightness)
+ * \param bulb The bulb to change
+ * \param brightness The new brightness, the rest of the color is kept
+ * \return The batch, so calls can be chained
+ */
+LifxCommandBatch& LifxCommandBatch::setBrightness(LifxBulb *bulb, uint16_t brightness)
+{
+    m_bulbs.append(bulb);
+    m_commands.append(LifxCommand::brightness(bulb ? bulb->targetAsLong() : 0, brightness, m_source, m_ackRequired));
+    m_waveformIndex.append(-1);
+    return *this;
+}
+
+/**
+ * \fn LifxCommandBatch& LifxCommandBatch::setPower(LifxBulb *bulb, bool on)
+ * \param bulb The bulb to change
+ * \param on True to turn the bulb on, false for off
+ * \return The batch, so calls can be chained
+ */
+LifxCommandBatch& LifxCommandBatch::setPower(LifxBulb *bulb, bool on)
+{
+    m_bulbs.append(bulb);
+    m_commands.append(LifxCommand::power(bulb ? bulb->targetAsLong() : 0, on, m_source, m_ackRequired));
+    m_waveformIndex.append(-1);
+    return *this;
+}
+
+/**
+ * \fn LifxCommandBatch& LifxCommandBatch::setWaveform(LifxBulb *bulb, const LifxWaveform &waveform)
+ * \param bulb The bulb to change
+ * \param waveform The effect for the bulb to run
+ * \return The batch, so calls can be chained
+ */
+LifxCommandBatch& LifxCommandBatch::setWaveform(LifxBulb *bulb, const LifxWaveform &waveform)
+{
+    m_bulbs.append(bulb);
+    m_commands.append(LifxCommand::waveform(bulb ? bulb->targetAsLong() : 0, m_source, m_ackRequired));
+    m_waveformIndex.append(m_waveforms.size());
+    m_waveforms.append(waveform);
+    return *this;
+}
+
+/**
+ * \fn LifxCommandBatch& LifxCommandBatch::refresh(LifxBulb *bulb)
+ * \param bulb The bulb to ask for its color
+ * \return The batch, so calls can be chained
+ */
+LifxCommandBatch& LifxCommandBatch::refresh(LifxBulb *bulb)
+{
+    m_bulbs.append(bulb);
+    m_commands.append(LifxCommand::refresh(bulb ? bulb->targetAsLong() : 0, m_source));
+    m_waveformIndex.append(-1);
+    return *this;
+}
+
+/**
+ * \fn LifxCommandBatch& LifxCommandBatch::add(LifxBulb *bulb, const LifxCommand &command)
+ * \param bulb The bulb the command is for
+ * \param command A command from the LifxCommand functions, it keeps its own source and ACK
+ * \return The batch, so calls can be chained
+ *
+ * Waveform commands can't be added this way since they don't carry the
+ * waveform, use setWaveform() for those.
+ */
+LifxCommandBatch& LifxCommandBatch::add(LifxBulb *bulb, const LifxCommand &command)
+{
+    if (command.type() == LifxCommand::Waveform || command.type() == LifxCommand::None)
+        return *this;
+
+    m_bulbs.append(bulb);
+    m_commands.append(command);
+    m_waveformIndex.append(-1);
+    return *this;
+}
+
+/**
+ * \fn void LifxCommandBatch::reserve(int size)
+ * \param size The number of commands the batch will hold
+ */
+void LifxCommandBatch::reserve(int size)
+{
+    m_bulbs.reserve(size);
+    m_commands.reserve(size);
+    m_waveformIndex.reserve(size);
+}
+
+/**
+ * \fn void LifxCommandBatch::clear()
+ *
+ * Empties the batch so it can be filled again, source and ACK are kept.
+ */
+void LifxCommandBatch::clear()
+{
+    m_bulbs.clear();
+    m_commands.clear();
+    m_waveformIndex.clear();
+    m_waveforms.clear();
+}
+
+/**
+ * \fn LifxWaveform LifxCommandBatch::waveform(int index) const
+ * \param index The command to look at
+ * \return The waveform for a Waveform command, an empty waveform otherwise
+ */
+LifxWaveform LifxCommandBatch::waveform(int index) const
+{
+    int waveform = m_waveformIndex[index];
+
+    if (waveform < 0)
+        return LifxWaveform();
+
+    return m_waveforms[waveform];
+}
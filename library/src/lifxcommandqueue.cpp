@@ -0,0 +1,155 @@
+/*
+ * Bounded lock free queue of bulb commands
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxcommandqueue.h"
+
+/**
+ * \fn LifxCommandQueue::LifxCommandQueue(int capacity, OverflowPolicy policy)
+ * \param capacity Most commands held at once, rounded up to a power of 2 (at least 2)
+ * \param policy What push() does when the queue is full
+ */
+LifxCommandQueue::LifxCommandQueue(int capacity, OverflowPolicy policy) :
+    m_policy(policy), m_dropped(0), m_tail(0), m_head(0)
+{
+    size_t size = 2;
+
+    while (size < static_cast<size_t>(qMax(capacity, 2)))
+        size *= 2;
+
+    m_mask = size - 1;
+    m_cells = new Cell[size];
+    for (size_t i = 0; i < size; i++)
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+LifxCommandQueue::~LifxCommandQueue()
+{
+    delete [] m_cells;
+}
+
+bool LifxCommandQueue::tryPush(const LifxCommand &command)
+{
+    size_t position = m_tail.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Cell *cell = &m_cells[position & m_mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+        if (diff == 0) {
+            // The cell is free for this lap, claim the position
+            if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell->command = command;
+                cell->sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            // The cell still holds a command from the previous lap, full
+            return false;
+        }
+        else {
+            position = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * \fn bool LifxCommandQueue::push(const LifxCommand &command)
+ * \param command The command to queue
+ * \return True if the command was queued, false if it was rejected because the queue is full
+ *
+ * Safe from any thread, never blocks.
+ */
+bool LifxCommandQueue::push(const LifxCommand &command)
+{
+    LifxCommand discarded;
+
+    while (!tryPush(command)) {
+        if (m_policy.load(std::memory_order_relaxed) == RejectNewest) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // Make room, another producer may take it first, in which case go again
+        if (pop(discarded))
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+/**
+ * \fn bool LifxCommandQueue::pop(LifxCommand &command)
+ * \param command Set to the oldest command
+ * \return True if there was a command, false if the queue is empty
+ *
+ * Safe from any thread, never blocks.
+ */
+bool LifxCommandQueue::pop(LifxCommand &command)
+{
+    size_t position = m_head.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Cell *cell = &m_cells[position & m_mask];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+
+        if (diff == 0) {
+            if (m_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                command = cell->command;
+                // Free the cell for the push one lap from now
+                cell->sequence.store(position + m_mask + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            position = m_head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * \fn int LifxCommandQueue::popBatch(LifxCommand *commands, int max)
+ * \param commands Array with room for max commands
+ * \param max The most commands to take
+ * \return The number of commands copied into commands, oldest first
+ */
+int LifxCommandQueue::popBatch(LifxCommand *commands, int max)
+{
+    int count = 0;
+
+    while (count < max && pop(commands[count]))
+        count++;
+
+    return count;
+}
+
+/**
+ * \fn int LifxCommandQueue::sizeApprox() const
+ * \return The number of queued commands, which may already be out of date when it returns
+ */
+int LifxCommandQueue::sizeApprox() const
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_relaxed);
+
+    return tail > head ? static_cast<int>(qMin(tail - head, m_mask + 1)) : 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * Blends layers of bulb colors from several producers
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxcompositor.h"
+#include "lifxmanager.h"
+#include "lifxtransitionengine.h"
+
+#include <algorithm>
+#include <cmath>
+
+LifxLayer::LifxLayer(LifxCompositor *compositor, const QString &name, int priority, Blend blend) :
+    m_compositor(compositor), m_name(name), m_priority(priority), m_blend(blend), m_opacity(1),
+    m_fadeFrom(1), m_fadeTo(1), m_fadeStart(0), m_fadeLength(0), m_removed(false)
+{
+}
+
+/**
+ * \fn void LifxLayer::setColor(LifxBulb *bulb, const HSBK &color, uint16_t alpha)
+ * \param bulb Pointer to LifxBulb object
+ * \param color The layer's color for the bulb
+ * \param alpha How much of color covers what is under it, 0 to 65535
+ */
+void LifxLayer::setColor(LifxBulb *bulb, const HSBK &color, uint16_t alpha)
+{
+    if (bulb == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb";
+        return;
+    }
+
+    int row = bulb->fleetIndex();
+    if (row >= m_alpha.size()) {
+        m_colors.resize(row + 1);
+        m_alpha.resize(row + 1);
+    }
+    m_colors[row] = { color.h(), color.s(), color.b(), color.k() };
+    m_alpha[row] = alpha;
+    m_compositor->touch(bulb);
+}
+
+/**
+ * \fn void LifxLayer::clear(LifxBulb *bulb)
+ * \param bulb Pointer to LifxBulb object
+ *
+ * The bulb shows what is under this layer again
+ */
+void LifxLayer::clear(LifxBulb *bulb)
+{
+    if (bulb && bulb->fleetIndex() < m_alpha.size()) {
+        m_alpha[bulb->fleetIndex()] = 0;
+        m_compositor->update();
+    }
+}
+
+/**
+ * \fn void LifxLayer::clear()
+ *
+ * Every bulb shows what is under this layer again
+ */
+void LifxLayer::clear()
+{
+    m_alpha.fill(0);
+    m_compositor->update();
+}
+
+/**
+ * \fn void LifxLayer::setOpacity(float opacity, int msecs)
+ * \param opacity 0 for hidden to 1 for fully shown
+ * \param msecs Millis to fade from the current opacity over
+ */
+void LifxLayer::setOpacity(float opacity, int msecs)
+{
+    qint64 now = m_compositor->now();
+
+    m_fadeFrom = opacityAt(now);
+    m_fadeTo = qBound(0.0f, opacity, 1.0f);
+    m_fadeStart = now;
+    m_fadeLength = qMax(msecs, 0);
+    m_compositor->update();
+}
+
+float LifxLayer::opacityAt(qint64 now) const
+{
+    if (m_fadeLength <= 0 || now >= m_fadeStart + m_fadeLength)
+        return m_fadeTo;
+
+    return m_fadeFrom + (m_fadeTo - m_fadeFrom) * static_cast<float>(now - m_fadeStart) / m_fadeLength;
+}
+
+LifxCompositor::LifxCompositor(LifxManager *manager, QObject *parent) : QObject(parent),
+    m_manager(manager), m_fps(30), m_dirty(false)
+{
+    m_timer = new QTimer(this);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    m_timer->setInterval(1000 / m_fps);
+    connect(m_timer, &QTimer::timeout, this, &LifxCompositor::frame);
+    m_clock.start();
+}
+
+LifxCompositor::~LifxCompositor()
+{
+    qDeleteAll(m_layers);
+}
+
+/**
+ * \fn LifxLayer* LifxCompositor::addLayer(const QString &name, int priority, LifxLayer::Blend blend, int fadeIn)
+ * \param name Name for debugging
+ * \param priority Layers with a higher priority go on top, equal ones in the order they were added
+ * \param blend How the layer combines with those under it
+ * \param fadeIn Millis to fade the layer's opacity up from 0 over
+ * \return The layer, owned by the compositor until removeLayer()
+ */
+LifxLayer* LifxCompositor::addLayer(const QString &name, int priority, LifxLayer::Blend blend, int fadeIn)
+{
+    LifxLayer *layer = new LifxLayer(this, name, priority, blend);
+
+    if (fadeIn > 0) {
+        layer->m_opacity = 0;
+        layer->m_fadeTo = 0;
+        layer->setOpacity(1, fadeIn);
+    }
+    m_layers.append(layer);
+    sortLayers();
+    m_dirty = true;
+    if (!m_timer->isActive())
+        m_timer->start();
+    return layer;
+}
+
+/**
+ * \fn void LifxCompositor::removeLayer(LifxLayer *layer, int fadeOut)
+ * \param layer A layer from addLayer()
+ * \param fadeOut Millis to fade the layer out over first
+ *
+ * The layer is deleted after the frame which shows it fully faded, so
+ * even with no fade its bulbs are sent what is under it. Don't use the
+ * pointer after this call.
+ */
+void LifxCompositor::removeLayer(LifxLayer *layer, int fadeOut)
+{
+    if (layer == nullptr || !m_layers.contains(layer)) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Not a layer of this compositor";
+        return;
+    }
+    if (layer->m_removed)
+        return;
+
+    layer->m_removed = true;
+    layer->setOpacity(0, fadeOut);
+}
+
+/**
+ * \fn void LifxCompositor::setPriority(LifxLayer *layer, int priority)
+ * \param layer A layer from addLayer()
+ * \param priority Layers with a higher priority go on top
+ */
+void LifxCompositor::setPriority(LifxLayer *layer, int priority)
+{
+    if (layer == nullptr || !m_layers.contains(layer))
+        return;
+
+    layer->m_priority = priority;
+    sortLayers();
+    m_dirty = true;
+}
+
+/**
+ * \fn void LifxCompositor::setFrameRate(int fps)
+ * \param fps Frames a second, 1 to 100
+ */
+void LifxCompositor::setFrameRate(int fps)
+{
+    m_fps = qBound(1, fps, 100);
+    m_timer->setInterval(1000 / m_fps);
+}
+
+void LifxCompositor::sortLayers()
+{
+    std::stable_sort(m_layers.begin(), m_layers.end(), [](const LifxLayer *a, const LifxLayer *b) { return a->m_priority < b->m_priority; });
+}
+
+/*
+ * A layer wrote to bulb. The first time any layer covers a bulb, what
+ * it shows now becomes the bottom of its stack.
+ */
+void LifxCompositor::touch(LifxBulb *bulb)
+{
+    int row = bulb->fleetIndex();
+
+    if (row >= m_bulbs.size()) {
+        m_bulbs.resize(row + 1);
+        m_base.resize(row + 1);
+        m_sent.resize(row + 1);
+        m_hasSent.resize(row + 1);
+    }
+    if (m_bulbs[row] == nullptr) {
+        HSBK color = bulb->expectedColor();
+        m_bulbs[row] = bulb;
+        m_base[row] = { color.h(), color.s(), color.b(), color.k() };
+        m_hasSent[row] = false;
+    }
+    m_dirty = true;
+}
+
+/**
+ * \fn void LifxCompositor::frame()
+ *
+ * Blends and sends one frame if anything changed. Called by the frame
+ * timer, call it directly to push a change out before the next tick.
+ */
+void LifxCompositor::frame()
+{
+    QElapsedTimer cost;
+    qint64 time = now();
+    int rows = m_bulbs.size();
+    uint32_t interval = static_cast<uint32_t>(1000 / m_fps);
+
+    cost.start();
+    for (auto layer : m_layers) {
+        float opacity = layer->opacityAt(time);
+        if (opacity != layer->m_opacity || time < layer->m_fadeStart + layer->m_fadeLength) {
+            layer->m_opacity = opacity;
+            m_dirty = true;
+        }
+    }
+    if (!m_dirty) {
+        if (m_layers.isEmpty())
+            m_timer->stop();
+        return;
+    }
+    m_dirty = false;
+
+    m_out = m_base;
+    m_weights.resize(rows);
+    m_covered.fill(false, rows);
+    for (auto layer : m_layers) {
+        int count = qMin(rows, layer->m_alpha.size());
+        uint32_t opacity = static_cast<uint32_t>(std::lround(layer->m_opacity * LifxTransitionEngine::WEIGHT_ONE));
+        const lx_hsbk_t *colors = layer->m_colors.constData();
+        lx_hsbk_t *out = m_out.data();
+
+        for (int i = 0; i < count; i++) {
+            uint32_t alpha = layer->m_alpha[i];
+            m_covered[i] = m_covered[i] || alpha;
+            m_weights[i] = static_cast<uint16_t>((alpha * opacity + 32767) / 65535);
+        }
+
+        switch (layer->m_blend) {
+            case LifxLayer::Replace:
+                LifxTransitionEngine::interpolate(out, colors, m_weights.constData(), out, count);
+                break;
+            case LifxLayer::AddBrightness:
+                for (int i = 0; i < count; i++) {
+                    uint32_t added = (colors[i].brightness * static_cast<uint32_t>(m_weights[i]) + 16384) >> 15;
+                    out[i].brightness = static_cast<uint16_t>(qMin<uint32_t>(out[i].brightness + added, 65535));
+                }
+                break;
+            case LifxLayer::Mask:
+                for (int i = 0; i < count; i++) {
+                    int masked = static_cast<int>(static_cast<uint32_t>(out[i].brightness) * colors[i].brightness / 65535);
+                    out[i].brightness = static_cast<uint16_t>(out[i].brightness + (((masked - out[i].brightness) * m_weights[i] + 16384) >> 15));
+                }
+                break;
+        }
+    }
+
+    m_batch.clear();
+    for (int row = 0; row < rows; row++) {
+        LifxBulb *bulb = m_bulbs[row];
+        if (bulb == nullptr)
+            continue;
+
+        // Nothing covers it any more, put the base back once, then the next
+        // layer to touch it takes a fresh base
+        if (!m_covered[row]) {
+            const lx_hsbk_t &base = m_base[row];
+            if (m_hasSent[row] && memcmp(&m_sent[row], &base, sizeof(lx_hsbk_t)) != 0) {
+                m_batch.setColor(bulb, HSBK(base.hue, base.saturation, base.brightness, base.kelvin), interval);
+                m_stats.sent++;
+            }
+            m_hasSent[row] = false;
+            m_bulbs[row] = nullptr;
+            continue;
+        }
+        if (m_hasSent[row] && memcmp(&m_sent[row], &m_out[row], sizeof(lx_hsbk_t)) == 0) {
+            m_stats.unchanged++;
+            continue;
+        }
+
+        const lx_hsbk_t &color = m_out[row];
+        m_batch.setColor(bulb, HSBK(color.hue, color.saturation, color.brightness, color.kelvin), interval);
+        m_sent[row] = color;
+        m_hasSent[row] = true;
+        m_stats.sent++;
+    }
+    if (!m_batch.isEmpty())
+        m_manager->submit(m_batch);
+
+    // Layers removed are deleted once a frame has shown them gone
+    for (int i = m_layers.size() - 1; i >= 0; i--) {
+        LifxLayer *layer = m_layers[i];
+        if (layer->m_removed && time >= layer->m_fadeStart + layer->m_fadeLength) {
+            m_layers.removeAt(i);
+            delete layer;
+            m_dirty = true;
+        }
+    }
+
+    m_stats.frames++;
+    m_stats.lastFrame = cost.nsecsElapsed();
+}
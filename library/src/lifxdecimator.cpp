@@ -0,0 +1,220 @@
+/*
+ * Turns dense color streams into timed transitions
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxdecimator.h"
+
+#include <cmath>
+
+LifxDecimator::LifxDecimator(Sink sink) : m_sink(sink), m_tolerance(512), m_maxSegment(1000), m_latency(0)
+{
+}
+
+/*
+ * The largest difference in any one field, hue the short way round
+ */
+int LifxDecimator::distance(const lx_hsbk_t &a, const lx_hsbk_t &b)
+{
+    int hue = qAbs(static_cast<int16_t>(static_cast<uint16_t>(a.hue - b.hue)));
+    int saturation = qAbs(a.saturation - b.saturation);
+    int brightness = qAbs(a.brightness - b.brightness);
+    int kelvin = qAbs(a.kelvin - b.kelvin);
+
+    return qMax(qMax(hue, saturation), qMax(brightness, kelvin));
+}
+
+/*
+ * Returns the worst error of the pending samples against a fade from
+ * the anchor to end, stopping early once it is past the tolerance, or
+ * -1 if end doesn't come after the anchor.
+ */
+int LifxDecimator::fit(const Stream &stream, const Sample &end) const
+{
+    qint64 span = end.time - stream.anchorTime;
+    int hue = static_cast<int16_t>(static_cast<uint16_t>(end.color.hue - stream.anchor.hue));
+    int saturation = end.color.saturation - stream.anchor.saturation;
+    int brightness = end.color.brightness - stream.anchor.brightness;
+    int kelvin = end.color.kelvin - stream.anchor.kelvin;
+    int worst = 0;
+
+    if (span <= 0)
+        return -1;
+
+    for (const auto &sample : stream.pending) {
+        double fraction = static_cast<double>(sample.time - stream.anchorTime) / span;
+        lx_hsbk_t expected;
+
+        expected.hue = static_cast<uint16_t>(stream.anchor.hue + std::lround(hue * fraction));
+        expected.saturation = static_cast<uint16_t>(stream.anchor.saturation + std::lround(saturation * fraction));
+        expected.brightness = static_cast<uint16_t>(stream.anchor.brightness + std::lround(brightness * fraction));
+        expected.kelvin = static_cast<uint16_t>(stream.anchor.kelvin + std::lround(kelvin * fraction));
+        worst = qMax(worst, distance(expected, sample.color));
+        if (worst > m_tolerance)
+            break;
+    }
+    return worst;
+}
+
+/*
+ * Sends the open line, unless every sample on it is close enough to
+ * where the bulb already is, and starts the next line from its end.
+ */
+void LifxDecimator::close(uint64_t target, Stream &stream)
+{
+    if (stream.pending.isEmpty())
+        return;
+
+    const Sample end = stream.pending.last();
+    int flat = 0;
+
+    for (const auto &sample : stream.pending)
+        flat = qMax(flat, distance(stream.anchor, sample.color));
+
+    if (flat <= m_tolerance) {
+        stream.stats.maxError = qMax(stream.stats.maxError, flat);
+    }
+    else {
+        if (m_sink)
+            m_sink(target, stream.anchorTime, HSBK(end.color.hue, end.color.saturation, end.color.brightness, end.color.kelvin), static_cast<uint32_t>(end.time - stream.anchorTime));
+        stream.stats.commands++;
+        stream.stats.maxError = qMax(stream.stats.maxError, stream.pendingError);
+        stream.anchor = end.color;
+    }
+    stream.anchorTime = end.time;
+    stream.pending.clear();
+    stream.pendingError = 0;
+}
+
+/**
+ * \fn void LifxDecimator::push(uint64_t target, qint64 msecs, const lx_hsbk_t &color)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param msecs When the bulb should show color, on whatever clock the sink uses
+ * \param color The color the effect wants
+ *
+ * The first color for a bulb is sent straight away with no fade, later
+ * ones when the line they are on ends, or once it has been open for
+ * latency(). Times must go up, a color that isn't later than the one
+ * before it is ignored.
+ */
+void LifxDecimator::push(uint64_t target, qint64 msecs, const lx_hsbk_t &color)
+{
+    Stream &stream = m_streams[target];
+    Sample sample = { msecs, color };
+
+    if (!stream.anchored) {
+        stream.anchored = true;
+        stream.anchor = color;
+        stream.anchorTime = msecs;
+        stream.stats.samples++;
+        stream.stats.commands++;
+        if (m_sink)
+            m_sink(target, msecs, HSBK(color.hue, color.saturation, color.brightness, color.kelvin), 0);
+        return;
+    }
+
+    qint64 last = stream.pending.isEmpty() ? stream.anchorTime : stream.pending.last().time;
+    if (msecs <= last) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Color at" << msecs << "is not after the last one at" << last;
+        return;
+    }
+
+    stream.stats.samples++;
+    if (!stream.pending.isEmpty()) {
+        int error = msecs - stream.anchorTime > m_maxSegment ? -1 : fit(stream, sample);
+        if (error < 0 || error > m_tolerance)
+            close(target, stream);
+        else
+            stream.pendingError = error;
+    }
+    stream.pending.append(sample);
+
+    // A live source can't wait for the line to end
+    if (m_latency > 0 && msecs - stream.anchorTime >= m_latency)
+        close(target, stream);
+}
+
+/**
+ * \fn void LifxDecimator::push(uint64_t target, qint64 msecs, const HSBK &color)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param msecs When the bulb should show color
+ * \param color The color the effect wants
+ */
+void LifxDecimator::push(uint64_t target, qint64 msecs, const HSBK &color)
+{
+    lx_hsbk_t hsbk;
+
+    hsbk.hue = color.h();
+    hsbk.saturation = color.s();
+    hsbk.brightness = color.b();
+    hsbk.kelvin = color.k();
+    push(target, msecs, hsbk);
+}
+
+/**
+ * \fn void LifxDecimator::flush(uint64_t target)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ *
+ * Sends the bulb's open line now, call when the effect stops.
+ */
+void LifxDecimator::flush(uint64_t target)
+{
+    auto it = m_streams.find(target);
+
+    if (it != m_streams.end())
+        close(target, it.value());
+}
+
+/**
+ * \fn void LifxDecimator::flush()
+ *
+ * Sends every bulb's open line now
+ */
+void LifxDecimator::flush()
+{
+    for (auto it = m_streams.begin(); it != m_streams.end(); ++it)
+        close(it.key(), it.value());
+}
+
+/**
+ * \fn void LifxDecimator::remove(uint64_t target)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ *
+ * Sends the bulb's open line and forgets the stream, the next color
+ * pushed for it is sent with no fade.
+ */
+void LifxDecimator::remove(uint64_t target)
+{
+    flush(target);
+    m_streams.remove(target);
+}
+
+/**
+ * \fn LifxDecimatorStats LifxDecimator::stats() const
+ * \return Counts added up over every stream, and the worst error of any
+ */
+LifxDecimatorStats LifxDecimator::stats() const
+{
+    LifxDecimatorStats total;
+
+    for (const auto &stream : m_streams) {
+        total.samples += stream.stats.samples;
+        total.commands += stream.stats.commands;
+        total.maxError = qMax(total.maxError, stream.stats.maxError);
+    }
+    return total;
+}
@@ -0,0 +1,541 @@
+/*
+ * Loads effects and runs them on layouts within a CPU budget
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxeffectrunner.h"
+#include "lifxbuiltineffects.h"
+#include "lifxlayout.h"
+#include "lifxmanager.h"
+
+#include <chrono>
+
+LifxEffectRunner::LifxEffectRunner(LifxManager *manager, QObject *parent) : QObject(parent),
+    m_manager(manager), m_fps(30), m_frame(0), m_nextId(1)
+{
+    m_timer = new QTimer(this);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    m_timer->setInterval(1000 / m_fps);
+    connect(m_timer, &QTimer::timeout, this, &LifxEffectRunner::frame);
+    m_clock.start();
+}
+
+LifxEffectRunner::~LifxEffectRunner()
+{
+    bool stuck = false;
+
+    stopAll();
+
+    // Effects made with create() and never destroyed must go before their code does
+    for (auto it = m_owners.begin(); it != m_owners.end(); ++it) {
+        if (it.value())
+            it.value()(it.key());
+        else
+            delete it.key();
+    }
+
+    // An effect still in render() is running plugin code
+    for (const auto &worker : m_abandoned) {
+        std::lock_guard<std::mutex> lock(worker->lock);
+        stuck = stuck || worker->busy;
+    }
+    if (stuck)
+        qWarning() << __PRETTY_FUNCTION__ << ": An effect is still rendering, its plugin is left loaded";
+
+    for (auto &plugin : m_plugins) {
+        if (!stuck)
+            plugin.library->unload();
+        delete plugin.library;
+    }
+}
+
+/**
+ * \fn bool LifxEffectRunner::loadPlugin(const QString &path)
+ * \param path Shared object exporting the functions described for LifxEffect
+ * \return true if the plugin loaded and its ABI matches
+ *
+ * A plugin naming an effect already known doesn't replace it, the first
+ * one loaded, or the built in, is made by create().
+ */
+bool LifxEffectRunner::loadPlugin(const QString &path)
+{
+    QLibrary *library = new QLibrary(path, this);
+
+    if (!library->load()) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to load" << path << ":" << library->errorString();
+        delete library;
+        return false;
+    }
+
+    AbiFn abi = reinterpret_cast<AbiFn>(library->resolve("qtlifx_effect_abi"));
+    CountFn count = reinterpret_cast<CountFn>(library->resolve("qtlifx_effect_count"));
+    NameFn name = reinterpret_cast<NameFn>(library->resolve("qtlifx_effect_name"));
+    Plugin plugin;
+    plugin.library = library;
+    plugin.create = reinterpret_cast<CreateFn>(library->resolve("qtlifx_effect_create"));
+    plugin.destroy = reinterpret_cast<DestroyFn>(library->resolve("qtlifx_effect_destroy"));
+
+    if (!abi || !count || !name || !plugin.create || !plugin.destroy) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "is not an effect plugin";
+        library->unload();
+        delete library;
+        return false;
+    }
+    if (abi() != LIFX_EFFECT_ABI) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "was built for effect ABI" << abi() << ", this library is" << LIFX_EFFECT_ABI;
+        library->unload();
+        delete library;
+        return false;
+    }
+
+    for (int i = 0; i < count(); i++) {
+        const char *effect = name(i);
+        if (effect)
+            plugin.names.append(QString::fromUtf8(effect));
+    }
+    m_plugins.append(plugin);
+    return true;
+}
+
+/**
+ * \fn int LifxEffectRunner::loadPlugins(const QString &dir)
+ * \param dir Directory of plugins
+ * \return The number of plugins loaded
+ */
+int LifxEffectRunner::loadPlugins(const QString &dir)
+{
+    QDir directory(dir);
+    int loaded = 0;
+
+    for (const auto &file : directory.entryList(QStringList() << "*.so" << "*.dylib" << "*.dll", QDir::Files, QDir::Name)) {
+        if (loadPlugin(directory.filePath(file)))
+            loaded++;
+    }
+    return loaded;
+}
+
+/**
+ * \fn QStringList LifxEffectRunner::effects() const
+ * \return Every effect create() can make, built in first
+ */
+QStringList LifxEffectRunner::effects() const
+{
+    QStringList names = LifxBuiltinEffects::names();
+
+    for (const auto &plugin : m_plugins) {
+        for (const auto &name : plugin.names) {
+            if (!names.contains(name))
+                names.append(name);
+        }
+    }
+    return names;
+}
+
+/**
+ * \fn LifxEffect* LifxEffectRunner::create(const QString &name)
+ * \param name One of effects()
+ * \return A new effect, nullptr if name isn't known. Free it with destroy().
+ */
+LifxEffect* LifxEffectRunner::create(const QString &name)
+{
+    LifxEffect *effect = LifxBuiltinEffects::create(name);
+
+    if (effect) {
+        m_owners.insert(effect, nullptr);
+        return effect;
+    }
+
+    for (const auto &plugin : m_plugins) {
+        if (plugin.names.contains(name)) {
+            effect = plugin.create(name.toUtf8().constData());
+            if (effect == nullptr) {
+                qWarning() << __PRETTY_FUNCTION__ << ": Plugin" << plugin.library->fileName() << "failed to make" << name;
+                return nullptr;
+            }
+            m_owners.insert(effect, plugin.destroy);
+            return effect;
+        }
+    }
+
+    qWarning() << __PRETTY_FUNCTION__ << ": No effect named" << name;
+    return nullptr;
+}
+
+/**
+ * \fn void LifxEffectRunner::destroy(LifxEffect *effect)
+ * \param effect An effect from create()
+ *
+ * Hands the effect back to whichever plugin made it
+ */
+void LifxEffectRunner::destroy(LifxEffect *effect)
+{
+    if (!m_owners.contains(effect))
+        return;
+
+    DestroyFn destroy = m_owners.take(effect);
+    if (destroy)
+        destroy(effect);
+    else
+        delete effect;
+}
+
+/**
+ * \fn int LifxEffectRunner::start(const QString &name, LifxLayout *layout, int budgetUsecs)
+ * \param name One of effects()
+ * \param layout Bound layout the effect writes and sends, it must outlive the effect
+ * \param budgetUsecs Micros a render may take
+ * \return An id for setParameter(), stop() and stats(), or -1 on failure
+ */
+int LifxEffectRunner::start(const QString &name, LifxLayout *layout, int budgetUsecs)
+{
+    if (layout == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null layout";
+        return -1;
+    }
+
+    LifxEffect *effect = create(name);
+    if (effect == nullptr)
+        return -1;
+
+    Running run;
+    run.effect = effect;
+    run.layout = layout;
+    run.worker = std::make_shared<Worker>();
+    run.worker->effect = effect;
+    run.worker->previous.resize(layout->size());
+    run.worker->out.resize(layout->size());
+    memcpy(run.worker->previous.data(), layout->colors(), sizeof(lx_hsbk_t) * layout->size());
+    memcpy(run.worker->out.data(), layout->colors(), sizeof(lx_hsbk_t) * layout->size());
+    run.started = m_clock.elapsed();
+    run.lastRender = run.started;
+    run.stats.name = name;
+    run.stats.budgetUsecs = qMax(budgetUsecs, 1);
+
+    effect->start(*layout);
+    run.worker->thread = std::thread(&LifxEffectRunner::renderer, run.worker);
+    m_running.insert(m_nextId, run);
+    if (!m_timer->isActive())
+        m_timer->start();
+    return m_nextId++;
+}
+
+/**
+ * \fn bool LifxEffectRunner::setParameter(int id, const QString &key, double value)
+ * \param id From start()
+ * \param key Parameter name, see the effect's documentation
+ * \param value New value
+ * \return false if id isn't running, or was disabled
+ *
+ * The effect is given it on its own thread, before its next render
+ */
+bool LifxEffectRunner::setParameter(int id, const QString &key, double value)
+{
+    auto it = m_running.find(id);
+
+    if (it == m_running.end() || it->effect == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> lock(it->worker->lock);
+    it->worker->parameters.append(qMakePair(key.toUtf8(), value));
+    return true;
+}
+
+/**
+ * \fn void LifxEffectRunner::stop(int id)
+ * \param id From start()
+ *
+ * The bulbs keep the last frame sent. A render in progress is given
+ * BUDGET_KILL budgets to finish before the effect is left to it.
+ */
+void LifxEffectRunner::stop(int id)
+{
+    auto it = m_running.find(id);
+
+    if (it == m_running.end())
+        return;
+
+    retire(it.value(), static_cast<qint64>(it->stats.budgetUsecs) * BUDGET_KILL);
+    m_running.erase(it);
+    if (idle())
+        m_timer->stop();
+}
+
+/**
+ * \fn void LifxEffectRunner::stopAll()
+ */
+void LifxEffectRunner::stopAll()
+{
+    for (int id : m_running.keys())
+        stop(id);
+}
+
+/**
+ * \fn LifxEffectStats LifxEffectRunner::stats(int id) const
+ * \param id From start()
+ * \return How the effect is doing, a default LifxEffectStats if id isn't running
+ */
+LifxEffectStats LifxEffectRunner::stats(int id) const
+{
+    return m_running.value(id).stats;
+}
+
+/**
+ * \fn void LifxEffectRunner::setFrameRate(int fps)
+ * \param fps Frames a second, 1 to 100
+ */
+void LifxEffectRunner::setFrameRate(int fps)
+{
+    m_fps = qBound(1, fps, 100);
+    m_timer->setInterval(1000 / m_fps);
+}
+
+/**
+ * \fn void LifxEffectRunner::frame()
+ *
+ * Sends every effect's render from the frame before, and asks for the
+ * next one, for the time it will be sent. Called by the frame timer.
+ */
+void LifxEffectRunner::frame()
+{
+    qint64 now = m_clock.elapsed();
+    uint32_t interval = static_cast<uint32_t>(1000 / m_fps);
+
+    m_frame++;
+
+    // A slot on one of the signals may stop effects, so go by id
+    for (int id : m_running.keys()) {
+        auto it = m_running.find(id);
+        if (it == m_running.end())
+            continue;
+
+        Running &run = it.value();
+        LifxLayout *layout = run.layout;
+        Worker &worker = *run.worker;
+        int divisor = run.stats.divisor;
+
+        if (run.effect == nullptr)
+            continue;
+        if (m_frame % divisor) {
+            run.stats.skipped++;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(worker.lock);
+        if (worker.busy) {
+            qint64 usecs = (m_clock.nsecsElapsed() - worker.posted) / 1000;
+            lock.unlock();
+            if (!run.late) {
+                run.late = true;
+                run.stats.late++;
+            }
+            if (usecs > static_cast<qint64>(run.stats.budgetUsecs) * BUDGET_KILL)
+                disable(id, run, usecs);
+            continue;
+        }
+        bool done = worker.done;
+        worker.done = false;
+        lock.unlock();
+
+        // The thread is idle, everything but the flags is ours until the next request
+        if (done) {
+            bool fresh = !run.late && worker.out.size() == layout->size();
+            run.late = false;
+            if (!budget(run, worker.usecs)) {
+                disable(id, run, worker.usecs);
+                continue;
+            }
+            memcpy(worker.previous.data(), worker.out.constData(), sizeof(lx_hsbk_t) * worker.out.size());
+            if (fresh) {
+                memcpy(layout->colors(), worker.out.constData(), sizeof(lx_hsbk_t) * layout->size());
+                layout->send(m_manager, interval * run.stats.divisor);
+            }
+        }
+
+        if (worker.out.size() != layout->size()) {
+            worker.previous.resize(layout->size());
+            worker.out.resize(layout->size());
+            memcpy(worker.previous.data(), layout->colors(), sizeof(lx_hsbk_t) * layout->size());
+            memcpy(worker.out.data(), layout->colors(), sizeof(lx_hsbk_t) * layout->size());
+            run.effect->start(*layout);
+        }
+
+        qint64 due = now + interval * run.stats.divisor;
+        LifxEffectFrame &context = worker.frame;
+        context.msecs = due - run.started;
+        context.delta = static_cast<int>(due - run.lastRender);
+        context.frame = run.stats.renders;
+        context.count = layout->size();
+        context.x = layout->x();
+        context.y = layout->y();
+        context.z = layout->z();
+        context.layout = layout;
+        context.previous = worker.previous.constData();
+        context.out = worker.out.data();
+        run.lastRender = due;
+
+        lock.lock();
+        worker.posted = m_clock.nsecsElapsed();
+        worker.requested = true;
+        worker.busy = true;
+        lock.unlock();
+        worker.wake.notify_one();
+
+        if (run.stats.divisor != divisor)
+            emit effectThrottled(id, run.stats.divisor);
+    }
+
+    if (idle())
+        m_timer->stop();
+}
+
+/*
+ * Stops a disabled effect and says so. A slot may stop() it, so run
+ * isn't touched after the signal.
+ */
+void LifxEffectRunner::disable(int id, Running &run, qint64 usecs)
+{
+    run.stats.disabled = true;
+    retire(run, 0);
+    qWarning() << __PRETTY_FUNCTION__ << ": Disabled" << run.stats.name << "after a" << usecs << "us render, budget" << run.stats.budgetUsecs << "us";
+    emit effectDisabled(id, run.stats.name, usecs);
+}
+
+/*
+ * Ends the effect's thread and destroys the effect. A render in progress
+ * is given waitUsecs to finish, then left to destroy the effect when
+ * render() returns.
+ */
+void LifxEffectRunner::retire(Running &run, qint64 waitUsecs)
+{
+    std::shared_ptr<Worker> worker = run.worker;
+
+    if (run.effect == nullptr)
+        return;
+
+    std::unique_lock<std::mutex> lock(worker->lock);
+    worker->quit = true;
+    worker->wake.notify_all();
+    worker->wake.wait_for(lock, std::chrono::microseconds(waitUsecs), [&worker]() { return !worker->busy; });
+    if (worker->busy) {
+        worker->abandoned = true;
+        worker->destroy = m_owners.take(run.effect);
+        lock.unlock();
+        worker->thread.detach();
+        m_abandoned.append(worker);
+    }
+    else {
+        lock.unlock();
+        worker->thread.join();
+        destroy(run.effect);
+    }
+    run.effect = nullptr;
+}
+
+/*
+ * True when no effect is left enabled, so the frame timer has nothing to do
+ */
+bool LifxEffectRunner::idle() const
+{
+    for (const auto &run : m_running) {
+        if (run.effect)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * An effect's thread. Renders each frame it is given, and destroys the
+ * effect itself if it was left behind while rendering.
+ */
+void LifxEffectRunner::renderer(std::shared_ptr<Worker> worker)
+{
+    std::unique_lock<std::mutex> lock(worker->lock);
+
+    for (;;) {
+        worker->wake.wait(lock, [&worker]() { return worker->quit || worker->requested; });
+        if (worker->quit)
+            break;
+
+        QVector<QPair<QByteArray, double>> parameters;
+        parameters.swap(worker->parameters);
+        worker->requested = false;
+        lock.unlock();
+
+        for (const auto &parameter : parameters)
+            worker->effect->setParameter(parameter.first.constData(), parameter.second);
+
+        QElapsedTimer cost;
+        cost.start();
+        worker->effect->render(worker->frame);
+        qint64 usecs = cost.nsecsElapsed() / 1000;
+
+        lock.lock();
+        worker->usecs = usecs;
+        worker->done = true;
+        if (worker->quit)
+            break;
+        worker->busy = false;
+    }
+
+    if (worker->abandoned) {
+        lock.unlock();
+        if (worker->destroy)
+            worker->destroy(worker->effect);
+        else
+            delete worker->effect;
+        lock.lock();
+    }
+    worker->busy = false;
+    worker->wake.notify_all();
+}
+
+/*
+ * Throttles an effect that went over its budget, and gives the rate back
+ * to one that has stayed well under it for about a second. Returns false
+ * if the effect is now disabled.
+ */
+bool LifxEffectRunner::budget(Running &run, qint64 usecs)
+{
+    LifxEffectStats &stats = run.stats;
+
+    stats.renders++;
+    stats.lastUsecs = usecs;
+    stats.meanUsecs = stats.renders == 1 ? usecs : (stats.meanUsecs * 7 + usecs) / 8;
+    stats.worstUsecs = qMax(stats.worstUsecs, usecs);
+
+    if (usecs > static_cast<qint64>(stats.budgetUsecs) * BUDGET_KILL) {
+        stats.disabled = true;
+    }
+    else if (usecs > stats.budgetUsecs) {
+        run.underruns = 0;
+        if (++run.overruns >= 2) {
+            run.overruns = 0;
+            if (stats.divisor >= MAX_DIVISOR)
+                stats.disabled = true;
+            else
+                stats.divisor *= 2;
+        }
+    }
+    else {
+        run.overruns = 0;
+        if (stats.divisor > 1 && usecs < stats.budgetUsecs / 4 && ++run.underruns >= m_fps / stats.divisor) {
+            run.underruns = 0;
+            stats.divisor /= 2;
+        }
+    }
+    return !stats.disabled;
+}
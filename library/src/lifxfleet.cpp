@@ -0,0 +1,310 @@
+/*
+ * Flat storage for the frequently used state of every known bulb
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxfleet.h"
+
+/*
+ * The MACs all share the LIFX OUI in their low bytes, so the target
+ * is mixed before it is used as a hash (splitmix64 finalizer).
+ */
+static inline uint64_t hashTarget(uint64_t target)
+{
+    target ^= target >> 30;
+    target *= 0xbf58476d1ce4e5b9ULL;
+    target ^= target >> 27;
+    target *= 0x94d049bb133111ebULL;
+    target ^= target >> 31;
+    return target;
+}
+
+/**
+ * \fn LifxFleet::LifxFleet(int capacity)
+ * \param capacity Number of rows to reserve room for
+ */
+LifxFleet::LifxFleet(int capacity) : m_keyCount(0)
+{
+    rehash(16);
+    reserve(capacity);
+    m_clock.start();
+}
+
+LifxFleet::~LifxFleet()
+{
+}
+
+/**
+ * \fn void LifxFleet::reserve(int capacity)
+ * \param capacity Number of rows to reserve room for
+ *
+ * Avoids regrowing the columns and the hash table while a large fleet
+ * is being discovered.
+ */
+void LifxFleet::reserve(int capacity)
+{
+    if (capacity <= m_targets.size())
+        return;
+
+    m_targets.reserve(capacity);
+    m_power.reserve(capacity);
+    m_colors.reserve(capacity);
+    m_ipv4.reserve(capacity);
+    m_ports.reserve(capacity);
+    m_lastSeen.reserve(capacity);
+    m_lastSent.reserve(capacity);
+    m_rssi.reserve(capacity);
+    m_capabilities.reserve(capacity);
+
+    int tableSize = m_keys.size();
+    while (tableSize < capacity * 2)
+        tableSize *= 2;
+    if (tableSize != m_keys.size())
+        rehash(tableSize);
+}
+
+/**
+ * \fn int LifxFleet::add(uint64_t target)
+ * \param target The MAC as a 64bit number, 0 if it isn't known yet
+ * \return The index of the row for target
+ *
+ * If target is already in the fleet, the existing row is returned.
+ */
+int LifxFleet::add(uint64_t target)
+{
+    lx_dev_color_t color;
+
+    if (target != 0) {
+        int index = indexOf(target);
+        if (index >= 0)
+            return index;
+    }
+
+    memset(&color, 0, sizeof(lx_dev_color_t));
+    int index = m_targets.size();
+    m_targets.append(target);
+    m_power.append(0);
+    m_colors.append(color);
+    m_ipv4.append(0);
+    m_ports.append(0);
+    m_lastSeen.append(-1);
+    m_lastSent.append(-1);
+    m_rssi.append(-100);
+    m_capabilities.append(0);
+
+    if (target != 0)
+        insertKey(target, index);
+
+    return index;
+}
+
+/**
+ * \fn int LifxFleet::indexOf(uint64_t target) const
+ * \param target The MAC as a 64bit number
+ * \return The row index for target, or -1 if it isn't in the fleet
+ */
+int LifxFleet::indexOf(uint64_t target) const
+{
+    if (target == 0)
+        return -1;
+
+    int slot = probe(target);
+    if (m_keys[slot] == target)
+        return m_slots[slot];
+
+    return -1;
+}
+
+/**
+ * \fn void LifxFleet::setTarget(int index, uint64_t target)
+ * \param index The row to change
+ * \param target The new MAC as a 64bit number
+ *
+ * If another row already has target, the lookup will find this row
+ * from now on.
+ */
+void LifxFleet::setTarget(int index, uint64_t target)
+{
+    if (index < 0 || index >= m_targets.size() || m_targets[index] == target)
+        return;
+
+    if (m_targets[index] != 0)
+        removeKey(m_targets[index]);
+
+    m_targets[index] = target;
+    if (target != 0) {
+        removeKey(target);
+        insertKey(target, index);
+    }
+}
+
+/**
+ * \fn int LifxFleet::countOn() const
+ * \return The number of rows with a non zero power level
+ */
+int LifxFleet::countOn() const
+{
+    const uint16_t *power = m_power.constData();
+    int count = 0;
+
+    for (int i = 0; i < m_power.size(); i++)
+        count += power[i] != 0;
+
+    return count;
+}
+
+/**
+ * \fn QVector<int> LifxFleet::notSeenSince(qint64 msecs) const
+ * \param msecs Age in millis
+ * \return The rows which have not sent anything in the last msecs millis, including those never heard from
+ */
+QVector<int> LifxFleet::notSeenSince(qint64 msecs) const
+{
+    const qint64 *seen = m_lastSeen.constData();
+    qint64 cutoff = now() - msecs;
+    QVector<int> stale;
+
+    for (int i = 0; i < m_lastSeen.size(); i++) {
+        if (seen[i] < cutoff)
+            stale.append(i);
+    }
+    return stale;
+}
+
+/**
+ * \fn void LifxFleet::setCapabilities(int index, int capabilities)
+ * \param index The row to change
+ * \param capabilities Capability flags the product has
+ */
+void LifxFleet::setCapabilities(int index, int capabilities)
+{
+    if (index < 0 || index >= m_capabilities.size())
+        return;
+
+    m_capabilities[index] = static_cast<quint8>(capabilities);
+    for (int bit = 0; bit < 5; bit++) {
+        LifxBitmap &rows = m_capabilityRows[bit];
+        if (rows.size() < m_targets.size())
+            rows.resize(m_targets.size());
+        rows.set(index, capabilities & (1 << bit));
+    }
+}
+
+/**
+ * \fn const LifxBitmap& LifxFleet::capabilityRows(Capability capability) const
+ * \param capability A single Capability flag
+ * \return The rows whose product has capability
+ *
+ * The bitmap may be shorter than size(), rows past its end don't have
+ * the capability.
+ */
+const LifxBitmap& LifxFleet::capabilityRows(Capability capability) const
+{
+    int bit = qCountTrailingZeroBits(static_cast<quint64>(capability));
+
+    return m_capabilityRows[qMin(bit, 4)];
+}
+
+/**
+ * \fn LifxBitmap LifxFleet::poweredOnRows() const
+ * \return The rows with a non zero power level
+ *
+ * Built from the power column 64 rows at a time.
+ */
+LifxBitmap LifxFleet::poweredOnRows() const
+{
+    LifxBitmap rows(m_power.size());
+    const uint16_t *power = m_power.constData();
+    quint64 *words = rows.words();
+
+    for (int i = 0; i < m_power.size(); i++)
+        words[i / 64] |= static_cast<quint64>(power[i] != 0) << (i % 64);
+
+    return rows;
+}
+
+/*
+ * Returns the slot holding target, or the empty slot where it would go
+ */
+int LifxFleet::probe(uint64_t target) const
+{
+    int mask = m_keys.size() - 1;
+    int slot = static_cast<int>(hashTarget(target) & mask);
+
+    while (m_keys[slot] != 0 && m_keys[slot] != target)
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+void LifxFleet::insertKey(uint64_t target, int index)
+{
+    if ((m_keyCount + 1) * 2 > m_keys.size())
+        rehash(m_keys.size() * 2);
+
+    int slot = probe(target);
+    if (m_keys[slot] == 0)
+        m_keyCount++;
+
+    m_keys[slot] = target;
+    m_slots[slot] = index;
+}
+
+/*
+ * Backward shift delete, so the probe chains stay intact without tombstones
+ */
+void LifxFleet::removeKey(uint64_t target)
+{
+    int mask = m_keys.size() - 1;
+    int slot = probe(target);
+
+    if (m_keys[slot] != target)
+        return;
+
+    int next = (slot + 1) & mask;
+    while (m_keys[next] != 0) {
+        int home = static_cast<int>(hashTarget(m_keys[next]) & mask);
+        // Move next back into the hole unless its home lies between the hole and next
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            m_keys[slot] = m_keys[next];
+            m_slots[slot] = m_slots[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    m_keys[slot] = 0;
+    m_keyCount--;
+}
+
+void LifxFleet::rehash(int capacity)
+{
+    QVector<uint64_t> keys = m_keys;
+    QVector<int> indexes = m_slots;
+
+    m_keys.fill(0, capacity);
+    m_slots.fill(-1, capacity);
+    m_keyCount = 0;
+
+    for (int i = 0; i < keys.size(); i++) {
+        if (keys[i] != 0) {
+            int slot = probe(keys[i]);
+            m_keys[slot] = keys[i];
+            m_slots[slot] = indexes[i];
+            m_keyCount++;
+        }
+    }
+}
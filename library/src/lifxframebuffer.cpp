@@ -0,0 +1,238 @@
+/*
+ * Host side copy of the colors on a multizone or matrix device
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxframebuffer.h"
+
+/**
+ * \fn LifxFrameBuffer::LifxFrameBuffer(int size)
+ * \param size Number of pixels (zones or tile pixels)
+ *
+ * A new buffer is all dirty, we don't know what the device shows yet
+ */
+LifxFrameBuffer::LifxFrameBuffer(int size) : m_forceDirty(true)
+{
+    resize(size);
+}
+
+LifxFrameBuffer::~LifxFrameBuffer()
+{
+}
+
+/**
+ * \fn void LifxFrameBuffer::resize(int size)
+ * \param size The new number of pixels
+ *
+ * New pixels are zeroed. If the size actually changes, the whole
+ * buffer is considered dirty.
+ */
+void LifxFrameBuffer::resize(int size)
+{
+    if (size == m_frame.size())
+        return;
+
+    int old = m_frame.size();
+    m_frame.resize(size);
+    m_sent.resize(size);
+    for (int i = old; i < size; i++) {
+        memset(&m_frame[i], 0, sizeof(lx_hsbk_t));
+        memset(&m_sent[i], 0, sizeof(lx_hsbk_t));
+    }
+    m_forceDirty = true;
+}
+
+/**
+ * \fn void LifxFrameBuffer::setPixel(int index, const HSBK &color)
+ * \param index The pixel to set
+ * \param color The new color, only the frame is changed
+ */
+void LifxFrameBuffer::setPixel(int index, const HSBK &color)
+{
+    if (index < 0 || index >= m_frame.size())
+        return;
+
+    m_frame[index].hue = color.h();
+    m_frame[index].saturation = color.s();
+    m_frame[index].brightness = color.b();
+    m_frame[index].kelvin = color.k();
+}
+
+/**
+ * \fn void LifxFrameBuffer::setPixels(int index, const lx_hsbk_t *colors, int count)
+ * \param index The first pixel to set
+ * \param colors Array of count colors
+ * \param count Number of colors, clipped to the end of the buffer
+ */
+void LifxFrameBuffer::setPixels(int index, const lx_hsbk_t *colors, int count)
+{
+    if (index < 0 || index >= m_frame.size() || count <= 0)
+        return;
+
+    count = qMin(count, m_frame.size() - index);
+    memcpy(m_frame.data() + index, colors, count * sizeof(lx_hsbk_t));
+}
+
+/**
+ * \fn lx_hsbk_t LifxFrameBuffer::pixel(int index) const
+ * \param index The pixel to read
+ * \return The frame color at index, or all zero if index is out of range
+ */
+lx_hsbk_t LifxFrameBuffer::pixel(int index) const
+{
+    lx_hsbk_t c;
+
+    if (index < 0 || index >= m_frame.size()) {
+        memset(&c, 0, sizeof(lx_hsbk_t));
+        return c;
+    }
+    return m_frame[index];
+}
+
+/**
+ * \fn void LifxFrameBuffer::fill(const HSBK &color)
+ * \param color Color to set every pixel in the frame to
+ */
+void LifxFrameBuffer::fill(const HSBK &color)
+{
+    for (int i = 0; i < m_frame.size(); i++)
+        setPixel(i, color);
+}
+
+/**
+ * \fn void LifxFrameBuffer::setConfirmed(int index, const lx_hsbk_t *colors, int count)
+ * \param index First pixel the device reported
+ * \param colors The reported colors
+ * \param count Number of colors reported
+ *
+ * Used when the device tells us what it is showing. Both the frame and
+ * the sent copy are updated, so those pixels are no longer dirty.
+ */
+void LifxFrameBuffer::setConfirmed(int index, const lx_hsbk_t *colors, int count)
+{
+    if (index < 0 || index >= m_frame.size() || count <= 0)
+        return;
+
+    count = qMin(count, m_frame.size() - index);
+    memcpy(m_frame.data() + index, colors, count * sizeof(lx_hsbk_t));
+    memcpy(m_sent.data() + index, colors, count * sizeof(lx_hsbk_t));
+    // Long devices report in several pieces, the last piece completes the picture
+    if (index + count == m_frame.size())
+        m_forceDirty = false;
+}
+
+bool LifxFrameBuffer::differs(int index) const
+{
+    return m_forceDirty || memcmp(&m_frame[index], &m_sent[index], sizeof(lx_hsbk_t)) != 0;
+}
+
+/**
+ * \fn bool LifxFrameBuffer::isDirty() const
+ * \return True if any pixel in the frame differs from what the device was sent
+ */
+bool LifxFrameBuffer::isDirty() const
+{
+    return isDirty(0, m_frame.size());
+}
+
+/**
+ * \fn bool LifxFrameBuffer::isDirty(int start, int count) const
+ * \param start First pixel to check
+ * \param count Number of pixels to check
+ * \return True if any of the pixels differ from what the device was sent
+ */
+bool LifxFrameBuffer::isDirty(int start, int count) const
+{
+    int end = qMin(start + count, m_frame.size());
+
+    if (m_forceDirty && start < end)
+        return true;
+
+    if (start < 0 || start >= end)
+        return false;
+
+    return memcmp(m_frame.constData() + start, m_sent.constData() + start, (end - start) * sizeof(lx_hsbk_t)) != 0;
+}
+
+/**
+ * \fn QVector<QPair<int,int>> LifxFrameBuffer::dirtyRanges(int maxLength) const
+ * \param maxLength The most pixels a single message can carry
+ * \return List of (start, count) ranges which cover every changed pixel
+ *
+ * Each message costs the same no matter how many of its slots are used,
+ * so this packs greedily. A range starts at the first changed pixel and
+ * covers up to maxLength pixels, trimmed back to the last changed pixel
+ * inside that window. Unchanged pixels between changes are resent rather
+ * than paying for another message.
+ */
+QVector<QPair<int,int>> LifxFrameBuffer::dirtyRanges(int maxLength) const
+{
+    QVector<QPair<int,int>> ranges;
+    int size = m_frame.size();
+    int i = 0;
+
+    if (maxLength <= 0)
+        return ranges;
+
+    while (i < size) {
+        if (!differs(i)) {
+            i++;
+            continue;
+        }
+
+        int start = i;
+        int windowEnd = qMin(start + maxLength, size);
+        int last = start;
+        for (int j = start + 1; j < windowEnd; j++) {
+            if (differs(j))
+                last = j;
+        }
+        ranges.append(qMakePair(start, last - start + 1));
+        i = last + 1;
+    }
+    return ranges;
+}
+
+/**
+ * \fn void LifxFrameBuffer::markClean(int start, int count)
+ * \param start First pixel which was sent
+ * \param count Number of pixels sent
+ *
+ * Copies the frame into the sent copy for the range that went out. A
+ * forced resend is only cleared once the whole buffer is marked clean.
+ */
+void LifxFrameBuffer::markClean(int start, int count)
+{
+    if (start < 0 || start >= m_frame.size() || count <= 0)
+        return;
+
+    count = qMin(count, m_frame.size() - start);
+    memcpy(m_sent.data() + start, m_frame.constData() + start, count * sizeof(lx_hsbk_t));
+    if (start == 0 && count == m_frame.size())
+        m_forceDirty = false;
+}
+
+/**
+ * \fn void LifxFrameBuffer::markDirty()
+ *
+ * Forces the whole buffer to be resent, for example after the device
+ * reboots and we can no longer trust what it shows.
+ */
+void LifxFrameBuffer::markDirty()
+{
+    m_forceDirty = true;
+}
@@ -28,6 +28,34 @@ LifxGroup::~LifxGroup()
 {
 }
 
+/**
+ * \fn void LifxGroup::addBulb(LifxBulb *bulb)
+ * \param bulb Pointer to a LifxBulb class
+ * \brief adds a bulb to this group, a bulb already in the group is not added twice
+ */
+void LifxGroup::addBulb(LifxBulb *bulb)
+{
+    if (m_members.contains(bulb))
+        return;
+
+    m_members.insert(bulb);
+    m_bulbs.push_back(bulb);
+    m_rows.set(bulb->fleetIndex());
+}
+
+/**
+ * \fn void LifxGroup::removeBulb(LifxBulb *bulb)
+ * \param bulb Pointer to a LifxBulb class
+ * \brief removes a bulb from this group
+ */
+void LifxGroup::removeBulb(LifxBulb *bulb)
+{
+    if (m_members.remove(bulb)) {
+        m_bulbs.removeOne(bulb);
+        m_rows.set(bulb->fleetIndex(), false);
+    }
+}
+
 /**
  * \fn QDebug operator<<(QDebug debug, const LifxGroup &bulb)
  * \brief Pretty print the LifxGroup object
@@ -0,0 +1,773 @@
+/*
+ * Drives a layout's bulbs, strips and tiles from images and video frames
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifximagemapper.h"
+#include "lifxbulb.h"
+#include "lifxlayout.h"
+#include "lifxmanager.h"
+#include "hsbk.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <unistd.h>
+
+namespace {
+
+const int STDIN_CHUNK = 1 << 18;       // Bytes read from stdin at a time
+const int POLL_INTERVAL = 2;           // Millis between looks for a frame the decoder hasn't finished
+
+/*
+ * Nanos since the last call, and starts the next lap
+ */
+qint64 lap(QElapsedTimer &timer)
+{
+    qint64 nanos = timer.nsecsElapsed();
+    timer.start();
+    return nanos;
+}
+
+}
+
+LifxImageMapper::LifxImageMapper(LifxManager *manager, LifxLayout *layout, QObject *parent) : QObject(parent),
+    m_manager(manager), m_layout(layout), m_filter(Box), m_autoRegion(true), m_left(0), m_top(0), m_right(0),
+    m_bottom(0), m_footprint(0), m_threshold(DEFAULT_THRESHOLD), m_kelvin(3500), m_duration(0), m_rawWidth(0),
+    m_rawHeight(0), m_planned(false), m_planWidth(0), m_planHeight(0), m_planPoints(0), m_fps(DEFAULT_FRAME_RATE),
+    m_shown(-1), m_playing(false), m_stop(false), m_notifier(nullptr), m_readNanos(0)
+{
+    m_frameTimer = new QTimer(this);
+    m_frameTimer->setTimerType(Qt::PreciseTimer);
+    m_frameTimer->setSingleShot(true);
+    connect(m_frameTimer, &QTimer::timeout, this, &LifxImageMapper::nextFrame);
+}
+
+LifxImageMapper::~LifxImageMapper()
+{
+    close();
+}
+
+/**
+ * \fn void LifxImageMapper::setRegion(float left, float top, float right, float bottom)
+ * \param left Layout x of the image's left edge
+ * \param top Layout y of the image's top row
+ * \param right Layout x of the image's right edge
+ * \param bottom Layout y of the image's bottom row
+ *
+ * The image is stretched to fit. For a layout whose y grows upwards give
+ * a top larger than the bottom. Points off the image are left alone.
+ */
+void LifxImageMapper::setRegion(float left, float top, float right, float bottom)
+{
+    if (left == right || top == bottom) {
+        qWarning() << __PRETTY_FUNCTION__ << ": The region has no area";
+        return;
+    }
+
+    m_left = left;
+    m_top = top;
+    m_right = right;
+    m_bottom = bottom;
+    m_autoRegion = false;
+    invalidate();
+}
+
+/**
+ * \fn void LifxImageMapper::setRawSize(int width, int height)
+ * \param width Pixels across
+ * \param height Rows
+ *
+ * Size of the frames read from stdin, and of sequence files named .rgb or
+ * .raw, which are packed 8 bit RGB with no header. A sequence keeps the
+ * size it was opened with.
+ */
+void LifxImageMapper::setRawSize(int width, int height)
+{
+    m_rawWidth = qMax(width, 0);
+    m_rawHeight = qMax(height, 0);
+}
+
+/**
+ * \fn void LifxImageMapper::invalidate()
+ *
+ * Works out the footprints and spans again on the next frame, and sends
+ * every point
+ */
+void LifxImageMapper::invalidate()
+{
+    m_planned = false;
+}
+
+/**
+ * \fn void LifxImageMapper::resend()
+ *
+ * Sends every point on the next frame whether it changed or not, after
+ * something else has set the lights, for instance
+ */
+void LifxImageMapper::resend()
+{
+    m_pending.fill(1);
+}
+
+/**
+ * \fn LifxImageMapperStats LifxImageMapper::stats() const
+ * \return Counts and stage times since the last resetStats()
+ */
+LifxImageMapperStats LifxImageMapper::stats() const
+{
+    LifxImageMapperStats stats = m_stats;
+    qint64 frames = static_cast<qint64>(qMax<quint64>(stats.frames, 1));
+
+    stats.mean.decode = m_total.decode / frames;
+    stats.mean.sample = m_total.sample / frames;
+    stats.mean.compare = m_total.compare / frames;
+    stats.mean.convert = m_total.convert / frames;
+    stats.mean.send = m_total.send / frames;
+    return stats;
+}
+
+/**
+ * \fn void LifxImageMapper::resetStats()
+ */
+void LifxImageMapper::resetStats()
+{
+    m_stats = LifxImageMapperStats();
+    m_total = LifxImageStageTimes();
+}
+
+/**
+ * \fn bool LifxImageMapper::processImage(const QImage &image)
+ * \param image Any format, converted to RGB888 if it isn't already
+ * \return true if the frame was mapped
+ *
+ * Maps and sends one frame now. The conversion counts as decoding.
+ */
+bool LifxImageMapper::processImage(const QImage &image)
+{
+    QElapsedTimer timer;
+
+    if (image.isNull()) {
+        qWarning() << __PRETTY_FUNCTION__ << ": The image is empty";
+        return false;
+    }
+
+    timer.start();
+    if (image.format() != QImage::Format_RGB888) {
+        QImage rgb = image.convertToFormat(QImage::Format_RGB888);
+        return map(rgb.constScanLine(0), rgb.width(), rgb.height(), rgb.bytesPerLine(), timer.nsecsElapsed());
+    }
+    return map(image.constScanLine(0), image.width(), image.height(), image.bytesPerLine(), timer.nsecsElapsed());
+}
+
+/**
+ * \fn bool LifxImageMapper::processRgb(const uchar *rgb, int width, int height, int bytesPerLine)
+ * \param rgb Packed 8 bit RGB rows, a frame from a decoder for instance
+ * \param width Pixels across
+ * \param height Rows
+ * \param bytesPerLine Bytes from the start of one row to the next
+ * \return true if the frame was mapped
+ */
+bool LifxImageMapper::processRgb(const uchar *rgb, int width, int height, int bytesPerLine)
+{
+    return map(rgb, width, height, bytesPerLine, 0);
+}
+
+/**
+ * \fn bool LifxImageMapper::openSequence(const QStringList &files, int fps, bool loop)
+ * \param files Images in order, anything QImage reads, or raw frames named .rgb or .raw
+ * \param fps Frames a second
+ * \param loop Go back to the first file after the last
+ * \return true if playback started
+ *
+ * The first frame is mapped as soon as it is read, and the rest at their
+ * times from then. finished() is emitted after the last frame unless
+ * looping. A file that can't be read is skipped with a warning.
+ */
+bool LifxImageMapper::openSequence(const QStringList &files, int fps, bool loop)
+{
+    if (files.isEmpty() || fps <= 0) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Nothing to play," << files.size() << "files at" << fps << "fps";
+        return false;
+    }
+
+    close();
+    m_fps = fps;
+    m_shown = -1;
+    m_stop = false;
+    m_playing = true;
+    m_decoder = std::thread(&LifxImageMapper::decoder, this, files, loop, QSize(m_rawWidth, m_rawHeight));
+    m_frameTimer->start(POLL_INTERVAL);
+    return true;
+}
+
+/**
+ * \fn bool LifxImageMapper::openStdin()
+ * \return true if reading started
+ *
+ * Reads frames of setRawSize() packed 8 bit RGB from stdin, from ffmpeg
+ * with -f rawvideo -pix_fmt rgb24 for instance, and maps each one as it
+ * completes. When more than one arrives at once only the newest is
+ * mapped, the rest count as dropped.
+ */
+bool LifxImageMapper::openStdin()
+{
+    if (m_rawWidth <= 0 || m_rawHeight <= 0) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Call setRawSize() first";
+        return false;
+    }
+
+    close();
+    m_partial.clear();
+    m_readNanos = 0;
+    m_notifier = new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &LifxImageMapper::readStdin);
+    return true;
+}
+
+/**
+ * \fn void LifxImageMapper::close()
+ *
+ * Stops reading. The lights keep the last frame sent.
+ */
+void LifxImageMapper::close()
+{
+    m_frameTimer->stop();
+    if (m_playing) {
+        stopDecoder();
+        m_playing = false;
+    }
+    delete m_notifier;
+    m_notifier = nullptr;
+}
+
+/*
+ * Maps the newest sequence frame that is due, dropping any older ones,
+ * and sets the timer for the one after
+ */
+void LifxImageMapper::nextFrame()
+{
+    qint64 due = m_shown < 0 ? 0 : m_clock.nsecsElapsed() * m_fps / 1000000000;
+    Decoded frame;
+    bool have = false;
+    bool ended = false;
+    quint64 skipped = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        while (!m_queue.empty()) {
+            Decoded &front = m_queue.front();
+            if (front.index < 0) {
+                // The end, once everything before it has been shown
+                ended = !have;
+                break;
+            }
+            if (front.index > due)
+                break;
+            if (have)
+                skipped++;
+            frame = std::move(front);
+            have = true;
+            m_queue.pop_front();
+        }
+    }
+    m_wake.notify_one();
+
+    if (ended) {
+        close();
+        emit finished();
+        return;
+    }
+
+    qint64 wait = POLL_INTERVAL;
+    if (have) {
+        if (m_shown < 0)
+            m_clock.start();
+        else if (frame.index < due)
+            m_stats.late++;
+        m_stats.dropped += skipped;
+        map(frame.image.constScanLine(0), frame.image.width(), frame.image.height(), frame.image.bytesPerLine(), frame.decode);
+        m_shown = frame.index;
+
+        qint64 next = (m_shown + 1) * 1000000000 / m_fps;
+        wait = qMax<qint64>((next - m_clock.nsecsElapsed() + 999999) / 1000000, 0);
+    }
+    m_frameTimer->start(static_cast<int>(wait));
+}
+
+/*
+ * Reads the sequence ahead of playback, keeping up to PREFETCH frames
+ * waiting, runs on m_decoder. The raw size is a copy taken when the
+ * sequence was opened, setRawSize() may be called meanwhile.
+ */
+void LifxImageMapper::decoder(QStringList files, bool loop, QSize rawSize)
+{
+    int failures = 0;
+
+    for (qint64 index = 0; ; index++) {
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_wake.wait(lock, [this]() { return m_stop || m_queue.size() < static_cast<size_t>(PREFETCH); });
+            if (m_stop)
+                return;
+            if ((!loop && index >= files.size()) || failures >= files.size()) {
+                m_queue.push_back({ -1, QImage(), 0 });
+                return;
+            }
+        }
+
+        QElapsedTimer timer;
+        QString path = files[static_cast<int>(index % files.size())];
+        QString suffix = QFileInfo(path).suffix().toLower();
+        QImage image;
+        bool loaded;
+
+        timer.start();
+        if (suffix == "rgb" || suffix == "raw")
+            loaded = loadRaw(path, rawSize, image);
+        else
+            loaded = image.load(path);
+        if (loaded && image.format() != QImage::Format_RGB888)
+            image = image.convertToFormat(QImage::Format_RGB888);
+        if (!loaded || image.isNull()) {
+            qWarning() << __PRETTY_FUNCTION__ << ": Unable to read" << path;
+            failures++;
+            continue;
+        }
+        failures = 0;
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_queue.push_back({ index, image, timer.nsecsElapsed() });
+    }
+}
+
+/*
+ * Asks the decoder to finish, waits for it and throws away what it read
+ */
+void LifxImageMapper::stopDecoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    if (m_decoder.joinable())
+        m_decoder.join();
+    m_queue.clear();
+}
+
+/*
+ * A frame of packed RGB with no header, size pixels
+ */
+bool LifxImageMapper::loadRaw(const QString &path, QSize size, QImage &image) const
+{
+    QFile file(path);
+    int row = size.width() * 3;
+
+    if (size.width() <= 0 || size.height() <= 0 || !file.open(QIODevice::ReadOnly))
+        return false;
+    if (file.size() < static_cast<qint64>(row) * size.height())
+        return false;
+
+    image = QImage(size, QImage::Format_RGB888);
+    for (int y = 0; y < size.height(); y++) {
+        if (file.read(reinterpret_cast<char*>(image.scanLine(y)), row) != row)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Puts stdin's bytes together into frames and maps the newest whole one
+ */
+void LifxImageMapper::readStdin()
+{
+    QElapsedTimer timer;
+    int size = m_partial.size();
+
+    timer.start();
+    m_partial.resize(size + STDIN_CHUNK);
+    ssize_t got = ::read(STDIN_FILENO, m_partial.data() + size, STDIN_CHUNK);
+    m_partial.resize(size + static_cast<int>(qMax<ssize_t>(got, 0)));
+    m_readNanos += timer.nsecsElapsed();
+
+    if (got <= 0) {
+        close();
+        emit finished();
+        return;
+    }
+
+    int row = m_rawWidth * 3;
+    int frameBytes = row * m_rawHeight;
+    int frames = m_partial.size() / frameBytes;
+    if (frames == 0)
+        return;
+
+    m_stats.dropped += frames - 1;
+    map(reinterpret_cast<const uchar*>(m_partial.constData()) + (frames - 1) * frameBytes, m_rawWidth, m_rawHeight, row, m_readNanos);
+    m_partial.remove(0, frames * frameBytes);
+    m_readNanos = 0;
+}
+
+/*
+ * Runs one frame through the stages, planning first if the image or the
+ * layout changed size
+ */
+bool LifxImageMapper::map(const uchar *rgb, int width, int height, int bytesPerLine, qint64 decode)
+{
+    LifxImageStageTimes times;
+    QElapsedTimer timer;
+
+    if (m_layout == nullptr || m_layout->size() == 0 || rgb == nullptr || width <= 0 || height <= 0)
+        return false;
+
+    timer.start();
+    if (!m_planned || width != m_planWidth || height != m_planHeight || m_layout->size() != m_planPoints)
+        plan(width, height);
+
+    times.decode = decode;
+    if (m_filter == Area)
+        sampleArea(rgb, bytesPerLine);
+    else
+        sampleBox(rgb, bytesPerLine);
+    times.sample = lap(timer);
+
+    int count = compare();
+    times.compare = lap(timer);
+
+    HSBK::convertRgbToHsbk(m_changedRgb.constData(), m_changedHsbk.data(), count, m_kelvin);
+    times.convert = lap(timer);
+
+    send(count);
+    times.send = lap(timer);
+
+    record(times);
+    return true;
+}
+
+/*
+ * Works out each point's footprint, the region if it follows the points,
+ * and the pixels under every point for an image of width by height
+ */
+void LifxImageMapper::plan(int width, int height)
+{
+    int count = m_layout->size();
+    const float *x = m_layout->x();
+    const float *y = m_layout->y();
+
+    footprints();
+    if (m_autoRegion) {
+        m_left = m_top = std::numeric_limits<float>::max();
+        m_right = m_bottom = std::numeric_limits<float>::lowest();
+        for (int p = 0; p < count; p++) {
+            float half = m_size[p] / 2;
+            m_left = qMin(m_left, x[p] - half);
+            m_right = qMax(m_right, x[p] + half);
+            m_top = qMin(m_top, y[p] - half);
+            m_bottom = qMax(m_bottom, y[p] + half);
+        }
+    }
+
+    // Pixels per layout unit, negative when the region is flipped
+    float sx = width / (m_right - m_left);
+    float sy = height / (m_bottom - m_top);
+
+    m_spans.resize(count);
+    for (int p = 0; p < count; p++) {
+        Span &span = m_spans[p];
+        float half = m_size[p] / 2;
+        float u0 = (x[p] - half - m_left) * sx;
+        float u1 = (x[p] + half - m_left) * sx;
+        float v0 = (y[p] - half - m_top) * sy;
+        float v1 = (y[p] + half - m_top) * sy;
+
+        weights(qMin(u0, u1), qMax(u0, u1), width, span.column, span.columns, span.left, span.inner, span.right);
+        weights(qMin(v0, v1), qMax(v0, v1), height, span.row, span.rows, span.top, span.middle, span.bottom);
+        if (span.columns == 0 || span.rows == 0)
+            span.columns = span.rows = 0;
+    }
+
+    m_rgb.fill(lx_rgb8_t{ 0, 0, 0 }, count);
+    m_sent.fill(lx_rgb8_t{ 0, 0, 0 }, count);
+    m_pending.fill(1, count);
+    m_changed.reserve(count);
+    m_changedRgb.resize(count);
+    m_changedHsbk.resize(count);
+    m_planWidth = width;
+    m_planHeight = height;
+    m_planPoints = count;
+    m_planned = true;
+}
+
+/*
+ * Every point's footprint, setFootprint() or the distance in x and y to
+ * its nearest neighbour. Points are swept in x order so each search stops
+ * once the gap in x alone is larger than the best found.
+ */
+void LifxImageMapper::footprints()
+{
+    int count = m_layout->size();
+    const float *x = m_layout->x();
+    const float *y = m_layout->y();
+
+    if (m_footprint > 0) {
+        m_size.fill(m_footprint, count);
+        return;
+    }
+
+    QVector<int> order(count);
+    for (int p = 0; p < count; p++)
+        order[p] = p;
+    std::sort(order.begin(), order.end(), [x](int a, int b) { return x[a] < x[b]; });
+
+    m_size.resize(count);
+    for (int i = 0; i < count; i++) {
+        int p = order[i];
+        float best = std::numeric_limits<float>::max();
+
+        for (int j = i + 1; j < count && x[order[j]] - x[p] < best; j++) {
+            float dx = x[order[j]] - x[p];
+            float dy = y[order[j]] - y[p];
+            float d = std::sqrt(dx * dx + dy * dy);
+            if (d > 0)
+                best = qMin(best, d);
+        }
+        for (int j = i - 1; j >= 0 && x[p] - x[order[j]] < best; j--) {
+            float dx = x[order[j]] - x[p];
+            float dy = y[order[j]] - y[p];
+            float d = std::sqrt(dx * dx + dy * dy);
+            if (d > 0)
+                best = qMin(best, d);
+        }
+
+        // A lone point gets a layout unit
+        m_size[p] = best < std::numeric_limits<float>::max() ? best : 1.0f;
+    }
+}
+
+/*
+ * The pixels from low to high along one axis of limit pixels. Box snaps
+ * to whole pixels, Area keeps the fraction of each edge pixel covered in
+ * its weight. A footprint smaller than a pixel takes the pixel under it.
+ */
+void LifxImageMapper::weights(float low, float high, int limit, int &first, int &count, float &lowEdge, float &inner, float &highEdge) const
+{
+    lowEdge = inner = highEdge = 0;
+    if (high - low < 1) {
+        float centre = (low + high) / 2;
+        low = centre - 0.5f;
+        high = centre + 0.5f;
+    }
+
+    if (m_filter == Box) {
+        int start = qMax(static_cast<int>(std::lround(low)), 0);
+        int end = qMin(static_cast<int>(std::lround(high)), limit);
+        first = start;
+        count = qMax(end - start, 0);
+        return;
+    }
+
+    low = qMax(low, 0.0f);
+    high = qMin(high, static_cast<float>(limit));
+    if (high <= low) {
+        first = count = 0;
+        return;
+    }
+
+    first = static_cast<int>(std::floor(low));
+    count = static_cast<int>(std::ceil(high)) - first;
+    inner = 1 / (high - low);
+    if (count == 1) {
+        lowEdge = 1;
+        return;
+    }
+    lowEdge = (first + 1 - low) * inner;
+    highEdge = (high - (first + count - 1)) * inner;
+}
+
+/*
+ * Plain mean of each point's pixels, integer sums are exact for any
+ * footprint under 16 million pixels
+ */
+void LifxImageMapper::sampleBox(const uchar *rgb, int bytesPerLine)
+{
+    const Span *spans = m_spans.constData();
+    lx_rgb8_t *out = m_rgb.data();
+
+    for (int p = 0; p < m_spans.size(); p++) {
+        const Span &span = spans[p];
+        if (span.columns == 0)
+            continue;
+
+        const uchar *line = rgb + static_cast<qint64>(span.row) * bytesPerLine + span.column * 3;
+        quint32 r = 0, g = 0, b = 0;
+        for (int j = 0; j < span.rows; j++, line += bytesPerLine) {
+            const uchar *pixel = line;
+            for (int i = 0; i < span.columns; i++, pixel += 3) {
+                r += pixel[0];
+                g += pixel[1];
+                b += pixel[2];
+            }
+        }
+
+        quint32 n = static_cast<quint32>(span.columns) * span.rows;
+        out[p] = { static_cast<uint8_t>((r + n / 2) / n), static_cast<uint8_t>((g + n / 2) / n), static_cast<uint8_t>((b + n / 2) / n) };
+    }
+}
+
+/*
+ * Each row weighted along x, then the rows weighted along y. The inside
+ * of a row is summed in integers like Box, only the two edge pixels and
+ * the row total are scaled.
+ */
+void LifxImageMapper::sampleArea(const uchar *rgb, int bytesPerLine)
+{
+    const Span *spans = m_spans.constData();
+    lx_rgb8_t *out = m_rgb.data();
+
+    for (int p = 0; p < m_spans.size(); p++) {
+        const Span &span = spans[p];
+        if (span.columns == 0)
+            continue;
+
+        const uchar *line = rgb + static_cast<qint64>(span.row) * bytesPerLine + span.column * 3;
+        const uchar *last = line + (span.columns - 1) * 3;
+        float r = 0, g = 0, b = 0;
+        for (int j = 0; j < span.rows; j++, line += bytesPerLine, last += bytesPerLine) {
+            float rr = span.left * line[0];
+            float gg = span.left * line[1];
+            float bb = span.left * line[2];
+            if (span.columns > 1) {
+                quint32 ir = 0, ig = 0, ib = 0;
+                for (const uchar *pixel = line + 3; pixel < last; pixel += 3) {
+                    ir += pixel[0];
+                    ig += pixel[1];
+                    ib += pixel[2];
+                }
+                rr += span.inner * ir + span.right * last[0];
+                gg += span.inner * ig + span.right * last[1];
+                bb += span.inner * ib + span.right * last[2];
+            }
+
+            float weight = j == 0 ? span.top : (j == span.rows - 1 ? span.bottom : span.middle);
+            r += weight * rr;
+            g += weight * gg;
+            b += weight * bb;
+        }
+
+        out[p] = { static_cast<uint8_t>(qMin(r + 0.5f, 255.0f)), static_cast<uint8_t>(qMin(g + 0.5f, 255.0f)),
+                   static_cast<uint8_t>(qMin(b + 0.5f, 255.0f)) };
+    }
+}
+
+/*
+ * Packs the points which moved past the threshold, or were never sent,
+ * for the conversion, and returns how many
+ */
+int LifxImageMapper::compare()
+{
+    const Span *spans = m_spans.constData();
+    const lx_rgb8_t *rgb = m_rgb.constData();
+    const lx_rgb8_t *sent = m_sent.constData();
+    const quint8 *pending = m_pending.constData();
+    lx_rgb8_t *packed = m_changedRgb.data();
+    int count = 0;
+
+    m_changed.clear();
+    for (int p = 0; p < m_spans.size(); p++) {
+        if (spans[p].columns == 0)
+            continue;
+
+        int moved = qMax(qMax(std::abs(rgb[p].r - sent[p].r), std::abs(rgb[p].g - sent[p].g)), std::abs(rgb[p].b - sent[p].b));
+        if (moved > m_threshold || pending[p]) {
+            m_changed.append(p);
+            packed[count++] = rgb[p];
+        }
+    }
+    return count;
+}
+
+/*
+ * Whole bulbs into one batch, zones and tile pixels into their frame
+ * buffers, then one update per device touched. A point whose bulb isn't
+ * bound stays pending.
+ */
+void LifxImageMapper::send(int count)
+{
+    if (m_manager == nullptr)
+        return;
+
+    lx_hsbk_t *colors = m_layout->colors();
+
+    m_batch.clear();
+    m_zoneBulbs.clear();
+    m_tileBulbs.clear();
+    for (int i = 0; i < count; i++) {
+        int p = m_changed[i];
+        LifxBulb *bulb = m_layout->bulb(p);
+        if (bulb == nullptr)
+            continue;
+
+        const lx_hsbk_t &color = m_changedHsbk[i];
+        colors[p] = color;
+        switch (m_layout->kind(p)) {
+            case LifxLayout::Bulb:
+                m_batch.setColor(bulb, HSBK(color.hue, color.saturation, color.brightness, color.kelvin), m_duration);
+                break;
+            case LifxLayout::Zone:
+                bulb->zones().setPixels(m_layout->index(p), &color, 1);
+                m_zoneBulbs.insert(bulb);
+                break;
+            case LifxLayout::TilePixel:
+                bulb->tiles().setPixels(m_layout->index(p), &color, 1);
+                m_tileBulbs.insert(bulb);
+                break;
+        }
+        m_sent[p] = m_rgb[p];
+        m_pending[p] = 0;
+        m_stats.points++;
+    }
+
+    if (!m_batch.isEmpty())
+        m_manager->submit(m_batch);
+    for (auto bulb : m_zoneBulbs)
+        m_manager->changeBulbZones(bulb, m_duration);
+    for (auto bulb : m_tileBulbs)
+        m_manager->changeBulbTiles(bulb, m_duration);
+}
+
+/*
+ * Adds a frame's stage times to the stats
+ */
+void LifxImageMapper::record(const LifxImageStageTimes &times)
+{
+    m_stats.frames++;
+    m_stats.last = times;
+
+    m_total.decode += times.decode;
+    m_total.sample += times.sample;
+    m_total.compare += times.compare;
+    m_total.convert += times.convert;
+    m_total.send += times.send;
+
+    m_stats.worst.decode = qMax(m_stats.worst.decode, times.decode);
+    m_stats.worst.sample = qMax(m_stats.worst.sample, times.sample);
+    m_stats.worst.compare = qMax(m_stats.worst.compare, times.compare);
+    m_stats.worst.convert = qMax(m_stats.worst.convert, times.convert);
+    m_stats.worst.send = qMax(m_stats.worst.send, times.send);
+}
@@ -0,0 +1,524 @@
+/*
+ * Where every bulb, zone and tile pixel is
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxlayout.h"
+#include "lifxmanager.h"
+#include "lifxbulb.h"
+
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+const char *kindNames[] = { "bulb", "zone", "pixel" };
+
+inline float fraction(float value)
+{
+    return value - std::floor(value);
+}
+
+/*
+ * Color weight of the way from a to b, hue the short way round
+ */
+inline lx_hsbk_t mix(const lx_hsbk_t &a, const lx_hsbk_t &b, float weight)
+{
+    lx_hsbk_t out;
+    int hue = static_cast<int16_t>(static_cast<uint16_t>(b.hue - a.hue));
+
+    out.hue = static_cast<uint16_t>(a.hue + static_cast<int>(std::lround(hue * weight)));
+    out.saturation = static_cast<uint16_t>(std::lround(a.saturation + (b.saturation - a.saturation) * weight));
+    out.brightness = static_cast<uint16_t>(std::lround(a.brightness + (b.brightness - a.brightness) * weight));
+    out.kelvin = static_cast<uint16_t>(std::lround(a.kelvin + (b.kelvin - a.kelvin) * weight));
+    return out;
+}
+
+inline lx_hsbk_t toHsbk(const HSBK &color)
+{
+    return { color.h(), color.s(), color.b(), color.k() };
+}
+
+}
+
+LifxLayout::LifxLayout()
+{
+}
+
+int LifxLayout::add(uint64_t target, Kind kind, int index, float x, float y, float z)
+{
+    m_x.append(x);
+    m_y.append(y);
+    m_z.append(z);
+    m_kind.append(static_cast<quint8>(kind));
+    m_index.append(index);
+    m_target.append(target);
+    m_bulbs.append(nullptr);
+    m_colors.append({ 0, 0, 0, 3500 });
+    m_sent.append({ 0, 0, 0, 3500 });
+    m_hasSent.append(false);
+    return m_x.size() - 1;
+}
+
+/**
+ * \fn int LifxLayout::addBulb(uint64_t target, float x, float y, float z)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param x Position
+ * \param y Position
+ * \param z Position
+ * \return The point number
+ */
+int LifxLayout::addBulb(uint64_t target, float x, float y, float z)
+{
+    return add(target, Bulb, 0, x, y, z);
+}
+
+/**
+ * \fn int LifxLayout::addZone(uint64_t target, int zone, float x, float y, float z)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param zone Zone on the strip
+ * \param x Position
+ * \param y Position
+ * \param z Position
+ * \return The point number
+ */
+int LifxLayout::addZone(uint64_t target, int zone, float x, float y, float z)
+{
+    return add(target, Zone, zone, x, y, z);
+}
+
+/**
+ * \fn int LifxLayout::addStrip(uint64_t target, int zones, float x1, float y1, float z1, float x2, float y2, float z2)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param zones Number of zones on the strip
+ * \param x1 Position of zone 0
+ * \param y1 Position of zone 0
+ * \param z1 Position of zone 0
+ * \param x2 Position of the last zone
+ * \param y2 Position of the last zone
+ * \param z2 Position of the last zone
+ * \return The point number of zone 0, the others follow it
+ *
+ * Spaces the zones evenly along a straight line
+ */
+int LifxLayout::addStrip(uint64_t target, int zones, float x1, float y1, float z1, float x2, float y2, float z2)
+{
+    int first = size();
+
+    for (int i = 0; i < zones; i++) {
+        float t = zones > 1 ? static_cast<float>(i) / (zones - 1) : 0;
+        add(target, Zone, i, x1 + (x2 - x1) * t, y1 + (y2 - y1) * t, z1 + (z2 - z1) * t);
+    }
+    return first;
+}
+
+/**
+ * \fn int LifxLayout::addTile(uint64_t target, int tile, float x, float y, float z, float pitch, int width, int height)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param tile Index of the tile in the chain
+ * \param x Position of the pixel at column 0, row 0
+ * \param y Position of the pixel at column 0, row 0
+ * \param z Position of every pixel
+ * \param pitch Distance between pixels, rows go down in y
+ * \param width Columns on the tile
+ * \param height Rows on the tile
+ * \return The point number of the first pixel, the others follow it row by row
+ */
+int LifxLayout::addTile(uint64_t target, int tile, float x, float y, float z, float pitch, int width, int height)
+{
+    int first = size();
+
+    for (int row = 0; row < height; row++) {
+        for (int column = 0; column < width; column++) {
+            if (row * width + column < TILE_PIXELS)
+                add(target, TilePixel, tile * TILE_PIXELS + row * width + column, x + column * pitch, y - row * pitch, z);
+        }
+    }
+    return first;
+}
+
+/**
+ * \fn void LifxLayout::clear()
+ */
+void LifxLayout::clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_z.clear();
+    m_kind.clear();
+    m_index.clear();
+    m_target.clear();
+    m_bulbs.clear();
+    m_zoneBulbs.clear();
+    m_tileBulbs.clear();
+    m_colors.clear();
+    m_sent.clear();
+    m_hasSent.clear();
+}
+
+/**
+ * \fn void LifxLayout::project(float dx, float dy, float dz, float *out, float *low, float *high) const
+ * \param dx Direction, need not be unit length
+ * \param dy Direction
+ * \param dz Direction
+ * \param out Array of size() to write each point's distance along the direction
+ * \param low If not null, set to the smallest distance
+ * \param high If not null, set to the largest distance
+ *
+ * The building block for directional effects, one multiply add per axis per point
+ */
+void LifxLayout::project(float dx, float dy, float dz, float *out, float *low, float *high) const
+{
+    float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+    const float *px = m_x.constData();
+    const float *py = m_y.constData();
+    const float *pz = m_z.constData();
+    int count = size();
+    float lo = 0;
+    float hi = 0;
+
+    if (length > 0) {
+        dx /= length;
+        dy /= length;
+        dz /= length;
+    }
+    else {
+        dx = 1;
+    }
+
+    for (int i = 0; i < count; i++)
+        out[i] = px[i] * dx + py[i] * dy + pz[i] * dz;
+
+    if (count) {
+        lo = hi = out[0];
+        for (int i = 1; i < count; i++) {
+            lo = qMin(lo, out[i]);
+            hi = qMax(hi, out[i]);
+        }
+    }
+    if (low)
+        *low = lo;
+    if (high)
+        *high = hi;
+}
+
+/**
+ * \fn int LifxLayout::bind(LifxManager *manager)
+ * \param manager A manager which has discovered the bulbs
+ * \return The number of points whose device was found
+ *
+ * Call again when more bulbs are discovered. Every point is sent again
+ * by the next send().
+ */
+int LifxLayout::bind(LifxManager *manager)
+{
+    int found = 0;
+
+    resend();
+    for (int i = 0; i < size(); i++) {
+        m_bulbs[i] = manager ? manager->getBulbByMac(m_target[i]) : nullptr;
+        if (m_bulbs[i])
+            found++;
+    }
+    return found;
+}
+
+/**
+ * \fn void LifxLayout::evaluate(const Effect &effect, qint64 msecs)
+ * \param effect Writes a color per point into colors()
+ * \param msecs The effect's time
+ */
+void LifxLayout::evaluate(const Effect &effect, qint64 msecs)
+{
+    if (effect)
+        effect(*this, msecs, m_colors.data());
+}
+
+/**
+ * \fn void LifxLayout::write(const lx_hsbk_t *colors, LifxCommandBatch &batch, uint32_t duration)
+ * \param colors Array of size() colors, one per point
+ * \param batch Gets a SET_COLOR for each whole bulb
+ * \param duration Transition time in millis for the bulbs
+ *
+ * Zones and tile pixels go into the device's frame buffer, send them
+ * with LifxManager::changeBulbZones() and changeBulbTiles(), or use send().
+ * A point whose color is the one it was last written with is skipped.
+ */
+void LifxLayout::write(const lx_hsbk_t *colors, LifxCommandBatch &batch, uint32_t duration)
+{
+    for (int i = 0; i < size(); i++) {
+        LifxBulb *bulb = m_bulbs[i];
+        if (bulb == nullptr)
+            continue;
+        if (m_hasSent[i] && memcmp(&m_sent[i], colors + i, sizeof(lx_hsbk_t)) == 0)
+            continue;
+
+        switch (m_kind[i]) {
+            case Bulb:
+                batch.setColor(bulb, HSBK(colors[i].hue, colors[i].saturation, colors[i].brightness, colors[i].kelvin), duration);
+                break;
+            case Zone:
+                bulb->zones().setPixels(m_index[i], colors + i, 1);
+                m_zoneBulbs.insert(bulb);
+                break;
+            case TilePixel:
+                bulb->tiles().setPixels(m_index[i], colors + i, 1);
+                m_tileBulbs.insert(bulb);
+                break;
+        }
+        m_sent[i] = colors[i];
+        m_hasSent[i] = true;
+    }
+}
+
+/**
+ * \fn void LifxLayout::send(LifxManager *manager, uint32_t duration)
+ * \param manager The manager bind() was given
+ * \param duration Transition time in millis
+ *
+ * Sends colors() as one batch for the bulbs, and one update per strip
+ * and tile chain. Points and devices which didn't change since the last
+ * send aren't sent anything.
+ */
+void LifxLayout::send(LifxManager *manager, uint32_t duration)
+{
+    if (manager == nullptr)
+        return;
+
+    m_batch.clear();
+    m_zoneBulbs.clear();
+    m_tileBulbs.clear();
+    write(m_colors.constData(), m_batch, duration);
+    if (!m_batch.isEmpty())
+        manager->submit(m_batch);
+    for (auto bulb : m_zoneBulbs)
+        manager->changeBulbZones(bulb, duration);
+    for (auto bulb : m_tileBulbs)
+        manager->changeBulbTiles(bulb, duration);
+    m_zoneBulbs.clear();
+    m_tileBulbs.clear();
+}
+
+/**
+ * \fn void LifxLayout::resend()
+ *
+ * Forgets what was sent, so the next write() or send() sends every
+ * point, after something else has changed the bulbs for instance
+ */
+void LifxLayout::resend()
+{
+    m_hasSent.fill(false);
+}
+
+/**
+ * \fn bool LifxLayout::save(const QString &path) const
+ * \param path The file to write
+ * \return False if the file can't be written
+ *
+ * The file is {"points": [{"mac": "d0:73:d5:01:02:03", "kind": "zone",
+ * "index": 4, "at": [x, y, z]}, ...]}
+ */
+bool LifxLayout::save(const QString &path) const
+{
+    QFile file(path);
+    QJsonArray points;
+
+    for (int i = 0; i < size(); i++) {
+        QJsonObject point;
+        QJsonArray at;
+
+        at.append(m_x[i]);
+        at.append(m_y[i]);
+        at.append(m_z[i]);
+        point.insert("mac", LifxBulb::targetToMac(m_target[i]));
+        point.insert("kind", kindNames[m_kind[i]]);
+        if (m_kind[i] != Bulb)
+            point.insert("index", m_index[i]);
+        point.insert("at", at);
+        points.append(point);
+    }
+
+    QJsonObject layout;
+    layout.insert("points", points);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(QJsonDocument(layout).toJson()) < 0) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to write" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * \fn bool LifxLayout::load(const QString &path)
+ * \param path A file from save()
+ * \return False if the file can't be read, points already added are replaced
+ */
+bool LifxLayout::load(const QString &path)
+{
+    QFile file(path);
+    QJsonParseError error;
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to open" << path << ":" << file.errorString();
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (doc.isNull() || !doc.isObject()) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "is not a layout:" << error.errorString();
+        return false;
+    }
+
+    clear();
+    QJsonArray points = doc.object().value("points").toArray();
+    for (int i = 0; i < points.size(); i++) {
+        QJsonObject point = points.at(i).toObject();
+        QJsonArray at = point.value("at").toArray();
+        QString kind = point.value("kind").toString("bulb");
+        bool ok;
+        uint64_t target = LifxBulb::macToTarget(point.value("mac").toString(), &ok);
+        int k = 0;
+
+        while (k < 3 && kind != kindNames[k])
+            k++;
+        if (!ok || k == 3 || at.size() < 2) {
+            qWarning() << __PRETTY_FUNCTION__ << ":" << path << "point" << i << "is not usable";
+            continue;
+        }
+        add(target, static_cast<Kind>(k), point.value("index").toInt(), at.at(0).toDouble(), at.at(1).toDouble(), at.at(2).toDouble());
+    }
+    return true;
+}
+
+/**
+ * \fn LifxLayout::Effect LifxLayout::gradient(const HSBK &from, const HSBK &to, float dx, float dy, float dz)
+ * \param from Color at the near end
+ * \param to Color at the far end
+ * \param dx Direction the gradient runs in
+ * \param dy Direction
+ * \param dz Direction
+ * \return A still effect, spread across the whole layout
+ */
+LifxLayout::Effect LifxLayout::gradient(const HSBK &from, const HSBK &to, float dx, float dy, float dz)
+{
+    lx_hsbk_t a = toHsbk(from);
+    lx_hsbk_t b = toHsbk(to);
+    auto distance = std::make_shared<QVector<float>>();
+
+    return [=](const LifxLayout &layout, qint64, lx_hsbk_t *out) {
+        float low, high;
+
+        distance->resize(layout.size());
+        layout.project(dx, dy, dz, distance->data(), &low, &high);
+        float scale = high > low ? 1 / (high - low) : 0;
+        for (int i = 0; i < layout.size(); i++)
+            out[i] = mix(a, b, ((*distance)[i] - low) * scale);
+    };
+}
+
+/**
+ * \fn LifxLayout::Effect LifxLayout::wave(const HSBK &color, float dx, float dy, float dz, float wavelength, int period)
+ * \param color Color at the crest
+ * \param dx Direction the wave travels
+ * \param dy Direction
+ * \param dz Direction
+ * \param wavelength Distance from crest to crest, in layout units
+ * \param period Millis for a crest to move one wavelength
+ * \return Brightness rising and falling as a sine wave moving across the layout
+ */
+LifxLayout::Effect LifxLayout::wave(const HSBK &color, float dx, float dy, float dz, float wavelength, int period)
+{
+    lx_hsbk_t crest = toHsbk(color);
+    auto distance = std::make_shared<QVector<float>>();
+    float k = wavelength > 0 ? 1 / wavelength : 0;
+    int p = qMax(period, 1);
+
+    return [=](const LifxLayout &layout, qint64 msecs, lx_hsbk_t *out) {
+        float phase = static_cast<float>(msecs % p) / p;
+
+        distance->resize(layout.size());
+        layout.project(dx, dy, dz, distance->data());
+        for (int i = 0; i < layout.size(); i++) {
+            float level = 0.5f + 0.5f * std::sin(2 * static_cast<float>(M_PI) * ((*distance)[i] * k - phase));
+            out[i] = crest;
+            out[i].brightness = static_cast<uint16_t>(crest.brightness * level);
+        }
+    };
+}
+
+/**
+ * \fn LifxLayout::Effect LifxLayout::chase(const HSBK &color, const HSBK &background, float dx, float dy, float dz, float width, int period)
+ * \param color Color of the band
+ * \param background Color everywhere else
+ * \param dx Direction the band moves
+ * \param dy Direction
+ * \param dz Direction
+ * \param width Width of the band in layout units, its edges are soft
+ * \param period Millis for the band to cross the layout
+ * \return A band sweeping across the layout, again and again
+ */
+LifxLayout::Effect LifxLayout::chase(const HSBK &color, const HSBK &background, float dx, float dy, float dz, float width, int period)
+{
+    lx_hsbk_t band = toHsbk(color);
+    lx_hsbk_t rest = toHsbk(background);
+    auto distance = std::make_shared<QVector<float>>();
+    float half = qMax(width / 2, 0.0001f);
+    int p = qMax(period, 1);
+
+    return [=](const LifxLayout &layout, qint64 msecs, lx_hsbk_t *out) {
+        float low, high;
+
+        distance->resize(layout.size());
+        layout.project(dx, dy, dz, distance->data(), &low, &high);
+        float center = low - half + (high - low + 2 * half) * static_cast<float>(msecs % p) / p;
+        for (int i = 0; i < layout.size(); i++) {
+            float weight = 1 - std::fabs((*distance)[i] - center) / half;
+            out[i] = mix(rest, band, qBound(0.0f, weight, 1.0f));
+        }
+    };
+}
+
+/**
+ * \fn LifxLayout::Effect LifxLayout::rainbow(float dx, float dy, float dz, float wavelength, int period, uint16_t brightness, uint16_t kelvin)
+ * \param dx Direction the colors move
+ * \param dy Direction
+ * \param dz Direction
+ * \param wavelength Distance for the hue to go all the way round, in layout units
+ * \param period Millis for the colors to move one wavelength
+ * \param brightness Brightness of every point
+ * \param kelvin Kelvin of every point
+ * \return The color wheel laid across the layout and scrolling along it
+ */
+LifxLayout::Effect LifxLayout::rainbow(float dx, float dy, float dz, float wavelength, int period, uint16_t brightness, uint16_t kelvin)
+{
+    auto distance = std::make_shared<QVector<float>>();
+    float k = wavelength > 0 ? 1 / wavelength : 0;
+    int p = qMax(period, 1);
+
+    return [=](const LifxLayout &layout, qint64 msecs, lx_hsbk_t *out) {
+        float phase = static_cast<float>(msecs % p) / p;
+
+        distance->resize(layout.size());
+        layout.project(dx, dy, dz, distance->data());
+        for (int i = 0; i < layout.size(); i++) {
+            out[i].hue = static_cast<uint16_t>(fraction((*distance)[i] * k - phase) * 65535);
+            out[i].saturation = 65535;
+            out[i].brightness = brightness;
+            out[i].kelvin = kelvin;
+        }
+    };
+}
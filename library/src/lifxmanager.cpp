@@ -19,9 +19,24 @@
 
 #include "lifxmanager.h"
 
-LifxManager::LifxManager(QObject *parent) : QObject(parent), m_debug(false)
+#include <limits>
+#include <memory>
+
+LifxManager::LifxManager(QObject *parent) : QObject(parent), m_snapshotDirty(false), m_groupsChanged(false), m_debug(false), m_suppressionWindow(5000), m_bulbInterval(50), m_suppressed(0)
 {
     m_protocol = new LifxProtocol();
+    m_fleet = new LifxFleet();
+    m_snapshots = new LifxSnapshotRing();
+    m_commands = new LifxCommandQueue();
+    m_drainScheduled = false;
+    m_requestTimer = new QTimer(this);
+    m_requestTimer->setSingleShot(true);
+    connect(m_requestTimer, &QTimer::timeout, this, &LifxManager::expireRequests);
+    m_reconciler = new LifxReconciler();
+    m_reconcileTimer = new QTimer(this);
+    m_reconcileTimer->setInterval(RECONCILE_INTERVAL);
+    connect(m_reconcileTimer, &QTimer::timeout, this, &LifxManager::reconcile);
+    connect(m_protocol, &LifxProtocol::packetsRead, this, &LifxManager::packetsRead);
     connect(m_protocol, &LifxProtocol::discoveryFailed, this, &LifxManager::discoveryFailed);
     connect(m_protocol, &LifxProtocol::newPacket, this, &LifxManager::newPacket);
     QByteArray debug = qgetenv("LIFX_DEBUG");
@@ -34,14 +49,42 @@ LifxManager::LifxManager(QObject *parent) : QObject(parent), m_debug(false)
 LifxManager::LifxManager(const LifxManager& object) : QObject()
 {
     m_protocol = object.m_protocol;
+    m_fleet = object.m_fleet;
+    m_snapshots = object.m_snapshots;
+    m_staging = object.m_staging;
+    m_snapshotDirty = object.m_snapshotDirty;
+    m_groupsChanged = object.m_groupsChanged;
+    m_commands = object.m_commands;
+    m_drainScheduled = false;
+    m_requestTimer = new QTimer(this);
+    m_requestTimer->setSingleShot(true);
+    connect(m_requestTimer, &QTimer::timeout, this, &LifxManager::expireRequests);
+    m_reconciler = object.m_reconciler;
+    m_reconcileTimer = new QTimer(this);
+    m_reconcileTimer->setInterval(RECONCILE_INTERVAL);
+    connect(m_reconcileTimer, &QTimer::timeout, this, &LifxManager::reconcile);
     m_bulbs = object.m_bulbs;
     m_groups = object.m_groups;
     m_bulbsByPID = object.m_bulbsByPID;
+    m_bulbsByLabel = object.m_bulbsByLabel;
+    m_bulbsByAddress = object.m_bulbsByAddress;
+    m_groupsByLabel = object.m_groupsByLabel;
+    m_groupForBulb = object.m_groupForBulb;
     m_productObjects = object.m_productObjects;
+    m_debug = object.m_debug;
+    m_suppressionWindow = object.m_suppressionWindow;
+    m_bulbInterval = object.m_bulbInterval;
+    m_suppressed = 0;
 }
 
 LifxManager::~LifxManager()
 {
+    QHash<quint64, PendingRequest> requests = m_requests;
+
+    m_requests.clear();
+    m_requestDeadlines.clear();
+    for (auto it = requests.begin(); it != requests.end(); ++it)
+        it->done(nullptr);
 }
 
 /**
@@ -94,8 +137,8 @@ void LifxManager::updateState(LifxBulb* bulb)
  */
 void LifxManager::updateState(uint64_t target)
 {
-    if (m_bulbs.contains(target)) {
-        LifxBulb *bulb = m_bulbs[target];
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
         updateState(bulb);
     }
 }
@@ -108,11 +151,9 @@ void LifxManager::updateState(uint64_t target)
  */
 void LifxManager::updateState()
 {
-    QMapIterator<uint64_t, LifxBulb*> i(m_bulbs);
-    while (i.hasNext()) {
-        i.next();
-        updateState(i.value());
-    }    
+    for (auto bulb : m_bulbs) {
+        updateState(bulb);
+    }
 }
 
 void LifxManager::discoverBulb(QHostAddress address, int port)
@@ -130,32 +171,49 @@ void LifxManager::discoverBulb(QHostAddress address, int port)
  */
 void LifxManager::newPacket(LifxPacket *packet)
 {
-    LifxBulb *bulb;
     uint64_t target = packet->targetAsLong();
-    
+    LifxBulb *bulb = bulbFor(target);
+
+    if (bulb) {
+        bulb->touch();
+        // Only after real timeouts, any other reply would cut the backoff short
+        if (m_reconciler->isOffline(bulb->fleetIndex()))
+            m_reconciler->wake(bulb->fleetIndex(), m_fleet->now());
+    }
+    m_snapshotDirty = true;
+
     switch (packet->type()) {
         case LIFX_DEFINES::STATE_SERVICE:
-            if (!m_bulbs.contains(target)) {
-                bulb = new LifxBulb();
+            if (!bulb) {
+                bulb = new LifxBulb(m_fleet, target);
                 lx_dev_service_t *service = (lx_dev_service_t*)packet->payload().data();
-                bulb->setAddress(packet->address(), service->port);
+                changeBulbAddress(bulb, packet->address(), service->port);
                 bulb->setService(service->service);
                 bulb->setTarget(packet->target());
                 if (m_debug)
                     qDebug() << __PRETTY_FUNCTION__ << ": SERVICE:" << bulb;
-                m_bulbs[target] = bulb;
+                m_bulbs.append(bulb);
+                bulb->touch();
                 m_protocol->getLabelForBulb(bulb);
             }
             else {
-                bulb = m_bulbs[target];
-                bulb->setAddress(packet->address(), packet->port());
+                changeBulbAddress(bulb, packet->address(), packet->port());
+                if (m_reconciler->hasDesired(bulb->fleetIndex())) {
+                    // Might have rebooted, so what it last reported can't be trusted
+                    bulb->invalidateColor();
+                    bulb->invalidatePower();
+                    m_reconciler->wake(bulb->fleetIndex(), m_fleet->now());
+                }
                 emit bulbStateChange(bulb);
             }
             break;
         case LIFX_DEFINES::STATE_LABEL:
-            if (m_bulbs.contains(target)) {
-                bulb = m_bulbs[target];
-                bulb->setLabel(QString::fromUtf8(packet->payload()));
+            if (bulb) {
+                QString label = QString::fromUtf8(packet->payload());
+                m_bulbsByLabel.remove(bulb->label(), bulb);
+                m_bulbsByLabel.insert(label, bulb);
+                bulb->setLabel(label);
+                m_staging.setLabel(bulb->fleetIndex(), label);
                 if (m_debug)
                     qDebug() << __PRETTY_FUNCTION__ << ": LABEL:" << bulb;
                 if (bulb->inDiscovery()) {
@@ -169,8 +227,7 @@ void LifxManager::newPacket(LifxPacket *packet)
             }
             break;
         case LIFX_DEFINES::STATE_HOST_FIRMWARE:
-            if (m_bulbs.contains(target)) {
-                bulb = m_bulbs[target];
+            if (bulb) {
                 lx_dev_firmware_t *firmware = (lx_dev_firmware_t*)packet->payload().data();
                 bulb->setMajor(firmware->major);
                 bulb->setMinor(firmware->minor);
@@ -186,15 +243,16 @@ void LifxManager::newPacket(LifxPacket *packet)
             }
             break;            
         case LIFX_DEFINES::STATE_VERSION:
-            if (m_bulbs.contains(target)) {
-                bulb = m_bulbs[target];
+            if (bulb) {
                 lx_dev_version_t *version = (lx_dev_version_t*)packet->payload().data();
+                m_bulbsByPID.remove(bulb->pid(), bulb);
                 bulb->setVID(version->vendor);
                 bulb->setPID(version->product);
                 if (m_productObjects.size() && m_productObjects.contains(version->product)) {
                     bulb->setProduct(m_productObjects[version->product]);
                 }
                 m_bulbsByPID.insert(version->product, bulb);
+                stageProduct(bulb);
                 if (m_debug)
                     qDebug() << __PRETTY_FUNCTION__ << ": VERSION:" << bulb;
 
@@ -208,17 +266,24 @@ void LifxManager::newPacket(LifxPacket *packet)
             }
             break;            
         case LIFX_DEFINES::STATE_GROUP:
-            if (m_bulbs.contains(target)) {
+            if (bulb) {
                 QString label;
                 QByteArray uuid;
-                bulb = m_bulbs[target];
                 lx_group_info_t *group = (lx_group_info_t*)packet->payload().data();
                 label = QString(group->label);
-                uuid = QByteArray::fromRawData(group->group, 16);
+                uuid = QByteArray(group->group, 16);
                 bulb->setGroup(group->label);
+                m_staging.setGroup(bulb->fleetIndex(), label);
                 if (m_groups.contains(uuid)) {
                     LifxGroup *g = m_groups[uuid];
                     if (g != nullptr) {
+                        if (g->label() != label) {
+                            if (m_groupsByLabel.value(g->label(), nullptr) == g)
+                                m_groupsByLabel.remove(g->label());
+                            g->setLabel(label);
+                            m_groupsByLabel.insert(label, g);
+                        }
+                        moveBulbToGroup(bulb, g);
                         if (!g->contains(bulb)) {
                             g->addBulb(bulb);
                             emit bulbGroupChange(g);
@@ -231,6 +296,8 @@ void LifxManager::newPacket(LifxPacket *packet)
                     LifxGroup *g = new LifxGroup(label, uuid, group->updated_at);
                     g->addBulb(bulb);
                     m_groups[uuid] = g;
+                    m_groupsByLabel.insert(label, g);
+                    moveBulbToGroup(bulb, g);
                     emit newGroupFound(label, uuid);
                     emit bulbGroupChange(g);
                     if (m_debug)
@@ -242,13 +309,16 @@ void LifxManager::newPacket(LifxPacket *packet)
             }
             break;
         case LIFX_DEFINES::LIGHT_STATE:
-            if (m_bulbs.contains(target)) {
-                bulb = m_bulbs[target];
+            if (bulb) {
                 lx_dev_lightstate_t *color = (lx_dev_lightstate_t*)packet->payload().data();
                 bulb->setDevColor(color);
                 if (bulb->inDiscovery()) {
                     bulb->setDiscoveryActive(false);
                     emit bulbDiscoveryFinished(bulb);
+                    if (bulb->isMultizone())
+                        m_protocol->getZonesForBulb(bulb);
+                    if (bulb->isMatrix())
+                        m_protocol->getDeviceChainForBulb(bulb);
                 }
                 else
                     emit bulbStateChange(bulb);
@@ -261,14 +331,14 @@ void LifxManager::newPacket(LifxPacket *packet)
             }
             break;
         case LIFX_DEFINES::STATE_POWER:
-            if (m_bulbs.contains(target)) {
-                bulb = m_bulbs[target];
+            if (bulb) {
                 uint16_t power = 0;
                 memcpy(&power, packet->payload().data(), 2);
                 if (m_debug)
                     qDebug() << __PRETTY_FUNCTION__ << ": Power has changed to" << power;
                 
                 bulb->setPower(power);
+                bulb->confirmPower(power);
                 if (!bulb->inDiscovery())
                     emit bulbPowerChange(bulb);
 
@@ -277,9 +347,8 @@ void LifxManager::newPacket(LifxPacket *packet)
             }
             break;
         case LIFX_DEFINES::ECHO_REPLY:
-            if (m_bulbs.contains(target)) {
-                bulb = m_bulbs[target];
-                bulb->setAddress(packet->address());
+            if (bulb) {
+                changeBulbAddress(bulb, packet->address());
                 lx_dev_echo_t *echo = (lx_dev_echo_t*)packet->payload().data();
                 if (echo->value == bulb->echoRequest(false)) {
                     bulb->echoPending(false);
@@ -295,8 +364,7 @@ void LifxManager::newPacket(LifxPacket *packet)
             }
             break;
         case LIFX_DEFINES::STATE_WIFI_INFO:
-            if (m_bulbs.contains(target)) {
-                bulb = m_bulbs[target];
+            if (bulb) {
                 float signal = 0;
                 memcpy(&signal, packet->payload().data(), 4);
                 bulb->setRSSI(signal);
@@ -307,6 +375,45 @@ void LifxManager::newPacket(LifxPacket *packet)
                 }
             }
             break;
+        case LIFX_DEFINES::STATE_EXTENDED_COLOR_ZONES:
+            if (bulb) {
+                if (packet->payload().size() < (int)sizeof(lx_dev_extended_zones_state_t)) {
+                    qWarning() << __PRETTY_FUNCTION__ << ": Short STATE_EXTENDED_COLOR_ZONES from" << bulb->label();
+                    break;
+                }
+                lx_dev_extended_zones_state_t *state = (lx_dev_extended_zones_state_t*)packet->payload().data();
+                bulb->setZoneState(state);
+                if (m_debug)
+                    qDebug() << __PRETTY_FUNCTION__ << ": ZONES:" << bulb->label() << "has" << state->zones_count << "zones, got" << state->colors_count << "from" << state->zone_index;
+
+                emit bulbZonesChange(bulb);
+            }
+            break;
+        case LIFX_DEFINES::STATE_DEVICE_CHAIN:
+            if (bulb) {
+                if (packet->payload().size() < (int)sizeof(lx_dev_device_chain_t)) {
+                    qWarning() << __PRETTY_FUNCTION__ << ": Short STATE_DEVICE_CHAIN from" << bulb->label();
+                    break;
+                }
+                lx_dev_device_chain_t *chain = (lx_dev_device_chain_t*)packet->payload().data();
+                bulb->setDeviceChain(chain);
+                if (m_debug)
+                    qDebug() << __PRETTY_FUNCTION__ << ": CHAIN:" << bulb->label() << "has" << bulb->tileCount() << "tiles";
+
+                m_protocol->getTilesForBulb(bulb);
+            }
+            break;
+        case LIFX_DEFINES::STATE64:
+            if (bulb) {
+                if (packet->payload().size() < (int)sizeof(lx_dev_state64_t)) {
+                    qWarning() << __PRETTY_FUNCTION__ << ": Short STATE64 from" << bulb->label();
+                    break;
+                }
+                lx_dev_state64_t *state = (lx_dev_state64_t*)packet->payload().data();
+                bulb->setTileState(state);
+                emit bulbTilesChange(bulb);
+            }
+            break;
         case LIFX_DEFINES::ACKNOWLEDGEMENT:
             if (m_debug)
                 qDebug() << __PRETTY_FUNCTION__ << ": Acknowledgment sent from" << packet->address().toString() << ":" << packet;
@@ -318,7 +425,10 @@ void LifxManager::newPacket(LifxPacket *packet)
             }
             break;
     }
-    
+
+    if (!m_requests.isEmpty())
+        completeRequest(target, packet);
+
     delete packet;
 }
 
@@ -329,10 +439,21 @@ void LifxManager::newPacket(LifxPacket *packet)
  */
 LifxBulb * LifxManager::getBulbByMac(uint64_t target)
 {
-    if (m_bulbs.contains(target))
-        return m_bulbs[target];
-    
-    return nullptr;
+    return bulbFor(target);
+}
+
+/*
+ * The fleet only holds rows for bulbs the manager created, so the row
+ * index is also the position in m_bulbs
+ */
+LifxBulb* LifxManager::bulbFor(uint64_t target) const
+{
+    int index = m_fleet->indexOf(target);
+
+    if (index < 0 || index >= m_bulbs.size())
+        return nullptr;
+
+    return m_bulbs[index];
 }
 
 /**
@@ -342,14 +463,254 @@ LifxBulb * LifxManager::getBulbByMac(uint64_t target)
  */
 LifxBulb * LifxManager::getBulbByName(QString& name)
 {
-    QMapIterator<uint64_t, LifxBulb*> i(m_bulbs);
-    while (i.hasNext()) {
-        i.next();
-        if (i.value()->label() == name)
-            return i.value();
+    return m_bulbsByLabel.value(name, nullptr);
+}
+
+/**
+ * \fn QList<LifxBulb*> LifxManager::getBulbsByName(QString& name)
+ * \param name QString name of the bulbs being queried
+ * \return Returns every bulb with the label name, labels don't have to be unique
+ */
+QList<LifxBulb*> LifxManager::getBulbsByName(QString& name)
+{
+    return m_bulbsByLabel.values(name);
+}
+
+/**
+ * \fn LifxBulb * LifxManager::getBulbByAddress(const QHostAddress& address)
+ * \param address The IPv4 address of the bulb
+ * \return Returns the bulb last heard from at address, nullptr if no bulb is known there
+ */
+LifxBulb * LifxManager::getBulbByAddress(const QHostAddress& address)
+{
+    bool ok = false;
+    quint32 ipv4 = address.toIPv4Address(&ok);
+
+    if (!ok)
+        return nullptr;
+
+    return m_bulbsByAddress.value(ipv4, nullptr);
+}
+
+/*
+ * Sets the bulb address and keeps the address index pointing at the
+ * bulb which most recently answered from each address. A port below 0
+ * leaves the port alone.
+ */
+void LifxManager::changeBulbAddress(LifxBulb *bulb, const QHostAddress &address, int port)
+{
+    quint32 previous = m_fleet->ipv4(bulb->fleetIndex());
+
+    if (port < 0)
+        bulb->setAddress(address);
+    else
+        bulb->setAddress(address, port);
+
+    quint32 current = m_fleet->ipv4(bulb->fleetIndex());
+    if (previous != current && m_bulbsByAddress.value(previous, nullptr) == bulb)
+        m_bulbsByAddress.remove(previous);
+    if (current != 0)
+        m_bulbsByAddress.insert(current, bulb);
+}
+
+/*
+ * Takes the bulb out of the group it was in before, if that isn't group
+ */
+void LifxManager::moveBulbToGroup(LifxBulb *bulb, LifxGroup *group)
+{
+    LifxGroup *previous = m_groupForBulb.value(bulb, nullptr);
+
+    if (previous != nullptr && previous != group) {
+        previous->removeBulb(bulb);
+        emit bulbGroupChange(previous);
     }
+    m_groupForBulb.insert(bulb, group);
+    m_groupsChanged = true;
+}
 
-    return nullptr;
+/**
+ * \fn bool LifxManager::submit(const LifxCommand &command)
+ * \param command The change to make
+ * \return True if the command was queued, false if the queue was full and the policy is RejectNewest
+ *
+ * Safe to call from any thread, and never blocks. The command is queued
+ * and carried out on the manager thread, in the order submitted from
+ * each thread. Only the first command into an idle queue costs a
+ * queued call to wake the manager thread, the rest ride along with it.
+ */
+bool LifxManager::submit(const LifxCommand &command)
+{
+    bool queued = m_commands->push(command);
+
+    if (!m_drainScheduled.exchange(true))
+        QMetaObject::invokeMethod(this, "drainCommands", Qt::QueuedConnection);
+
+    return queued;
+}
+
+/*
+ * Runs on the manager thread. The flag is cleared before popping, so a
+ * command pushed after the last pop always schedules another drain.
+ * At most a batch is handled per call so the event loop keeps turning
+ * while producers are busy.
+ */
+void LifxManager::drainCommands()
+{
+    LifxCommand commands[256];
+    LifxCommandBatch batch;
+    int count;
+
+    m_drainScheduled.store(false);
+    count = m_commands->popBatch(commands, 256);
+    batch.reserve(count);
+    for (int i = 0; i < count; i++) {
+        LifxBulb *bulb = bulbFor(commands[i].target());
+        if (bulb == nullptr) {
+            if (m_debug)
+                qDebug() << __PRETTY_FUNCTION__ << ": dropping command for unknown target" << commands[i].target();
+            continue;
+        }
+        batch.add(bulb, commands[i]);
+    }
+    submit(batch);
+
+    if (count == 256 && !m_drainScheduled.exchange(true))
+        QMetaObject::invokeMethod(this, "drainCommands", Qt::QueuedConnection);
+}
+
+/**
+ * \fn LifxBatchResult LifxManager::submit(const LifxCommandBatch &batch)
+ * \param batch The commands to send
+ * \return What was sent, skipped and refused, and the skew between the first and last send
+ *
+ * Every command is applied to its bulb and encoded first, then the
+ * whole buffer is flushed in one go. Commands the bulb already shows
+ * are skipped the same way the single bulb calls skip them. Must be
+ * called from the thread the manager lives on.
+ */
+LifxBatchResult LifxManager::submit(const LifxCommandBatch &batch)
+{
+    LifxBatchResult result;
+    int queued = 0;
+
+    for (int i = 0; i < batch.size(); i++) {
+        LifxBulb *bulb = batch.bulb(i);
+        const LifxCommand &command = batch.command(i);
+        LifxPacket packet;
+
+        if (bulb == nullptr) {
+            result.failed++;
+            continue;
+        }
+
+        switch (command.type()) {
+            case LifxCommand::Color:
+            case LifxCommand::Brightness: {
+                bool running = bulb->waveformActive();
+                if (command.type() == LifxCommand::Color) {
+                    HSBK color = command.hsbk();
+                    bulb->setColor(color);
+                    bulb->setDuration(command.duration());
+                }
+                else {
+                    bulb->setBrightness(command.brightnessValue());
+                }
+                if (!running && suppressColor(bulb, command.ackRequired())) {
+                    result.suppressed++;
+                    continue;
+                }
+                packet.setBulbColor(bulb, command.source(), command.ackRequired());
+                m_protocol->queueDatagram(packet, bulb);
+                bulb->invalidateColor();
+                break;
+            }
+            case LifxCommand::Power: {
+                uint16_t power = command.on() ? 65535 : 0;
+                if (suppressPower(bulb, power, command.ackRequired())) {
+                    result.suppressed++;
+                    continue;
+                }
+                bulb->setPower(power);
+                packet.setBulbPower(bulb, command.source(), command.ackRequired());
+                m_protocol->queueDatagram(packet, bulb);
+                bulb->invalidatePower();
+                break;
+            }
+            case LifxCommand::Waveform: {
+                LifxWaveform waveform = batch.waveform(i);
+                bulb->setWaveform(waveform);
+                packet.setBulbWaveform(bulb, waveform, command.source(), command.ackRequired());
+                m_protocol->queueDatagram(packet, bulb);
+                break;
+            }
+            case LifxCommand::Refresh:
+                packet.getBulbColor(bulb, command.source());
+                m_protocol->queueDatagram(packet, bulb);
+                break;
+            case LifxCommand::None:
+                continue;
+        }
+        queued++;
+    }
+
+    result.sent = m_protocol->flushDatagrams(&result.skew);
+    result.failed += queued - result.sent;
+
+    if (m_debug)
+        qDebug() << __PRETTY_FUNCTION__ << ": Sent" << result.sent << "of" << batch.size() << "commands in" << result.skew << "ns";
+
+    return result;
+}
+
+void LifxManager::stageProduct(LifxBulb *bulb)
+{
+    m_staging.setProduct(bulb->fleetIndex(), bulb->pid(), bulb->product() ? bulb->product()->name() : QString());
+}
+
+/*
+ * Called once the protocol has handed over every packet that was waiting
+ */
+void LifxManager::packetsRead()
+{
+    if (m_snapshotDirty)
+        publishSnapshot();
+}
+
+/**
+ * \fn void LifxManager::publishSnapshot()
+ *
+ * Makes the current state of the fleet visible to snapshot(). This is
+ * done automatically after each batch of packets that came in, call it
+ * directly to publish changes made some other way. Must be called on
+ * the manager thread.
+ *
+ * If readers are still holding every older snapshot, publishing is
+ * retried shortly and readers keep the previous one until then.
+ */
+void LifxManager::publishSnapshot()
+{
+    if (m_groupsChanged) {
+        QVector<LifxSnapshotGroup> groups;
+        groups.reserve(m_groups.size());
+        for (auto group : m_groups) {
+            LifxSnapshotGroup g;
+            g.label = group->label();
+            g.uuid = group->uuid();
+            g.rows = group->rows();
+            groups.append(g);
+        }
+        m_staging.setGroups(groups);
+        m_groupsChanged = false;
+    }
+
+    if (m_snapshots->publish(m_staging, *m_fleet)) {
+        m_snapshotDirty = false;
+        emit snapshotPublished(m_snapshots->generation());
+    }
+    else {
+        m_snapshotDirty = true;
+        QTimer::singleShot(10, this, &LifxManager::packetsRead);
+    }
 }
 
 /**
@@ -361,11 +722,9 @@ LifxBulb * LifxManager::getBulbByName(QString& name)
  */
 void LifxManager::changeBulbColor(uint64_t target, QColor color, uint32_t duration, int source, bool ackRequired)
 {
-    if (m_bulbs.contains(target)) {
-        LifxBulb *bulb = m_bulbs[target];
-        bulb->setColor(color);
-        bulb->setDuration(duration);
-        m_protocol->setBulbColor(bulb, source, ackRequired);
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
+        changeBulbColor(bulb, color, duration, source, ackRequired);
     }
     else {
         qWarning() << __PRETTY_FUNCTION__ << ": bulb for target" << target << "not found in bulbs map";
@@ -382,8 +741,12 @@ void LifxManager::changeBulbColor(uint64_t target, QColor color, uint32_t durati
 void LifxManager::changeBulbColor(LifxBulb *bulb, QColor color, uint32_t duration, int source, bool ackRequired)
 {
     if (bulb) {
+        bool running = bulb->waveformActive();
         bulb->setColor(color);
         bulb->setDuration(duration);
+        if (!running && suppressColor(bulb, ackRequired))
+            return;
+
         m_protocol->setBulbColor(bulb, source, ackRequired);
     }
 }
@@ -397,11 +760,9 @@ void LifxManager::changeBulbColor(LifxBulb *bulb, QColor color, uint32_t duratio
  */
 void LifxManager::changeBulbColor(uint64_t target, HSBK color, uint32_t duration, int source, bool ackRequired)
 {
-    if (m_bulbs.contains(target)) {
-        LifxBulb *bulb = m_bulbs[target];
-        bulb->setColor(color);
-        bulb->setDuration(duration);
-        m_protocol->setBulbColor(bulb, source, ackRequired);
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
+        changeBulbColor(bulb, color, duration, source, ackRequired);
     }
     else {
         qWarning() << __PRETTY_FUNCTION__ << ": bulb for target" << target << "not found in bulbs map";
@@ -418,8 +779,12 @@ void LifxManager::changeBulbColor(uint64_t target, HSBK color, uint32_t duration
 void LifxManager::changeBulbColor(LifxBulb *bulb, HSBK color, uint32_t duration, int source, bool ackRequired)
 {
     if (bulb) {
+        bool running = bulb->waveformActive();
         bulb->setColor(color);
         bulb->setDuration(duration);
+        if (!running && suppressColor(bulb, ackRequired))
+            return;
+
         m_protocol->setBulbColor(bulb, source, ackRequired);
     }
 }
@@ -432,10 +797,9 @@ void LifxManager::changeBulbColor(LifxBulb *bulb, HSBK color, uint32_t duration,
  */
 void LifxManager::changeBulbBrightness(uint64_t target, uint16_t brightness, int source, bool ackRequired)
 {
-    if (m_bulbs.contains(target)) {
-        LifxBulb *bulb = m_bulbs[target];
-        bulb->setBrightness(brightness);
-        m_protocol->setBulbColor(bulb, source, ackRequired);
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
+        changeBulbBrightness(bulb, brightness, source, ackRequired);
     }
     else {
         qWarning() << __PRETTY_FUNCTION__ << ": bulb for target" << target << "not found in bulbs map";
@@ -451,7 +815,11 @@ void LifxManager::changeBulbBrightness(uint64_t target, uint16_t brightness, int
 void LifxManager::changeBulbBrightness(LifxBulb *bulb, uint16_t brightness, int source, bool ackRequired)
 {
     if (bulb) {
+        bool running = bulb->waveformActive();
         bulb->setBrightness(brightness);
+        if (!running && suppressColor(bulb, ackRequired))
+            return;
+
         m_protocol->setBulbColor(bulb, source, ackRequired);
     }
 }
@@ -464,12 +832,21 @@ void LifxManager::changeBulbBrightness(LifxBulb *bulb, uint16_t brightness, int
  */
 void LifxManager::changeGroupColor(QByteArray& uuid, QColor color, int source, bool ackRequired)
 {
-    if (m_groups.contains(uuid)) {
-        LifxGroup *group = m_groups[uuid];
-        QVector<LifxBulb*> bulbs = group->bulbs();
-        for (auto bulb : bulbs) {
-            changeBulbColor(bulb->targetAsLong(), color, source, ackRequired);
+    LifxGroup *group = m_groups.value(uuid);
+
+    if (group) {
+        // Converted once, the same way LifxBulb::setColor(QColor&) does, each bulb keeps its kelvin
+        qreal max = std::numeric_limits<uint16_t>::max();
+        uint16_t h = color.hsvHueF() < 0 ? 0 : qRound(color.hsvHueF() * max);
+        uint16_t s = qRound(color.hsvSaturationF() * max);
+        uint16_t v = qRound(color.valueF() * max);
+
+        LifxCommandBatch batch(source, ackRequired);
+        batch.reserve(group->bulbs().size());
+        for (auto bulb : group->bulbs()) {
+            batch.setColor(bulb, HSBK(h, s, v, bulb->toDeviceColor()->kelvin), 400);
         }
+        submit(batch);
     }
 }
 
@@ -481,13 +858,80 @@ void LifxManager::changeGroupColor(QByteArray& uuid, QColor color, int source, b
  */
 void LifxManager::changeGroupColor(QByteArray& uuid, HSBK color, int source, bool ackRequired)
 {
-    if (m_groups.contains(uuid)) {
-        LifxGroup *group = m_groups[uuid];
-        QVector<LifxBulb*> bulbs = group->bulbs();
-        for (auto bulb : bulbs) {
-            changeBulbColor(bulb->targetAsLong(), color, source, ackRequired);
+    LifxGroup *group = m_groups.value(uuid);
+
+    if (group) {
+        LifxCommandBatch batch(source, ackRequired);
+        for (auto bulb : group->bulbs()) {
+            batch.setColor(bulb, color);
         }
+        submit(batch);
+    }
+}
+
+/**
+ * \fn void LifxManager::changeBulbSetColor(const LifxBulbSet &bulbs, HSBK color, uint32_t duration, int source, bool ackRequired)
+ * \param bulbs The bulbs to change, usually from query()
+ * \param color The HSBK color to assign to the bulbs
+ * \param duration The uint32_t value in millis to slow the transition down
+ * \brief Sets the color of every bulb in the set to color
+ */
+void LifxManager::changeBulbSetColor(const LifxBulbSet &bulbs, HSBK color, uint32_t duration, int source, bool ackRequired)
+{
+    LifxCommandBatch batch(source, ackRequired);
+
+    batch.reserve(bulbs.bulbs().size());
+    for (auto bulb : bulbs) {
+        batch.setColor(bulb, color, duration);
+    }
+    submit(batch);
+}
+
+/**
+ * \fn void LifxManager::changeBulbSetState(const LifxBulbSet &bulbs, bool state, int source, bool ackRequired)
+ * \param bulbs The bulbs to change, usually from query()
+ * \param state Turns the bulbs ON/OFF based on state TRUE/FALSE
+ */
+void LifxManager::changeBulbSetState(const LifxBulbSet &bulbs, bool state, int source, bool ackRequired)
+{
+    LifxCommandBatch batch(source, ackRequired);
+
+    batch.reserve(bulbs.bulbs().size());
+    for (auto bulb : bulbs) {
+        batch.setPower(bulb, state);
+    }
+    submit(batch);
+}
+
+/**
+ * \fn LifxBulbSet LifxManager::query(const LifxQuery &query) const
+ * \param query The conditions to match
+ * \return The bulbs which meet every condition in query
+ *
+ * Group conditions are resolved here by label, a group which doesn't
+ * exist matches nothing. See LifxQuery for how the rest is evaluated.
+ */
+LifxBulbSet LifxManager::query(const LifxQuery &query) const
+{
+    LifxBitmap candidates(m_bulbs.size(), true);
+
+    for (const QString &label : query.groups()) {
+        LifxGroup *group = m_groupsByLabel.value(label, nullptr);
+        if (group == nullptr)
+            return LifxBulbSet();
+        candidates &= group->rows();
     }
+
+    return LifxBulbSet(query.evaluate(m_fleet, candidates), m_bulbs);
+}
+
+/**
+ * \fn LifxBulbSet LifxManager::allBulbs() const
+ * \return Every bulb the manager knows about
+ */
+LifxBulbSet LifxManager::allBulbs() const
+{
+    return LifxBulbSet(LifxBitmap(m_bulbs.size(), true), m_bulbs);
 }
 
 /**
@@ -498,17 +942,7 @@ void LifxManager::changeGroupColor(QByteArray& uuid, HSBK color, int source, boo
  */
 LifxGroup * LifxManager::getGroupByName(QString& name)
 {
-    QMapIterator<QByteArray, LifxGroup*> i(m_groups);
-    
-    while (i.hasNext()) {
-        i.next();
-        LifxGroup *group = i.value();
-        if (group->label() == name) {
-            return group;
-        }
-    }
-    
-    return nullptr;
+    return m_groupsByLabel.value(name, nullptr);
 }
 
 /**
@@ -534,8 +968,8 @@ void LifxManager::getColorForBulb(LifxBulb *bulb, int source)
  */
 void LifxManager::getColorForBulb(uint64_t target, int source)
 {
-    if (m_bulbs.contains(target)) {
-        LifxBulb *bulb = m_bulbs[target];
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
         m_protocol->getColorForBulb(bulb, source);
     }
     else {
@@ -566,9 +1000,14 @@ LifxGroup * LifxManager::getGroupByUUID(QByteArray& uuid)
  */
 void LifxManager::changeGroupState(QByteArray& uuid, bool state, int source, bool ackRequired)
 {
-    if (m_groups.contains(uuid)) {
-        LifxGroup *group = m_groups[uuid];
-        m_protocol->setGroupState(group, state, source, ackRequired);
+    LifxGroup *group = m_groups.value(uuid);
+
+    if (group) {
+        LifxCommandBatch batch(source, ackRequired);
+        for (auto bulb : group->bulbs()) {
+            batch.setPower(bulb, state);
+        }
+        submit(batch);
     }
 }
 
@@ -614,7 +1053,9 @@ void LifxManager::setProductCapabilities(QJsonDocument& doc)
                                 QList<LifxBulb*> bulbs = m_bulbsByPID.values(pid);
                                 for (auto bulb : bulbs) {
                                     bulb->setProduct(obj);
+                                    stageProduct(bulb);
                                 }
+                                m_snapshotDirty = true;
                             }
                         }
                     }
@@ -637,6 +1078,9 @@ void LifxManager::changeBulbState(LifxBulb* bulb, bool state, int source, bool a
         if (m_debug)
             qDebug() << __PRETTY_FUNCTION__ << ": Setting" << bulb->label() << "to" << state;
 
+        if (suppressPower(bulb, state ? 65535 : 0, ackRequired))
+            return;
+
         m_protocol->setBulbState(bulb, state, source, ackRequired);
     }
     else {
@@ -646,8 +1090,8 @@ void LifxManager::changeBulbState(LifxBulb* bulb, bool state, int source, bool a
 
 void LifxManager::changeBulbState(uint64_t target, bool state, int source, bool ackRequired)
 {
-    if (m_bulbs.contains(target)) {
-        LifxBulb *bulb = m_bulbs[target];
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
         changeBulbState(bulb, state, source, ackRequired);
     }
 }
@@ -660,8 +1104,8 @@ void LifxManager::rebootBulb(LifxBulb* bulb)
 
 void LifxManager::rebootBulb(uint64_t target)
 {
-    if (m_bulbs.contains(target)) {
-        LifxBulb *bulb = m_bulbs[target];
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
         rebootBulb(bulb);
     }
 }
@@ -678,6 +1122,928 @@ void LifxManager::rebootGroup(QByteArray& uuid)
     }
 }
 
+/**
+ * \fn void LifxManager::changeBulbWaveform(uint64_t target, LifxWaveform waveform, int source, bool ackRequired)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param waveform The effect for the bulb to run
+ * \brief Sends a single SET_WAVEFORM to the bulb, which then runs the effect on its own
+ */
+void LifxManager::changeBulbWaveform(uint64_t target, LifxWaveform waveform, int source, bool ackRequired)
+{
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
+        changeBulbWaveform(bulb, waveform, source, ackRequired);
+    }
+    else {
+        qWarning() << __PRETTY_FUNCTION__ << ": bulb for target" << target << "not found in bulbs map";
+    }
+}
+
+/**
+ * \fn void LifxManager::changeBulbWaveform(LifxBulb *bulb, LifxWaveform waveform, int source, bool ackRequired)
+ * \param bulb Pointer to LifxBulb object
+ * \param waveform The effect for the bulb to run
+ * \brief Sends a single SET_WAVEFORM to the bulb, which then runs the effect on its own
+ * 
+ * The bulb models the waveform locally, so LifxBulb::color() follows
+ * the effect without polling.
+ */
+void LifxManager::changeBulbWaveform(LifxBulb *bulb, LifxWaveform waveform, int source, bool ackRequired)
+{
+    if (bulb) {
+        if (m_debug)
+            qDebug() << __PRETTY_FUNCTION__ << ": Sending" << waveform << "to" << bulb->label();
+
+        m_protocol->setBulbWaveform(bulb, waveform, source, ackRequired);
+    }
+}
+
+/**
+ * \fn void LifxManager::changeGroupWaveform(QByteArray &uuid, LifxWaveform waveform, int source, bool ackRequired)
+ * \param uuid The group UUID to query for bulbs
+ * \param waveform The effect for the bulbs to run
+ * \brief Sends one SET_WAVEFORM to each bulb in the group
+ */
+void LifxManager::changeGroupWaveform(QByteArray &uuid, LifxWaveform waveform, int source, bool ackRequired)
+{
+    if (m_groups.contains(uuid)) {
+        LifxGroup *group = m_groups[uuid];
+        m_protocol->setGroupWaveform(group, waveform, source, ackRequired);
+    }
+}
+
+/**
+ * \fn void LifxManager::pulseBulb(LifxBulb *bulb, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+ * \param bulb Pointer to LifxBulb object
+ * \param color The color to pulse to
+ * \param period Millis for each pulse
+ * \param cycles Number of pulses
+ * \brief Switches the bulb between its color and color, then returns to the original
+ */
+void LifxManager::pulseBulb(LifxBulb *bulb, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+{
+    changeBulbWaveform(bulb, LifxWaveform::pulse(color, period, cycles), source, ackRequired);
+}
+
+/**
+ * \fn void LifxManager::breatheBulb(LifxBulb *bulb, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+ * \param bulb Pointer to LifxBulb object
+ * \param color The color to breathe to
+ * \param period Millis for each breath
+ * \param cycles Number of breaths
+ * \brief Smoothly fades the bulb to color and back, then returns to the original
+ */
+void LifxManager::breatheBulb(LifxBulb *bulb, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+{
+    changeBulbWaveform(bulb, LifxWaveform::breathe(color, period, cycles), source, ackRequired);
+}
+
+/**
+ * \fn void LifxManager::strobeBulb(LifxBulb *bulb, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+ * \param bulb Pointer to LifxBulb object
+ * \param color The color to flash
+ * \param period Millis between flashes
+ * \param cycles Number of flashes
+ * \brief Briefly flashes color each period, then returns to the original
+ */
+void LifxManager::strobeBulb(LifxBulb *bulb, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+{
+    changeBulbWaveform(bulb, LifxWaveform::strobe(color, period, cycles), source, ackRequired);
+}
+
+/**
+ * \fn void LifxManager::pulseGroup(QByteArray &uuid, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+ * \param uuid The group UUID to query for bulbs
+ * \param color The color to pulse to
+ * \param period Millis for each pulse
+ * \param cycles Number of pulses
+ * \brief Pulses every bulb in the group, see pulseBulb()
+ */
+void LifxManager::pulseGroup(QByteArray &uuid, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+{
+    changeGroupWaveform(uuid, LifxWaveform::pulse(color, period, cycles), source, ackRequired);
+}
+
+/**
+ * \fn void LifxManager::breatheGroup(QByteArray &uuid, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+ * \param uuid The group UUID to query for bulbs
+ * \param color The color to breathe to
+ * \param period Millis for each breath
+ * \param cycles Number of breaths
+ * \brief Breathes every bulb in the group, see breatheBulb()
+ */
+void LifxManager::breatheGroup(QByteArray &uuid, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+{
+    changeGroupWaveform(uuid, LifxWaveform::breathe(color, period, cycles), source, ackRequired);
+}
+
+/**
+ * \fn void LifxManager::strobeGroup(QByteArray &uuid, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+ * \param uuid The group UUID to query for bulbs
+ * \param color The color to flash
+ * \param period Millis between flashes
+ * \param cycles Number of flashes
+ * \brief Strobes every bulb in the group, see strobeBulb()
+ */
+void LifxManager::strobeGroup(QByteArray &uuid, HSBK color, uint32_t period, float cycles, int source, bool ackRequired)
+{
+    changeGroupWaveform(uuid, LifxWaveform::strobe(color, period, cycles), source, ackRequired);
+}
+
+/**
+ * \fn void LifxManager::changeBulbZones(uint64_t target, uint32_t duration, bool apply, int source, bool ackRequired)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param duration Transition time in millis
+ * \param apply If false, the zones are held until applyBulbZones() is called
+ * \brief Sends the zones that changed in LifxBulb::zones() to the strip
+ */
+void LifxManager::changeBulbZones(uint64_t target, uint32_t duration, bool apply, int source, bool ackRequired)
+{
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
+        changeBulbZones(bulb, duration, apply, source, ackRequired);
+    }
+    else {
+        qWarning() << __PRETTY_FUNCTION__ << ": bulb for target" << target << "not found in bulbs map";
+    }
+}
+
+/**
+ * \fn void LifxManager::changeBulbZones(LifxBulb *bulb, uint32_t duration, bool apply, int source, bool ackRequired)
+ * \param bulb Pointer to LifxBulb object
+ * \param duration Transition time in millis
+ * \param apply If false, the zones are held until applyBulbZones() is called
+ * \brief Sends the zones that changed in LifxBulb::zones() to the strip
+ * 
+ * Write the new colors into bulb->zones() first. Only the changed
+ * zones are sent, packed into as few SET_EXTENDED_COLOR_ZONES messages
+ * as possible, and the strip changes all at once. If nothing changed,
+ * nothing is sent.
+ */
+void LifxManager::changeBulbZones(LifxBulb *bulb, uint32_t duration, bool apply, int source, bool ackRequired)
+{
+    if (bulb) {
+        if (!bulb->isMultizone()) {
+            qWarning() << __PRETTY_FUNCTION__ << ":" << bulb->label() << "does not support extended multizone";
+            return;
+        }
+        int sent = m_protocol->setBulbZones(bulb, duration, apply, source, ackRequired);
+        if (m_debug)
+            qDebug() << __PRETTY_FUNCTION__ << ": Sent" << sent << "zone messages to" << bulb->label();
+    }
+}
+
+/**
+ * \fn void LifxManager::applyBulbZones(LifxBulb *bulb, int source, bool ackRequired)
+ * \param bulb Pointer to LifxBulb object
+ * \brief Shows zones previously sent with apply set to false
+ */
+void LifxManager::applyBulbZones(LifxBulb *bulb, int source, bool ackRequired)
+{
+    if (bulb)
+        m_protocol->applyBulbZones(bulb, source, ackRequired);
+}
+
+/**
+ * \fn void LifxManager::getZonesForBulb(LifxBulb *bulb, int source)
+ * \param bulb Pointer to LifxBulb object
+ * \brief Asks the strip for its zone colors, bulbZonesChange() is emitted with the result
+ */
+void LifxManager::getZonesForBulb(LifxBulb *bulb, int source)
+{
+    if (bulb)
+        m_protocol->getZonesForBulb(bulb, source);
+}
+
+/**
+ * \fn void LifxManager::getZonesForBulb(uint64_t target, int source)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \brief Asks the strip for its zone colors, bulbZonesChange() is emitted with the result
+ */
+void LifxManager::getZonesForBulb(uint64_t target, int source)
+{
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
+        getZonesForBulb(bulb, source);
+    }
+    else {
+        qWarning() << __PRETTY_FUNCTION__ << ": bulb for target" << target << "not found in bulbs map";
+    }
+}
+
+/**
+ * \fn void LifxManager::changeBulbTiles(uint64_t target, uint32_t duration, int source, bool ackRequired)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param duration Transition time in millis
+ * \brief Sends the tiles that changed in LifxBulb::tiles() to the chain
+ */
+void LifxManager::changeBulbTiles(uint64_t target, uint32_t duration, int source, bool ackRequired)
+{
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
+        changeBulbTiles(bulb, duration, source, ackRequired);
+    }
+    else {
+        qWarning() << __PRETTY_FUNCTION__ << ": bulb for target" << target << "not found in bulbs map";
+    }
+}
+
+/**
+ * \fn void LifxManager::changeBulbTiles(LifxBulb *bulb, uint32_t duration, int source, bool ackRequired)
+ * \param bulb Pointer to LifxBulb object
+ * \param duration Transition time in millis
+ * \brief Sends the tiles that changed in LifxBulb::tiles() to the chain
+ * 
+ * Write the new pixels into bulb->tiles() or bulb->tilePixels() first.
+ * Only tiles with a changed pixel are sent, to an off screen frame
+ * buffer, and then the whole chain switches at once.
+ */
+void LifxManager::changeBulbTiles(LifxBulb *bulb, uint32_t duration, int source, bool ackRequired)
+{
+    if (bulb) {
+        if (bulb->tileCount() == 0) {
+            qWarning() << __PRETTY_FUNCTION__ << ":" << bulb->label() << "has no known tiles";
+            return;
+        }
+        int sent = m_protocol->setBulbTiles(bulb, duration, source, ackRequired);
+        if (m_debug)
+            qDebug() << __PRETTY_FUNCTION__ << ": Sent" << sent << "of" << bulb->tileCount() << "tiles to" << bulb->label();
+    }
+}
+
+/**
+ * \fn void LifxManager::getTilesForBulb(LifxBulb *bulb, int source)
+ * \param bulb Pointer to LifxBulb object
+ * \brief Asks for the tile chain, bulbTilesChange() is emitted as each tile reports its pixels
+ */
+void LifxManager::getTilesForBulb(LifxBulb *bulb, int source)
+{
+    if (bulb)
+        m_protocol->getDeviceChainForBulb(bulb, source);
+}
+
+/**
+ * \fn void LifxManager::getTilesForBulb(uint64_t target, int source)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \brief Asks for the tile chain, bulbTilesChange() is emitted as each tile reports its pixels
+ */
+void LifxManager::getTilesForBulb(uint64_t target, int source)
+{
+    LifxBulb *bulb = bulbFor(target);
+    if (bulb) {
+        getTilesForBulb(bulb, source);
+    }
+    else {
+        qWarning() << __PRETTY_FUNCTION__ << ": bulb for target" << target << "not found in bulbs map";
+    }
+}
+
+/**
+ * \fn int LifxManager::applyScene(const LifxScene &scene, int source)
+ * \param scene The state to put the bulbs in
+ * \param source An option source field to help identify the byte stream messages
+ * \return The number of messages that will be sent
+ *
+ * Each bulb in the scene is compared with the last state it reported,
+ * however long ago, and only gets the messages it needs. A bulb which
+ * was sent a change since its last report is always sent again. A bulb
+ * being turned on gets its color first, with no transition, so it comes
+ * up in the right color.
+ *
+ * The messages go out as batches. No bulb gets two messages closer
+ * together than the rate limit allows, counting anything sent to it
+ * before the scene, so the first batch goes now and the power batch
+ * one interval later, well within the transition time.
+ */
+int LifxManager::applyScene(const LifxScene &scene, int source)
+{
+    const qint64 known = std::numeric_limits<qint64>::max();
+    QHash<LifxBulb*, LifxSceneEntry> states = sceneStates(scene);
+    QMap<qint64, LifxCommandBatch> waves;
+    qint64 now = m_fleet->now();
+    int messages = 0;
+
+    // Send times are rounded up to 10ms so bulbs last sent to at different times share a batch
+    auto wave = [&waves, now, source](qint64 at) -> LifxCommandBatch& {
+        qint64 delay = at > now ? (at - now + 9) / 10 * 10 : 0;
+        if (!waves.contains(delay))
+            waves.insert(delay, LifxCommandBatch(source));
+        return waves[delay];
+    };
+
+    for (auto it = states.constBegin(); it != states.constEnd(); ++it) {
+        LifxBulb *bulb = it.key();
+        const LifxSceneEntry &entry = it.value();
+        uint16_t power = entry.on ? 65535 : 0;
+        bool wasOff = !bulb->isOn();
+        bool needsColor = false;
+        bool needsPower = !bulb->powerConfirmed(power, known);
+        qint64 at = qMax(now, bulb->lastSent() + m_bulbInterval);
+
+        if (entry.on) {
+            HSBK color = entry.color;
+            bulb->setColor(color);
+            bulb->setDuration(entry.duration);
+            needsColor = !bulb->colorConfirmed(known);
+        }
+
+        if (needsColor) {
+            wave(at).setColor(bulb, entry.color, wasOff && needsPower ? 0 : entry.duration);
+            at += m_bulbInterval;
+            messages++;
+        }
+        if (needsPower) {
+            wave(at).setPower(bulb, entry.on);
+            messages++;
+        }
+    }
+
+    if (m_debug)
+        qDebug() << __PRETTY_FUNCTION__ << ": Scene" << scene.name() << "needs" << messages << "messages for" << states.size() << "bulbs";
+
+    for (auto it = waves.constBegin(); it != waves.constEnd(); ++it) {
+        if (it.key() <= 0) {
+            submit(it.value());
+        }
+        else {
+            LifxCommandBatch batch = it.value();
+            QTimer::singleShot(static_cast<int>(it.key()), this, [this, batch]() { submit(batch); });
+        }
+    }
+    return messages;
+}
+
+/**
+ * \fn QHash<LifxBulb*, LifxSceneEntry> LifxManager::sceneStates(const LifxScene &scene) const
+ * \param scene The scene to expand
+ * \return One entry per known bulb the scene covers
+ *
+ * Group entries are expanded first, so a bulb entry replaces its group's.
+ * Bulbs and groups that haven't been discovered are left out.
+ */
+QHash<LifxBulb*, LifxSceneEntry> LifxManager::sceneStates(const LifxScene &scene) const
+{
+    QHash<LifxBulb*, LifxSceneEntry> states;
+
+    for (const auto &entry : scene.entries()) {
+        if (entry.group.isEmpty())
+            continue;
+
+        LifxGroup *group = m_groups.value(entry.group);
+        if (group == nullptr) {
+            if (m_debug)
+                qDebug() << __PRETTY_FUNCTION__ << ": Scene" << scene.name() << "names an unknown group";
+            continue;
+        }
+        for (auto bulb : group->bulbs())
+            states.insert(bulb, entry);
+    }
+    for (const auto &entry : scene.entries()) {
+        LifxBulb *bulb = entry.group.isEmpty() ? bulbFor(entry.target) : nullptr;
+        if (bulb)
+            states.insert(bulb, entry);
+    }
+    return states;
+}
+
+/**
+ * \fn void LifxManager::captureState(std::function<void(const LifxScene&, const QList<LifxBulb*>&)> done, int timeout, int retries)
+ * \param done Called once with the captured state, and the bulbs which never answered
+ * \param timeout Millis to wait for each answer
+ * \param retries How many times to ask a bulb again before giving up
+ *
+ * Every known bulb is asked for its color and power, CAPTURE_CHUNK bulbs
+ * at a time CAPTURE_PACE millis apart so the replies don't all land at
+ * once. The result is a scene with one entry per bulb that answered,
+ * ready to hand to restoreState() or applyScene(). A bulb running a
+ * waveform reports a point on the curve, so the color it will be left
+ * at when the waveform ends is captured instead, the color it started
+ * from for a transient waveform and the waveform's color otherwise.
+ */
+void LifxManager::captureState(std::function<void(const LifxScene&, const QList<LifxBulb*>&)> done, int timeout, int retries)
+{
+    struct Capture {
+        LifxScene state;
+        QList<LifxBulb*> missing;
+        int remaining;
+    };
+    auto capture = std::make_shared<Capture>();
+    QVector<LifxBulb*> bulbs;
+
+    for (auto bulb : m_bulbs) {
+        if (bulb && bulb->targetAsLong() != 0)
+            bulbs.append(bulb);
+    }
+
+    capture->state.setName(QStringLiteral("captured"));
+    capture->remaining = bulbs.size();
+    if (bulbs.isEmpty()) {
+        done(capture->state, capture->missing);
+        return;
+    }
+
+    for (int first = 0; first < bulbs.size(); first += CAPTURE_CHUNK) {
+        QVector<LifxBulb*> chunk = bulbs.mid(first, CAPTURE_CHUNK);
+        auto poll = [this, chunk, capture, done, timeout, retries]() {
+            for (auto bulb : chunk) {
+                requestColor(bulb, [bulb, capture, done](bool ok, HSBK color) {
+                    if (ok && bulb->waveformActive()) {
+                        // The reply is a point on the curve. The device color was moved to where
+                        // the waveform ends by setWaveform(), and setDevColor() leaves it alone
+                        const lx_dev_color_t *under = bulb->toDeviceColor();
+                        capture->state.setBulb(bulb->targetAsLong(), HSBK(under->hue, under->saturation, under->brightness, under->kelvin), bulb->isOn(), 0);
+                    }
+                    else if (ok) {
+                        capture->state.setBulb(bulb->targetAsLong(), color, bulb->isOn(), 0);
+                    }
+                    else {
+                        capture->missing.append(bulb);
+                    }
+
+                    if (--capture->remaining == 0)
+                        done(capture->state, capture->missing);
+                }, timeout, retries);
+            }
+        };
+
+        if (first == 0)
+            poll();
+        else
+            QTimer::singleShot(first / CAPTURE_CHUNK * CAPTURE_PACE, this, poll);
+    }
+}
+
+/**
+ * \fn void LifxManager::restoreState(const LifxScene &state, uint32_t duration, std::function<void(const QList<LifxBulb*>&)> done, int timeout, int retries)
+ * \param state A state from captureState(), or any scene
+ * \param duration The uint32_t value in millis for every bulb to fade back over
+ * \param done Called once with the bulbs which didn't ACK both their color and power
+ * \param timeout Millis to wait for each ACK
+ * \param retries How many times to send a message again before giving up
+ *
+ * Unlike applyScene(), nothing is skipped, every bulb is sent its color
+ * and its power with an ACK required, color first unless the bulb is
+ * being turned off. The messages are spaced by
+ * the bulb rate limit, see setBulbRateLimit(), and each send time is
+ * shared by every bulb due then, so only a handful of timers are used.
+ */
+void LifxManager::restoreState(const LifxScene &state, uint32_t duration, std::function<void(const QList<LifxBulb*>&)> done, int timeout, int retries)
+{
+    struct Restore {
+        QSet<LifxBulb*> failed;
+        int remaining;
+    };
+    QHash<LifxBulb*, LifxSceneEntry> states = sceneStates(state);
+    QMap<qint64, QVector<std::function<void()>>> steps;
+    auto restore = std::make_shared<Restore>();
+    qint64 now = m_fleet->now();
+
+    restore->remaining = states.size() * 2;
+    if (states.isEmpty()) {
+        done(QList<LifxBulb*>());
+        return;
+    }
+
+    auto acked = [restore, done](LifxBulb *bulb) {
+        return [restore, done, bulb](bool ok) {
+            if (!ok)
+                restore->failed.insert(bulb);
+            if (--restore->remaining == 0)
+                done(restore->failed.values());
+        };
+    };
+
+    for (auto it = states.constBegin(); it != states.constEnd(); ++it) {
+        LifxBulb *bulb = it.key();
+        LifxSceneEntry entry = it.value();
+        qint64 at = qMax(now, bulb->lastSent() + m_bulbInterval);
+        qint64 delay = at > now ? (at - now + 9) / 10 * 10 : 0;
+        uint32_t fade = bulb->isOn() ? duration : 0;
+        // A bulb going off is turned off first so the color change isn't seen
+        qint64 colorAt = entry.on ? delay : delay + m_bulbInterval;
+        qint64 powerAt = entry.on ? delay + m_bulbInterval : delay;
+
+        steps[colorAt].append([this, bulb, entry, fade, acked, timeout, retries]() {
+            changeBulbColorAcked(bulb, entry.color, fade, acked(bulb), timeout, retries);
+        });
+        steps[powerAt].append([this, bulb, entry, acked, timeout, retries]() {
+            changeBulbStateAcked(bulb, entry.on, acked(bulb), timeout, retries);
+        });
+    }
+
+    for (auto it = steps.constBegin(); it != steps.constEnd(); ++it) {
+        QVector<std::function<void()>> work = it.value();
+        auto run = [work]() {
+            for (const auto &step : work)
+                step();
+        };
+
+        if (it.key() == 0)
+            run();
+        else
+            QTimer::singleShot(static_cast<int>(it.key()), this, run);
+    }
+}
+
+/**
+ * \fn void LifxManager::setDesiredState(LifxBulb *bulb, const HSBK &color, bool on, uint32_t duration)
+ * \param bulb The bulb to keep in this state
+ * \param color The color the bulb should show while on
+ * \param on True if the bulb should be on
+ * \param duration The uint32_t value in millis to slow the transition down
+ *
+ * Instead of sending once, the manager keeps comparing what the bulb
+ * reports against this state and sends only what differs, until
+ * clearDesiredState() is called. A bulb that doesn't answer is retried
+ * with a backoff of up to a minute, and is brought back into line as
+ * soon as it shows up again or reboots. The color is checked once the
+ * transition is over, so a long duration isn't restarted, and a bulb
+ * that answers but can't show the color stays on the backoff.
+ * bulbConverged() is emitted each time the bulb reaches the state.
+ *
+ * Every bulb shares the budget from setReconcileBudget(), 100 messages
+ * a second by default.
+ */
+void LifxManager::setDesiredState(LifxBulb *bulb, const HSBK &color, bool on, uint32_t duration)
+{
+    if (bulb == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb pointer";
+        return;
+    }
+
+    m_reconciler->setDesired(bulb->fleetIndex(), color, on, duration, m_fleet->now());
+    if (!m_reconcileTimer->isActive())
+        m_reconcileTimer->start();
+}
+
+/**
+ * \fn void LifxManager::setDesiredState(const LifxScene &scene)
+ * \param scene The state to keep each bulb in the scene in
+ *
+ * Groups are expanded to the bulbs in them now, a bulb which joins the
+ * group later isn't added.
+ */
+void LifxManager::setDesiredState(const LifxScene &scene)
+{
+    QHash<LifxBulb*, LifxSceneEntry> states = sceneStates(scene);
+
+    for (auto it = states.constBegin(); it != states.constEnd(); ++it)
+        setDesiredState(it.key(), it->color, it->on, it->duration);
+}
+
+/**
+ * \fn void LifxManager::clearDesiredState(LifxBulb *bulb)
+ * \param bulb The bulb to stop reconciling, it is left as it is
+ */
+void LifxManager::clearDesiredState(LifxBulb *bulb)
+{
+    if (bulb)
+        m_reconciler->clearDesired(bulb->fleetIndex());
+}
+
+/**
+ * \fn void LifxManager::clearDesiredState()
+ *
+ * Stops reconciling every bulb.
+ */
+void LifxManager::clearDesiredState()
+{
+    m_reconciler->clear();
+    m_reconcileTimer->stop();
+}
+
+/**
+ * \fn void LifxManager::reconcile()
+ * \brief SLOT which sends whatever bulbs need to reach their desired state
+ */
+void LifxManager::reconcile()
+{
+    LifxCommandBatch batch;
+    QVector<QPair<LifxBulb*, qint64>> converged;
+
+    if (m_reconciler->desiredCount() == 0) {
+        m_reconcileTimer->stop();
+        return;
+    }
+
+    m_reconciler->plan(m_bulbs, m_fleet->now(), batch, converged);
+    if (batch.size())
+        submit(batch);
+
+    for (const auto &bulb : converged) {
+        if (m_debug)
+            qDebug() << __PRETTY_FUNCTION__ << ":" << bulb.first << "converged in" << bulb.second << "ms";
+        emit bulbConverged(bulb.first, bulb.second);
+    }
+}
+
+/**
+ * \fn void LifxManager::setBulbRateLimit(int messagesPerSecond)
+ * \param messagesPerSecond The most messages applyScene() sends one bulb each second, 0 for no limit
+ *
+ * LIFX asks for no more than 20 messages a second to a bulb, which is
+ * the default.
+ */
+void LifxManager::setBulbRateLimit(int messagesPerSecond)
+{
+    m_bulbInterval = messagesPerSecond > 0 ? qMax(1000 / messagesPerSecond, 1) : 0;
+}
+
+/**
+ * \fn void LifxManager::setSuppressionWindow(int msecs)
+ * \param msecs How recent in millis a bulb report must be to skip a send, 0 turns suppression off
+ * 
+ * A color, brightness or power change is not sent if the bulb already
+ * reported that exact state within the last msecs millis, and no change
+ * was sent to it since. Messages which require an ACK are always sent.
+ * The default is 5 seconds.
+ */
+void LifxManager::setSuppressionWindow(int msecs)
+{
+    m_suppressionWindow = qMax(msecs, 0);
+}
+
+/**
+ * \fn bool LifxManager::suppressColor(LifxBulb *bulb, bool ackRequired)
+ * \param bulb The bulb about to be sent its color
+ * \param ackRequired True if the caller wants an ACK for this message
+ * \return True if the bulb already confirmed the color, and the send can be skipped
+ */
+bool LifxManager::suppressColor(LifxBulb *bulb, bool ackRequired)
+{
+    if (ackRequired || m_suppressionWindow == 0)
+        return false;
+
+    if (bulb->colorConfirmed(m_suppressionWindow)) {
+        m_suppressed++;
+        if (m_debug)
+            qDebug() << __PRETTY_FUNCTION__ << ": Skipping color change for" << bulb->label() << ", confirmed" << bulb->confirmedAge() << "ms ago";
+        return true;
+    }
+    return false;
+}
+
+/**
+ * \fn bool LifxManager::suppressPower(LifxBulb *bulb, uint16_t power, bool ackRequired)
+ * \param bulb The bulb about to be sent its power
+ * \param power The power level to send
+ * \param ackRequired True if the caller wants an ACK for this message
+ * \return True if the bulb already confirmed the power, and the send can be skipped
+ */
+bool LifxManager::suppressPower(LifxBulb *bulb, uint16_t power, bool ackRequired)
+{
+    if (ackRequired || m_suppressionWindow == 0)
+        return false;
+
+    if (bulb->powerConfirmed(power, m_suppressionWindow)) {
+        m_suppressed++;
+        if (m_debug)
+            qDebug() << __PRETTY_FUNCTION__ << ": Skipping power change for" << bulb->label();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * \fn void LifxManager::requestColor(LifxBulb *bulb, std::function<void(bool, HSBK)> done, int timeout, int retries)
+ * \param bulb The bulb to ask
+ * \param done Called once, with true and the color the bulb reported, or false if it never answered
+ * \param timeout Millis to wait for each attempt
+ * \param retries How many times to ask again before giving up
+ *
+ * Nothing blocks and no timer is made per request, so thousands can be
+ * outstanding at once. done is called from the event loop, the bulb
+ * state has already been updated from the reply when it runs.
+ */
+void LifxManager::requestColor(LifxBulb *bulb, std::function<void(bool, HSBK)> done, int timeout, int retries)
+{
+    if (!bulb) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb pointer";
+        done(false, HSBK());
+        return;
+    }
+
+    trackRequest(bulb, LIFX_DEFINES::LIGHT_STATE,
+        [this, bulb]() {
+            m_protocol->getColorForBulb(bulb);
+            return m_protocol->lastSequence();
+        },
+        [bulb, done](LifxPacket *reply) {
+            done(reply != nullptr, reply ? bulb->confirmedColor() : HSBK());
+        },
+        timeout, retries);
+}
+
+/**
+ * \fn void LifxManager::changeBulbColorAcked(LifxBulb *bulb, HSBK color, uint32_t duration, std::function<void(bool)> done, int timeout, int retries)
+ * \param bulb The bulb to change
+ * \param color HSBK object containing the new color to set the bulb to
+ * \param duration The uint32_t value in millis to slow the transition down
+ * \param done Called once, with true when the bulb ACKs, or false if it never did
+ * \param timeout Millis to wait for each attempt
+ * \param retries How many times to send again before giving up
+ */
+void LifxManager::changeBulbColorAcked(LifxBulb *bulb, HSBK color, uint32_t duration, std::function<void(bool)> done, int timeout, int retries)
+{
+    if (!bulb) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb pointer";
+        done(false);
+        return;
+    }
+
+    trackRequest(bulb, LIFX_DEFINES::ACKNOWLEDGEMENT,
+        [this, bulb, color, duration]() {
+            changeBulbColor(bulb, color, duration, 0, true);
+            return m_protocol->lastSequence();
+        },
+        [done](LifxPacket *reply) { done(reply != nullptr); },
+        timeout, retries);
+}
+
+/**
+ * \fn void LifxManager::changeBulbStateAcked(LifxBulb *bulb, bool state, std::function<void(bool)> done, int timeout, int retries)
+ * \param bulb The bulb to change
+ * \param state Boolean state for the bulb true = on, false = off
+ * \param done Called once, with true when the bulb ACKs, or false if it never did
+ * \param timeout Millis to wait for each attempt
+ * \param retries How many times to send again before giving up
+ */
+void LifxManager::changeBulbStateAcked(LifxBulb *bulb, bool state, std::function<void(bool)> done, int timeout, int retries)
+{
+    if (!bulb) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb pointer";
+        done(false);
+        return;
+    }
+
+    trackRequest(bulb, LIFX_DEFINES::ACKNOWLEDGEMENT,
+        [this, bulb, state]() {
+            changeBulbState(bulb, state, 0, true);
+            return m_protocol->lastSequence();
+        },
+        [done](LifxPacket *reply) { done(reply != nullptr); },
+        timeout, retries);
+}
+
+#ifdef LIFX_ENABLE_COROUTINES
+/**
+ * \fn LifxColorAwaiter LifxManager::getColor(LifxBulb *bulb, int timeout, int retries)
+ * \param bulb The bulb to ask
+ * \param timeout Millis to wait for each attempt
+ * \param retries How many times to ask again before giving up
+ * \return An awaiter, co_await it for a LifxColorResult
+ *
+ * The request is sent when the awaiter is awaited, see requestColor().
+ */
+LifxColorAwaiter LifxManager::getColor(LifxBulb *bulb, int timeout, int retries)
+{
+    return LifxColorAwaiter([this, bulb, timeout, retries](std::function<void(LifxColorResult)> done) {
+        requestColor(bulb, [done](bool ok, HSBK color) {
+            LifxColorResult result;
+            result.ok = ok;
+            result.color = color;
+            done(result);
+        }, timeout, retries);
+    });
+}
+
+/**
+ * \fn LifxAckAwaiter LifxManager::setColorAcked(LifxBulb *bulb, HSBK color, uint32_t duration, int timeout, int retries)
+ * \param bulb The bulb to change
+ * \param color HSBK object containing the new color to set the bulb to
+ * \param duration The uint32_t value in millis to slow the transition down
+ * \param timeout Millis to wait for each attempt
+ * \param retries How many times to send again before giving up
+ * \return An awaiter, co_await it for true if the bulb ACKed
+ */
+LifxAckAwaiter LifxManager::setColorAcked(LifxBulb *bulb, HSBK color, uint32_t duration, int timeout, int retries)
+{
+    return LifxAckAwaiter([this, bulb, color, duration, timeout, retries](std::function<void(bool)> done) {
+        changeBulbColorAcked(bulb, color, duration, done, timeout, retries);
+    });
+}
+
+/**
+ * \fn LifxAckAwaiter LifxManager::setStateAcked(LifxBulb *bulb, bool state, int timeout, int retries)
+ * \param bulb The bulb to change
+ * \param state Boolean state for the bulb true = on, false = off
+ * \param timeout Millis to wait for each attempt
+ * \param retries How many times to send again before giving up
+ * \return An awaiter, co_await it for true if the bulb ACKed
+ */
+LifxAckAwaiter LifxManager::setStateAcked(LifxBulb *bulb, bool state, int timeout, int retries)
+{
+    return LifxAckAwaiter([this, bulb, state, timeout, retries](std::function<void(bool)> done) {
+        changeBulbStateAcked(bulb, state, done, timeout, retries);
+    });
+}
+#endif
+
+/*
+ * Sends the first attempt and remembers the request under the bulb
+ * and sequence the reply will carry. All deadlines share one timer.
+ */
+void LifxManager::trackRequest(LifxBulb *bulb, uint16_t reply, std::function<uint8_t()> send, std::function<void(LifxPacket*)> done, int timeout, int retries)
+{
+    PendingRequest request;
+
+    request.target = bulb->targetAsLong();
+    request.reply = reply;
+    request.send = send;
+    request.done = done;
+    request.timeout = qMax(timeout, 1);
+    request.retries = qMax(retries, 0);
+    sendRequest(request);
+    scheduleRequestTimer();
+}
+
+/*
+ * Sends one attempt and files the request under the sequence it went
+ * out with, with a fresh deadline.
+ */
+void LifxManager::sendRequest(PendingRequest &request)
+{
+    quint64 key = requestKey(request.target, request.send());
+
+    // The 8 bit sequence wrapped onto a request still waiting, it can never match now
+    if (m_requests.contains(key)) {
+        PendingRequest stale = m_requests.take(key);
+        stale.done(nullptr);
+    }
+
+    request.deadline = m_fleet->now() + request.timeout;
+    m_requests.insert(key, request);
+    m_requestDeadlines.insert(request.deadline, key);
+}
+
+/*
+ * Called for every packet while requests are pending. The packet must
+ * be the type the request waits for, from the bulb it went to, with the
+ * sequence it was sent with.
+ */
+void LifxManager::completeRequest(uint64_t target, LifxPacket *packet)
+{
+    auto it = m_requests.find(requestKey(target, packet->sequence()));
+
+    if (it == m_requests.end() || it->reply != packet->type())
+        return;
+
+    PendingRequest request = it.value();
+    m_requests.erase(it);
+    // The deadline entry is left behind, expireRequests() skips it
+    request.done(packet);
+}
+
+/*
+ * Handles every deadline that has passed, sending again while there
+ * are retries left and failing the request after that.
+ */
+void LifxManager::expireRequests()
+{
+    qint64 now = m_fleet->now();
+    QList<QPair<qint64, quint64>> expired;
+
+    while (!m_requestDeadlines.isEmpty() && m_requestDeadlines.firstKey() <= now) {
+        auto first = m_requestDeadlines.begin();
+        expired.append(qMakePair(first.key(), first.value()));
+        m_requestDeadlines.erase(first);
+    }
+
+    for (const auto &entry : expired) {
+        auto it = m_requests.find(entry.second);
+
+        // Answered, or already resent with a later deadline
+        if (it == m_requests.end() || it->deadline != entry.first)
+            continue;
+
+        PendingRequest request = it.value();
+        m_requests.erase(it);
+
+        if (request.retries > 0) {
+            if (m_debug)
+                qDebug() << __PRETTY_FUNCTION__ << ": No reply from" << request.target << ", retrying";
+
+            request.retries--;
+            sendRequest(request);
+        }
+        else {
+            request.done(nullptr);
+        }
+    }
+
+    scheduleRequestTimer();
+}
+
+void LifxManager::scheduleRequestTimer()
+{
+    if (m_requestDeadlines.isEmpty()) {
+        m_requestTimer->stop();
+        return;
+    }
+
+    m_requestTimer->start(static_cast<int>(qMax<qint64>(m_requestDeadlines.firstKey() - m_fleet->now(), 0)));
+}
+
 void LifxManager::enableBulbEcho(QString& name, int timeout, QByteArray echoing)
 {
     if (timeout >= 1000) {
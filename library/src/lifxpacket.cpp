@@ -134,8 +134,8 @@ void LifxPacket::makeDiscoveryPacketForBulb(QHostAddress address, int port)
 QByteArray LifxPacket::datagram()
 {
     uint16_t size = m_headerSize + m_payload.size();
-    m_hdr[0] = size << 0;
-    m_hdr[1] = size << 8;
+    m_hdr[0] = size & 0xff;
+    m_hdr[1] = size >> 8;
     m_datagram.clear();
     m_datagram.append(m_hdr);
     m_datagram.append(m_payload);
@@ -143,6 +143,21 @@ QByteArray LifxPacket::datagram()
     return m_datagram;
 }
 
+/**
+ * \fn void LifxPacket::setSequence(uint8_t sequence)
+ * \param sequence The sequence number for an outgoing packet
+ *
+ * The bulb copies the sequence into its ACK and any response, which is
+ * how a reply is matched to the request that caused it. Must be called
+ * after the packet has been built.
+ */
+void LifxPacket::setSequence(uint8_t sequence)
+{
+    m_header.sequence = sequence;
+    if (m_hdr.size() == m_headerSize)
+        m_hdr[static_cast<int>(offsetof(lx_protocol_header_t, sequence))] = static_cast<char>(sequence);
+}
+
 void LifxPacket::setHeader(const char* data)
 {
     memcpy(&m_header, data, m_headerSize);
@@ -349,6 +364,171 @@ uint16_t LifxPacket::setBulbPower(LifxBulb* bulb, int source, bool ackRequired)
     return m_type;
 }
 
+/**
+ * The bulb runs the waveform on its own, so there is nothing to respond with
+ * until it's done. Like SET_POWER, ask for an ACK if delivery matters.
+ * SET_WAVEFORM_OPTIONAL is only used if the waveform leaves some of the
+ * HSBK fields alone.
+ */
+uint16_t LifxPacket::setBulbWaveform(LifxBulb* bulb, const LifxWaveform &waveform, int source, bool ackRequired)
+{
+    m_tagged = 0;
+    m_ackRequired = ackRequired;
+    m_resRequired = false;
+    m_source = source;
+
+    if (waveform.isOptional()) {
+        lx_dev_waveform_optional_t wf = waveform.toDeviceWaveformOptional();
+        m_type = LIFX_DEFINES::SET_WAVEFORM_OPTIONAL;
+        createHeader(bulb, false);
+        m_payload = QByteArray((char*)&wf, sizeof(lx_dev_waveform_optional_t));
+    }
+    else {
+        lx_dev_waveform_t wf = waveform.toDeviceWaveform();
+        m_type = LIFX_DEFINES::SET_WAVEFORM;
+        createHeader(bulb, false);
+        m_payload = QByteArray((char*)&wf, sizeof(lx_dev_waveform_t));
+    }
+    return m_type;
+}
+
+uint16_t LifxPacket::getBulbExtendedZones(LifxBulb* bulb, int source, bool ackRequired)
+{
+    m_tagged = 0;
+    m_ackRequired = ackRequired;
+    m_resRequired = false;
+    m_type = LIFX_DEFINES::GET_EXTENDED_COLOR_ZONES;
+    m_source = source;
+
+    createHeader(bulb, false);
+    return m_type;
+}
+
+/**
+ * The payload is always the full 82 zone struct, colors_count tells the
+ * device how many of them to use. The colors come from the bulb zone
+ * frame buffer starting at index.
+ */
+uint16_t LifxPacket::setBulbExtendedZones(LifxBulb* bulb, int index, int count, uint32_t duration, uint8_t apply, int source, bool ackRequired)
+{
+    lx_dev_extended_zones_t zones;
+
+    memset(&zones, 0, sizeof(lx_dev_extended_zones_t));
+    count = qBound(0, count, MAX_EXTENDED_ZONES);
+    if (index + count > bulb->zones().size())
+        count = qMax(0, bulb->zones().size() - index);
+
+    zones.duration = duration;
+    zones.apply = apply;
+    zones.zone_index = static_cast<uint16_t>(index);
+    zones.colors_count = static_cast<uint8_t>(count);
+    if (count > 0)
+        memcpy(zones.colors, bulb->zones().data() + index, count * sizeof(lx_hsbk_t));
+
+    m_tagged = 0;
+    m_ackRequired = ackRequired;
+    m_resRequired = false;
+    m_type = LIFX_DEFINES::SET_EXTENDED_COLOR_ZONES;
+    m_source = source;
+
+    createHeader(bulb, false);
+    m_payload = QByteArray((char*)&zones, sizeof(lx_dev_extended_zones_t));
+    return m_type;
+}
+
+uint16_t LifxPacket::getDeviceChain(LifxBulb* bulb, int source, bool ackRequired)
+{
+    m_tagged = 0;
+    m_ackRequired = ackRequired;
+    m_resRequired = false;
+    m_type = LIFX_DEFINES::GET_DEVICE_CHAIN;
+    m_source = source;
+
+    createHeader(bulb, false);
+    return m_type;
+}
+
+/**
+ * Asks for the visible frame buffer of length tiles starting at
+ * tileIndex. The device sends one STATE64 per tile.
+ */
+uint16_t LifxPacket::getTileState64(LifxBulb* bulb, int tileIndex, int length, int source, bool ackRequired)
+{
+    lx_dev_get64_t get;
+
+    memset(&get, 0, sizeof(lx_dev_get64_t));
+    get.tile_index = static_cast<uint8_t>(tileIndex);
+    get.length = static_cast<uint8_t>(length);
+    get.width = static_cast<uint8_t>(qMax(bulb->tileWidth(tileIndex), 8));
+
+    m_tagged = 0;
+    m_ackRequired = ackRequired;
+    m_resRequired = false;
+    m_type = LIFX_DEFINES::GET64;
+    m_source = source;
+
+    createHeader(bulb, false);
+    m_payload = QByteArray((char*)&get, sizeof(lx_dev_get64_t));
+    return m_type;
+}
+
+/**
+ * Writes one tile worth of colors from the bulb tile frame buffer into
+ * frame buffer fbIndex on that tile.
+ */
+uint16_t LifxPacket::setTileState64(LifxBulb* bulb, int tileIndex, uint8_t fbIndex, uint32_t duration, int source, bool ackRequired)
+{
+    lx_dev_set64_t set;
+    lx_hsbk_t *pixels = bulb->tilePixels(tileIndex);
+
+    memset(&set, 0, sizeof(lx_dev_set64_t));
+    set.tile_index = static_cast<uint8_t>(tileIndex);
+    set.length = 1;
+    set.fb_index = fbIndex;
+    set.width = static_cast<uint8_t>(bulb->tileWidth(tileIndex));
+    set.duration = duration;
+    if (pixels)
+        memcpy(set.colors, pixels, TILE_PIXELS * sizeof(lx_hsbk_t));
+
+    m_tagged = 0;
+    m_ackRequired = ackRequired;
+    m_resRequired = false;
+    m_type = LIFX_DEFINES::SET64;
+    m_source = source;
+
+    createHeader(bulb, false);
+    m_payload = QByteArray((char*)&set, sizeof(lx_dev_set64_t));
+    return m_type;
+}
+
+/**
+ * Copies the whole of frame buffer srcIndex to dstIndex on length tiles
+ * starting at tileIndex. Copying to frame buffer 0 shows the colors.
+ */
+uint16_t LifxPacket::copyTileFrameBuffer(LifxBulb* bulb, int tileIndex, int length, uint8_t srcIndex, uint8_t dstIndex, uint32_t duration, int source, bool ackRequired)
+{
+    lx_dev_copy_frame_buffer_t copy;
+
+    memset(&copy, 0, sizeof(lx_dev_copy_frame_buffer_t));
+    copy.tile_index = static_cast<uint8_t>(tileIndex);
+    copy.length = static_cast<uint8_t>(length);
+    copy.src_fb_index = srcIndex;
+    copy.dst_fb_index = dstIndex;
+    copy.width = static_cast<uint8_t>(qMax(bulb->tileWidth(tileIndex), 8));
+    copy.height = static_cast<uint8_t>(qMax(bulb->tileHeight(tileIndex), 8));
+    copy.duration = duration;
+
+    m_tagged = 0;
+    m_ackRequired = ackRequired;
+    m_resRequired = false;
+    m_type = LIFX_DEFINES::COPY_FRAME_BUFFER;
+    m_source = source;
+
+    createHeader(bulb, false);
+    m_payload = QByteArray((char*)&copy, sizeof(lx_dev_copy_frame_buffer_t));
+    return m_type;
+}
+
 uint16_t LifxPacket::rebootBulb(LifxBulb* bulb)
 {
     m_tagged = 0;
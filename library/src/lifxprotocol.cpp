@@ -19,9 +19,15 @@
 
 #include "lifxprotocol.h"
 
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
 LifxProtocol::LifxProtocol(QObject *parent) : QObject(parent)
 {
     m_socket = nullptr;
+    m_sequence = 0;
     m_socket = new QUdpSocket(this);
     m_socket->bind(LIFX_PORT);
     connect(m_socket, &QUdpSocket::readyRead, this, &LifxProtocol::readDatagram);
@@ -34,7 +40,174 @@ LifxProtocol::~LifxProtocol()
 LifxProtocol::LifxProtocol(const LifxProtocol& object) : QObject()
 {
     m_socket = object.m_socket;
+    m_sequence = object.m_sequence;
+}
+
+/*
+ * Every packet to a bulb goes out here, so each one gets its own sequence
+ * number for matching up the ACK or response
+ */
+qint64 LifxProtocol::send(LifxPacket &packet, LifxBulb *bulb)
+{
+    packet.setSequence(++m_sequence);
+    bulb->markSent();
+    return m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+}
+
+/**
+ * \fn void LifxProtocol::queueDatagram(LifxPacket &packet, LifxBulb *bulb)
+ * \param packet A packet already built for bulb
+ * \param bulb Where the packet goes
+ *
+ * The packet is stamped with its sequence number and encoded onto the
+ * end of one buffer, nothing is sent until flushDatagrams().
+ */
+void LifxProtocol::queueDatagram(LifxPacket &packet, LifxBulb *bulb)
+{
+    QueuedDatagram queued;
+
+    packet.setSequence(++m_sequence);
+    QByteArray datagram = packet.datagram();
+
+    queued.offset = m_queue.size();
+    queued.size = datagram.size();
+    queued.address = bulb->address();
+    queued.port = static_cast<quint16>(bulb->port());
+    m_queue.append(datagram);
+    bulb->markSent();
+    m_queued.append(queued);
+}
+
+/**
+ * \fn int LifxProtocol::flushDatagrams(qint64 *skew)
+ * \param skew If not null, set to the nanoseconds from the start of the first send to the end of the last
+ * \return The number of datagrams the socket took
+ *
+ * Sends everything queued with queueDatagram() back to back. On Linux
+ * the datagrams are handed to the kernel with sendmmsg(), as few calls
+ * as it takes; anything left over goes out one at a time. The queue is
+ * empty afterwards either way, the buffer is kept for the next batch.
+ */
+int LifxProtocol::flushDatagrams(qint64 *skew)
+{
+    QElapsedTimer timer;
+    int sent = 0;
+
+    timer.start();
+#ifdef Q_OS_LINUX
+    sent = sendQueued();
+#endif
+    for (int i = sent; i < m_queued.size(); i++) {
+        const QueuedDatagram &queued = m_queued[i];
+        if (m_socket->writeDatagram(m_queue.constData() + queued.offset, queued.size, queued.address, queued.port) == queued.size)
+            sent++;
+    }
+
+    if (skew)
+        *skew = timer.nsecsElapsed();
+
+    m_queue.resize(0);
+    m_queued.resize(0);
+    return sent;
+}
+
+/*
+ * Sends the queued datagrams with sendmmsg(), straight to
+ * the socket Qt owns. Returns how many went, the caller sends any the
+ * kernel didn't take.
+ */
+int LifxProtocol::sendQueued()
+{
+#ifdef Q_OS_LINUX
+    int fd = static_cast<int>(socketDescriptor());
+    int family = socketFamily();
+    int count = m_queued.size();
+
+    if (fd < 0 || family < 0 || count <= 0)
+        return 0;
+
+    QVector<mmsghdr> messages(count);
+    QVector<iovec> vectors(count);
+    QVector<sockaddr_storage> addresses(count);
+
+    for (int i = 0; i < count; i++) {
+        const QueuedDatagram &queued = m_queued[i];
+
+        vectors[i].iov_base = const_cast<char*>(m_queue.constData() + queued.offset);
+        vectors[i].iov_len = queued.size;
+        memset(&messages[i], 0, sizeof(mmsghdr));
+        messages[i].msg_hdr.msg_name = &addresses[i];
+        messages[i].msg_hdr.msg_namelen = socketAddress(queued.address, queued.port, family, &addresses[i]);
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int sent = 0;
+    while (sent < count) {
+        int result = sendmmsg(fd, messages.data() + sent, count - sent, 0);
+        if (result <= 0)
+            break;
+        sent += result;
+    }
+    return sent;
+#else
+    return 0;
+#endif
+}
+
+#ifdef Q_OS_LINUX
+/**
+ * \fn int LifxProtocol::socketFamily() const
+ * \return AF_INET or AF_INET6 for the bound socket, -1 if there isn't one
+ */
+int LifxProtocol::socketFamily() const
+{
+    sockaddr_storage local;
+    socklen_t length = sizeof(local);
+    int fd = static_cast<int>(socketDescriptor());
+
+    if (fd < 0 || getsockname(fd, reinterpret_cast<sockaddr*>(&local), &length) != 0)
+        return -1;
+
+    return local.ss_family;
+}
+
+/**
+ * \fn socklen_t LifxProtocol::socketAddress(const QHostAddress &address, quint16 port, int family, sockaddr_storage *storage)
+ * \param address An IPv4 bulb address
+ * \param port The bulb port
+ * \param family The socketFamily() the address will be sent from
+ * \param storage Gets the address
+ * \return The length of the address in storage
+ *
+ * QUdpSocket bound to Any is a dual stack IPv6 socket, so the IPv4 bulb
+ * address is mapped when family is AF_INET6.
+ */
+socklen_t LifxProtocol::socketAddress(const QHostAddress &address, quint16 port, int family, sockaddr_storage *storage)
+{
+    quint32 ipv4 = address.toIPv4Address();
+
+    memset(storage, 0, sizeof(sockaddr_storage));
+    if (family == AF_INET6) {
+        sockaddr_in6 *in6 = reinterpret_cast<sockaddr_in6*>(storage);
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(port);
+        in6->sin6_addr.s6_addr[10] = 0xff;
+        in6->sin6_addr.s6_addr[11] = 0xff;
+        in6->sin6_addr.s6_addr[12] = ipv4 >> 24;
+        in6->sin6_addr.s6_addr[13] = (ipv4 >> 16) & 0xff;
+        in6->sin6_addr.s6_addr[14] = (ipv4 >> 8) & 0xff;
+        in6->sin6_addr.s6_addr[15] = ipv4 & 0xff;
+        return sizeof(sockaddr_in6);
+    }
+
+    sockaddr_in *in = reinterpret_cast<sockaddr_in*>(storage);
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    in->sin_addr.s_addr = htonl(ipv4);
+    return sizeof(sockaddr_in);
 }
+#endif
 
 qint64 LifxProtocol::discover()
 {
@@ -54,6 +227,7 @@ void LifxProtocol::readDatagram()
 {
     QByteArray datagram;
     QHostAddress address;
+    int count = 0;
 
     while (m_socket->hasPendingDatagrams()) {
         QNetworkDatagram datagram = m_socket->receiveDatagram();
@@ -62,11 +236,15 @@ void LifxProtocol::readDatagram()
 
             packet->setDatagram(datagram);
             emit newPacket(packet);
+            count++;
         }
         else {
             qWarning() << __PRETTY_FUNCTION__ << ": Invalid datagram detected";
         }
     }
+    // Lets the manager act once per batch instead of once per packet
+    if (count)
+        emit packetsRead();
 }
 
 bool LifxProtocol::newPacketAvailable()
@@ -84,7 +262,7 @@ uint16_t LifxProtocol::getPowerForBulb(LifxBulb* bulb, int source)
     uint16_t type;
     
     type = packet.getBulbPower(bulb, source);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
     return type;
 }
 
@@ -94,7 +272,7 @@ uint16_t LifxProtocol::getLabelForBulb(LifxBulb* bulb, int source)
     uint16_t type;
 
     type = packet.getBulbLabel(bulb, source);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
     return type;
 }
 
@@ -104,7 +282,7 @@ uint16_t LifxProtocol::getFirmwareForBulb(LifxBulb* bulb, int source)
     uint16_t type;
 
     type = packet.getBulbFirmware(bulb, source);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
     return type;
 }
 
@@ -114,7 +292,7 @@ uint16_t LifxProtocol::getVersionForBulb(LifxBulb* bulb, int source)
     uint16_t type;
 
     type = packet.getBulbVersion(bulb, source);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
     return type;
 }
 
@@ -124,7 +302,7 @@ uint16_t LifxProtocol::getColorForBulb(LifxBulb* bulb, int source)
     uint16_t type;
 
     type = packet.getBulbColor(bulb, source);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
     return type;
 }
 
@@ -134,7 +312,8 @@ uint16_t LifxProtocol::setBulbColor(LifxBulb* bulb, int source, bool ackRequired
     uint16_t type;
 
     type = packet.setBulbColor(bulb, source, ackRequired);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
+    bulb->invalidateColor();
     return type;
 }
 
@@ -145,7 +324,8 @@ uint16_t LifxProtocol::setBulbColor(LifxBulb* bulb, QColor color, int source, bo
 
     bulb->setColor(color);
     type = packet.setBulbColor(bulb, source, ackRequired);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
+    bulb->invalidateColor();
     return type;
 }
 
@@ -155,7 +335,7 @@ uint16_t LifxProtocol::getGroupForBulb(LifxBulb* bulb, int source)
     uint16_t type;
 
     type = packet.getBulbGroup(bulb, source);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
     return type;
 }
 
@@ -165,7 +345,40 @@ uint16_t LifxProtocol::getWifiInfoForBulb(LifxBulb* bulb, int source)
     uint16_t type;
 
     type = packet.getWifiInfoForBulb(bulb, source);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
+    return type;
+}
+
+uint16_t LifxProtocol::getZonesForBulb(LifxBulb* bulb, int source)
+{
+    LifxPacket packet;
+    uint16_t type;
+
+    type = packet.getBulbExtendedZones(bulb, source);
+    send(packet, bulb);
+    return type;
+}
+
+uint16_t LifxProtocol::getDeviceChainForBulb(LifxBulb* bulb, int source)
+{
+    LifxPacket packet;
+    uint16_t type;
+
+    type = packet.getDeviceChain(bulb, source);
+    send(packet, bulb);
+    return type;
+}
+
+uint16_t LifxProtocol::getTilesForBulb(LifxBulb* bulb, int source)
+{
+    LifxPacket packet;
+    uint16_t type;
+
+    if (bulb->tileCount() == 0)
+        return 0;
+
+    type = packet.getTileState64(bulb, 0, bulb->tileCount(), source);
+    send(packet, bulb);
     return type;
 }
 
@@ -175,7 +388,7 @@ uint16_t LifxProtocol::rebootBulb(LifxBulb* bulb)
     uint16_t type;
 
     type = packet.rebootBulb(bulb);
-    m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+    send(packet, bulb);
     return type;
 }
 
@@ -188,7 +401,8 @@ uint16_t LifxProtocol::setBulbState(LifxBulb* bulb, bool state, int source, bool
     if (bulb) {
         bulb->setPower(power);
         type = packet.setBulbPower(bulb, source, ackRequired);
-        m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+        send(packet, bulb);
+        bulb->invalidatePower();
         return type;
     }
     else {
@@ -201,14 +415,129 @@ void LifxProtocol::setGroupState(LifxGroup* group, bool state, int source, bool
 {
     uint16_t power = state ? 65535 : 0;
     
-    LifxPacket packet;
-
     QVector<LifxBulb*> bulbs = group->bulbs();
     for (auto bulb : bulbs) {
+        LifxPacket packet;
         bulb->setPower(power);
         packet.setBulbPower(bulb, source, ackRequired);
-        m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+        send(packet, bulb);
+        bulb->invalidatePower();
+    }
+}
+
+uint16_t LifxProtocol::setBulbWaveform(LifxBulb* bulb, const LifxWaveform &waveform, int source, bool ackRequired)
+{
+    LifxPacket packet;
+    uint16_t type;
+
+    if (bulb) {
+        bulb->setWaveform(waveform);
+        type = packet.setBulbWaveform(bulb, waveform, source, ackRequired);
+        send(packet, bulb);
+        return type;
+    }
+    else {
+        qWarning() << __PRETTY_FUNCTION__ << ": Protocol request for a NULL bulb";
     }
+    return 0;
+}
+
+void LifxProtocol::setGroupWaveform(LifxGroup* group, const LifxWaveform &waveform, int source, bool ackRequired)
+{
+    QVector<LifxBulb*> bulbs = group->bulbs();
+    for (auto bulb : bulbs) {
+        LifxPacket packet;
+        bulb->setWaveform(waveform);
+        packet.setBulbWaveform(bulb, waveform, source, ackRequired);
+        send(packet, bulb);
+    }
+}
+
+/**
+ * Sends only the zones which changed since the last send. If the change
+ * needs more than one message, all but the last are sent with NO_APPLY so
+ * the strip changes all at once. If apply is false, even the last one is
+ * held, and applyBulbZones() shows them later.
+ * 
+ * Returns the number of messages sent, 0 if nothing changed.
+ */
+int LifxProtocol::setBulbZones(LifxBulb* bulb, uint32_t duration, bool apply, int source, bool ackRequired)
+{
+    if (bulb == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Protocol request for a NULL bulb";
+        return 0;
+    }
+
+    LifxFrameBuffer &zones = bulb->zones();
+    QVector<QPair<int,int>> ranges = zones.dirtyRanges(MAX_EXTENDED_ZONES);
+
+    for (int i = 0; i < ranges.size(); i++) {
+        LifxPacket packet;
+        uint8_t mode = LIFX_DEFINES::MULTIZONE_NO_APPLY;
+
+        if (apply && i == ranges.size() - 1)
+            mode = LIFX_DEFINES::MULTIZONE_APPLY;
+
+        packet.setBulbExtendedZones(bulb, ranges[i].first, ranges[i].second, duration, mode, source, ackRequired);
+        send(packet, bulb);
+    }
+    if (ranges.size())
+        zones.markClean(0, zones.size());
+
+    return ranges.size();
+}
+
+uint16_t LifxProtocol::applyBulbZones(LifxBulb* bulb, int source, bool ackRequired)
+{
+    LifxPacket packet;
+    uint16_t type;
+
+    if (bulb) {
+        type = packet.setBulbExtendedZones(bulb, 0, 0, 0, LIFX_DEFINES::MULTIZONE_APPLY_ONLY, source, ackRequired);
+        send(packet, bulb);
+        return type;
+    }
+    return 0;
+}
+
+/**
+ * Each tile whose pixels changed gets a SET64 into the back frame buffer
+ * with no transition, nothing changes on the tiles yet. Then a single
+ * COPY_FRAME_BUFFER moves the back buffer to the visible one on every
+ * tile in the chain, so the whole chain changes together using duration.
+ * The back buffer keeps the last frame, so unchanged tiles are copied
+ * as they were.
+ * 
+ * Returns the number of tiles sent, 0 if nothing changed.
+ */
+int LifxProtocol::setBulbTiles(LifxBulb* bulb, uint32_t duration, int source, bool ackRequired)
+{
+    if (bulb == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Protocol request for a NULL bulb";
+        return 0;
+    }
+
+    LifxFrameBuffer &tiles = bulb->tiles();
+    int sent = 0;
+
+    for (int i = 0; i < bulb->tileCount(); i++) {
+        if (!tiles.isDirty(i * TILE_PIXELS, TILE_PIXELS))
+            continue;
+
+        LifxPacket packet;
+        packet.setTileState64(bulb, i, LIFX_DEFINES::TILE_BACK_FB, 0, source, ackRequired);
+        send(packet, bulb);
+        sent++;
+    }
+
+    if (sent) {
+        LifxPacket packet;
+        packet.copyTileFrameBuffer(bulb, 0, bulb->tileCount(), LIFX_DEFINES::TILE_BACK_FB, LIFX_DEFINES::TILE_VISIBLE_FB, duration, source, ackRequired);
+        send(packet, bulb);
+        tiles.markClean(0, tiles.size());
+    }
+
+    return sent;
 }
 
 void LifxProtocol::echoRequest(LifxBulb* bulb, QByteArray echoing)
@@ -216,7 +545,7 @@ void LifxProtocol::echoRequest(LifxBulb* bulb, QByteArray echoing)
     if (bulb) {
         LifxPacket packet;
         packet.echoBulb(bulb, echoing);
-        m_socket->writeDatagram(packet.datagram(), bulb->address(), bulb->port());
+        send(packet, bulb);
     }
 }
 
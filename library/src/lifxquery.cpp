@@ -0,0 +1,261 @@
+/*
+ * Predicate queries over the bulb fleet
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxquery.h"
+
+#include <limits>
+
+/*
+ * Clears the candidate bits of rows whose value is outside [low, high],
+ * or equal to low when notEqual is set. Blocks with no candidates
+ * left are skipped without reading the column.
+ */
+template<typename Value>
+static void filterRows(LifxBitmap &rows, int size, qint64 low, qint64 high, bool notEqual, Value value)
+{
+    quint64 *words = rows.words();
+    int count = qMin(rows.wordCount(), (size + 63) / 64);
+
+    for (int w = 0; w < count; w++) {
+        if (words[w] == 0)
+            continue;
+
+        int first = w * 64;
+        int last = qMin(first + 64, size);
+        quint64 pass = 0;
+        for (int i = first; i < last; i++) {
+            qint64 v = value(i);
+            bool match = notEqual ? (v != low) : (v >= low && v <= high);
+            pass |= static_cast<quint64>(match) << (i - first);
+        }
+        words[w] &= pass;
+    }
+    for (int w = count; w < rows.wordCount(); w++)
+        words[w] = 0;
+}
+
+static void filterField(const LifxFleet *fleet, LifxQuery::Field field, LifxBitmap &rows, qint64 low, qint64 high, bool notEqual)
+{
+    const lx_dev_color_t *color = fleet->colorColumn();
+    int size = fleet->size();
+
+    switch (field) {
+        case LifxQuery::Hue:
+            filterRows(rows, size, low, high, notEqual, [color](int i) { return static_cast<qint64>(color[i].hue); });
+            break;
+        case LifxQuery::Saturation:
+            filterRows(rows, size, low, high, notEqual, [color](int i) { return static_cast<qint64>(color[i].saturation); });
+            break;
+        case LifxQuery::Brightness:
+            filterRows(rows, size, low, high, notEqual, [color](int i) { return static_cast<qint64>(color[i].brightness); });
+            break;
+        case LifxQuery::Kelvin:
+            filterRows(rows, size, low, high, notEqual, [color](int i) { return static_cast<qint64>(color[i].kelvin); });
+            break;
+        case LifxQuery::Power: {
+            const uint16_t *power = fleet->powerColumn();
+            filterRows(rows, size, low, high, notEqual, [power](int i) { return static_cast<qint64>(power[i]); });
+            break;
+        }
+        case LifxQuery::RSSI: {
+            const qint16 *rssi = fleet->rssiColumn();
+            filterRows(rows, size, low, high, notEqual, [rssi](int i) { return static_cast<qint64>(rssi[i]); });
+            break;
+        }
+        case LifxQuery::Age: {
+            const qint64 *seen = fleet->lastSeenColumn();
+            qint64 now = fleet->now();
+            filterRows(rows, size, low, high, notEqual, [seen, now](int i) {
+                return seen[i] < 0 ? std::numeric_limits<qint64>::max() : now - seen[i];
+            });
+            break;
+        }
+    }
+}
+
+LifxQuery::LifxQuery() : m_power(-1), m_required(0), m_excluded(0)
+{
+}
+
+LifxQuery::~LifxQuery()
+{
+}
+
+/**
+ * \fn LifxQuery& LifxQuery::isOn()
+ * \return This query, matching only bulbs with power on
+ */
+LifxQuery& LifxQuery::isOn()
+{
+    m_power = 1;
+    return *this;
+}
+
+/**
+ * \fn LifxQuery& LifxQuery::isOff()
+ * \return This query, matching only bulbs with power off
+ */
+LifxQuery& LifxQuery::isOff()
+{
+    m_power = 0;
+    return *this;
+}
+
+/**
+ * \fn LifxQuery& LifxQuery::hasCapability(LifxFleet::Capability capability)
+ * \param capability Product feature the bulb must have
+ * \return This query
+ *
+ * Capabilities come from products.json, a bulb with no product matches
+ * no capability.
+ */
+LifxQuery& LifxQuery::hasCapability(LifxFleet::Capability capability)
+{
+    m_required |= capability;
+    return *this;
+}
+
+/**
+ * \fn LifxQuery& LifxQuery::lacksCapability(LifxFleet::Capability capability)
+ * \param capability Product feature the bulb must not have
+ * \return This query
+ */
+LifxQuery& LifxQuery::lacksCapability(LifxFleet::Capability capability)
+{
+    m_excluded |= capability;
+    return *this;
+}
+
+/**
+ * \fn LifxQuery& LifxQuery::inGroup(const QString &label)
+ * \param label Name of a group the bulb must be in
+ * \return This query
+ */
+LifxQuery& LifxQuery::inGroup(const QString &label)
+{
+    m_groups.append(label);
+    return *this;
+}
+
+/**
+ * \fn LifxQuery& LifxQuery::where(Field field, Compare compare, qint64 value)
+ * \param field The bulb value to compare
+ * \param compare How to compare it
+ * \param value The value to compare against
+ * \return This query
+ */
+LifxQuery& LifxQuery::where(Field field, Compare compare, qint64 value)
+{
+    Condition condition;
+
+    condition.field = field;
+    condition.compare = compare;
+    condition.value = value;
+    m_conditions.append(condition);
+    return *this;
+}
+
+/**
+ * \fn LifxBitmap LifxQuery::evaluate(const LifxFleet *fleet, LifxBitmap candidates) const
+ * \param fleet The fleet to look at
+ * \param candidates The rows which may match, usually narrowed to the groups() already
+ * \return The rows which meet every condition
+ *
+ * The bitmap conditions are applied first since they are cheapest and
+ * leave fewer blocks for the column scans to read. The value conditions
+ * are then reduced to one [low, high] range per field, plus any not
+ * equal conditions, so each field's column is read once.
+ */
+LifxBitmap LifxQuery::evaluate(const LifxFleet *fleet, LifxBitmap candidates) const
+{
+    const qint64 lowest = std::numeric_limits<qint64>::min();
+    const qint64 highest = std::numeric_limits<qint64>::max();
+    qint64 low[Age + 1];
+    qint64 high[Age + 1];
+    bool used[Age + 1];
+
+    if (candidates.size() > fleet->size())
+        candidates.resize(fleet->size());
+
+    if (m_power == 1)
+        candidates &= fleet->poweredOnRows();
+    else if (m_power == 0)
+        candidates.subtract(fleet->poweredOnRows());
+
+    for (int bit = 0; bit < 5; bit++) {
+        LifxFleet::Capability capability = static_cast<LifxFleet::Capability>(1 << bit);
+        if (m_required & capability)
+            candidates &= fleet->capabilityRows(capability);
+        if (m_excluded & capability)
+            candidates.subtract(fleet->capabilityRows(capability));
+    }
+
+    for (int f = 0; f <= Age; f++) {
+        low[f] = lowest;
+        high[f] = highest;
+        used[f] = false;
+    }
+
+    for (const Condition &c : m_conditions) {
+        switch (c.compare) {
+            case Less:
+                if (c.value == lowest)
+                    low[c.field] = highest;     // Nothing is less, leave an empty range
+                else
+                    high[c.field] = qMin(high[c.field], c.value - 1);
+                break;
+            case LessEqual:
+                high[c.field] = qMin(high[c.field], c.value);
+                break;
+            case Equal:
+                low[c.field] = qMax(low[c.field], c.value);
+                high[c.field] = qMin(high[c.field], c.value);
+                break;
+            case GreaterEqual:
+                low[c.field] = qMax(low[c.field], c.value);
+                break;
+            case Greater:
+                if (c.value == highest)
+                    high[c.field] = lowest;
+                else
+                    low[c.field] = qMax(low[c.field], c.value + 1);
+                break;
+            case NotEqual:
+                continue;
+        }
+        used[c.field] = true;
+    }
+
+    for (int f = 0; f <= Age; f++) {
+        if (!used[f])
+            continue;
+        if (low[f] > high[f]) {
+            candidates.fill(false);
+            return candidates;
+        }
+        filterField(fleet, static_cast<Field>(f), candidates, low[f], high[f], false);
+    }
+
+    for (const Condition &c : m_conditions) {
+        if (c.compare == NotEqual)
+            filterField(fleet, c.field, candidates, c.value, c.value, true);
+    }
+
+    return candidates;
+}
@@ -0,0 +1,343 @@
+/*
+ * Converges bulbs on a desired state
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxreconciler.h"
+
+#include <limits>
+
+LifxReconciler::LifxReconciler() :
+    m_desiredCount(0), m_cursor(0), m_budget(100), m_verifyInterval(60000),
+    m_tokens(100), m_refilled(-1), m_packets(0), m_convergences(0),
+    m_lastConvergence(0), m_totalConvergence(0), m_maxConvergence(0)
+{
+}
+
+void LifxReconciler::ensureRow(int row)
+{
+    if (row < m_flags.size())
+        return;
+
+    m_flags.resize(row + 1);
+    m_color.resize(row + 1);
+    m_duration.resize(row + 1);
+    m_divergedSince.resize(row + 1);
+    m_nextAttempt.resize(row + 1);
+    m_verifyAt.resize(row + 1);
+    m_attempts.resize(row + 1);
+    m_missed.resize(row + 1);
+    m_sentAt.resize(row + 1);
+}
+
+/**
+ * \fn void LifxReconciler::setDesired(int row, const HSBK &color, bool on, uint32_t duration, qint64 now)
+ * \param row The fleet row of the bulb
+ * \param color The color the bulb should show while on
+ * \param on The power the bulb should have
+ * \param duration The transition to use when a change has to be sent
+ * \param now The fleet clock time
+ *
+ * The row is treated as out of step from now, until plan() sees a
+ * report which matches.
+ */
+void LifxReconciler::setDesired(int row, const HSBK &color, bool on, uint32_t duration, qint64 now)
+{
+    ensureRow(row);
+
+    if (!(m_flags[row] & HasDesired))
+        m_desiredCount++;
+
+    m_flags[row] = HasDesired | (on ? DesiredOn : 0);
+    m_color[row].hue = color.h();
+    m_color[row].saturation = color.s();
+    m_color[row].brightness = color.b();
+    m_color[row].kelvin = color.k();
+    m_duration[row] = duration;
+    m_divergedSince[row] = now;
+    m_nextAttempt[row] = now;
+    m_attempts[row] = 0;
+    m_missed[row] = 0;
+    m_sentAt[row] = -1;
+}
+
+/**
+ * \fn void LifxReconciler::clearDesired(int row)
+ * \param row The fleet row of the bulb, which is left in whatever state it's in
+ */
+void LifxReconciler::clearDesired(int row)
+{
+    if (!hasDesired(row))
+        return;
+
+    m_flags[row] = 0;
+    m_desiredCount--;
+}
+
+/**
+ * \fn void LifxReconciler::clear()
+ *
+ * Forgets every desired state, the statistics are kept.
+ */
+void LifxReconciler::clear()
+{
+    m_flags.fill(0);
+    m_desiredCount = 0;
+}
+
+/**
+ * \fn bool LifxReconciler::hasDesired(int row) const
+ * \param row The fleet row of the bulb
+ * \return True if the row has a desired state
+ */
+bool LifxReconciler::hasDesired(int row) const
+{
+    return row >= 0 && row < m_flags.size() && (m_flags[row] & HasDesired);
+}
+
+/**
+ * \fn bool LifxReconciler::isOffline(int row) const
+ * \param row The fleet row of the bulb
+ * \return True if the row is out of step and has not answered OFFLINE_ATTEMPTS tries in a row
+ */
+bool LifxReconciler::isOffline(int row) const
+{
+    return hasDesired(row) && !(m_flags[row] & Converged) && m_missed[row] >= OFFLINE_ATTEMPTS;
+}
+
+/**
+ * \fn void LifxReconciler::wake(int row, qint64 now)
+ * \param row The fleet row of the bulb
+ * \param now The fleet clock time
+ *
+ * Called when a bulb shows up again, after being offline or rebooting.
+ * The backoff is dropped and the row is looked at on the next plan().
+ * Only for a STATE_SERVICE or a reply after real timeouts, an ordinary
+ * reply must not cut the backoff short.
+ */
+void LifxReconciler::wake(int row, qint64 now)
+{
+    if (!hasDesired(row))
+        return;
+
+    if (m_flags[row] & Converged) {
+        m_flags[row] &= ~Converged;
+        m_divergedSince[row] = now;
+    }
+    m_flags[row] &= ~AwaitingPoll;
+    m_attempts[row] = 0;
+    m_missed[row] = 0;
+    m_sentAt[row] = -1;
+    m_nextAttempt[row] = now;
+}
+
+/**
+ * \fn void LifxReconciler::setBudget(int packetsPerSecond)
+ * \param packetsPerSecond The most messages plan() adds across the whole fleet each second
+ */
+void LifxReconciler::setBudget(int packetsPerSecond)
+{
+    m_budget = qMax(packetsPerSecond, 1);
+    m_tokens = qMin(m_tokens, static_cast<double>(m_budget));
+}
+
+/*
+ * Bulbs round the values they are sent, so a report within
+ * COLOR_TOLERANCE counts as a match. Hue goes round a circle.
+ */
+bool LifxReconciler::sameColor(const HSBK &reported, const lx_hsbk_t &desired) const
+{
+    uint16_t hue = static_cast<uint16_t>(reported.h() - desired.hue);
+
+    if (qMin<int>(hue, 65536 - hue) > COLOR_TOLERANCE)
+        return false;
+
+    return qAbs(reported.s() - desired.saturation) <= COLOR_TOLERANCE &&
+           qAbs(reported.b() - desired.brightness) <= COLOR_TOLERANCE &&
+           qAbs(reported.k() - desired.kelvin) <= COLOR_TOLERANCE;
+}
+
+qint64 LifxReconciler::backoff(int attempts) const
+{
+    qint64 wait = ATTEMPT_TIMEOUT;
+
+    for (int i = 1; i < attempts && wait < MAX_BACKOFF; i++)
+        wait *= 2;
+
+    return qMin<qint64>(wait, MAX_BACKOFF);
+}
+
+/**
+ * \fn void LifxReconciler::plan(const QVector<LifxBulb*> &bulbs, qint64 now, LifxCommandBatch &batch, QVector<QPair<LifxBulb*, qint64>> &converged)
+ * \param bulbs The manager's bulbs, indexed by fleet row
+ * \param now The fleet clock time
+ * \param batch Gets the messages to send
+ * \param converged Gets each bulb which reached its desired state since the last plan(), with the millis it took
+ *
+ * A bulb is converged when it last reported the desired power, and the
+ * desired color if it should be on. A bulb being sent a change has its
+ * reports invalidated until it answers, so nothing is resent before the
+ * reply could arrive or the backoff runs out. The reply to SET_COLOR is
+ * the color at the start of the fade, so after a color is sent the row
+ * is left until the transition is over, then polled, and only sent the
+ * color again if that report still differs. Rows mid waveform are left
+ * alone until the effect ends.
+ */
+void LifxReconciler::plan(const QVector<LifxBulb*> &bulbs, qint64 now, LifxCommandBatch &batch, QVector<QPair<LifxBulb*, qint64>> &converged)
+{
+    const qint64 ever = std::numeric_limits<qint64>::max();
+    int rows = qMin(bulbs.size(), m_flags.size());
+
+    if (m_refilled >= 0)
+        m_tokens = qMin(static_cast<double>(m_budget), m_tokens + (now - m_refilled) * m_budget / 1000.0);
+    m_refilled = now;
+
+    if (rows == 0)
+        return;
+
+    m_cursor %= rows;
+    for (int n = 0; n < rows; n++) {
+        int row = (m_cursor + n) % rows;
+        LifxBulb *bulb = bulbs[row];
+        quint8 flags = m_flags[row];
+
+        if (!(flags & HasDesired) || bulb == nullptr || bulb->waveformActive())
+            continue;
+
+        bool on = flags & DesiredOn;
+        bool powerKnown = bulb->powerConfirmed(0, ever) || bulb->powerConfirmed(65535, ever);
+        bool powerMatches = bulb->powerConfirmed(on ? 65535 : 0, ever);
+        bool colorMatches = bulb->confirmedAge() >= 0 && sameColor(bulb->confirmedColor(), m_color[row]);
+
+        if (powerMatches && (!on || colorMatches)) {
+            if (!(flags & Converged)) {
+                qint64 took = now - m_divergedSince[row];
+                m_flags[row] = (flags | Converged) & ~AwaitingPoll;
+                m_attempts[row] = 0;
+                m_missed[row] = 0;
+                m_verifyAt[row] = now + m_verifyInterval;
+                m_convergences++;
+                m_lastConvergence = took;
+                m_totalConvergence += took;
+                m_maxConvergence = qMax(m_maxConvergence, took);
+                converged.append(qMakePair(bulb, took));
+            }
+            else if (m_verifyInterval > 0 && now >= m_verifyAt[row]) {
+                if (m_tokens < 1) {
+                    m_cursor = row;
+                    return;
+                }
+                batch.refresh(bulb);
+                m_tokens -= 1;
+                m_packets++;
+                m_verifyAt[row] = now + m_verifyInterval;
+            }
+            continue;
+        }
+
+        if (flags & Converged) {
+            // Drifted since it converged, changed from somewhere else
+            m_flags[row] &= ~Converged;
+            m_divergedSince[row] = now;
+            m_nextAttempt[row] = now;
+            m_attempts[row] = 0;
+            m_missed[row] = 0;
+            m_sentAt[row] = -1;
+        }
+
+        if (now < m_nextAttempt[row])
+            continue;
+
+        bool answered = m_sentAt[row] < 0 || bulb->lastSeen() >= m_sentAt[row];
+
+        // The transition of the color sent is over, see where the bulb got to
+        if (flags & AwaitingPoll) {
+            if (m_tokens < 1) {
+                m_cursor = row;
+                return;
+            }
+            batch.refresh(bulb);
+            m_tokens -= 1;
+            m_packets++;
+            m_missed[row] = answered ? 0 : m_missed[row] + 1;
+            m_flags[row] &= ~AwaitingPoll;
+            m_sentAt[row] = now;
+            m_nextAttempt[row] = now + backoff(m_attempts[row]);
+            continue;
+        }
+
+        // Power changes get no reply, so follow with the color or a poll
+        int cost = (powerMatches ? 0 : 1) + 1;
+        if (m_tokens < cost) {
+            m_cursor = row;
+            return;
+        }
+
+        HSBK color(m_color[row].hue, m_color[row].saturation, m_color[row].brightness, m_color[row].kelvin);
+        bool wasOff = powerKnown && !bulb->powerConfirmed(65535, ever);
+        uint32_t duration = wasOff ? 0 : m_duration[row];
+        if (on && !colorMatches)
+            batch.setColor(bulb, color, duration);
+        if (!powerMatches)
+            batch.setPower(bulb, on);
+        if (!on || colorMatches)
+            batch.refresh(bulb);
+
+        m_tokens -= cost;
+        m_packets += cost;
+        m_missed[row] = answered ? 0 : m_missed[row] + 1;
+        m_sentAt[row] = now;
+        m_attempts[row]++;
+        if (on && !colorMatches) {
+            m_flags[row] |= AwaitingPoll;
+            m_nextAttempt[row] = now + qMax<qint64>(duration, ATTEMPT_TIMEOUT);
+        }
+        else {
+            m_nextAttempt[row] = now + backoff(m_attempts[row]);
+        }
+    }
+    m_cursor = (m_cursor + 1) % rows;
+}
+
+/**
+ * \fn LifxReconcileStats LifxReconciler::stats() const
+ * \return Counts of where the rows are, and how long convergence takes
+ */
+LifxReconcileStats LifxReconciler::stats() const
+{
+    LifxReconcileStats stats;
+
+    for (int row = 0; row < m_flags.size(); row++) {
+        if (!(m_flags[row] & HasDesired))
+            continue;
+
+        stats.desired++;
+        if (m_flags[row] & Converged)
+            stats.converged++;
+        else if (m_missed[row] >= OFFLINE_ATTEMPTS)
+            stats.offline++;
+        else
+            stats.diverged++;
+    }
+
+    stats.packets = m_packets;
+    stats.convergences = m_convergences;
+    stats.lastConvergence = m_lastConvergence;
+    stats.meanConvergence = m_convergences ? m_totalConvergence / static_cast<qint64>(m_convergences) : 0;
+    stats.maxConvergence = m_maxConvergence;
+    return stats;
+}
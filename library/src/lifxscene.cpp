@@ -0,0 +1,198 @@
+/*
+ * A named set of bulb and group states
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxscene.h"
+
+/*
+ * Each entry starts with its kind, followed by the target or the group
+ * UUID, then h, s, b, k, power and duration.
+ */
+static constexpr quint8 ENTRY_BULB = 0;
+static constexpr quint8 ENTRY_GROUP = 1;
+
+/**
+ * \fn LifxScene::LifxScene(const QString &name)
+ * \param name The scene name
+ */
+LifxScene::LifxScene(const QString &name) : m_name(name)
+{
+}
+
+/**
+ * \fn void LifxScene::setBulb(uint64_t target, const HSBK &color, bool on, uint32_t duration)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param color The color for the bulb
+ * \param on True if the bulb should be on
+ * \param duration The uint32_t value in millis to slow the transition down
+ *
+ * Replaces any earlier entry for the same bulb.
+ */
+void LifxScene::setBulb(uint64_t target, const HSBK &color, bool on, uint32_t duration)
+{
+    LifxSceneEntry entry;
+
+    entry.target = target;
+    entry.color = color;
+    entry.on = on;
+    entry.duration = duration;
+    setEntry(entry);
+}
+
+/**
+ * \fn void LifxScene::setBulb(LifxBulb *bulb, const HSBK &color, bool on, uint32_t duration)
+ * \param bulb The bulb
+ * \param color The color for the bulb
+ * \param on True if the bulb should be on
+ * \param duration The uint32_t value in millis to slow the transition down
+ */
+void LifxScene::setBulb(LifxBulb *bulb, const HSBK &color, bool on, uint32_t duration)
+{
+    if (bulb)
+        setBulb(bulb->targetAsLong(), color, on, duration);
+    else
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb pointer";
+}
+
+/**
+ * \fn void LifxScene::setGroup(const QByteArray &uuid, const HSBK &color, bool on, uint32_t duration)
+ * \param uuid The group UUID
+ * \param color The color for every bulb in the group
+ * \param on True if the bulbs should be on
+ * \param duration The uint32_t value in millis to slow the transition down
+ *
+ * Replaces any earlier entry for the same group.
+ */
+void LifxScene::setGroup(const QByteArray &uuid, const HSBK &color, bool on, uint32_t duration)
+{
+    LifxSceneEntry entry;
+
+    entry.group = uuid;
+    entry.color = color;
+    entry.on = on;
+    entry.duration = duration;
+    setEntry(entry);
+}
+
+void LifxScene::setEntry(const LifxSceneEntry &entry)
+{
+    for (auto &existing : m_entries) {
+        if (existing.target == entry.target && existing.group == entry.group) {
+            existing = entry;
+            return;
+        }
+    }
+    m_entries.append(entry);
+}
+
+/**
+ * \fn QByteArray LifxScene::toBinary() const
+ * \return The scene in the compact binary form, see fromBinary()
+ */
+QByteArray LifxScene::toBinary() const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream << MAGIC << VERSION << m_name.toUtf8() << static_cast<quint32>(m_entries.size());
+
+    for (const auto &entry : m_entries) {
+        if (entry.group.isEmpty())
+            stream << ENTRY_BULB << static_cast<quint64>(entry.target);
+        else
+            stream << ENTRY_GROUP << entry.group;
+
+        stream << entry.color.h() << entry.color.s() << entry.color.b() << entry.color.k();
+        stream << static_cast<quint8>(entry.on) << static_cast<quint32>(entry.duration);
+    }
+    return data;
+}
+
+/**
+ * \fn LifxScene LifxScene::fromBinary(const QByteArray &data, bool *ok)
+ * \param data A scene from toBinary()
+ * \param ok If not null, set to false if data isn't a scene this version can read
+ * \return The scene, empty if data couldn't be read
+ */
+LifxScene LifxScene::fromBinary(const QByteArray &data, bool *ok)
+{
+    QDataStream stream(data);
+    LifxScene scene;
+    quint32 magic = 0;
+    quint8 version = 0;
+    QByteArray name;
+    quint32 count = 0;
+
+    if (ok)
+        *ok = false;
+
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream >> magic >> version >> name >> count;
+    if (stream.status() != QDataStream::Ok || magic != MAGIC || version != VERSION) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Not a scene, or a newer version";
+        return LifxScene();
+    }
+
+    scene.setName(QString::fromUtf8(name));
+    for (quint32 i = 0; i < count; i++) {
+        LifxSceneEntry entry;
+        quint8 kind = 0;
+        quint16 h = 0, s = 0, b = 0, k = 0;
+        quint8 on = 0;
+        quint32 duration = 0;
+
+        stream >> kind;
+        if (kind == ENTRY_BULB) {
+            quint64 target = 0;
+            stream >> target;
+            entry.target = target;
+        }
+        else {
+            stream >> entry.group;
+        }
+        stream >> h >> s >> b >> k >> on >> duration;
+
+        if (stream.status() != QDataStream::Ok || kind > ENTRY_GROUP) {
+            qWarning() << __PRETTY_FUNCTION__ << ": Scene data is truncated or corrupt at entry" << i;
+            return LifxScene();
+        }
+
+        entry.color = HSBK(h, s, b, k);
+        entry.on = on != 0;
+        entry.duration = duration;
+        scene.m_entries.append(entry);
+    }
+
+    if (ok)
+        *ok = true;
+    return scene;
+}
+
+/**
+ * \fn QDebug operator<<(QDebug debug, const LifxScene &scene)
+ * \brief Pretty print the LifxScene object
+ *
+ * For use with qDebug() only
+ */
+QDebug operator<<(QDebug debug, const LifxScene &scene)
+{
+    QDebugStateSaver saver(debug);
+    debug.nospace().noquote() << "Scene: " << scene.name() << " entries: " << scene.size();
+    return debug;
+}
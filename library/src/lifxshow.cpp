@@ -0,0 +1,156 @@
+/*
+ * Timed frames of bulb changes for the show player
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxshow.h"
+
+#include <algorithm>
+
+/**
+ * \fn int LifxShowSource::findFrame(qint64 msecs) const
+ * \param msecs Millis from the start of the show
+ * \return The first frame at or after msecs, frameCount() if there is none
+ *
+ * A binary search over frameTime(), sources with an index of their own
+ * can do better.
+ */
+int LifxShowSource::findFrame(qint64 msecs) const
+{
+    int low = 0;
+    int high = frameCount();
+
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (frameTime(middle) < msecs)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+LifxShow::LifxShow()
+{
+}
+
+/**
+ * \fn int LifxShow::addBulb(uint64_t target)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \return The index of the bulb in bulbs(), the existing one if it was already added
+ */
+int LifxShow::addBulb(uint64_t target)
+{
+    auto it = m_bulbIndex.constFind(target);
+
+    if (it != m_bulbIndex.constEnd())
+        return it.value();
+
+    m_bulbs.append(target);
+    m_bulbIndex.insert(target, m_bulbs.size() - 1);
+    return m_bulbs.size() - 1;
+}
+
+/*
+ * Finds or makes the record for bulb in the frame at msecs, making the
+ * frame too if needed.
+ */
+LifxShowRecord& LifxShow::record(qint64 msecs, int bulb)
+{
+    auto at = std::lower_bound(m_times.begin(), m_times.end(), msecs);
+    int frame = static_cast<int>(at - m_times.begin());
+
+    if (at == m_times.end() || *at != msecs) {
+        m_times.insert(frame, msecs);
+        m_frames.insert(frame, QVector<LifxShowRecord>());
+    }
+
+    QVector<LifxShowRecord> &records = m_frames[frame];
+    for (auto &record : records) {
+        if (record.bulb == bulb)
+            return record;
+    }
+
+    LifxShowRecord record;
+    memset(&record, 0, sizeof(record));
+    record.bulb = static_cast<quint16>(bulb);
+    records.append(record);
+    return records.last();
+}
+
+/**
+ * \fn void LifxShow::setColor(qint64 msecs, uint64_t target, const HSBK &color, uint32_t duration)
+ * \param msecs Millis from the start of the show
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param color The color to send
+ * \param duration The uint32_t value in millis for the bulb to fade over
+ */
+void LifxShow::setColor(qint64 msecs, uint64_t target, const HSBK &color, uint32_t duration)
+{
+    LifxShowRecord &entry = record(msecs, addBulb(target));
+
+    entry.flags |= LifxShowRecord::Color;
+    entry.color.hue = color.h();
+    entry.color.saturation = color.s();
+    entry.color.brightness = color.b();
+    entry.color.kelvin = color.k();
+    entry.duration = duration;
+}
+
+/**
+ * \fn void LifxShow::setPower(qint64 msecs, uint64_t target, bool on)
+ * \param msecs Millis from the start of the show
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param on True to turn the bulb on, false for off
+ */
+void LifxShow::setPower(qint64 msecs, uint64_t target, bool on)
+{
+    LifxShowRecord &entry = record(msecs, addBulb(target));
+
+    entry.flags |= LifxShowRecord::Power;
+    if (on)
+        entry.flags |= LifxShowRecord::On;
+    else
+        entry.flags &= ~LifxShowRecord::On;
+}
+
+/**
+ * \fn void LifxShow::clear()
+ *
+ * Removes every frame and bulb.
+ */
+void LifxShow::clear()
+{
+    m_bulbs.clear();
+    m_bulbIndex.clear();
+    m_times.clear();
+    m_frames.clear();
+}
+
+/**
+ * \fn int LifxShow::readFrame(int frame, LifxShowRecord *records)
+ * \param frame The frame to read
+ * \param records Gets the records, room for bulbs().size()
+ * \return The number of records
+ */
+int LifxShow::readFrame(int frame, LifxShowRecord *records)
+{
+    const QVector<LifxShowRecord> &source = m_frames[frame];
+
+    memcpy(records, source.constData(), source.size() * sizeof(LifxShowRecord));
+    return source.size();
+}
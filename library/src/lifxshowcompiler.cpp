@@ -0,0 +1,546 @@
+/*
+ * Compiles designer cue lists into show files
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxshowcompiler.h"
+#include "lifxmanager.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+LifxShowCompiler::LifxShowCompiler() : m_rateLimit(20), m_frameBudget(0), m_resolution(10), m_tolerance(512)
+{
+}
+
+/**
+ * \fn void LifxShowCompiler::addBulb(uint64_t target, const QString &label, const QString &group)
+ * \param target 64bit integer which has an encoded version of the MAC address
+ * \param label The bulb label cues may use
+ * \param group The group name cues may use, can be empty
+ */
+void LifxShowCompiler::addBulb(uint64_t target, const QString &label, const QString &group)
+{
+    if (m_byTarget.contains(target))
+        return;
+
+    int bulb = m_targets.size();
+    m_targets.append(target);
+    m_labels.append(label);
+    m_byTarget.insert(target, bulb);
+    if (!label.isEmpty())
+        m_byLabel.insert(label.toLower(), bulb);
+    if (!group.isEmpty())
+        m_byGroup.insert(group.toLower(), bulb);
+}
+
+/**
+ * \fn bool LifxShowCompiler::loadFleetCache(const QString &path)
+ * \param path A file from saveFleetCache()
+ * \return False if the file can't be read
+ *
+ * The file is {"bulbs": [{"mac": "d0:73:d5:01:02:03", "label": "Porch",
+ * "group": "Outside"}, ...]}, so it can be written by hand too.
+ */
+bool LifxShowCompiler::loadFleetCache(const QString &path)
+{
+    QFile file(path);
+    QJsonParseError error;
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to open" << path << ":" << file.errorString();
+        return false;
+    }
+
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (doc.isNull() || !doc.isObject()) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "is not a fleet cache:" << error.errorString();
+        return false;
+    }
+
+    QJsonArray bulbs = doc.object().value("bulbs").toArray();
+    for (int i = 0; i < bulbs.size(); i++) {
+        QJsonObject bulb = bulbs.at(i).toObject();
+        bool ok;
+        uint64_t target = LifxBulb::macToTarget(bulb.value("mac").toString(), &ok);
+
+        if (!ok) {
+            qWarning() << __PRETTY_FUNCTION__ << ":" << path << "entry" << i << "has no usable mac";
+            continue;
+        }
+        addBulb(target, bulb.value("label").toString(), bulb.value("group").toString());
+    }
+    return true;
+}
+
+/**
+ * \fn bool LifxShowCompiler::saveFleetCache(LifxManager *manager, const QString &path)
+ * \param manager A manager which has discovered the bulbs the show uses
+ * \param path The file to write
+ * \return False if the file can't be written
+ */
+bool LifxShowCompiler::saveFleetCache(LifxManager *manager, const QString &path)
+{
+    QFile file(path);
+    QJsonArray bulbs;
+
+    if (manager == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null manager";
+        return false;
+    }
+
+    for (auto bulb : manager->allBulbs()) {
+        QJsonObject entry;
+        entry.insert("mac", LifxBulb::targetToMac(bulb->targetAsLong()));
+        entry.insert("label", bulb->label());
+        entry.insert("group", bulb->group());
+        bulbs.append(entry);
+    }
+
+    QJsonObject cache;
+    cache.insert("bulbs", bulbs);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(QJsonDocument(cache).toJson()) < 0) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to write" << path << ":" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+void LifxShowCompiler::issue(LifxShowIssue::Kind kind, int line, qint64 time, const QString &message)
+{
+    LifxShowIssue entry;
+
+    entry.kind = kind;
+    entry.line = line;
+    entry.time = time;
+    entry.message = message;
+    m_issues.append(entry);
+}
+
+/*
+ * A color is a name from HSBK::colors(), optionally @ a brightness
+ * percentage, or h:s:b:k as 16 bit values.
+ */
+bool LifxShowCompiler::parseColor(const QString &text, HSBK &color) const
+{
+    QStringList fields = text.trimmed().split(':');
+
+    if (fields.size() == 4) {
+        uint16_t values[4];
+        for (int i = 0; i < 4; i++) {
+            bool ok;
+            uint value = fields[i].trimmed().toUInt(&ok);
+            if (!ok || value > 65535)
+                return false;
+            values[i] = static_cast<uint16_t>(value);
+        }
+        color = HSBK(values[0], values[1], values[2], values[3]);
+        return true;
+    }
+
+    QStringList named = text.trimmed().split('@');
+    if (named.size() > 2 || !HSBK::colors().contains(named[0].trimmed(), Qt::CaseInsensitive))
+        return false;
+
+    HSBK base(named[0].trimmed());
+    uint16_t brightness = base.b();
+    if (named.size() == 2) {
+        bool ok;
+        float percent = named[1].trimmed().remove('%').toFloat(&ok);
+        if (!ok || percent < 0 || percent > 100)
+            return false;
+        brightness = static_cast<uint16_t>(qRound(percent * 655.35f));
+    }
+    color = HSBK(base.h(), base.s(), brightness, base.k());
+    return true;
+}
+
+/*
+ * Lines are time,target,color,fade,power with the times in seconds.
+ * Color and power may be empty, fade and power may be left off. Blank
+ * lines, # comments and a header line are skipped.
+ */
+bool LifxShowCompiler::parseCsv(QFile &file)
+{
+    int line = 0;
+
+    while (!file.atEnd()) {
+        QString text = QString::fromUtf8(file.readLine()).trimmed();
+        line++;
+
+        if (text.isEmpty() || text.startsWith("#"))
+            continue;
+
+        QStringList fields = text.split(',');
+        LifxCue cue;
+        bool ok;
+        double seconds = fields[0].trimmed().toDouble(&ok);
+
+        if (!ok && line == 1)
+            continue;
+
+        cue.line = line;
+        if (!ok || seconds < 0 || fields.size() < 3) {
+            issue(LifxShowIssue::Unresolved, line, 0, QString("Line %1 needs a time, target and color").arg(line));
+            continue;
+        }
+
+        cue.time = qRound64(seconds * 1000);
+        cue.target = fields[1].trimmed();
+        if (!fields[2].trimmed().isEmpty()) {
+            cue.hasColor = parseColor(fields[2], cue.color);
+            if (!cue.hasColor) {
+                issue(LifxShowIssue::Unresolved, line, cue.time, QString("Unknown color \"%1\"").arg(fields[2].trimmed()));
+                continue;
+            }
+        }
+        if (fields.size() > 3 && !fields[3].trimmed().isEmpty())
+            cue.fade = static_cast<uint32_t>(qMax<qint64>(qRound64(fields[3].trimmed().toDouble() * 1000), 0));
+        if (fields.size() > 4 && !fields[4].trimmed().isEmpty()) {
+            QString power = fields[4].trimmed().toLower();
+            if (power == "on" || power == "1")
+                cue.power = 1;
+            else if (power == "off" || power == "0")
+                cue.power = 0;
+            else {
+                issue(LifxShowIssue::Unresolved, line, cue.time, QString("Power must be on or off, not \"%1\"").arg(power));
+                continue;
+            }
+        }
+        m_cues.append(cue);
+    }
+    return true;
+}
+
+/*
+ * An array of {"time", "target", "color" or "hsbk": [h, s, b, k],
+ * "fade", "power"}, times in seconds, either bare or as "cues" in an
+ * object.
+ */
+bool LifxShowCompiler::parseJson(const QByteArray &data)
+{
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+
+    if (doc.isNull()) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Not a cue list:" << error.errorString();
+        return false;
+    }
+
+    QJsonArray cues = doc.isArray() ? doc.array() : doc.object().value("cues").toArray();
+    for (int i = 0; i < cues.size(); i++) {
+        QJsonObject entry = cues.at(i).toObject();
+        LifxCue cue;
+
+        cue.line = i + 1;
+        cue.time = qRound64(entry.value("time").toDouble(-1) * 1000);
+        cue.target = entry.value("target").toString();
+        if (cue.time < 0 || cue.target.isEmpty()) {
+            issue(LifxShowIssue::Unresolved, cue.line, 0, QString("Cue %1 needs a time and target").arg(cue.line));
+            continue;
+        }
+
+        if (entry.contains("hsbk")) {
+            QJsonArray hsbk = entry.value("hsbk").toArray();
+            cue.hasColor = hsbk.size() == 4;
+            if (cue.hasColor)
+                cue.color = HSBK(hsbk.at(0).toInt(), hsbk.at(1).toInt(), hsbk.at(2).toInt(), hsbk.at(3).toInt());
+        }
+        else if (entry.contains("color")) {
+            cue.hasColor = parseColor(entry.value("color").toString(), cue.color);
+        }
+        if ((entry.contains("hsbk") || entry.contains("color")) && !cue.hasColor) {
+            issue(LifxShowIssue::Unresolved, cue.line, cue.time, QString("Cue %1 has an unknown color").arg(cue.line));
+            continue;
+        }
+
+        cue.fade = static_cast<uint32_t>(qMax<qint64>(qRound64(entry.value("fade").toDouble() * 1000), 0));
+        if (entry.contains("power"))
+            cue.power = entry.value("power").toBool() ? 1 : 0;
+        m_cues.append(cue);
+    }
+    return true;
+}
+
+/**
+ * \fn bool LifxShowCompiler::loadCues(const QString &path)
+ * \param path A .json or .csv cue list
+ * \return False if the file can't be read at all
+ *
+ * Cues that can't be read are reported in issues() and left out, the
+ * rest are added to any already loaded.
+ */
+bool LifxShowCompiler::loadCues(const QString &path)
+{
+    QFile file(path);
+    bool result;
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to open" << path << ":" << file.errorString();
+        return false;
+    }
+
+    m_issues = m_loadIssues;
+    if (QFileInfo(path).suffix().toLower() == "json")
+        result = parseJson(file.readAll());
+    else
+        result = parseCsv(file);
+    m_loadIssues = m_issues;
+    return result;
+}
+
+/*
+ * Target names are matched group first, then label, then MAC, all
+ * without case.
+ */
+QVector<int> LifxShowCompiler::resolve(const QString &target) const
+{
+    QString key = target.trimmed().toLower();
+    QVector<int> bulbs;
+
+    if (key == "*") {
+        for (int i = 0; i < m_targets.size(); i++)
+            bulbs.append(i);
+        return bulbs;
+    }
+
+    bulbs = m_byGroup.values(key).toVector();
+    if (bulbs.isEmpty())
+        bulbs = m_byLabel.values(key).toVector();
+    if (bulbs.isEmpty()) {
+        bool ok;
+        uint64_t mac = LifxBulb::macToTarget(key, &ok);
+        if (ok && m_byTarget.contains(mac))
+            bulbs.append(m_byTarget.value(mac));
+    }
+    return bulbs;
+}
+
+/*
+ * True if at sits within the tolerance of the point fraction of the
+ * way from one color to another. Hue goes the short way round, like
+ * the bulb fades it.
+ */
+bool LifxShowCompiler::onLine(const lx_hsbk_t &from, const lx_hsbk_t &to, const lx_hsbk_t &at, double fraction) const
+{
+    const uint16_t begin[4] = { from.hue, from.saturation, from.brightness, from.kelvin };
+    const uint16_t end[4] = { to.hue, to.saturation, to.brightness, to.kelvin };
+    const uint16_t actual[4] = { at.hue, at.saturation, at.brightness, at.kelvin };
+
+    for (int i = 0; i < 4; i++) {
+        int span = i == 0 ? static_cast<int16_t>(static_cast<uint16_t>(end[i] - begin[i])) : end[i] - begin[i];
+        int expected = begin[i] + static_cast<int>(std::lround(span * fraction));
+        int error = i == 0 ? static_cast<int16_t>(static_cast<uint16_t>(actual[i] - expected)) : actual[i] - expected;
+
+        if (qAbs(error) > m_tolerance)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Folds runs of color steps on a straight line into one fade. A step
+ * with no fade of its own counts as arriving when the next one starts,
+ * which is what a fade drawn as a staircase of cues means. A run must
+ * start from a known color, the end of a fade that finished, and can't
+ * include power changes or overlapping fades.
+ */
+void LifxShowCompiler::foldFades(QVector<Change> &changes)
+{
+    int out = 0;
+    int count = changes.size();
+
+    auto arrival = [&changes](int k, int last) {
+        qint64 gap = k < last ? changes[k + 1].time - changes[k].time : (k > 0 ? changes[k].time - changes[k - 1].time : 0);
+        return changes[k].time + qMax<qint64>(changes[k].fade, gap);
+    };
+
+    for (int i = 0; i < count; ) {
+        Change start = changes[i];
+        int end = i;
+
+        if (out > 0 && start.color && start.power < 0) {
+            const Change &before = changes[out - 1];
+            bool anchored = before.color && before.time + before.fade <= start.time;
+
+            for (int j = i + 1; anchored && j < count; j++) {
+                const Change &next = changes[j];
+                if (!next.color || next.power >= 0 || changes[j - 1].time + changes[j - 1].fade > next.time)
+                    break;
+
+                qint64 span = arrival(j, j) - start.time;
+                bool fits = span > 0;
+                for (int k = i; fits && k < j; k++)
+                    fits = onLine(before.hsbk, next.hsbk, changes[k].hsbk, static_cast<double>(arrival(k, j) - start.time) / span);
+                if (!fits)
+                    break;
+                end = j;
+            }
+        }
+
+        if (end > i) {
+            start.hsbk = changes[end].hsbk;
+            qint64 finish = arrival(end, end);
+            if (end + 1 < count)
+                finish = qMin(finish, changes[end + 1].time);
+            start.fade = static_cast<uint32_t>(finish - start.time);
+            m_stats.faded += end - i;
+        }
+        changes[out++] = start;
+        i = end + 1;
+    }
+    changes.resize(out);
+}
+
+/*
+ * Spaces a bulb's changes so it never gets more than the rate limit.
+ * A change that comes too soon is moved to when the bulb is free,
+ * shortening its fade so it still ends on time. If the next change is
+ * due by then, this one is dropped and its power carried forward.
+ */
+void LifxShowCompiler::limitRate(int bulb, QVector<Change> &changes)
+{
+    if (m_rateLimit <= 0)
+        return;
+
+    double interval = 1000.0 / m_rateLimit;
+    qint64 free = std::numeric_limits<qint64>::min();
+    int out = 0;
+
+    for (int i = 0; i < changes.size(); i++) {
+        Change change = changes[i];
+        int cost = (change.color ? 1 : 0) + (change.power >= 0 ? 1 : 0);
+
+        if (change.time < free) {
+            qint64 moved = (free + m_resolution - 1) / m_resolution * m_resolution;
+
+            if (i + 1 < changes.size() && changes[i + 1].time <= moved) {
+                if (change.power >= 0 && changes[i + 1].power < 0)
+                    changes[i + 1].power = change.power;
+                m_stats.dropped++;
+                issue(LifxShowIssue::Dropped, change.line, change.time,
+                      QString("%1 at %2s is dropped, the rate limit leaves no room before the next change").arg(m_labels[bulb]).arg(change.time / 1000.0));
+                continue;
+            }
+
+            qint64 end = change.time + change.fade;
+            m_stats.postponed++;
+            issue(LifxShowIssue::Postponed, change.line, change.time,
+                  QString("%1 at %2s is moved %3 ms later by the rate limit").arg(m_labels[bulb]).arg(change.time / 1000.0).arg(moved - change.time));
+            change.time = moved;
+            change.fade = static_cast<uint32_t>(qMax<qint64>(end - moved, 0));
+        }
+
+        free = change.time + static_cast<qint64>(std::ceil(cost * interval));
+        changes[out++] = change;
+    }
+    changes.resize(out);
+}
+
+/**
+ * \fn bool LifxShowCompiler::compile(LifxShow &show)
+ * \param show Gets the compiled show, anything in it already is cleared
+ * \return False if nothing could be compiled
+ */
+bool LifxShowCompiler::compile(LifxShow &show)
+{
+    QVector<QVector<Change>> changes(m_targets.size());
+
+    m_issues = m_loadIssues;
+    m_stats = LifxShowCompileStats();
+    m_stats.cues = m_cues.size() + m_loadIssues.size();
+    m_stats.unresolved = m_loadIssues.size();
+    show.clear();
+
+    for (const auto &cue : m_cues) {
+        QVector<int> bulbs = resolve(cue.target);
+        Change change;
+
+        if (bulbs.isEmpty()) {
+            m_stats.unresolved++;
+            issue(LifxShowIssue::Unresolved, cue.line, cue.time, QString("\"%1\" is not a group, label or MAC in the fleet cache").arg(cue.target));
+            continue;
+        }
+        if (!cue.hasColor && cue.power < 0)
+            continue;
+
+        change.time = (cue.time + m_resolution / 2) / m_resolution * m_resolution;
+        change.color = cue.hasColor;
+        change.hsbk.hue = cue.color.h();
+        change.hsbk.saturation = cue.color.s();
+        change.hsbk.brightness = cue.color.b();
+        change.hsbk.kelvin = cue.color.k();
+        change.fade = cue.fade;
+        change.power = cue.power;
+        change.line = cue.line;
+        for (int bulb : bulbs)
+            changes[bulb].append(change);
+    }
+
+    QMap<qint64, int> frames;
+    for (int bulb = 0; bulb < changes.size(); bulb++) {
+        QVector<Change> &list = changes[bulb];
+
+        // Later cues win when two land on the same time
+        std::stable_sort(list.begin(), list.end(), [](const Change &a, const Change &b) { return a.time < b.time; });
+        int out = 0;
+        for (int i = 0; i < list.size(); i++) {
+            if (out > 0 && list[out - 1].time == list[i].time) {
+                Change &merged = list[out - 1];
+                if (list[i].color) {
+                    merged.color = true;
+                    merged.hsbk = list[i].hsbk;
+                    merged.fade = list[i].fade;
+                }
+                if (list[i].power >= 0)
+                    merged.power = list[i].power;
+                merged.line = list[i].line;
+            }
+            else {
+                list[out++] = list[i];
+            }
+        }
+        list.resize(out);
+        m_stats.changes += out;
+
+        foldFades(list);
+        limitRate(bulb, list);
+
+        for (const auto &change : list) {
+            if (change.color) {
+                show.setColor(change.time, m_targets[bulb], HSBK(change.hsbk.hue, change.hsbk.saturation, change.hsbk.brightness, change.hsbk.kelvin), change.fade);
+                frames[change.time]++;
+            }
+            if (change.power >= 0) {
+                show.setPower(change.time, m_targets[bulb], change.power == 1);
+                frames[change.time]++;
+            }
+        }
+    }
+
+    for (auto it = frames.constBegin(); it != frames.constEnd(); ++it) {
+        m_stats.messages += it.value();
+        if (m_frameBudget > 0 && it.value() > m_frameBudget) {
+            m_stats.overBudget++;
+            issue(LifxShowIssue::OverBudget, 0, it.key(), QString("Frame at %1s sends %2 messages, the budget is %3").arg(it.key() / 1000.0).arg(it.value()).arg(m_frameBudget));
+        }
+    }
+    m_stats.frames = show.frameCount();
+
+    return show.frameCount() > 0;
+}
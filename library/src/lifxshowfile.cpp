@@ -0,0 +1,510 @@
+/*
+ * Pre-rendered shows in a memory mapped file
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxshowfile.h"
+
+#include <algorithm>
+
+#ifdef Q_OS_LINUX
+#include <sys/mman.h>
+#endif
+
+/*
+ * Header field offsets
+ */
+static constexpr int H_MAGIC = 0;
+static constexpr int H_VERSION = 4;
+static constexpr int H_BULBS = 8;
+static constexpr int H_FRAMES = 12;
+static constexpr int H_KEYFRAMES = 16;
+static constexpr int H_INTERVAL = 20;
+static constexpr int H_DATA = 24;
+static constexpr int H_DATA_SIZE = 32;
+static constexpr int H_FRAME_TABLE = 40;
+static constexpr int H_KEYFRAME_INDEX = 48;
+static constexpr int H_STATES = 56;
+
+/*
+ * Tag bits above the LifxShowRecord flags
+ */
+static constexpr quint8 TAG_FLAGS = 0x07;
+static constexpr quint8 TAG_HUE = 0x08;
+static constexpr quint8 TAG_SATURATION = 0x10;
+static constexpr quint8 TAG_BRIGHTNESS = 0x20;
+static constexpr quint8 TAG_KELVIN = 0x40;
+static constexpr quint8 TAG_DURATION = 0x80;
+
+static void appendVarint(QByteArray &out, quint32 value)
+{
+    while (value >= 0x80) {
+        out.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+static bool readVarint(const uchar *&data, const uchar *end, quint32 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && data < end; shift += 7) {
+        uchar byte = *data++;
+        value |= static_cast<quint32>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Colors wrap at 16 bits, so the delta is taken as a signed 16 bit
+ * number and zigzagged to keep small steps either way in one byte
+ */
+static void appendDelta(QByteArray &out, uint16_t from, uint16_t to)
+{
+    int32_t delta = static_cast<int16_t>(static_cast<uint16_t>(to - from));
+    appendVarint(out, (static_cast<quint32>(delta) << 1) ^ static_cast<quint32>(delta >> 31));
+}
+
+static bool readDelta(const uchar *&data, const uchar *end, uint16_t &value)
+{
+    quint32 zigzag;
+
+    if (!readVarint(data, end, zigzag))
+        return false;
+
+    int32_t delta = static_cast<int32_t>(zigzag >> 1) ^ -static_cast<int32_t>(zigzag & 1);
+    value = static_cast<uint16_t>(value + delta);
+    return true;
+}
+
+template<typename T> static void appendLittleEndian(QByteArray &out, T value)
+{
+    char bytes[sizeof(T)];
+
+    qToLittleEndian<T>(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+LifxShowFile::LifxShowFile() :
+    m_data(nullptr), m_size(0), m_frameCount(0), m_keyframeCount(0), m_keyframeInterval(0),
+    m_frames(nullptr), m_keyframes(nullptr), m_states(nullptr), m_records(nullptr),
+    m_recordsSize(0), m_next(-1)
+{
+}
+
+LifxShowFile::~LifxShowFile()
+{
+    close();
+}
+
+/**
+ * \fn bool LifxShowFile::open(const QString &path)
+ * \param path A file from write()
+ * \return False if the file can't be mapped, or isn't a show this version can play
+ *
+ * Every table is checked here, so a damaged file fails to open instead
+ * of misbehaving during playback.
+ */
+bool LifxShowFile::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to open" << path << ":" << m_file.errorString();
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size < HEADER_SIZE || (m_data = m_file.map(0, m_size)) == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "is too short or can't be mapped";
+        close();
+        return false;
+    }
+
+    quint32 bulbs = qFromLittleEndian<quint32>(m_data + H_BULBS);
+    quint32 frames = qFromLittleEndian<quint32>(m_data + H_FRAMES);
+    quint32 keyframes = qFromLittleEndian<quint32>(m_data + H_KEYFRAMES);
+    quint64 data = qFromLittleEndian<quint64>(m_data + H_DATA);
+    quint64 dataSize = qFromLittleEndian<quint64>(m_data + H_DATA_SIZE);
+    quint64 frameTable = qFromLittleEndian<quint64>(m_data + H_FRAME_TABLE);
+    quint64 keyframeIndex = qFromLittleEndian<quint64>(m_data + H_KEYFRAME_INDEX);
+    quint64 states = qFromLittleEndian<quint64>(m_data + H_STATES);
+    quint64 size = static_cast<quint64>(m_size);
+
+    auto fits = [size](quint64 offset, quint64 length) { return offset <= size && length <= size - offset; };
+
+    if (qFromLittleEndian<quint32>(m_data + H_MAGIC) != MAGIC || qFromLittleEndian<quint16>(m_data + H_VERSION) != VERSION) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "is not a show, or a newer version";
+        close();
+        return false;
+    }
+    if (bulbs > MAX_BULBS || frames > 0x7fffffff || keyframes > frames || (frames && keyframes == 0) ||
+            !fits(HEADER_SIZE, static_cast<quint64>(bulbs) * 8) || !fits(data, dataSize) ||
+            !fits(frameTable, static_cast<quint64>(frames) * FRAME_ENTRY_SIZE) ||
+            !fits(keyframeIndex, static_cast<quint64>(keyframes) * 4) ||
+            !fits(states, static_cast<quint64>(keyframes) * bulbs * STATE_SIZE)) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << path << "has a section past the end of the file";
+        close();
+        return false;
+    }
+
+    m_frameCount = static_cast<int>(frames);
+    m_keyframeCount = static_cast<int>(keyframes);
+    m_keyframeInterval = static_cast<int>(qFromLittleEndian<quint32>(m_data + H_INTERVAL));
+    m_records = m_data + data;
+    m_recordsSize = static_cast<qint64>(dataSize);
+    m_frames = m_data + frameTable;
+    m_keyframes = m_data + keyframeIndex;
+    m_states = m_data + states;
+
+    quint64 lastOffset = 0;
+    quint32 lastTime = 0;
+    for (int i = 0; i < m_frameCount; i++) {
+        const uchar *entry = m_frames + i * FRAME_ENTRY_SIZE;
+        quint64 offset = qFromLittleEndian<quint64>(entry);
+        quint32 time = qFromLittleEndian<quint32>(entry + 8);
+
+        if (offset < lastOffset || offset > dataSize || time < lastTime || qFromLittleEndian<quint16>(entry + 12) > bulbs) {
+            qWarning() << __PRETTY_FUNCTION__ << ":" << path << "has a bad frame table at frame" << i;
+            close();
+            return false;
+        }
+        lastOffset = offset;
+        lastTime = time;
+    }
+    for (int i = 0; i < m_keyframeCount; i++) {
+        quint32 frame = qFromLittleEndian<quint32>(m_keyframes + i * 4);
+        if (frame >= frames || (i == 0 && frame != 0) || (i > 0 && frame <= qFromLittleEndian<quint32>(m_keyframes + (i - 1) * 4))) {
+            qWarning() << __PRETTY_FUNCTION__ << ":" << path << "has a bad keyframe index at" << i;
+            close();
+            return false;
+        }
+    }
+
+    m_bulbs.resize(bulbs);
+    for (quint32 i = 0; i < bulbs; i++)
+        m_bulbs[i] = qFromLittleEndian<quint64>(m_data + HEADER_SIZE + i * 8);
+    m_color.resize(bulbs);
+    m_duration.resize(bulbs);
+    m_next = -1;
+
+#ifdef Q_OS_LINUX
+    // Playback walks the frame data front to back, let the kernel read ahead and drop behind
+    posix_madvise(const_cast<uchar*>(m_data), m_size, POSIX_MADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+/**
+ * \fn void LifxShowFile::close()
+ *
+ * Unmaps the show, it must not be playing.
+ */
+void LifxShowFile::close()
+{
+    if (m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+    if (m_file.isOpen())
+        m_file.close();
+
+    m_data = nullptr;
+    m_size = 0;
+    m_frameCount = 0;
+    m_keyframeCount = 0;
+    m_keyframeInterval = 0;
+    m_frames = m_keyframes = m_states = m_records = nullptr;
+    m_recordsSize = 0;
+    m_bulbs.clear();
+    m_color.clear();
+    m_duration.clear();
+    m_next = -1;
+}
+
+/**
+ * \fn qint64 LifxShowFile::frameTime(int frame) const
+ * \param frame The frame to look at
+ * \return Millis from the start of the show the frame plays at
+ */
+qint64 LifxShowFile::frameTime(int frame) const
+{
+    return qFromLittleEndian<quint32>(m_frames + frame * FRAME_ENTRY_SIZE + 8);
+}
+
+/*
+ * The last keyframe at or before frame, by binary search
+ */
+int LifxShowFile::keyframeFor(int frame) const
+{
+    int low = 0;
+    int high = m_keyframeCount - 1;
+
+    while (low < high) {
+        int middle = low + (high - low + 1) / 2;
+        if (static_cast<int>(qFromLittleEndian<quint32>(m_keyframes + middle * 4)) <= frame)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return low;
+}
+
+void LifxShowFile::restore(int keyframe)
+{
+    const uchar *state = m_states + static_cast<qint64>(keyframe) * m_bulbs.size() * STATE_SIZE;
+
+    for (int i = 0; i < m_bulbs.size(); i++, state += STATE_SIZE) {
+        m_color[i].hue = qFromLittleEndian<quint16>(state);
+        m_color[i].saturation = qFromLittleEndian<quint16>(state + 2);
+        m_color[i].brightness = qFromLittleEndian<quint16>(state + 4);
+        m_color[i].kelvin = qFromLittleEndian<quint16>(state + 6);
+        m_duration[i] = qFromLittleEndian<quint32>(state + 8);
+    }
+    m_next = static_cast<int>(qFromLittleEndian<quint32>(m_keyframes + keyframe * 4));
+}
+
+/*
+ * Decodes frame, which must be m_next, updating the bulb state. A
+ * record that runs off the end of the frame stops the decode and
+ * forces the next read back to a keyframe.
+ */
+int LifxShowFile::decode(int frame, LifxShowRecord *records)
+{
+    const uchar *entry = m_frames + frame * FRAME_ENTRY_SIZE;
+    const uchar *data = m_records + qFromLittleEndian<quint64>(entry);
+    const uchar *end = m_records + (frame + 1 < m_frameCount ? qFromLittleEndian<quint64>(entry + FRAME_ENTRY_SIZE) : m_recordsSize);
+    int count = qFromLittleEndian<quint16>(entry + 12);
+    int bulb = -1;
+
+    m_next = -1;
+    for (int i = 0; i < count; i++) {
+        LifxShowRecord &record = records[i];
+        quint32 gap;
+
+        if (!readVarint(data, end, gap) || data >= end || gap >= static_cast<quint32>(m_bulbs.size() - bulb - 1))
+            return i;
+
+        bulb += gap + 1;
+        quint8 tag = *data++;
+        lx_hsbk_t &color = m_color[bulb];
+
+        if ((tag & TAG_HUE) && !readDelta(data, end, color.hue))
+            return i;
+        if ((tag & TAG_SATURATION) && !readDelta(data, end, color.saturation))
+            return i;
+        if ((tag & TAG_BRIGHTNESS) && !readDelta(data, end, color.brightness))
+            return i;
+        if ((tag & TAG_KELVIN) && !readDelta(data, end, color.kelvin))
+            return i;
+        if ((tag & TAG_DURATION) && !readVarint(data, end, m_duration[bulb]))
+            return i;
+
+        record.bulb = static_cast<quint16>(bulb);
+        record.flags = tag & TAG_FLAGS;
+        record.color = color;
+        record.duration = m_duration[bulb];
+    }
+
+    m_next = frame + 1;
+    return count;
+}
+
+/**
+ * \fn int LifxShowFile::readFrame(int frame, LifxShowRecord *records)
+ * \param frame The frame to read
+ * \param records Gets the records, room for bulbs().size()
+ * \return The number of records
+ */
+int LifxShowFile::readFrame(int frame, LifxShowRecord *records)
+{
+    if (frame < 0 || frame >= m_frameCount)
+        return 0;
+
+    if (frame != m_next) {
+        int keyframe = keyframeFor(frame);
+        if (m_next < 0 || m_next > frame || static_cast<int>(qFromLittleEndian<quint32>(m_keyframes + keyframe * 4)) > m_next)
+            restore(keyframe);
+        while (m_next >= 0 && m_next < frame)
+            decode(m_next, records);
+        if (m_next != frame)
+            return 0;
+    }
+    return decode(frame, records);
+}
+
+/**
+ * \fn bool LifxShowFile::write(const QString &path, LifxShowSource *show, int keyframeInterval)
+ * \param path The file to write, replaced if it exists
+ * \param show The show to write, read once front to back
+ * \param keyframeInterval Frames between keyframes, fewer makes seeking faster and the file bigger
+ * \return False if the file can't be written, or the show doesn't fit the format
+ *
+ * Frame times must fit in 32 bits of millis, which is 49 days.
+ */
+bool LifxShowFile::write(const QString &path, LifxShowSource *show, int keyframeInterval)
+{
+    QFile file(path);
+
+    if (show == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null show";
+        return false;
+    }
+
+    QVector<uint64_t> bulbs = show->bulbs();
+    int frames = show->frameCount();
+    int interval = qMax(keyframeInterval, 1);
+
+    if (bulbs.size() > MAX_BULBS) {
+        qWarning() << __PRETTY_FUNCTION__ << ": A show file holds at most" << MAX_BULBS << "bulbs";
+        return false;
+    }
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to open" << path << ":" << file.errorString();
+        return false;
+    }
+
+    QByteArray out(HEADER_SIZE, 0);
+    for (auto target : bulbs)
+        appendLittleEndian<quint64>(out, target);
+    file.write(out);
+
+    quint64 data = out.size();
+    quint64 dataSize = 0;
+    QByteArray frameTable;
+    QByteArray keyframeIndex;
+    QByteArray states;
+    QVector<LifxShowRecord> records(bulbs.size());
+    QVector<lx_hsbk_t> colors(bulbs.size());
+    QVector<uint32_t> durations(bulbs.size(), 0);
+    qint64 lastTime = 0;
+
+    memset(colors.data(), 0, colors.size() * sizeof(lx_hsbk_t));
+    frameTable.reserve(frames * FRAME_ENTRY_SIZE);
+    for (int frame = 0; frame < frames; frame++) {
+        qint64 time = show->frameTime(frame);
+        int count = show->readFrame(frame, records.data());
+        int written = 0;
+        int last = -1;
+
+        if (time < lastTime || time > 0xffffffffLL) {
+            qWarning() << __PRETTY_FUNCTION__ << ": Frame" << frame << "is out of order or too late at" << time;
+            file.close();
+            file.remove();
+            return false;
+        }
+        lastTime = time;
+
+        if (frame % interval == 0) {
+            appendLittleEndian<quint32>(keyframeIndex, static_cast<quint32>(frame));
+            for (int i = 0; i < bulbs.size(); i++) {
+                appendLittleEndian<quint16>(states, colors[i].hue);
+                appendLittleEndian<quint16>(states, colors[i].saturation);
+                appendLittleEndian<quint16>(states, colors[i].brightness);
+                appendLittleEndian<quint16>(states, colors[i].kelvin);
+                appendLittleEndian<quint32>(states, durations[i]);
+            }
+        }
+
+        std::stable_sort(records.begin(), records.begin() + count, [](const LifxShowRecord &a, const LifxShowRecord &b) { return a.bulb < b.bulb; });
+        out.resize(0);
+        for (int i = 0; i < count; i++) {
+            const LifxShowRecord &record = records[i];
+            int bulb = record.bulb;
+            quint8 tag = record.flags & TAG_FLAGS;
+
+            if (bulb >= bulbs.size() || bulb == last || !(tag & (LifxShowRecord::Color | LifxShowRecord::Power)))
+                continue;
+
+            lx_hsbk_t &color = colors[bulb];
+            if (tag & LifxShowRecord::Color) {
+                if (record.color.hue != color.hue)
+                    tag |= TAG_HUE;
+                if (record.color.saturation != color.saturation)
+                    tag |= TAG_SATURATION;
+                if (record.color.brightness != color.brightness)
+                    tag |= TAG_BRIGHTNESS;
+                if (record.color.kelvin != color.kelvin)
+                    tag |= TAG_KELVIN;
+                if (record.duration != durations[bulb])
+                    tag |= TAG_DURATION;
+            }
+
+            appendVarint(out, static_cast<quint32>(bulb - last - 1));
+            out.append(static_cast<char>(tag));
+            if (tag & TAG_HUE)
+                appendDelta(out, color.hue, record.color.hue);
+            if (tag & TAG_SATURATION)
+                appendDelta(out, color.saturation, record.color.saturation);
+            if (tag & TAG_BRIGHTNESS)
+                appendDelta(out, color.brightness, record.color.brightness);
+            if (tag & TAG_KELVIN)
+                appendDelta(out, color.kelvin, record.color.kelvin);
+            if (tag & TAG_DURATION)
+                appendVarint(out, record.duration);
+
+            if (tag & LifxShowRecord::Color) {
+                color = record.color;
+                durations[bulb] = record.duration;
+            }
+            last = bulb;
+            written++;
+        }
+
+        appendLittleEndian<quint64>(frameTable, dataSize);
+        appendLittleEndian<quint32>(frameTable, static_cast<quint32>(time));
+        appendLittleEndian<quint16>(frameTable, static_cast<quint16>(written));
+        appendLittleEndian<quint16>(frameTable, 0);
+        file.write(out);
+        dataSize += out.size();
+    }
+
+    // Keep the tables 8 byte aligned in the mapping
+    out.fill(0, static_cast<int>((8 - (data + dataSize) % 8) % 8));
+    file.write(out);
+    quint64 frameOffset = data + dataSize + out.size();
+    file.write(frameTable);
+    quint64 keyframeOffset = frameOffset + frameTable.size();
+    file.write(keyframeIndex);
+    out.fill(0, (8 - keyframeIndex.size() % 8) % 8);
+    file.write(out);
+    quint64 stateOffset = keyframeOffset + keyframeIndex.size() + out.size();
+    file.write(states);
+
+    out.fill(0, HEADER_SIZE);
+    qToLittleEndian<quint32>(MAGIC, out.data() + H_MAGIC);
+    qToLittleEndian<quint16>(VERSION, out.data() + H_VERSION);
+    qToLittleEndian<quint32>(static_cast<quint32>(bulbs.size()), out.data() + H_BULBS);
+    qToLittleEndian<quint32>(static_cast<quint32>(frames), out.data() + H_FRAMES);
+    qToLittleEndian<quint32>(static_cast<quint32>(keyframeIndex.size() / 4), out.data() + H_KEYFRAMES);
+    qToLittleEndian<quint32>(static_cast<quint32>(interval), out.data() + H_INTERVAL);
+    qToLittleEndian<quint64>(data, out.data() + H_DATA);
+    qToLittleEndian<quint64>(dataSize, out.data() + H_DATA_SIZE);
+    qToLittleEndian<quint64>(frameOffset, out.data() + H_FRAME_TABLE);
+    qToLittleEndian<quint64>(keyframeOffset, out.data() + H_KEYFRAME_INDEX);
+    qToLittleEndian<quint64>(stateOffset, out.data() + H_STATES);
+
+    if (!file.seek(0) || file.write(out) != HEADER_SIZE) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Unable to write" << path << ":" << file.errorString();
+        file.close();
+        file.remove();
+        return false;
+    }
+    file.close();
+    return true;
+}
@@ -0,0 +1,473 @@
+/*
+ * Plays a show on a thread of its own, to the millisecond
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxshowplayer.h"
+#include "lifxmanager.h"
+
+#include <chrono>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+/*
+ * The player thread never sleeps longer than this in one go, so stop()
+ * doesn't wait on a frame that is a long way off
+ */
+static constexpr qint64 SLEEP_SLICE = 100000000;
+
+/**
+ * \fn qint64 LifxJitterHistogram::percentile(double fraction) const
+ * \param fraction Between 0 and 1, 0.99 for the 99th percentile
+ * \return The micros fraction of the frames were no later than, rounded up to a bucket limit
+ */
+qint64 LifxJitterHistogram::percentile(double fraction) const
+{
+    quint64 wanted = static_cast<quint64>(qBound(0.0, fraction, 1.0) * frames);
+    quint64 seen = 0;
+
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= wanted && seen > 0)
+            return qMin(bucketLimit(i), worst);
+    }
+    return worst;
+}
+
+/**
+ * \fn int LifxJitterHistogram::bucketFor(qint64 usecs)
+ * \param usecs Micros late, early frames count as 0
+ * \return The bucket usecs is counted in
+ */
+int LifxJitterHistogram::bucketFor(qint64 usecs)
+{
+    int bucket = 0;
+
+    while (bucket < BUCKETS - 1 && usecs > bucketLimit(bucket))
+        bucket++;
+    return bucket;
+}
+
+/**
+ * \fn LifxShowPlayer::LifxShowPlayer(LifxManager *manager, QObject *parent)
+ * \param manager The manager whose socket and bulbs the show uses
+ * \param parent QObject parent
+ */
+LifxShowPlayer::LifxShowPlayer(LifxManager *manager, QObject *parent) : QObject(parent),
+    m_manager(manager), m_show(nullptr), m_playing(false), m_stop(false), m_policy(Merge),
+    m_maxLateness(4000), m_source(0), m_priority(0), m_pendingCount(0), m_position(0),
+    m_framesSent(0), m_framesDropped(0), m_framesMerged(0), m_datagrams(0)
+{
+#ifdef Q_OS_LINUX
+    m_fd = -1;
+#endif
+    resetJitter();
+}
+
+LifxShowPlayer::~LifxShowPlayer()
+{
+    // Not stop(), the manager and its bulbs may already be gone
+    m_stop = true;
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+/**
+ * \fn bool LifxShowPlayer::start(LifxShowSource *show, qint64 from)
+ * \param show The show to play, which must stay around until finished() or stop()
+ * \param from Millis into the show to start at, frames before it are skipped
+ * \return False if the show can't be played
+ *
+ * Call from the manager's thread. Any show already playing is stopped.
+ * The frame at from plays straight away, the rest relative to it. The
+ * bulbs the show plays on lose their confirmed color and power first,
+ * see forgetState().
+ */
+bool LifxShowPlayer::start(LifxShowSource *show, qint64 from)
+{
+    stop();
+
+    if (show == nullptr || m_manager == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null show or manager";
+        return false;
+    }
+
+    m_show = show;
+    m_targets = show->bulbs();
+    int bulbs = m_targets.size();
+
+    m_resolved.fill(false, bulbs);
+    m_colorPackets.fill(0, bulbs * COLOR_SIZE);
+    m_powerPackets.fill(0, bulbs * POWER_SIZE);
+    m_pending.fill(0, bulbs);
+    m_pendingBulbs.fill(0, bulbs);
+    m_pendingCount = 0;
+    m_records.resize(bulbs);
+
+#ifdef Q_OS_LINUX
+    LifxProtocol *protocol = m_manager->getProtocol();
+    int family = protocol->socketFamily();
+
+    m_fd = static_cast<int>(protocol->socketDescriptor());
+    if (m_fd < 0 || family < 0) {
+        qWarning() << __PRETTY_FUNCTION__ << ": The manager has no socket to send on";
+        return false;
+    }
+    m_addresses.resize(bulbs);
+    m_addressLengths.fill(0, bulbs);
+    m_vectors.resize(bulbs * 2);
+    m_messages.resize(bulbs * 2);
+    memset(m_messages.data(), 0, m_messages.size() * sizeof(mmsghdr));
+#endif
+
+    int missing = 0;
+    for (int i = 0; i < bulbs; i++) {
+        LifxBulb *bulb = m_manager->getBulbByMac(m_targets[i]);
+        lx_protocol_header_t header;
+
+        if (bulb == nullptr || bulb->address().isNull()) {
+            missing++;
+            continue;
+        }
+        m_resolved[i] = true;
+
+        memset(&header, 0, sizeof(header));
+        header.protocol = PROTOCOL_NUMBER;
+        header.addressable = ADDRESSABLE;
+        header.origin = ORIGIN;
+        header.source = m_source;
+        memcpy(header.target, bulb->target(), 8);
+        memcpy(header.protoid, LifxPacket::protoid, 6);
+
+        header.size = COLOR_SIZE;
+        header.type = LIFX_DEFINES::SET_COLOR;
+        memcpy(m_colorPackets.data() + i * COLOR_SIZE, &header, sizeof(header));
+        header.size = POWER_SIZE;
+        header.type = LIFX_DEFINES::SET_POWER;
+        memcpy(m_powerPackets.data() + i * POWER_SIZE, &header, sizeof(header));
+
+#ifdef Q_OS_LINUX
+        m_addressLengths[i] = LifxProtocol::socketAddress(bulb->address(), static_cast<quint16>(bulb->port()), family, &m_addresses[i]);
+        m_vectors[i * 2].iov_base = m_colorPackets.data() + i * COLOR_SIZE;
+        m_vectors[i * 2].iov_len = COLOR_SIZE;
+        m_vectors[i * 2 + 1].iov_base = m_powerPackets.data() + i * POWER_SIZE;
+        m_vectors[i * 2 + 1].iov_len = POWER_SIZE;
+#endif
+    }
+    if (missing)
+        qWarning() << __PRETTY_FUNCTION__ << ":" << missing << "of" << bulbs << "show bulbs aren't known yet and are left out";
+
+    forgetState();
+    m_stop = false;
+    m_playing = true;
+    m_thread = std::thread(&LifxShowPlayer::run, this, from);
+    return true;
+}
+
+/**
+ * \fn void LifxShowPlayer::stop()
+ *
+ * Stops the show and waits for the player thread, which takes at most a
+ * frame's send. Nothing is sent to put the bulbs back, but whatever the
+ * show left them at is treated as unknown, so the next color or power
+ * the manager sends them goes out.
+ */
+void LifxShowPlayer::stop()
+{
+    m_stop = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+        forgetState();
+    }
+    m_playing = false;
+}
+
+/*
+ * The player sends behind the manager's back, so the color and power
+ * each bulb last confirmed say nothing about what it is showing now,
+ * and a scene or the reconciler would skip a send that is needed.
+ * Called on the manager's thread when a show starts and again when it
+ * ends, since a reply that arrives mid show confirms a frame that has
+ * since been replaced.
+ */
+void LifxShowPlayer::forgetState()
+{
+    if (m_manager == nullptr)
+        return;
+
+    for (int i = 0; i < m_targets.size(); i++) {
+        if (!m_resolved[i])
+            continue;
+
+        LifxBulb *bulb = m_manager->getBulbByMac(m_targets[i]);
+        if (bulb) {
+            bulb->invalidateColor();
+            bulb->invalidatePower();
+        }
+    }
+}
+
+/**
+ * \fn LifxJitterHistogram LifxShowPlayer::jitter() const
+ * \return How late frames were since the last resetJitter(), safe from any thread
+ *
+ * The buckets are read one at a time while the player writes them, so
+ * a copy taken mid show can be off by a frame.
+ */
+LifxJitterHistogram LifxShowPlayer::jitter() const
+{
+    LifxJitterHistogram histogram;
+
+    for (int i = 0; i < LifxJitterHistogram::BUCKETS; i++)
+        histogram.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    histogram.frames = m_jitterFrames.load(std::memory_order_relaxed);
+    histogram.worst = m_worst.load(std::memory_order_relaxed);
+    histogram.total = m_total.load(std::memory_order_relaxed);
+    return histogram;
+}
+
+/**
+ * \fn void LifxShowPlayer::resetJitter()
+ *
+ * Empties the histogram, best done while nothing is playing.
+ */
+void LifxShowPlayer::resetJitter()
+{
+    for (int i = 0; i < LifxJitterHistogram::BUCKETS; i++)
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    m_jitterFrames.store(0, std::memory_order_relaxed);
+    m_worst.store(0, std::memory_order_relaxed);
+    m_total.store(0, std::memory_order_relaxed);
+}
+
+qint64 LifxShowPlayer::monotonicNanos()
+{
+#ifdef Q_OS_LINUX
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<qint64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/*
+ * Sleeps to an absolute monotonic time in slices, so a stop() is seen
+ */
+void LifxShowPlayer::sleepUntil(qint64 deadline)
+{
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        qint64 now = monotonicNanos();
+        if (now >= deadline)
+            return;
+
+        qint64 until = qMin(deadline, now + SLEEP_SLICE);
+#ifdef Q_OS_LINUX
+        timespec wake;
+        wake.tv_sec = until / 1000000000;
+        wake.tv_nsec = until % 1000000000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) == EINTR)
+            ;
+#else
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(until)));
+#endif
+    }
+}
+
+void LifxShowPlayer::record(qint64 lateness)
+{
+    qint64 usecs = qMax<qint64>(lateness / 1000, 0);
+    int bucket = LifxJitterHistogram::bucketFor(usecs);
+
+    m_buckets[bucket].store(m_buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_jitterFrames.store(m_jitterFrames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_total.store(m_total.load(std::memory_order_relaxed) + usecs, std::memory_order_relaxed);
+    if (usecs > m_worst.load(std::memory_order_relaxed))
+        m_worst.store(usecs, std::memory_order_relaxed);
+}
+
+/*
+ * Writes a frame's records into the per bulb packets and marks them
+ * pending. A later record for the same bulb replaces an earlier one,
+ * which is what makes Merge work.
+ */
+void LifxShowPlayer::gather(const LifxShowRecord *records, int count)
+{
+    for (int i = 0; i < count; i++) {
+        const LifxShowRecord &record = records[i];
+        int bulb = record.bulb;
+
+        if (bulb >= m_targets.size() || !m_resolved[bulb] || !(record.flags & (LifxShowRecord::Color | LifxShowRecord::Power)))
+            continue;
+
+        if (record.flags & LifxShowRecord::Color) {
+            lx_dev_color_t color;
+            color.reserved = 0;
+            color.hue = record.color.hue;
+            color.saturation = record.color.saturation;
+            color.brightness = record.color.brightness;
+            color.kelvin = record.color.kelvin;
+            color.duration = record.duration;
+            memcpy(m_colorPackets.data() + bulb * COLOR_SIZE + sizeof(lx_protocol_header_t), &color, sizeof(color));
+        }
+        if (record.flags & LifxShowRecord::Power) {
+            uint16_t level = (record.flags & LifxShowRecord::On) ? 65535 : 0;
+            memcpy(m_powerPackets.data() + bulb * POWER_SIZE + sizeof(lx_protocol_header_t), &level, sizeof(level));
+            m_pending[bulb] &= ~LifxShowRecord::On;
+        }
+
+        if (m_pending[bulb] == 0)
+            m_pendingBulbs[m_pendingCount++] = bulb;
+        m_pending[bulb] |= record.flags;
+    }
+}
+
+/*
+ * Sends everything pending. A bulb turning on gets its color first, so
+ * it doesn't flash the old one, a bulb turning off gets power first.
+ */
+int LifxShowPlayer::dispatch()
+{
+    int sent = 0;
+
+#ifdef Q_OS_LINUX
+    int count = 0;
+
+    for (int i = 0; i < m_pendingCount; i++) {
+        int bulb = m_pendingBulbs[i];
+        quint8 flags = m_pending[bulb];
+        bool powerFirst = (flags & LifxShowRecord::Power) && !(flags & LifxShowRecord::On);
+
+        for (int step = 0; step < 2; step++) {
+            bool power = (step == 0) == powerFirst;
+            if (!(flags & (power ? LifxShowRecord::Power : LifxShowRecord::Color)))
+                continue;
+
+            msghdr &message = m_messages[count++].msg_hdr;
+            message.msg_name = &m_addresses[bulb];
+            message.msg_namelen = m_addressLengths[bulb];
+            message.msg_iov = &m_vectors[bulb * 2 + (power ? 1 : 0)];
+            message.msg_iovlen = 1;
+        }
+        m_pending[bulb] = 0;
+    }
+
+    while (sent < count) {
+        int result = sendmmsg(m_fd, m_messages.data() + sent, count - sent, 0);
+        if (result <= 0)
+            break;
+        sent += result;
+    }
+#else
+    for (int i = 0; i < m_pendingCount; i++) {
+        int bulb = m_pendingBulbs[i];
+        quint8 flags = m_pending[bulb];
+        lx_dev_color_t color;
+
+        if (flags & LifxShowRecord::Color) {
+            memcpy(&color, m_colorPackets.constData() + bulb * COLOR_SIZE + sizeof(lx_protocol_header_t), sizeof(color));
+            if (m_manager->submit(LifxCommand::color(m_targets[bulb], HSBK(color.hue, color.saturation, color.brightness, color.kelvin), color.duration, m_source)))
+                sent++;
+        }
+        if (flags & LifxShowRecord::Power) {
+            if (m_manager->submit(LifxCommand::power(m_targets[bulb], flags & LifxShowRecord::On, m_source)))
+                sent++;
+        }
+        m_pending[bulb] = 0;
+    }
+#endif
+
+    m_pendingCount = 0;
+    return sent;
+}
+
+/*
+ * The player thread. Each frame is read and gathered ahead of its
+ * deadline, so waking up is followed straight away by the send.
+ */
+void LifxShowPlayer::run(qint64 from)
+{
+#ifdef Q_OS_LINUX
+    if (m_priority > 0) {
+        sched_param param;
+        param.sched_priority = m_priority;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+            qWarning() << __PRETTY_FUNCTION__ << ": Unable to run the player at realtime priority" << m_priority;
+    }
+#endif
+
+    int frames = m_show->frameCount();
+    int frame = m_show->findFrame(from);
+    qint64 start = monotonicNanos() - from * 1000000;
+    qint64 published = monotonicNanos();
+    qint64 tolerance = static_cast<qint64>(m_maxLateness) * 1000;
+
+    for (; frame < frames && !m_stop.load(std::memory_order_relaxed); frame++) {
+        qint64 at = m_show->frameTime(frame);
+        qint64 deadline = start + at * 1000000;
+        int count = m_show->readFrame(frame, m_records.data());
+        bool late;
+
+        if (m_policy == Merge || monotonicNanos() - deadline <= tolerance)
+            gather(m_records.constData(), count);
+
+        sleepUntil(deadline);
+        if (m_stop.load(std::memory_order_relaxed))
+            break;
+
+        qint64 now = monotonicNanos();
+        qint64 lateness = now - deadline;
+        late = lateness > tolerance;
+        record(lateness);
+        m_position.store(at, std::memory_order_relaxed);
+
+        if (!late) {
+            m_datagrams.fetch_add(dispatch(), std::memory_order_relaxed);
+            m_framesSent.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (m_policy == Merge) {
+            m_framesMerged.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            // Anything gathered belongs to this frame, throw it away
+            for (int i = 0; i < m_pendingCount; i++)
+                m_pending[m_pendingBulbs[i]] = 0;
+            m_pendingCount = 0;
+            m_framesDropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (now - published >= 1000000000) {
+            published = now;
+            emit jitterPublished();
+        }
+    }
+
+    // A Merge show that ends late still owes its last changes
+    if (m_pendingCount && !m_stop.load(std::memory_order_relaxed))
+        m_datagrams.fetch_add(dispatch(), std::memory_order_relaxed);
+
+    // Queued ahead of finished(), so its receivers see the bulbs forgotten
+    QMetaObject::invokeMethod(this, "forgetState", Qt::QueuedConnection);
+    m_playing = false;
+    emit jitterPublished();
+    emit finished();
+}
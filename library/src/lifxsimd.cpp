@@ -0,0 +1,68 @@
+/*
+ * Picks the SIMD level every kernel table in the library uses
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxsimd.h"
+
+namespace {
+
+LifxSimd::Level detect()
+{
+    if (qEnvironmentVariableIsSet("QTLIFX_NO_SIMD"))
+        return LifxSimd::Scalar;
+
+#ifdef LIFX_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return LifxSimd::Avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return LifxSimd::Sse41;
+#endif
+    return LifxSimd::Scalar;
+}
+
+}
+
+/**
+ * \fn LifxSimd::Level LifxSimd::level()
+ * \return The widest level the CPU supports, Scalar if QTLIFX_NO_SIMD is set
+ *
+ * Decided on the first call, the environment and CPU aren't looked at again
+ */
+LifxSimd::Level LifxSimd::level()
+{
+    static const Level level = detect();
+    return level;
+}
+
+/**
+ * \fn const char* LifxSimd::name(Level level)
+ * \param level A level
+ * \return scalar, sse4.1 or avx2
+ */
+const char* LifxSimd::name(Level level)
+{
+    switch (level) {
+        case Sse41:
+            return "sse4.1";
+        case Avx2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
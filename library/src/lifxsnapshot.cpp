@@ -0,0 +1,101 @@
+/*
+ * Immutable copy of the fleet state for other threads to read
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxsnapshot.h"
+
+LifxSnapshot::LifxSnapshot() : m_generation(0), m_published(0)
+{
+}
+
+LifxSnapshot::~LifxSnapshot()
+{
+}
+
+void LifxSnapshot::ensureRow(int row)
+{
+    if (row < m_labels.size())
+        return;
+
+    m_labels.resize(row + 1);
+    m_groupLabels.resize(row + 1);
+    m_pids.resize(row + 1);
+    m_productNames.resize(row + 1);
+}
+
+/**
+ * \fn void LifxSnapshot::setLabel(int row, const QString &label)
+ * \param row The fleet row of the bulb
+ * \param label The new bulb label
+ *
+ * Only for the manager building the next snapshot
+ */
+void LifxSnapshot::setLabel(int row, const QString &label)
+{
+    if (row < 0)
+        return;
+
+    ensureRow(row);
+    m_labels[row] = label;
+}
+
+/**
+ * \fn void LifxSnapshot::setGroup(int row, const QString &label)
+ * \param row The fleet row of the bulb
+ * \param label The label of the group the bulb is now in
+ *
+ * Only for the manager building the next snapshot
+ */
+void LifxSnapshot::setGroup(int row, const QString &label)
+{
+    if (row < 0)
+        return;
+
+    ensureRow(row);
+    m_groupLabels[row] = label;
+}
+
+/**
+ * \fn void LifxSnapshot::setProduct(int row, int pid, const QString &name)
+ * \param row The fleet row of the bulb
+ * \param pid The product ID
+ * \param name The product name, empty if products.json wasn't given
+ *
+ * Only for the manager building the next snapshot
+ */
+void LifxSnapshot::setProduct(int row, int pid, const QString &name)
+{
+    if (row < 0)
+        return;
+
+    ensureRow(row);
+    m_pids[row] = pid;
+    m_productNames[row] = name;
+}
+
+/**
+ * \fn void LifxSnapshot::setFleet(const LifxFleet &fleet, quint64 generation)
+ * \param fleet The live fleet to copy
+ * \param generation The publish counter for this snapshot
+ */
+void LifxSnapshot::setFleet(const LifxFleet &fleet, quint64 generation)
+{
+    m_fleet = fleet;
+    m_generation = generation;
+    m_published = fleet.now();
+}
@@ -0,0 +1,133 @@
+/*
+ * Publishes fleet snapshots to reader threads without locking
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxsnapshotring.h"
+
+LifxSnapshotHandle::LifxSnapshotHandle() : m_snapshot(nullptr), m_readers(nullptr)
+{
+}
+
+LifxSnapshotHandle::LifxSnapshotHandle(const LifxSnapshot *snapshot, std::atomic<int> *readers) :
+    m_snapshot(snapshot), m_readers(readers)
+{
+}
+
+LifxSnapshotHandle::LifxSnapshotHandle(LifxSnapshotHandle &&other) :
+    m_snapshot(other.m_snapshot), m_readers(other.m_readers)
+{
+    other.m_snapshot = nullptr;
+    other.m_readers = nullptr;
+}
+
+LifxSnapshotHandle& LifxSnapshotHandle::operator=(LifxSnapshotHandle &&other)
+{
+    if (this != &other) {
+        release();
+        m_snapshot = other.m_snapshot;
+        m_readers = other.m_readers;
+        other.m_snapshot = nullptr;
+        other.m_readers = nullptr;
+    }
+    return *this;
+}
+
+LifxSnapshotHandle::~LifxSnapshotHandle()
+{
+    release();
+}
+
+/**
+ * \fn void LifxSnapshotHandle::release()
+ *
+ * Lets the snapshot go before the handle is destroyed. The handle is
+ * null afterwards.
+ */
+void LifxSnapshotHandle::release()
+{
+    if (m_readers)
+        m_readers->fetch_sub(1, std::memory_order_release);
+
+    m_snapshot = nullptr;
+    m_readers = nullptr;
+}
+
+/**
+ * \fn LifxSnapshotRing::LifxSnapshotRing()
+ *
+ * Starts with an empty generation 0 snapshot current, so acquire()
+ * always has something to return.
+ */
+LifxSnapshotRing::LifxSnapshotRing() : m_current(0), m_generation(0)
+{
+    for (int i = 0; i < SLOTS; i++)
+        m_slots[i].readers.store(0);
+}
+
+LifxSnapshotRing::~LifxSnapshotRing()
+{
+}
+
+/**
+ * \fn LifxSnapshotHandle LifxSnapshotRing::acquire() const
+ * \return A handle to the current snapshot
+ *
+ * Safe to call from any thread, never blocks.
+ */
+LifxSnapshotHandle LifxSnapshotRing::acquire() const
+{
+    for (;;) {
+        int current = m_current.load();
+        const Slot &slot = m_slots[current];
+
+        slot.readers.fetch_add(1);
+        if (m_current.load() == current)
+            return LifxSnapshotHandle(&slot.snapshot, &slot.readers);
+
+        // A publish moved on before our count was seen, the slot may be refilled
+        slot.readers.fetch_sub(1);
+    }
+}
+
+/**
+ * \fn bool LifxSnapshotRing::publish(const LifxSnapshot &staging, const LifxFleet &fleet)
+ * \param staging The bulb, group and product details for the new snapshot
+ * \param fleet The live fleet columns
+ * \return True if the new snapshot is now current, false if every spare slot was still being read
+ *
+ * Only one thread may publish.
+ */
+bool LifxSnapshotRing::publish(const LifxSnapshot &staging, const LifxFleet &fleet)
+{
+    int current = m_current.load();
+
+    for (int i = 1; i < SLOTS; i++) {
+        int index = (current + i) % SLOTS;
+        Slot &slot = m_slots[index];
+
+        if (slot.readers.load() != 0)
+            continue;
+
+        slot.snapshot = staging;
+        slot.snapshot.setFleet(fleet, m_generation + 1);
+        m_generation++;
+        m_current.store(index);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,503 @@
+/*
+ * Host side fades for bulbs and zones
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxtransitionengine.h"
+#include "lifxmanager.h"
+#include "lifxsimd.h"
+
+#include <algorithm>
+
+#ifdef LIFX_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/*
+ * All of the kernels produce exactly the same output. Each field is
+ *
+ *   out = from + ((to - from) * w + 16384) >> 15
+ *
+ * in 32 bit integers, w being 0 to 32768, so (to - from) * w can't
+ * overflow. Hue takes the short way round: its difference is taken as
+ * a signed 16 bit number and the result wraps.
+ */
+namespace {
+
+typedef void (*InterpolateKernel)(const lx_hsbk_t*, const lx_hsbk_t*, const uint16_t*, lx_hsbk_t*, int);
+
+inline uint16_t lerpField(int from, int delta, int weight)
+{
+    return static_cast<uint16_t>(from + ((delta * weight + 16384) >> 15));
+}
+
+void interpolateScalar(const lx_hsbk_t *from, const lx_hsbk_t *to, const uint16_t *weights, lx_hsbk_t *out, int count)
+{
+    for (int i = 0; i < count; i++) {
+        int w = weights[i];
+
+        out[i].hue = lerpField(from[i].hue, static_cast<int16_t>(static_cast<uint16_t>(to[i].hue - from[i].hue)), w);
+        out[i].saturation = lerpField(from[i].saturation, to[i].saturation - from[i].saturation, w);
+        out[i].brightness = lerpField(from[i].brightness, to[i].brightness - from[i].brightness, w);
+        out[i].kelvin = lerpField(from[i].kelvin, to[i].kelvin - from[i].kelvin, w);
+    }
+}
+
+#ifdef LIFX_X86_KERNELS
+
+/*
+ * SSE4.1, one color per 32 bit vector, 2 colors at a time
+ */
+__attribute__((target("sse4.1")))
+inline __m128i lerpSse(__m128i from, __m128i to, __m128i weight)
+{
+    __m128i delta = _mm_sub_epi32(to, from);
+    __m128i wrapped = _mm_srai_epi32(_mm_slli_epi32(delta, 16), 16);
+
+    // Hue is the low 32 bit lane, 16 bit lanes 0 and 1
+    delta = _mm_blend_epi16(wrapped, delta, 0xfc);
+    delta = _mm_srai_epi32(_mm_add_epi32(_mm_mullo_epi32(delta, weight), _mm_set1_epi32(16384)), 15);
+    return _mm_and_si128(_mm_add_epi32(from, delta), _mm_set1_epi32(0xffff));
+}
+
+__attribute__((target("sse4.1")))
+void interpolateSse41(const lx_hsbk_t *from, const lx_hsbk_t *to, const uint16_t *weights, lx_hsbk_t *out, int count)
+{
+    int i = 0;
+
+    for (; i + 2 <= count; i += 2) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + i));
+        __m128i lo = lerpSse(_mm_cvtepu16_epi32(a), _mm_cvtepu16_epi32(b), _mm_set1_epi32(weights[i]));
+        __m128i hi = lerpSse(_mm_cvtepu16_epi32(_mm_srli_si128(a, 8)), _mm_cvtepu16_epi32(_mm_srli_si128(b, 8)), _mm_set1_epi32(weights[i + 1]));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi32(lo, hi));
+    }
+    interpolateScalar(from + i, to + i, weights + i, out + i, count - i);
+}
+
+/*
+ * AVX2, 4 colors at a time
+ */
+__attribute__((target("avx2")))
+inline __m256i lerpAvx2(__m256i from, __m256i to, __m256i weight)
+{
+    __m256i delta = _mm256_sub_epi32(to, from);
+    __m256i wrapped = _mm256_srai_epi32(_mm256_slli_epi32(delta, 16), 16);
+
+    delta = _mm256_blend_epi16(wrapped, delta, 0xfc);
+    delta = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(delta, weight), _mm256_set1_epi32(16384)), 15);
+    return _mm256_and_si256(_mm256_add_epi32(from, delta), _mm256_set1_epi32(0xffff));
+}
+
+__attribute__((target("avx2")))
+void interpolateAvx2(const lx_hsbk_t *from, const lx_hsbk_t *to, const uint16_t *weights, lx_hsbk_t *out, int count)
+{
+    int i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i));
+        __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i + 2));
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + i));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + i + 2));
+        __m256i w0 = _mm256_set_m128i(_mm_set1_epi32(weights[i + 1]), _mm_set1_epi32(weights[i]));
+        __m256i w1 = _mm256_set_m128i(_mm_set1_epi32(weights[i + 3]), _mm_set1_epi32(weights[i + 2]));
+        __m256i lo = lerpAvx2(_mm256_cvtepu16_epi32(a0), _mm256_cvtepu16_epi32(b0), w0);
+        __m256i hi = lerpAvx2(_mm256_cvtepu16_epi32(a1), _mm256_cvtepu16_epi32(b1), w1);
+
+        // packus works within 128 bit lanes, leaving colors 0 2 1 3
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    interpolateSse41(from + i, to + i, weights + i, out + i, count - i);
+}
+
+#endif
+
+/*
+ * Picks the widest kernel the CPU supports, once.
+ */
+struct InterpolateKernels {
+    InterpolateKernel interpolate;
+    const char *name;
+
+    InterpolateKernels() : interpolate(interpolateScalar), name(LifxSimd::name(LifxSimd::level()))
+    {
+#ifdef LIFX_X86_KERNELS
+        switch (LifxSimd::level()) {
+            case LifxSimd::Avx2:
+                interpolate = interpolateAvx2;
+                break;
+            case LifxSimd::Sse41:
+                interpolate = interpolateSse41;
+                break;
+            case LifxSimd::Scalar:
+                break;
+        }
+#endif
+    }
+};
+
+const InterpolateKernels& kernels()
+{
+    static const InterpolateKernels k;
+    return k;
+}
+
+}
+
+LifxTransitionEngine::LifxTransitionEngine(LifxManager *manager, QObject *parent) : QObject(parent),
+    m_manager(manager), m_fps(DEFAULT_FRAME_RATE), m_totalNanos(0)
+{
+    m_timer = new QTimer(this);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    m_timer->setInterval(1000 / m_fps);
+    connect(m_timer, &QTimer::timeout, this, &LifxTransitionEngine::frame);
+    m_clock.start();
+}
+
+LifxTransitionEngine::~LifxTransitionEngine()
+{
+}
+
+/**
+ * \fn void LifxTransitionEngine::interpolate(const lx_hsbk_t *from, const lx_hsbk_t *to, const uint16_t *weights, lx_hsbk_t *out, int count)
+ * \param from Array of count start colors
+ * \param to Array of count end colors
+ * \param weights Array of count fractions, 0 gives from and WEIGHT_ONE gives to
+ * \param out Array of count colors to write, may be from or to
+ * \param count Number of colors
+ *
+ * Hue goes the short way round the wheel. Uses SSE4.1 or AVX2 when the
+ * CPU has them, the output is identical whichever kernel runs.
+ */
+void LifxTransitionEngine::interpolate(const lx_hsbk_t *from, const lx_hsbk_t *to, const uint16_t *weights, lx_hsbk_t *out, int count)
+{
+    if (from == nullptr || to == nullptr || weights == nullptr || out == nullptr || count <= 0)
+        return;
+
+    kernels().interpolate(from, to, weights, out, count);
+}
+
+/**
+ * \fn QString LifxTransitionEngine::interpolationKernel()
+ * \return The name of the kernel interpolate() uses, scalar, sse4.1 or avx2
+ *
+ * Setting QTLIFX_NO_SIMD in the environment forces the scalar kernel.
+ */
+QString LifxTransitionEngine::interpolationKernel()
+{
+    return QString(kernels().name);
+}
+
+/**
+ * \fn void LifxTransitionEngine::setFrameRate(int fps)
+ * \param fps Frames a second, 1 to 100
+ */
+void LifxTransitionEngine::setFrameRate(int fps)
+{
+    m_fps = qBound(1, fps, 100);
+    m_timer->setInterval(1000 / m_fps);
+}
+
+/*
+ * Drops runs whose bulb was cleared, closing up the slot arrays
+ */
+void LifxTransitionEngine::compact()
+{
+    int runs = 0;
+    int used = 0;
+
+    for (int i = 0; i < m_runs.size(); i++) {
+        Run run = m_runs[i];
+        if (run.bulb == nullptr)
+            continue;
+
+        if (run.first != used) {
+            memmove(m_from.data() + used, m_from.constData() + run.first, run.count * sizeof(lx_hsbk_t));
+            memmove(m_to.data() + used, m_to.constData() + run.first, run.count * sizeof(lx_hsbk_t));
+            memmove(m_out.data() + used, m_out.constData() + run.first, run.count * sizeof(lx_hsbk_t));
+        }
+        run.first = used;
+        used += run.count;
+        m_runs[runs++] = run;
+    }
+    m_runs.resize(runs);
+    m_from.resize(used);
+    m_to.resize(used);
+    m_out.resize(used);
+    m_weights.resize(used);
+}
+
+/*
+ * Replaces any fade of the same kind on bulb with a new run of count
+ * slots at the end of the arrays, and returns its first slot.
+ */
+int LifxTransitionEngine::begin(LifxBulb *bulb, int count, bool zones, int msecs)
+{
+    Run run;
+
+    for (auto &existing : m_runs) {
+        if (existing.bulb == bulb && existing.zones == zones) {
+            existing.bulb = nullptr;
+            compact();
+            break;
+        }
+    }
+
+    run.bulb = bulb;
+    run.first = m_from.size();
+    run.count = count;
+    run.zones = zones;
+    run.start = m_clock.elapsed();
+    run.length = qMax(msecs, 0);
+    m_runs.append(run);
+    m_from.resize(run.first + count);
+    m_to.resize(run.first + count);
+    m_out.resize(run.first + count);
+    m_weights.resize(run.first + count);
+
+    if (!m_timer->isActive())
+        m_timer->start();
+    return run.first;
+}
+
+/**
+ * \fn void LifxTransitionEngine::fade(LifxBulb *bulb, const HSBK &from, const HSBK &to, int msecs)
+ * \param bulb Pointer to LifxBulb object
+ * \param from Color to start from, sent on the next frame
+ * \param to Color to end at
+ * \param msecs Millis the fade lasts
+ */
+void LifxTransitionEngine::fade(LifxBulb *bulb, const HSBK &from, const HSBK &to, int msecs)
+{
+    if (bulb == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb";
+        return;
+    }
+
+    int slot = begin(bulb, 1, false, msecs);
+    m_from[slot] = { from.h(), from.s(), from.b(), from.k() };
+    m_to[slot] = { to.h(), to.s(), to.b(), to.k() };
+    m_out[slot] = m_from[slot];
+}
+
+/**
+ * \fn void LifxTransitionEngine::fade(LifxBulb *bulb, const HSBK &to, int msecs)
+ * \param bulb Pointer to LifxBulb object
+ * \param to Color to end at
+ * \param msecs Millis the fade lasts
+ *
+ * Starts from where a running fade on the bulb has got to, otherwise
+ * from LifxBulb::expectedColor().
+ */
+void LifxTransitionEngine::fade(LifxBulb *bulb, const HSBK &to, int msecs)
+{
+    if (bulb == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb";
+        return;
+    }
+
+    for (const auto &run : m_runs) {
+        if (run.bulb == bulb && !run.zones) {
+            const lx_hsbk_t &at = m_out[run.first];
+            fade(bulb, HSBK(at.hue, at.saturation, at.brightness, at.kelvin), to, msecs);
+            return;
+        }
+    }
+    fade(bulb, bulb->expectedColor(), to, msecs);
+}
+
+/**
+ * \fn void LifxTransitionEngine::fadeZones(LifxBulb *bulb, const lx_hsbk_t *to, int count, int msecs)
+ * \param bulb Pointer to a multizone LifxBulb
+ * \param to Array of count zone colors to end at, from the first zone
+ * \param count Number of zones to fade, clipped to the strip
+ * \param msecs Millis the fade lasts
+ *
+ * Starts from where a running zone fade has got to, otherwise from
+ * LifxBulb::zones(). Zones past count stay as they are.
+ */
+void LifxTransitionEngine::fadeZones(LifxBulb *bulb, const lx_hsbk_t *to, int count, int msecs)
+{
+    if (bulb == nullptr || to == nullptr) {
+        qWarning() << __PRETTY_FUNCTION__ << ": Called with a null bulb or colors";
+        return;
+    }
+    if (bulb->zoneCount() == 0) {
+        qWarning() << __PRETTY_FUNCTION__ << ":" << bulb->label() << "has no zones yet, call getZonesForBulb() first";
+        return;
+    }
+
+    count = qMin(count, bulb->zoneCount());
+    if (count <= 0)
+        return;
+
+    QVector<lx_hsbk_t> from(count);
+    memcpy(from.data(), bulb->zones().data(), count * sizeof(lx_hsbk_t));
+    for (const auto &run : m_runs) {
+        if (run.bulb == bulb && run.zones) {
+            memcpy(from.data(), m_out.constData() + run.first, qMin(count, run.count) * sizeof(lx_hsbk_t));
+            break;
+        }
+    }
+
+    int slot = begin(bulb, count, true, msecs);
+    memcpy(m_from.data() + slot, from.constData(), count * sizeof(lx_hsbk_t));
+    memcpy(m_to.data() + slot, to, count * sizeof(lx_hsbk_t));
+    memcpy(m_out.data() + slot, from.constData(), count * sizeof(lx_hsbk_t));
+}
+
+/**
+ * \fn void LifxTransitionEngine::crossFade(const LifxScene &scene, int msecs)
+ * \param scene The scene to fade to
+ * \param msecs Millis the fade lasts, the scene's own durations are ignored
+ *
+ * Every bulb the scene covers fades from where it is to its scene color,
+ * in step with the others. Power is left alone, use LifxManager::applyScene()
+ * for bulbs that need turning on or off.
+ */
+void LifxTransitionEngine::crossFade(const LifxScene &scene, int msecs)
+{
+    QHash<LifxBulb*, LifxSceneEntry> states = m_manager->sceneStates(scene);
+
+    for (auto it = states.constBegin(); it != states.constEnd(); ++it)
+        fade(it.key(), it.value().color, msecs);
+}
+
+/**
+ * \fn void LifxTransitionEngine::cancel(LifxBulb *bulb)
+ * \param bulb Pointer to LifxBulb object
+ *
+ * Stops the bulb's color and zone fades where they are, fadeFinished()
+ * is not emitted.
+ */
+void LifxTransitionEngine::cancel(LifxBulb *bulb)
+{
+    bool found = false;
+
+    for (auto &run : m_runs) {
+        if (run.bulb == bulb) {
+            run.bulb = nullptr;
+            found = true;
+        }
+    }
+    if (found)
+        compact();
+    if (m_runs.isEmpty())
+        m_timer->stop();
+}
+
+/**
+ * \fn void LifxTransitionEngine::cancel()
+ *
+ * Stops every fade where it is
+ */
+void LifxTransitionEngine::cancel()
+{
+    m_runs.clear();
+    compact();
+    m_timer->stop();
+}
+
+/**
+ * \fn bool LifxTransitionEngine::isFading(LifxBulb *bulb) const
+ * \param bulb Pointer to LifxBulb object
+ * \return True if the bulb's color or zones are being faded
+ */
+bool LifxTransitionEngine::isFading(LifxBulb *bulb) const
+{
+    for (const auto &run : m_runs) {
+        if (run.bulb == bulb)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * \fn LifxTransitionStats LifxTransitionEngine::stats() const
+ * \return Frame counts and times since the engine was made or resetStats()
+ */
+LifxTransitionStats LifxTransitionEngine::stats() const
+{
+    LifxTransitionStats stats = m_stats;
+
+    stats.active = m_runs.size();
+    stats.meanFrame = stats.frames ? m_totalNanos / static_cast<qint64>(stats.frames) : 0;
+    return stats;
+}
+
+/**
+ * \fn void LifxTransitionEngine::resetStats()
+ */
+void LifxTransitionEngine::resetStats()
+{
+    m_stats = LifxTransitionStats();
+    m_totalNanos = 0;
+}
+
+/*
+ * One frame: the fraction done per slot, every color at once, then one
+ * batch for the bulbs and a zone message per strip.
+ */
+void LifxTransitionEngine::frame()
+{
+    QElapsedTimer cost;
+    QVector<LifxBulb*> finished;
+    qint64 now = m_clock.elapsed();
+    uint32_t interval = static_cast<uint32_t>(1000 / m_fps);
+
+    cost.start();
+    for (const auto &run : m_runs) {
+        qint64 done = now - run.start;
+        uint16_t weight = done >= run.length ? WEIGHT_ONE : static_cast<uint16_t>(qMax<qint64>(done, 0) * WEIGHT_ONE / run.length);
+        std::fill(m_weights.begin() + run.first, m_weights.begin() + run.first + run.count, weight);
+    }
+    interpolate(m_from.constData(), m_to.constData(), m_weights.constData(), m_out.data(), m_out.size());
+
+    m_batch.clear();
+    for (auto &run : m_runs) {
+        if (run.zones) {
+            run.bulb->zones().setPixels(0, m_out.constData() + run.first, run.count);
+            m_manager->changeBulbZones(run.bulb, interval);
+        }
+        else {
+            const lx_hsbk_t &color = m_out[run.first];
+            m_batch.setColor(run.bulb, HSBK(color.hue, color.saturation, color.brightness, color.kelvin), interval);
+        }
+        if (m_weights[run.first] == WEIGHT_ONE) {
+            finished.append(run.bulb);
+            run.bulb = nullptr;
+        }
+    }
+    if (!m_batch.isEmpty())
+        m_manager->submit(m_batch);
+
+    m_stats.frames++;
+    m_stats.colors += m_out.size();
+    if (!finished.isEmpty())
+        compact();
+    if (m_runs.isEmpty())
+        m_timer->stop();
+
+    m_stats.lastFrame = cost.nsecsElapsed();
+    m_stats.maxFrame = qMax(m_stats.maxFrame, m_stats.lastFrame);
+    m_totalNanos += m_stats.lastFrame;
+
+    for (auto bulb : finished)
+        emit fadeFinished(bulb);
+}
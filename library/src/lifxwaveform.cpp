@@ -0,0 +1,335 @@
+/*
+ * LIFX waveform effect description and host side model
+ *
+ * Copyright (C) 2021  Peter Buelow <goballstate at gmail>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lifxwaveform.h"
+
+/**
+ * \fn LifxWaveform::LifxWaveform(HSBK color, Waveform waveform, uint32_t period, float cycles, bool transient, int16_t skew)
+ * \param color The color the bulb will move towards
+ * \param waveform The curve to follow
+ * \param period Millis for a single cycle
+ * \param cycles Number of cycles to run
+ * \param transient If true, the bulb goes back to the original color when done
+ * \param skew Skew ratio, 0 is a centered peak or a 50% duty cycle
+ *
+ * All four HSBK fields are changed by default, which sends a SET_WAVEFORM
+ */
+LifxWaveform::LifxWaveform(HSBK color, Waveform waveform, uint32_t period, float cycles, bool transient, int16_t skew) :
+    m_waveform(waveform), m_period(period), m_cycles(cycles), m_transient(transient), m_skew(skew),
+    m_setHue(true), m_setSaturation(true), m_setBrightness(true), m_setKelvin(true)
+{
+    m_color = color.getHSBK();
+    m_color.reserved = 0;
+    m_color.duration = 0;
+    memset(&m_origin, 0, sizeof(lx_dev_color_t));
+}
+
+LifxWaveform::~LifxWaveform()
+{
+}
+
+/**
+ * \fn LifxWaveform LifxWaveform::pulse(HSBK color, uint32_t period, float cycles)
+ * \param color The color to pulse to
+ * \param period Millis for each pulse
+ * \param cycles Number of pulses
+ * \return A transient PULSE waveform with an even duty cycle
+ */
+LifxWaveform LifxWaveform::pulse(HSBK color, uint32_t period, float cycles)
+{
+    return LifxWaveform(color, Pulse, period, cycles, true, 0);
+}
+
+/**
+ * \fn LifxWaveform LifxWaveform::breathe(HSBK color, uint32_t period, float cycles)
+ * \param color The color to breathe to
+ * \param period Millis for each breath
+ * \param cycles Number of breaths
+ * \return A transient SINE waveform
+ */
+LifxWaveform LifxWaveform::breathe(HSBK color, uint32_t period, float cycles)
+{
+    return LifxWaveform(color, Sine, period, cycles, true, 0);
+}
+
+/**
+ * \fn LifxWaveform LifxWaveform::strobe(HSBK color, uint32_t period, float cycles)
+ * \param color The color to flash
+ * \param period Millis between flashes
+ * \param cycles Number of flashes
+ * \return A transient PULSE waveform which shows color for 10% of each period
+ */
+LifxWaveform LifxWaveform::strobe(HSBK color, uint32_t period, float cycles)
+{
+    return LifxWaveform(color, Pulse, period, cycles, true, 26214);
+}
+
+/**
+ * \fn void LifxWaveform::setOptional(bool hue, bool saturation, bool brightness, bool kelvin)
+ * \param hue True if the waveform changes hue
+ * \param saturation True if the waveform changes saturation
+ * \param brightness True if the waveform changes brightness
+ * \param kelvin True if the waveform changes kelvin
+ *
+ * Turning off any field makes this a SET_WAVEFORM_OPTIONAL, and the bulb
+ * keeps its current value for that field for the length of the effect.
+ */
+void LifxWaveform::setOptional(bool hue, bool saturation, bool brightness, bool kelvin)
+{
+    m_setHue = hue;
+    m_setSaturation = saturation;
+    m_setBrightness = brightness;
+    m_setKelvin = kelvin;
+}
+
+/**
+ * \fn HSBK LifxWaveform::color() const
+ * \return The color the waveform moves towards as an HSBK
+ */
+HSBK LifxWaveform::color() const
+{
+    return HSBK(m_color.hue, m_color.saturation, m_color.brightness, m_color.kelvin);
+}
+
+/**
+ * \fn bool LifxWaveform::isOptional() const
+ * \return True if SET_WAVEFORM_OPTIONAL is needed to send this waveform
+ */
+bool LifxWaveform::isOptional() const
+{
+    return !(m_setHue && m_setSaturation && m_setBrightness && m_setKelvin);
+}
+
+/**
+ * \fn qint64 LifxWaveform::length() const
+ * \return The total run time of the effect in millis
+ */
+qint64 LifxWaveform::length() const
+{
+    if (m_cycles <= 0)
+        return 0;
+
+    return static_cast<qint64>(static_cast<double>(m_period) * m_cycles);
+}
+
+/**
+ * \fn void LifxWaveform::start(const lx_dev_color_t &origin)
+ * \param origin The color the bulb is showing when the waveform is sent
+ *
+ * Starts the local model. This should be called at the same time the
+ * waveform is sent to the bulb.
+ */
+void LifxWaveform::start(const lx_dev_color_t &origin)
+{
+    memcpy(&m_origin, &origin, sizeof(lx_dev_color_t));
+    m_origin.duration = 0;
+    m_timer.start();
+}
+
+/**
+ * \fn void LifxWaveform::stop()
+ *
+ * Stops the local model. The bulb abandons a waveform when it gets a
+ * new SET_COLOR, so the owner calls this at the same time.
+ */
+void LifxWaveform::stop()
+{
+    m_timer.invalidate();
+}
+
+/**
+ * \fn bool LifxWaveform::isActive() const
+ * \return True if the model has been started and the effect has not finished
+ */
+bool LifxWaveform::isActive() const
+{
+    if (!m_timer.isValid())
+        return false;
+
+    return m_timer.elapsed() < length();
+}
+
+/**
+ * \fn lx_dev_color_t LifxWaveform::target() const
+ * \return The color the waveform moves towards, with the fields it does not
+ * change taken from the original color
+ */
+lx_dev_color_t LifxWaveform::target() const
+{
+    lx_dev_color_t t = m_origin;
+
+    if (m_setHue)
+        t.hue = m_color.hue;
+    if (m_setSaturation)
+        t.saturation = m_color.saturation;
+    if (m_setBrightness)
+        t.brightness = m_color.brightness;
+    if (m_setKelvin)
+        t.kelvin = m_color.kelvin;
+
+    return t;
+}
+
+/**
+ * \fn float LifxWaveform::curve(float phase) const
+ * \param phase Position within a single cycle, 0 to 1
+ * \return How far towards the new color the bulb is, 0 to 1
+ *
+ * The skew ratio moves the peak for the smooth curves, and sets the
+ * portion of the cycle spent on the original color for a Pulse.
+ */
+float LifxWaveform::curve(float phase) const
+{
+    float skew = (static_cast<float>(m_skew) + 32768.0f) / 65535.0f;
+    float warped = phase;
+
+    if (skew > 0.0f && skew < 1.0f) {
+        if (phase < skew)
+            warped = phase / (2.0f * skew);
+        else
+            warped = 0.5f + (phase - skew) / (2.0f * (1.0f - skew));
+    }
+
+    switch (m_waveform) {
+        case Saw:
+            return phase;
+        case Sine:
+            return (1.0f - std::cos(2.0f * static_cast<float>(M_PI) * warped)) / 2.0f;
+        case HalfSine:
+            return std::sin(static_cast<float>(M_PI) * warped);
+        case Triangle:
+            return warped < 0.5f ? warped * 2.0f : (1.0f - warped) * 2.0f;
+        case Pulse:
+            return phase < skew ? 0.0f : 1.0f;
+    }
+    return 0.0f;
+}
+
+/**
+ * \fn lx_dev_color_t LifxWaveform::colorAt(qint64 elapsed) const
+ * \param elapsed Millis since the waveform was started
+ * \return The color the bulb should be showing at that time
+ *
+ * Hue takes the shortest way around the color wheel, the other fields
+ * are blended linearly.
+ */
+lx_dev_color_t LifxWaveform::colorAt(qint64 elapsed) const
+{
+    if (elapsed >= length() || m_period == 0)
+        return finalColor();
+
+    lx_dev_color_t to = target();
+    lx_dev_color_t c = m_origin;
+    float phase = static_cast<float>(elapsed % m_period) / static_cast<float>(m_period);
+    float v = curve(phase);
+    int16_t hueDelta = static_cast<int16_t>(to.hue - m_origin.hue);
+
+    c.hue = static_cast<uint16_t>(m_origin.hue + qRound(hueDelta * v));
+    c.saturation = static_cast<uint16_t>(m_origin.saturation + qRound((to.saturation - m_origin.saturation) * v));
+    c.brightness = static_cast<uint16_t>(m_origin.brightness + qRound((to.brightness - m_origin.brightness) * v));
+    c.kelvin = static_cast<uint16_t>(m_origin.kelvin + qRound((to.kelvin - m_origin.kelvin) * v));
+    return c;
+}
+
+/**
+ * \fn lx_dev_color_t LifxWaveform::currentColor() const
+ * \return The color the bulb should be showing right now
+ */
+lx_dev_color_t LifxWaveform::currentColor() const
+{
+    if (!m_timer.isValid())
+        return finalColor();
+
+    return colorAt(m_timer.elapsed());
+}
+
+/**
+ * \fn lx_dev_color_t LifxWaveform::finalColor() const
+ * \return The color the bulb is left at once the waveform completes
+ */
+lx_dev_color_t LifxWaveform::finalColor() const
+{
+    if (m_transient)
+        return m_origin;
+
+    return target();
+}
+
+/**
+ * \fn lx_dev_waveform_t LifxWaveform::toDeviceWaveform() const
+ * \return The SET_WAVEFORM payload for this waveform
+ */
+lx_dev_waveform_t LifxWaveform::toDeviceWaveform() const
+{
+    lx_dev_waveform_t wf;
+
+    memset(&wf, 0, sizeof(lx_dev_waveform_t));
+    wf.transient = m_transient ? 1 : 0;
+    wf.hue = m_color.hue;
+    wf.saturation = m_color.saturation;
+    wf.brightness = m_color.brightness;
+    wf.kelvin = m_color.kelvin;
+    wf.period = m_period;
+    wf.cycles = m_cycles;
+    wf.skew_ratio = m_skew;
+    wf.waveform = static_cast<uint8_t>(m_waveform);
+    return wf;
+}
+
+/**
+ * \fn lx_dev_waveform_optional_t LifxWaveform::toDeviceWaveformOptional() const
+ * \return The SET_WAVEFORM_OPTIONAL payload for this waveform
+ */
+lx_dev_waveform_optional_t LifxWaveform::toDeviceWaveformOptional() const
+{
+    lx_dev_waveform_optional_t wf;
+
+    memset(&wf, 0, sizeof(lx_dev_waveform_optional_t));
+    wf.transient = m_transient ? 1 : 0;
+    wf.hue = m_color.hue;
+    wf.saturation = m_color.saturation;
+    wf.brightness = m_color.brightness;
+    wf.kelvin = m_color.kelvin;
+    wf.period = m_period;
+    wf.cycles = m_cycles;
+    wf.skew_ratio = m_skew;
+    wf.waveform = static_cast<uint8_t>(m_waveform);
+    wf.set_hue = m_setHue ? 1 : 0;
+    wf.set_saturation = m_setSaturation ? 1 : 0;
+    wf.set_brightness = m_setBrightness ? 1 : 0;
+    wf.set_kelvin = m_setKelvin ? 1 : 0;
+    return wf;
+}
+
+/**
+ * \fn QDebug operator<<(QDebug debug, const LifxWaveform &waveform)
+ * \brief Pretty print the LifxWaveform object
+ *
+ * For use with qDebug() only
+ */
+QDebug operator<<(QDebug debug, const LifxWaveform &waveform)
+{
+    QDebugStateSaver saver(debug);
+    HSBK color = waveform.color();
+    debug.nospace().noquote() << "Waveform: " << static_cast<int>(waveform.waveform())
+                << " Color(" << color.h() << "," << color.s() << "," << color.b() << "," << color.k() << ")"
+                << " period: " << waveform.period() << " cycles: " << waveform.cycles()
+                << " skew: " << waveform.skewRatio() << " transient: " << waveform.transient();
+    return debug;
+}